@@ -0,0 +1,145 @@
+/*
+ * tracker is an analyzer for binary executable files
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019-2020 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#ifndef _ANALYSES_H
+#define _ANALYSES_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "traces.h"
+
+/* ***** Dominator trees ***** */
+
+typedef struct _domtree_t domtree_t;
+
+/* Compute the dominator tree of the CFG rooted at its entry node (node 0),
+ * returns NULL on error (and set errno) */
+domtree_t *domtree_new (cfg_t *const cfg);
+
+/* Compute the post-dominator tree of the CFG (nodes without successors are
+ * the exits of the CFG), returns NULL on error (and set errno) */
+domtree_t *domtree_post_new (cfg_t *const cfg);
+
+/* Free the given dominator tree */
+void domtree_delete (domtree_t *dt);
+
+/* Returns the immediate (post-)dominator of the node, CFG_NONE if the node
+ * is a root of the tree or has not been reached */
+size_t domtree_idom (domtree_t *const dt, const size_t node);
+
+/* Returns true if the node has been reached when computing the tree */
+bool domtree_reachable (domtree_t *const dt, const size_t node);
+
+/* Returns true if node 'a' (post-)dominates node 'b' */
+bool domtree_dominates (domtree_t *const dt, const size_t a, const size_t b);
+
+/* Update a dominator tree with the nodes and edges added to the CFG since
+ * the tree was computed (or last updated), at a cost proportional to the
+ * part of the tree affected by the new edges. Returns 0 on success and -1
+ * on error (post-dominator trees cannot be updated) */
+int domtree_update (domtree_t *const dt, cfg_t *const cfg);
+
+/* ***** Loop-nesting forest ***** */
+
+typedef struct _loops_t loops_t;
+
+/* Find the natural loops of the CFG (back edges sharing a header form a
+ * single loop) and their nesting forest, returns NULL on error. Cycles
+ * without a dominating header (irreducible) are not reported as loops */
+loops_t *loops_new (cfg_t *const cfg);
+
+/* Free the given loop-nesting forest */
+void loops_delete (loops_t *loops);
+
+/* Returns the number of loops, loops are identified by an index starting
+ * at 0 and inner loops always have a smaller index than enclosing ones */
+size_t loops_count (loops_t *const loops);
+
+/* Returns the innermost loop containing the node, CFG_NONE if none */
+size_t loops_innermost (loops_t *const loops, const size_t node);
+
+/* Returns true if the node belongs to the loop (or to a nested loop) */
+bool loops_contains (loops_t *const loops, const size_t loop,
+		     const size_t node);
+
+/* Returns the header node of the loop, CFG_NONE on error */
+size_t loops_header (loops_t *const loops, const size_t loop);
+
+/* Returns the enclosing loop, CFG_NONE for outermost loops or on error */
+size_t loops_parent (loops_t *const loops, const size_t loop);
+
+/* Returns the nesting depth of the loop (outermost loops are at depth 1) */
+size_t loops_depth (loops_t *const loops, const size_t loop);
+
+/* Returns the number of nodes of the loop body (nested loops included) */
+size_t loops_size (loops_t *const loops, const size_t loop);
+
+/* Returns the i-th node (starts at 0) of the loop body, CFG_NONE on error */
+size_t loops_node (loops_t *const loops, const size_t loop, const size_t i);
+
+/* Returns the number of edges leaving the loop */
+size_t loops_exits (loops_t *const loops, const size_t loop);
+
+/* Returns the i-th edge (starts at 0) leaving the loop, CFG_NONE on error */
+size_t loops_exit (loops_t *const loops, const size_t loop, const size_t i);
+
+/* Returns the number of times the loop has been entered in the traces */
+size_t loops_entries (loops_t *const loops, const size_t loop);
+
+/* Returns the number of iterations of the loop observed in the traces (the
+ * number of times its header has been reached) */
+size_t loops_iterations (loops_t *const loops, const size_t loop);
+
+/* Returns the number of instructions executed within the loop body */
+size_t loops_instructions (loops_t *const loops, const size_t loop);
+
+/* ***** Functions ***** */
+
+typedef struct _functions_t functions_t;
+
+/* Partition the nodes of the CFG into functions. Entries are the entry of
+ * the CFG, the targets of the call instructions and the nodes at the given
+ * addresses (e.g. from the symbol table, may be NULL). A function holds the
+ * nodes reached from its entry without crossing another entry, following
+ * calls to their return site and stopping at returns; nodes reached from
+ * no entry start functions of their own. Returns NULL on error */
+functions_t *functions_new (cfg_t *const cfg, const uintptr_t *entries,
+			    const size_t count);
+
+/* Free the given functions */
+void functions_delete (functions_t *fn);
+
+/* Returns the number of functions, functions are identified by an index
+ * starting at 0 (in the order of their entry nodes) */
+size_t functions_count (functions_t *const fn);
+
+/* Returns the function the node belongs to, CFG_NONE on error */
+size_t functions_of (functions_t *const fn, const size_t node);
+
+/* Returns the entry node of the function, CFG_NONE on error */
+size_t functions_entry (functions_t *const fn, const size_t function);
+
+/* Returns the number of nodes of the function */
+size_t functions_size (functions_t *const fn, const size_t function);
+
+/* Returns the i-th node (starts at 0, the entry) of the function, CFG_NONE
+ * on error */
+size_t functions_node (functions_t *const fn, const size_t function,
+		       const size_t i);
+
+/* Returns the number of times the function has been called */
+size_t functions_calls (functions_t *const fn, const size_t function);
+
+/* Returns the number of instructions executed within the function */
+size_t functions_instructions (functions_t *const fn, const size_t function);
+
+#endif /* _ANALYSES_H */
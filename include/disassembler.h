@@ -0,0 +1,132 @@
+/*
+ * tracker is an analyzer for binary executable files
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019-2020 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#ifndef _DISASSEMBLER_H
+#define _DISASSEMBLER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <capstone/capstone.h>
+
+#include "executables.h"
+#include "traces.h"
+
+/* ***** Instruction classification ***** */
+
+/* Get the kind of control-flow transfer of a decoded instruction */
+instr_type_t disasm_instr_type (csh handle, cs_insn *insn);
+
+/* Get the CFG node type of a decoded instruction */
+node_t disasm_node_type (csh handle, cs_insn *insn);
+
+/* ***** Static disassembler ***** */
+
+typedef struct _disasm_t disasm_t;
+typedef struct _decode_cache_t decode_cache_t;
+
+/* Create a static disassembler of the executable segments of exec, mapped
+ * at their link-time address plus bias. Instructions found in the decode
+ * cache of exec (may be NULL) are not decoded again. Returns NULL on error */
+disasm_t *disasm_new (executable_t *exec, const uintptr_t bias,
+		      decode_cache_t *cache);
+
+/* Free the given disassembler */
+void disasm_delete (disasm_t *d);
+
+/* Disassemble recursively from the instructions of the CFG, following the
+ * direct jumps and calls and the fall-throughs, with up to 'threads'
+ * threads. Instructions decoded by a previous run are not decoded again.
+ * Returns 0 on success and -1 on error */
+int disasm_run (disasm_t *const d, cfg_t *const cfg, const size_t threads);
+
+/* Disassemble recursively from the entry point and the function symbols of
+ * exec (without running it), as disasm_run() does from the CFG. Returns 0
+ * on success and -1 on error */
+int disasm_run_static (disasm_t *const d, executable_t *exec,
+		       const size_t threads);
+
+/* Returns the number of instructions found (sorted by address) */
+size_t disasm_count (disasm_t *const d);
+
+/* Returns the address of the i-th instruction, 0 on error */
+uintptr_t disasm_addr (disasm_t *const d, const size_t i);
+
+/* Returns the size (in bytes) of the i-th instruction, 0 on error */
+size_t disasm_size (disasm_t *const d, const size_t i);
+
+/* Returns true if the i-th instruction has been executed (it belongs to
+ * the CFG), false if it has only been reached statically */
+bool disasm_executed (disasm_t *const d, const size_t i);
+
+/* Returns the index of the instruction at addr, CFG_NONE if none */
+size_t disasm_lookup (disasm_t *const d, const uintptr_t addr);
+
+/* Build the static CFG of the instructions found, whose edges are the
+ * direct jumps and calls and the fall-throughs (each one taken once). Its
+ * entry is the instruction at the run-time address entry (the first one
+ * if not found). Instructions are taken from ht or created and stored in
+ * ht, which owns them. Returns NULL on error (and set errno) */
+cfg_t *disasm_cfg (disasm_t *const d, const uintptr_t entry,
+		   hashtable_t *const ht);
+
+/* ***** Decode cache ***** */
+
+/* Instruction of the decode cache */
+typedef struct
+{
+  uintptr_t addr;	/* Run-time address */
+  uintptr_t target;	/* Run-time target of a direct jump (0 if none) */
+  uint8_t size;		/* Size of the instruction */
+  instr_type_t type;	/* Kind of control-flow transfer */
+  node_t node_type;	/* CFG node type */
+  bool fallthrough;	/* Execution may go on with the next instruction */
+  const uint8_t *bytes; /* Opcodes (as found in the executable file) */
+  const char *text;	/* Mnemonic and operands */
+} decoded_t;
+
+/* Decode linearly the code sections of exec, mapped at their link-time
+ * address plus bias, with up to 'threads' threads working on separate
+ * chunks (resynchronized at their boundaries). Texts use the Intel syntax
+ * if intel is true (AT&T otherwise). Returns NULL on error */
+decode_cache_t *decode_cache_new (executable_t *exec, const uintptr_t bias,
+				  const bool intel, const size_t threads);
+
+/* Save the decode cache to a binary file, returns 0 on success and -1 on
+ * error (and set errno) */
+int decode_cache_save (decode_cache_t *const cache, const char *filename);
+
+/* Map a decode cache saved by decode_cache_save() for the same executable,
+ * bias and syntax (the texts hold run-time addresses). Returns NULL on
+ * error (and set errno, EINVAL if the file does not match) */
+decode_cache_t *decode_cache_load (executable_t *exec, const uintptr_t bias,
+				   const bool intel, const char *filename);
+
+/* Free the decode cache */
+void decode_cache_delete (decode_cache_t *cache);
+
+/* Returns the number of instructions in the cache */
+size_t decode_cache_count (decode_cache_t *const cache);
+
+/* Returns the instruction decoded at the run-time address addr, NULL if
+ * none. Lookups are fastest when following the execution order */
+const decoded_t *decode_cache_lookup (decode_cache_t *const cache,
+				      const uintptr_t addr);
+
+/* Invalidate the instructions overlapping the run-time addresses from start
+ * to end (excluded), once the code there has been modified: they are no
+ * longer returned by lookups nor saved. Returns the number of instructions
+ * invalidated */
+size_t decode_cache_invalidate (decode_cache_t *const cache,
+				const uintptr_t start, const uintptr_t end);
+
+#endif /* _DISASSEMBLER_H */
@@ -12,6 +12,8 @@
 #ifndef _EXECUTABLE_H
 #define _EXECUTABLE_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 
@@ -21,7 +23,10 @@ typedef struct _executable_t executable_t;
 /* Platform architecture arch_t type */
 typedef enum { unknown_arch = 0, x86_32_arch = 1, x86_64_arch = 2 } arch_t;
 
-/* Create and initialize a new executable_t */
+/* Create and initialize a new executable_t, the file is mapped in memory
+ * until executable_delete() and its tables are read from the mapping.
+ * Returns NULL on error (errno is ENOEXEC if the file is not a valid x86
+ * ELF file) */
 executable_t *executable_new (char *execfilename);
 
 /* Free the given executable */
@@ -33,13 +38,117 @@ arch_t executable_arch (executable_t *exec);
 /* Print the current architecture of the executable file */
 void executable_print_arch (executable_t *exec, FILE *fd);
 
+/* Get the entry point of the executable (link-time address) */
+uintptr_t executable_entry (executable_t *exec);
+
+/* Get the link-time address of the start of the file once mapped (the
+ * offset of an address from the start of the mapping of the file is
+ * independent of where the file is loaded) */
+uintptr_t executable_base (executable_t *exec);
+
+/* Get the content of the index-th executable segment (starts at 0) and its
+ * link-time address and size, returns NULL after the last segment */
+const uint8_t *executable_segment (executable_t *exec, const size_t index,
+				   uintptr_t *addr, size_t *size);
+
+/* Get the number of sections (including the null section) */
+size_t executable_sections (executable_t *exec);
+
 /* Iterator on executable sections, return NULL after last item and cycle */
-char *executable_section_next (executable_t *exec);
+const char *executable_section_next (executable_t *exec);
+
+/* Get the content of the section called name and its link-time address
+ * (0 if not loaded) and size, returns NULL if absent or without content */
+const uint8_t *executable_section_by_name (executable_t *exec,
+					   const char *name, uintptr_t *addr,
+					   size_t *size);
+
+/* Get the content of the index-th code section (starts at 0) and its
+ * link-time address and size, returns NULL after the last code section */
+const uint8_t *executable_code (executable_t *exec, const size_t index,
+				uintptr_t *addr, size_t *size);
+
+/* Get the name of the loaded section that contains the given link-time
+ * address, return NULL if the address is outside of the sections */
+const char *executable_get_section_by_addr (executable_t *exec,
+					    uintptr_t addr);
+
+/* Get the name of the function symbol (from .symtab or .dynsym) covering
+ * the given link-time address, return NULL if no symbol is matching */
+const char *executable_get_symbol_by_addr (executable_t *exec,
+					   uintptr_t addr);
+
+/* Get the names of the symbols covering the 'count' addresses, which must
+ * be sorted by increasing address, in a single pass (names[i] is NULL if
+ * no symbol covers addrs[i]). Returns the number of addresses matched */
+size_t executable_get_symbols_by_addr (executable_t *exec,
+				       const uintptr_t *addrs,
+				       const size_t count, const char **names);
+
+/* Same as executable_get_symbol_by_addr() with C++ names demangled, each
+ * symbol being demangled once (on first use) */
+const char *executable_get_demangled_symbol_by_addr (executable_t *exec,
+						     uintptr_t addr);
+
+/* Get the number of function symbols */
+size_t executable_symbols (executable_t *exec);
+
+/* Get the link-time address of the index-th function symbol (sorted by
+ * address), its size and its name, returns 0 on error */
+uintptr_t executable_symbol (executable_t *exec, const size_t index,
+			     size_t *size, const char **name);
+
+/* Get the name of the imported function whose PLT entry (in .plt, .plt.sec
+ * or .plt.got) covers the given link-time address, NULL if none */
+const char *executable_get_import_by_addr (executable_t *exec,
+					   uintptr_t addr);
+
+/* Same as executable_get_import_by_addr() with C++ names demangled, each
+ * import being demangled once (on first use) */
+const char *executable_get_demangled_import_by_addr (executable_t *exec,
+						     uintptr_t addr);
+
+/* Get the number of imported functions called through a PLT entry */
+size_t executable_imports (executable_t *exec);
+
+/* Get the link-time address of the PLT entry of the index-th import
+ * (sorted by address) and its name, returns 0 on error */
+uintptr_t executable_import (executable_t *exec, const size_t index,
+			     const char **name);
+
+/* Get the number of rows of the DWARF line table (.debug_line), which is
+ * read on first use. Returns 0 if the executable has no line information */
+size_t executable_lines (executable_t *exec);
+
+/* Get the source line (and file, if not NULL) of the given link-time
+ * address from the DWARF line table, returns 0 if unknown */
+size_t executable_get_line_by_addr (executable_t *exec, uintptr_t addr,
+				    const char **file);
+
+/* Get the source lines (and files, if not NULL) of the 'count' addresses,
+ * which must be sorted by increasing address, in a single pass (lines[i] is
+ * 0 if addrs[i] is unknown). Returns the number of addresses matched */
+size_t executable_get_lines_by_addr (executable_t *exec,
+				     const uintptr_t *addrs,
+				     const size_t count, const char **files,
+				     size_t *lines);
+
+/* Get the GNU build-ID of the executable and its size, returns NULL if the
+ * executable has none */
+const uint8_t *executable_build_id (executable_t *exec, size_t *size);
+
+/* Get a stable identifier of the executable file: its build-ID in hex, or
+ * a hash of its content if it has none */
+const char *executable_id (executable_t *exec);
 
-/* Get the section that contains the given address */
-char *executable_get_section_by_addr (executable_t *exec, uintptr_t addr);
+/* Get the path of the file called name in the cache directory of the
+ * executable ($XDG_CACHE_HOME/tracker/ID, created if needed), the result
+ * must be freed by the caller. Returns NULL on error (and set errno) */
+char *executable_cache_path (executable_t *exec, const char *name);
 
-/* Get symbol by address, return NULL if no symbol is matching */
-char *executable_get_symbol_by_addr (executable_t *exec, uintptr_t addr);
+/* Keep the indexes of the executable built on first use (the symbols) in
+ * its cache directory: they are read from there when present and saved
+ * there otherwise. To be set before any symbol lookup */
+void executable_set_cache (executable_t *exec, const bool use_cache);
 
 #endif /* _EXECUTABLE_H */
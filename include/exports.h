@@ -0,0 +1,55 @@
+/*
+ * tracker is an analyzer for binary executable files
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019-2020 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#ifndef _EXPORTS_H
+#define _EXPORTS_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "traces.h"
+
+/* Output formats of the CFG */
+typedef enum { dot_format = 0, graphml_format = 1, json_format = 2 } format_t;
+
+/* Selection of the nodes to export (edges are exported if both their ends
+ * are), a zeroed filter selects the whole CFG */
+typedef struct
+{
+  uintptr_t start; /* Lowest address exported */
+  uintptr_t end;   /* Highest address exported (excluded), 0 for no limit */
+  bool (*keep) (cfg_t *const cfg, const size_t node, void *data);
+  void *data; /* Extra argument given to the 'keep' predicate */
+} filter_t;
+
+/* Guess the format from the extension of the filename ('.dot', '.graphml'
+ * or '.json'), returns -1 if unknown */
+int format_from_filename (const char *filename);
+
+/* Stream the CFG to fd in the given format, annotated with hit counts and
+ * restricted to the nodes selected by filter (may be NULL). Records are
+ * written as they are produced, returns 0 on success and -1 on error */
+int cfg_export (cfg_t *const cfg, FILE *fd, const format_t format,
+		const filter_t *const filter);
+
+/* Write the coverage frontier of the CFG as a JSON array: conditional
+ * branches with a single observed successor (and the missing side) and
+ * dynjump sites, ranked by decreasing hits. Returns 0 on success and -1
+ * on error */
+int cfg_export_frontier (cfg_t *const cfg, FILE *fd);
+
+/* Stream the call graph to fd in the given format, functions being labelled
+ * with the address of their entry in the CFG. The JSON format also holds
+ * the calling-context tree. Returns 0 on success and -1 on error */
+int callgraph_export (callgraph_t *const cg, cfg_t *const cfg, FILE *fd,
+		      const format_t format);
+
+#endif /* _EXPORTS_H */
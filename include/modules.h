@@ -0,0 +1,97 @@
+/*
+ * tracker is an analyzer for binary executable files
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019-2020 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#ifndef _MODULES_H
+#define _MODULES_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <sys/types.h>
+
+#include "executables.h"
+
+/* ***** Runtime module map ***** */
+
+/* Modules are the files (or named regions such as '[vdso]') mapped in the
+ * memory of a process. A module keeps its index for the whole life of the
+ * map, even after being unmapped */
+typedef struct _modules_t modules_t;
+
+/* Index returned for addresses outside of any module */
+#define MODULE_NONE SIZE_MAX
+
+/* Create the module map of the process pid from /proc/pid/maps, returns
+ * NULL on error */
+modules_t *modules_new (const pid_t pid);
+
+/* Free the module map (and the executables of the modules) */
+void modules_delete (modules_t *modules);
+
+/* Read /proc/pid/maps again (after a mmap(), munmap(), mremap() or
+ * mprotect()), returns 0 on success and -1 on error */
+int modules_update (modules_t *const modules);
+
+/* Returns the number of modules seen so far */
+size_t modules_count (modules_t *const modules);
+
+/* Returns the module mapped at addr and sets offset to the position of addr
+ * from the base address of the module (may be NULL), MODULE_NONE if addr is
+ * not in a module */
+size_t modules_lookup (modules_t *const modules, const uintptr_t addr,
+		       uintptr_t *offset);
+
+/* Returns the path (or name) of the module, NULL on error */
+const char *modules_name (modules_t *const modules, const size_t module);
+
+/* Returns the base address of the module (where its file offset 0 is
+ * mapped), 0 on error */
+uintptr_t modules_base (modules_t *const modules, const size_t module);
+
+/* Returns the executable of the module, loaded on first use, NULL if the
+ * module is not an ELF file */
+executable_t *modules_executable (modules_t *const modules,
+				  const size_t module);
+
+/* Returns the identifier of the executable of the module (see
+ * executable_id()), NULL if the module is not an ELF file. With the offset
+ * from the base of the module, it gives a key of the instructions which
+ * holds across runs, hosts and address randomization */
+const char *modules_id (modules_t *const modules, const size_t module);
+
+/* Returns the link-time address, in the executable of its module, of the
+ * run-time address addr and sets exec to this executable, 0 if addr is not
+ * in an ELF module */
+uintptr_t modules_link_addr (modules_t *const modules, const uintptr_t addr,
+			     executable_t **exec);
+
+/* ***** Module coverage ***** */
+
+/* Hits of the instruction at offset from the base of its module */
+typedef struct
+{
+  uint64_t offset;
+  uint64_t hits;
+} coverage_t;
+
+/* Add the hits of the 'count' records (sorted by offset, one per offset)
+ * to the coverage file, which is created if missing and replaced
+ * atomically. Concurrent merges (from any process) are serialized by a lock
+ * on 'filename.lock'. Returns 0 on success and -1 on error (and set
+ * errno) */
+int coverage_merge (const char *filename, const coverage_t *records,
+		    const size_t count);
+
+/* Read the records of the coverage file into records (to be freed by the
+ * caller), returns their number or -1 on error (and set errno) */
+ssize_t coverage_load (const char *filename, coverage_t **records);
+
+#endif /* _MODULES_H */
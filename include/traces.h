@@ -23,6 +23,9 @@
 
 typedef struct _instr_t instr_t;
 
+/* Kind of control-flow transfer performed by the instruction */
+typedef enum { INSTR, BRANCH, CALL, JMP, RET } instr_type_t;
+
 /* Return a new instr_t struct, NULL otherwise (and set errno) */
 instr_t *instr_new (const uintptr_t addr, const uint8_t size,
 		    const uint8_t *const opcodes);
@@ -39,6 +42,19 @@ size_t instr_size (instr_t *const instr);
 /* Get a pointer to the opcodes of the instruction */
 uint8_t *instr_opcodes (instr_t *const instr);
 
+/* Get the kind of the instruction (INSTR unless set) */
+instr_type_t instr_type (instr_t *const instr);
+
+/* Set the kind of the instruction */
+void instr_set_type (instr_t *const instr, const instr_type_t type);
+
+/* Get the generation of the instruction: the number of times the code at
+ * its address was found overwritten before it was fetched (0 unless set) */
+uint16_t instr_generation (instr_t *const instr);
+
+/* Set the generation of the instruction */
+void instr_set_generation (instr_t *const instr, const uint16_t generation);
+
 /* ***** Instructions' hashtables ***** */
 
 typedef uint64_t hash_t;
@@ -60,6 +76,14 @@ bool hashtable_insert (hashtable_t *const ht, instr_t *const instr);
 /* Look-up if current instruction is already in the hashtable */
 bool hashtable_lookup (hashtable_t *const ht, instr_t *const instr);
 
+/* Get the instruction of the hashtable matching instr, NULL if none */
+instr_t *hashtable_get (hashtable_t *const ht, instr_t *const instr);
+
+/* Get the instruction of the hashtable standing at addr in the given
+ * generation of the code (whatever its opcodes), NULL if none */
+instr_t *hashtable_find (hashtable_t *const ht, const uintptr_t addr,
+			 const uint16_t generation);
+
 /* Count the number of entries in the hashtable */
 size_t hashtable_entries (hashtable_t *const ht);
 
@@ -97,8 +121,151 @@ size_t trace_compare (trace_t *const t1, trace_t *const t2);
 typedef struct _cfg_t cfg_t;
 typedef enum { single = 0, branch = 1, dynjump = 2 } node_t;
 
+/* Nodes and edges are identified by their index in the CFG (starting at 0),
+ * CFG_NONE stands for 'no such node or edge' */
+#define CFG_NONE SIZE_MAX
+
+/* Create a new CFG whose entry node (index 0) is instr, NULL on error.
+ * Instructions are not owned by the CFG and must outlive it */
 cfg_t *cfg_new (instr_t *instr, node_t node_type);
+
+/* Append instr as a successor of the last inserted instruction and update
+ * hit counts, returns cfg or NULL on error (and set errno) */
 cfg_t *cfg_insert (cfg_t *cfg, instr_t *instr, node_t node_type);
+
+/* Start a new trace at instr (no edge is added from the last inserted
+ * instruction), returns cfg or NULL on error (and set errno) */
+cfg_t *cfg_restart (cfg_t *cfg, instr_t *instr, node_t node_type);
+
+/* Free the CFG (but not the instructions it refers to) */
 void cfg_delete (cfg_t *cfg);
 
+/* Returns the number of nodes of the CFG */
+size_t cfg_nodes (cfg_t *const cfg);
+
+/* Returns the number of edges of the CFG */
+size_t cfg_edges (cfg_t *const cfg);
+
+/* Returns the index of the node holding instr, CFG_NONE if none */
+size_t cfg_lookup (cfg_t *const cfg, instr_t *const instr);
+
+/* Returns the node of the last inserted instruction, CFG_NONE if none */
+size_t cfg_current (cfg_t *const cfg);
+
+/* Returns the instruction of the node, NULL on error */
+instr_t *cfg_node_instr (cfg_t *const cfg, const size_t node);
+
+/* Returns the type of the node (single on error) */
+node_t cfg_node_type (cfg_t *const cfg, const size_t node);
+
+/* Returns the number of times the node has been reached */
+size_t cfg_node_hits (cfg_t *const cfg, const size_t node);
+
+/* Returns the number of outgoing edges of the node */
+size_t cfg_node_degree (cfg_t *const cfg, const size_t node);
+
+/* Returns the index of the i-th outgoing edge (starts at 0) of the node,
+ * CFG_NONE on error */
+size_t cfg_node_edge (cfg_t *const cfg, const size_t node, const size_t i);
+
+/* Returns the edge going from node to node dst, CFG_NONE if none. For
+ * dynjump nodes, outgoing edges are the observed targets of the jump
+ * (looked-up in a hash set when they are numerous) */
+size_t cfg_node_successor (cfg_t *const cfg, const size_t node,
+			   const size_t dst);
+
+/* Returns the number of times the node has been reached since its last new
+ * successor was discovered (a low value means the set is still growing) */
+size_t cfg_node_stable_hits (cfg_t *const cfg, const size_t node);
+
+/* Returns the source node of the edge, CFG_NONE on error */
+size_t cfg_edge_src (cfg_t *const cfg, const size_t edge);
+
+/* Returns the destination node of the edge, CFG_NONE on error */
+size_t cfg_edge_dst (cfg_t *const cfg, const size_t edge);
+
+/* Returns the number of times the edge has been taken */
+size_t cfg_edge_hits (cfg_t *const cfg, const size_t edge);
+
+/* Build the CFG of a set of traces (each trace starting with cfg_restart),
+ * node types are given by node_type (all single if NULL). Traces are split
+ * into contiguous subsets handled by up to 'threads' threads whose partial
+ * CFGs are merged in order, the result (indexes, hits, instructions) is the
+ * same as a sequential build. Returns NULL on error (and set errno) */
+cfg_t *cfg_build (trace_t **traces, const size_t count,
+		  node_t (*node_type) (instr_t *const instr),
+		  const size_t threads);
+
+/* Append the nodes, edges and hits of src to dst, as if the traces of src
+ * were inserted after the ones of dst (the stable hits of the nodes getting
+ * new targets are approximated). dst then refers to the instructions of
+ * src. Returns 0 on success and -1 on error (and set errno) */
+int cfg_append (cfg_t *const dst, cfg_t *const src);
+
+/* Save the CFG and its instructions to a binary file, returns 0 on success
+ * and -1 on error (and set errno) */
+int cfg_save (cfg_t *const cfg, const char *filename);
+
+/* Map a CFG saved by cfg_save(), returns NULL on error (and set errno). The
+ * loaded CFG is read in place from a read-only mapping of the file (no
+ * allocation per node), it is copied to the heap by its first cfg_insert()
+ * or cfg_restart(). Its instructions stay in the mapping (read-only) and are
+ * valid until cfg_delete() */
+cfg_t *cfg_load (const char *filename);
+
+/* ***** Dynamic call graph ***** */
+
+/* Functions are identified by the CFG node of their entry, the root
+ * function being the entry of the CFG (node 0) */
+typedef struct _callgraph_t callgraph_t;
+
+/* Create a new call graph whose calling-context tree is limited to
+ * max_depth levels (deeper calls are counted in their ancestor at depth
+ * max_depth), returns NULL on error */
+callgraph_t *callgraph_new (const size_t max_depth);
+
+/* Free the call graph */
+void callgraph_delete (callgraph_t *cg);
+
+/* Record a call from the function on top of the shadow stack to callee,
+ * returning to ret. Returns 0 on success and -1 on error */
+int callgraph_call (callgraph_t *const cg, const size_t callee,
+		    const uintptr_t ret);
+
+/* Record a return to addr: pop the shadow stack down to the frame returning
+ * to addr (returns matching no recent frame are ignored) */
+void callgraph_return (callgraph_t *const cg, const uintptr_t addr);
+
+/* Returns the current depth of the shadow stack */
+size_t callgraph_depth (callgraph_t *const cg);
+
+/* Returns the number of caller to callee edges */
+size_t callgraph_edges (callgraph_t *const cg);
+
+/* Returns the caller of the edge, CFG_NONE on error */
+size_t callgraph_edge_caller (callgraph_t *const cg, const size_t edge);
+
+/* Returns the callee of the edge, CFG_NONE on error */
+size_t callgraph_edge_callee (callgraph_t *const cg, const size_t edge);
+
+/* Returns the number of calls through the edge */
+size_t callgraph_edge_calls (callgraph_t *const cg, const size_t edge);
+
+/* Returns the number of nodes of the calling-context tree (the root is
+ * the context 0) */
+size_t callgraph_contexts (callgraph_t *const cg);
+
+/* Returns the parent of the context, CFG_NONE for the root or on error */
+size_t callgraph_context_parent (callgraph_t *const cg, const size_t context);
+
+/* Returns the function called in the context, CFG_NONE on error */
+size_t callgraph_context_function (callgraph_t *const cg,
+				   const size_t context);
+
+/* Returns the depth of the context (the root is at depth 0) */
+size_t callgraph_context_depth (callgraph_t *const cg, const size_t context);
+
+/* Returns the number of calls that reached the context */
+size_t callgraph_context_calls (callgraph_t *const cg, const size_t context);
+
 #endif /* _TRACES_H */
@@ -0,0 +1,54 @@
+/*
+ * tracker is an analyzer for binary executable files
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019-2020 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#ifndef _WRITERS_H
+#define _WRITERS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* ***** Buffered writer ***** */
+
+/* Writer bypassing stdio: the values it formats are gathered in its
+ * buffer, the texts given by writer_text() are only referred to, and all
+ * of them are written at once by writev() when the buffer is full */
+typedef struct _writer_t writer_t;
+
+/* Create a writer to the file descriptor of fd (fd being flushed first),
+ * flushing after each line if line_buffered is true. Returns NULL on error
+ * (and set errno) */
+writer_t *writer_new (FILE *fd, const bool line_buffered);
+
+/* Flush and free the writer, returns 0 if all the writes succeeded and -1
+ * otherwise (and set errno) */
+int writer_delete (writer_t *w);
+
+/* Write all the pending data, returns 0 on success and -1 on error (and
+ * set errno). Errors are kept until writer_delete() */
+int writer_flush (writer_t *const w);
+
+/* Append the string to the output (copied) */
+void writer_str (writer_t *const w, const char *str);
+
+/* Append size bytes of text to the output, the text is not copied and must
+ * be left untouched until the next flush */
+void writer_text (writer_t *const w, const char *text, const size_t size);
+
+/* Append the value in decimal to the output */
+void writer_dec (writer_t *const w, size_t value);
+
+/* Append '0x' and the value in hexadecimal (without leading zeros) to the
+ * output */
+void writer_hex (writer_t *const w, uintptr_t value);
+
+#endif /* _WRITERS_H */
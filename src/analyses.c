@@ -0,0 +1,1636 @@
+/*
+ * tracker is an analyzer for binary executable files
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019-2020 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#include "analyses.h"
+
+#include <errno.h>
+#include <string.h>
+
+/* **********[ Compressed Graph Data-structure ]********** */
+
+/* Adjacency lists of a graph stored as compressed sparse rows: successors of
+ * node v are succ[succ_idx[v]] ... succ[succ_idx[v + 1] - 1] (same for pred) */
+typedef struct
+{
+  size_t nodes;	    /* Number of nodes */
+  size_t *succ_idx; /* Offsets of the successors of each node */
+  size_t *succ;	    /* Successors lists */
+  size_t *pred_idx; /* Offsets of the predecessors of each node */
+  size_t *pred;	    /* Predecessors lists */
+} graph_t;
+
+static void
+graph_free (graph_t *g)
+{
+  free (g->succ_idx);
+  free (g->succ);
+  free (g->pred_idx);
+  free (g->pred);
+}
+
+/* Build the compressed rows of 'nodes' nodes from the arcs (from[i], to[i]) */
+static int
+csr_fill (const size_t nodes, const size_t arcs, size_t *from, size_t *to,
+	  size_t **idx, size_t **adj)
+{
+  *idx = calloc (nodes + 1, sizeof (size_t));
+  *adj = malloc ((arcs ? arcs : 1) * sizeof (size_t));
+  if (*idx == NULL || *adj == NULL)
+    return -1;
+
+  size_t *offsets = *idx;
+  for (size_t i = 0; i < arcs; i++)
+    offsets[from[i] + 1]++;
+
+  for (size_t v = 0; v < nodes; v++)
+    offsets[v + 1] += offsets[v];
+
+  /* Offsets are used as insertion cursors, then shifted back in place */
+  for (size_t i = 0; i < arcs; i++)
+    (*adj)[offsets[from[i]]++] = to[i];
+
+  for (size_t v = nodes; v > 0; v--)
+    offsets[v] = offsets[v - 1];
+  offsets[0] = 0;
+
+  return 0;
+}
+
+/* Build the graph of the CFG, or of the reversed CFG with an extra virtual
+ * node (index cfg_nodes (cfg)) leading to all the exit nodes */
+static int
+graph_build (graph_t *g, cfg_t *const cfg, const bool reverse)
+{
+  size_t n = cfg_nodes (cfg), m = cfg_edges (cfg);
+  size_t arcs = 0;
+
+  *g = (graph_t){0};
+  g->nodes = reverse ? n + 1 : n;
+
+  size_t *from = malloc ((m + n + 1) * sizeof (size_t));
+  size_t *to = malloc ((m + n + 1) * sizeof (size_t));
+  if (from == NULL || to == NULL)
+    goto fail;
+
+  for (size_t e = 0; e < m; e++, arcs++)
+    {
+      from[arcs] = cfg_edge_src (cfg, e);
+      to[arcs] = cfg_edge_dst (cfg, e);
+      if (reverse)
+	{
+	  size_t tmp = from[arcs];
+	  from[arcs] = to[arcs];
+	  to[arcs] = tmp;
+	}
+    }
+
+  if (reverse)
+    for (size_t v = 0; v < n; v++)
+      if (cfg_node_degree (cfg, v) == 0)
+	{
+	  from[arcs] = n;
+	  to[arcs++] = v;
+	}
+
+  if (csr_fill (g->nodes, arcs, from, to, &g->succ_idx, &g->succ) == -1 ||
+      csr_fill (g->nodes, arcs, to, from, &g->pred_idx, &g->pred) == -1)
+    goto fail;
+
+  free (from);
+  free (to);
+  return 0;
+
+fail:
+  free (from);
+  free (to);
+  graph_free (g);
+  errno = ENOMEM;
+  return -1;
+}
+
+/* **********[ Vectors of Indexes ]********** */
+
+typedef struct
+{
+  size_t count; /* Number of elements */
+  size_t size;	/* Allocated size */
+  size_t *data; /* Elements */
+} vector_t;
+
+static int
+vector_push (vector_t *const vec, const size_t value)
+{
+  if (vec->count == vec->size)
+    {
+      size_t size = vec->size ? 2 * vec->size : 64;
+      size_t *data = realloc (vec->data, size * sizeof (size_t));
+      if (data == NULL)
+	{
+	  errno = ENOMEM;
+	  return -1;
+	}
+
+      vec->data = data;
+      vec->size = size;
+    }
+
+  vec->data[vec->count++] = value;
+  return 0;
+}
+
+/* **********[ Dominator Trees ]********** */
+
+struct _domtree_t
+{
+  bool reverse; /* Post-dominator tree */
+  size_t size;	/* Number of nodes of the CFG */
+  size_t nodes; /* Number of nodes of the tree (including a virtual root) */
+  size_t root;	/* Root of the tree */
+  size_t *idom; /* Immediate dominator of each node (CFG_NONE if none) */
+  size_t *pre;	/* Pre-order number of each node in the tree (lazy) */
+  size_t *post; /* Post-order number of each node in the tree (lazy) */
+
+  /* Incremental updates (dominator trees only) */
+  size_t capacity;   /* Allocated size of the per-node arrays */
+  size_t *depth;     /* Depth of each node in the tree */
+  size_t *child;     /* First child of each node in the tree */
+  size_t *next;	     /* Next sibling of each node in the tree */
+  size_t *prev;	     /* Previous sibling of each node in the tree */
+  size_t *mark;	     /* Last search in which each node was visited */
+  size_t stamp;	     /* Identifier of the current search */
+  size_t edges;	     /* Number of CFG edges already seen */
+  size_t done_size;  /* Allocated size of 'done' */
+  uint8_t *done;     /* Edges already taken into account in the tree */
+  vector_t heap;     /* Max-heap (on depth) of the nodes to process */
+  vector_t stack;    /* Stack of the nodes to explore */
+  vector_t affected; /* Nodes whose immediate dominator changes */
+  vector_t pending;  /* Edges to insert once new nodes have been reached */
+};
+
+/* Path compression of the Lengauer-Tarjan 'eval' function (iterative) */
+static void
+snca_compress (const size_t v, size_t *ancestor, size_t *label,
+	       const size_t *semi, size_t *stack)
+{
+  size_t top = 0, x = v;
+
+  while (ancestor[ancestor[x]] != 0)
+    {
+      stack[top++] = x;
+      x = ancestor[x];
+    }
+
+  while (top > 0)
+    {
+      x = stack[--top];
+      size_t a = ancestor[x];
+      if (semi[label[a]] < semi[label[x]])
+	label[x] = label[a];
+      ancestor[x] = ancestor[a];
+    }
+}
+
+/* Semi-NCA algorithm (Georgiadis, Tarjan): semi-dominators are computed as
+ * in Lengauer-Tarjan and immediate dominators are derived as the nearest
+ * common ancestors in the DFS tree. Vertices are numbered from 1 in DFS
+ * pre-order, 0 meaning 'not visited' */
+static int
+snca (const graph_t *const g, const size_t root, size_t *idom)
+{
+  size_t n = g->nodes;
+  size_t *num = calloc (n, sizeof (size_t));
+  size_t *vertex = malloc ((n + 1) * sizeof (size_t));
+  size_t *parent = malloc ((n + 1) * sizeof (size_t));
+  size_t *semi = malloc ((n + 1) * sizeof (size_t));
+  size_t *label = malloc ((n + 1) * sizeof (size_t));
+  size_t *ancestor = calloc (n + 1, sizeof (size_t));
+  size_t *stack = malloc ((n + 1) * sizeof (size_t));
+  size_t *cursor = malloc ((n + 1) * sizeof (size_t));
+
+  int ret = -1;
+  if (!num || !vertex || !parent || !semi || !label || !ancestor || !stack ||
+      !cursor)
+    {
+      errno = ENOMEM;
+      goto end;
+    }
+
+  /* Iterative depth-first search numbering the vertices */
+  size_t count = 1, top = 0;
+  num[root] = 1;
+  vertex[1] = root;
+  parent[1] = 0;
+  stack[top] = root;
+  cursor[top++] = g->succ_idx[root];
+
+  while (top > 0)
+    {
+      size_t v = stack[top - 1];
+      if (cursor[top - 1] == g->succ_idx[v + 1])
+	{
+	  top--;
+	  continue;
+	}
+
+      size_t w = g->succ[cursor[top - 1]++];
+      if (num[w] != 0)
+	continue;
+
+      num[w] = ++count;
+      vertex[count] = w;
+      parent[count] = num[v];
+      stack[top] = w;
+      cursor[top++] = g->succ_idx[w];
+    }
+
+  /* Semi-dominators, in reverse pre-order */
+  for (size_t i = 0; i <= count; i++)
+    semi[i] = label[i] = i;
+
+  for (size_t w = count; w > 1; w--)
+    {
+      size_t v = vertex[w];
+      for (size_t k = g->pred_idx[v]; k < g->pred_idx[v + 1]; k++)
+	{
+	  size_t u = num[g->pred[k]];
+	  if (u == 0)
+	    continue;
+
+	  if (ancestor[u] != 0)
+	    {
+	      snca_compress (u, ancestor, label, semi, stack);
+	      u = label[u];
+	    }
+
+	  if (semi[u] < semi[w])
+	    semi[w] = semi[u];
+	}
+      ancestor[w] = parent[w];
+    }
+
+  /* Immediate dominators (reusing 'label' to store them), in pre-order */
+  label[1] = 0;
+  for (size_t w = 2; w <= count; w++)
+    {
+      size_t d = parent[w];
+      while (d > semi[w])
+	d = label[d];
+      label[w] = d;
+    }
+
+  for (size_t v = 0; v < n; v++)
+    idom[v] = CFG_NONE;
+  for (size_t w = 2; w <= count; w++)
+    idom[vertex[w]] = vertex[label[w]];
+
+  ret = 0;
+
+end:
+  free (num);
+  free (vertex);
+  free (parent);
+  free (semi);
+  free (label);
+  free (ancestor);
+  free (stack);
+  free (cursor);
+
+  return ret;
+}
+
+/* Attach node v as a child of parent in the tree */
+static void
+domtree_link (domtree_t *const dt, const size_t v, const size_t parent)
+{
+  dt->idom[v] = parent;
+  dt->prev[v] = CFG_NONE;
+  dt->next[v] = dt->child[parent];
+  if (dt->child[parent] != CFG_NONE)
+    dt->prev[dt->child[parent]] = v;
+  dt->child[parent] = v;
+}
+
+/* Detach node v from its parent in the tree */
+static void
+domtree_unlink (domtree_t *const dt, const size_t v)
+{
+  if (dt->prev[v] != CFG_NONE)
+    dt->next[dt->prev[v]] = dt->next[v];
+  else
+    dt->child[dt->idom[v]] = dt->next[v];
+
+  if (dt->next[v] != CFG_NONE)
+    dt->prev[dt->next[v]] = dt->prev[v];
+}
+
+/* Set the depths of the subtree rooted at v (stackless traversal) */
+static void
+domtree_set_depths (domtree_t *const dt, const size_t v, const size_t depth)
+{
+  size_t u = v;
+  dt->depth[v] = depth;
+
+  while (true)
+    {
+      if (dt->child[u] != CFG_NONE)
+	u = dt->child[u];
+      else
+	{
+	  while (u != v && dt->next[u] == CFG_NONE)
+	    u = dt->idom[u];
+	  if (u == v)
+	    break;
+	  u = dt->next[u];
+	}
+      dt->depth[u] = dt->depth[dt->idom[u]] + 1;
+    }
+}
+
+/* Grow the per-node and per-edge arrays to fit the CFG */
+static int
+domtree_grow (domtree_t *const dt, cfg_t *const cfg)
+{
+  size_t n = cfg_nodes (cfg), m = cfg_edges (cfg);
+
+  if (n > dt->capacity)
+    {
+      size_t capacity = dt->capacity ? dt->capacity : 1;
+      while (capacity < n)
+	capacity *= 2;
+
+      size_t **arrays[] = {&dt->idom, &dt->depth, &dt->child,
+			   &dt->next, &dt->prev,  &dt->mark};
+      for (size_t i = 0; i < sizeof (arrays) / sizeof (arrays[0]); i++)
+	{
+	  size_t *array = realloc (*arrays[i], capacity * sizeof (size_t));
+	  if (array == NULL)
+	    goto fail;
+	  *arrays[i] = array;
+	}
+      dt->capacity = capacity;
+    }
+
+  for (size_t v = dt->size; v < n; v++)
+    {
+      dt->idom[v] = dt->child[v] = dt->next[v] = dt->prev[v] = CFG_NONE;
+      dt->depth[v] = dt->mark[v] = 0;
+    }
+  dt->size = dt->nodes = n;
+
+  if (m > dt->done_size)
+    {
+      size_t size = dt->done_size ? dt->done_size : 1;
+      while (size < m)
+	size *= 2;
+
+      uint8_t *done = realloc (dt->done, size);
+      if (done == NULL)
+	goto fail;
+
+      memset (done + dt->done_size, 0, size - dt->done_size);
+      dt->done = done;
+      dt->done_size = size;
+    }
+
+  return 0;
+
+fail:
+  errno = ENOMEM;
+  return -1;
+}
+
+/* Set up the structures needed to update a freshly computed tree */
+static int
+domtree_init_updates (domtree_t *const dt, cfg_t *const cfg)
+{
+  size_t *idom = dt->idom;
+
+  /* Build the tree (parent, children, depths) from scratch */
+  dt->idom = NULL;
+  dt->size = 0;
+  if (domtree_grow (dt, cfg) == -1)
+    {
+      dt->idom = idom;
+      return -1;
+    }
+
+  for (size_t v = 0; v < dt->size; v++)
+    if (idom[v] != CFG_NONE)
+      domtree_link (dt, v, idom[v]);
+  free (idom);
+
+  if (dt->size > 0)
+    domtree_set_depths (dt, dt->root, 0);
+
+  /* Edges leaving unreached nodes are taken into account later */
+  dt->edges = cfg_edges (cfg);
+  for (size_t e = 0; e < dt->edges; e++)
+    dt->done[e] = domtree_reachable (dt, cfg_edge_src (cfg, e));
+
+  return 0;
+}
+
+static domtree_t *
+domtree_compute (cfg_t *const cfg, const bool post)
+{
+  if (cfg == NULL)
+    {
+      errno = EINVAL;
+      return NULL;
+    }
+
+  graph_t g;
+  if (graph_build (&g, cfg, post) == -1)
+    return NULL;
+
+  domtree_t *dt = malloc (sizeof (domtree_t));
+  if (dt == NULL)
+    goto fail;
+
+  *dt = (domtree_t){0};
+  dt->reverse = post;
+  dt->size = cfg_nodes (cfg);
+  dt->nodes = g.nodes;
+  dt->root = post ? dt->size : 0;
+  dt->idom = malloc (dt->nodes * sizeof (size_t));
+  if (dt->idom == NULL || snca (&g, dt->root, dt->idom) == -1)
+    goto fail;
+
+  if (!post && domtree_init_updates (dt, cfg) == -1)
+    goto fail;
+
+  graph_free (&g);
+  return dt;
+
+fail:
+  graph_free (&g);
+  domtree_delete (dt);
+  errno = ENOMEM;
+  return NULL;
+}
+
+domtree_t *
+domtree_new (cfg_t *const cfg)
+{
+  return domtree_compute (cfg, false);
+}
+
+domtree_t *
+domtree_post_new (cfg_t *const cfg)
+{
+  return domtree_compute (cfg, true);
+}
+
+void
+domtree_delete (domtree_t *dt)
+{
+  if (dt == NULL)
+    return;
+
+  free (dt->idom);
+  free (dt->pre);
+  free (dt->post);
+  free (dt->depth);
+  free (dt->child);
+  free (dt->next);
+  free (dt->prev);
+  free (dt->mark);
+  free (dt->done);
+  free (dt->heap.data);
+  free (dt->stack.data);
+  free (dt->affected.data);
+  free (dt->pending.data);
+  free (dt);
+}
+
+size_t
+domtree_idom (domtree_t *const dt, const size_t node)
+{
+  if (dt == NULL || node >= dt->size)
+    {
+      errno = EINVAL;
+      return CFG_NONE;
+    }
+
+  /* Hide the virtual exit of post-dominator trees */
+  if (dt->idom[node] == dt->size)
+    return CFG_NONE;
+
+  return dt->idom[node];
+}
+
+bool
+domtree_reachable (domtree_t *const dt, const size_t node)
+{
+  if (dt == NULL || node >= dt->size)
+    {
+      errno = EINVAL;
+      return false;
+    }
+
+  return node == dt->root || dt->idom[node] != CFG_NONE;
+}
+
+/* Number the nodes in pre-order and post-order along the tree, so that
+ * dominance queries become interval inclusion tests */
+static int
+domtree_number (domtree_t *const dt)
+{
+  size_t n = dt->nodes, arcs = 0;
+  size_t *from = malloc (n * sizeof (size_t));
+  size_t *to = malloc (n * sizeof (size_t));
+  size_t *stack = malloc (n * sizeof (size_t));
+  size_t *cursor = malloc (n * sizeof (size_t));
+  size_t *idx = NULL, *children = NULL;
+  int ret = -1;
+
+  dt->pre = malloc (n * sizeof (size_t));
+  dt->post = malloc (n * sizeof (size_t));
+  if (!from || !to || !stack || !cursor || !dt->pre || !dt->post)
+    goto end;
+
+  for (size_t v = 0; v < n; v++)
+    if (dt->idom[v] != CFG_NONE)
+      {
+	from[arcs] = dt->idom[v];
+	to[arcs++] = v;
+      }
+
+  if (csr_fill (n, arcs, from, to, &idx, &children) == -1)
+    goto end;
+
+  for (size_t v = 0; v < n; v++)
+    dt->pre[v] = dt->post[v] = CFG_NONE;
+
+  size_t pre = 0, post = 0, top = 0;
+  dt->pre[dt->root] = pre++;
+  stack[top] = dt->root;
+  cursor[top++] = idx[dt->root];
+
+  while (top > 0)
+    {
+      size_t v = stack[top - 1];
+      if (cursor[top - 1] == idx[v + 1])
+	{
+	  dt->post[v] = post++;
+	  top--;
+	  continue;
+	}
+
+      size_t w = children[cursor[top - 1]++];
+      dt->pre[w] = pre++;
+      stack[top] = w;
+      cursor[top++] = idx[w];
+    }
+
+  ret = 0;
+
+end:
+  free (from);
+  free (to);
+  free (stack);
+  free (cursor);
+  free (idx);
+  free (children);
+
+  if (ret == -1)
+    {
+      free (dt->pre);
+      free (dt->post);
+      dt->pre = dt->post = NULL;
+      errno = ENOMEM;
+    }
+
+  return ret;
+}
+
+bool
+domtree_dominates (domtree_t *const dt, const size_t a, const size_t b)
+{
+  if (dt == NULL || a >= dt->size || b >= dt->size)
+    {
+      errno = EINVAL;
+      return false;
+    }
+
+  if (dt->pre == NULL && domtree_number (dt) == -1)
+    return false;
+
+  if (dt->pre[a] == CFG_NONE || dt->pre[b] == CFG_NONE)
+    return false;
+
+  return dt->pre[a] <= dt->pre[b] && dt->post[b] <= dt->post[a];
+}
+
+/* Push node v in the max-heap of nodes ordered by depth */
+static int
+domtree_heap_push (domtree_t *const dt, const size_t v)
+{
+  if (vector_push (&dt->heap, v) == -1)
+    return -1;
+
+  size_t *heap = dt->heap.data, i = dt->heap.count - 1;
+  while (i > 0 && dt->depth[heap[(i - 1) / 2]] < dt->depth[v])
+    {
+      heap[i] = heap[(i - 1) / 2];
+      i = (i - 1) / 2;
+    }
+  heap[i] = v;
+
+  return 0;
+}
+
+/* Pop the deepest node of the max-heap */
+static size_t
+domtree_heap_pop (domtree_t *const dt)
+{
+  size_t *heap = dt->heap.data, top = heap[0];
+  size_t v = heap[--dt->heap.count], count = dt->heap.count, i = 0;
+
+  while (2 * i + 1 < count)
+    {
+      size_t c = 2 * i + 1;
+      if (c + 1 < count && dt->depth[heap[c + 1]] > dt->depth[heap[c]])
+	c++;
+      if (dt->depth[heap[c]] <= dt->depth[v])
+	break;
+      heap[i] = heap[c];
+      i = c;
+    }
+  if (count > 0)
+    heap[i] = v;
+
+  return top;
+}
+
+static int domtree_insert (domtree_t *const dt, cfg_t *const cfg,
+			   const size_t edge);
+
+/* Edge (x, y) makes y (and all the nodes only reachable from it) reachable:
+ * nodes newly reached are attached along a DFS tree, then the other edges
+ * leaving them are inserted one by one */
+static int
+domtree_reach (domtree_t *const dt, cfg_t *const cfg, const size_t x,
+	       const size_t y)
+{
+  domtree_link (dt, y, x);
+  dt->depth[y] = dt->depth[x] + 1;
+
+  dt->stack.count = dt->pending.count = 0;
+  if (vector_push (&dt->stack, y) == -1)
+    return -1;
+
+  while (dt->stack.count > 0)
+    {
+      size_t v = dt->stack.data[--dt->stack.count];
+      for (size_t i = 0; i < cfg_node_degree (cfg, v); i++)
+	{
+	  size_t e = cfg_node_edge (cfg, v, i), w = cfg_edge_dst (cfg, e);
+	  if (domtree_reachable (dt, w))
+	    {
+	      if (vector_push (&dt->pending, e) == -1)
+		return -1;
+	      continue;
+	    }
+
+	  dt->done[e] = 1;
+	  domtree_link (dt, w, v);
+	  dt->depth[w] = dt->depth[v] + 1;
+	  if (vector_push (&dt->stack, w) == -1)
+	    return -1;
+	}
+    }
+
+  for (size_t i = 0; i < dt->pending.count; i++)
+    if (!dt->done[dt->pending.data[i]] &&
+	domtree_insert (dt, cfg, dt->pending.data[i]) == -1)
+      return -1;
+
+  return 0;
+}
+
+/* Insert an edge (x, y) with the depth-based search of Georgiadis et al.:
+ * a node w is affected iff depth(nca(x, y)) + 1 < depth(w) and w is
+ * reachable from y through nodes not shallower than w. Affected nodes are
+ * found from the deepest to the shallowest and become children of nca */
+static int
+domtree_insert (domtree_t *const dt, cfg_t *const cfg, const size_t edge)
+{
+  size_t x = cfg_edge_src (cfg, edge), y = cfg_edge_dst (cfg, edge);
+
+  /* Edges leaving unreached nodes are inserted when the node gets reached */
+  if (!domtree_reachable (dt, x))
+    return 0;
+
+  dt->done[edge] = 1;
+  if (!domtree_reachable (dt, y))
+    return domtree_reach (dt, cfg, x, y);
+
+  size_t nca = x, v = y;
+  while (nca != v)
+    {
+      if (dt->depth[nca] >= dt->depth[v])
+	nca = dt->idom[nca];
+      else
+	v = dt->idom[v];
+    }
+
+  size_t depth = dt->depth[nca] + 1;
+  if (dt->depth[y] <= depth)
+    return 0;
+
+  dt->stamp++;
+  dt->mark[y] = dt->stamp;
+  dt->heap.count = dt->affected.count = 0;
+  if (domtree_heap_push (dt, y) == -1)
+    return -1;
+
+  while (dt->heap.count > 0)
+    {
+      size_t z = domtree_heap_pop (dt);
+      dt->stack.count = 0;
+      if (vector_push (&dt->affected, z) == -1 ||
+	  vector_push (&dt->stack, z) == -1)
+	return -1;
+
+      while (dt->stack.count > 0)
+	{
+	  v = dt->stack.data[--dt->stack.count];
+	  for (size_t i = 0; i < cfg_node_degree (cfg, v); i++)
+	    {
+	      size_t e = cfg_node_edge (cfg, v, i), w = cfg_edge_dst (cfg, e);
+	      if (!dt->done[e] || dt->mark[w] == dt->stamp)
+		continue;
+
+	      if (dt->depth[w] > dt->depth[z])
+		{
+		  dt->mark[w] = dt->stamp;
+		  if (vector_push (&dt->stack, w) == -1)
+		    return -1;
+		}
+	      else if (dt->depth[w] > depth)
+		{
+		  dt->mark[w] = dt->stamp;
+		  if (domtree_heap_push (dt, w) == -1)
+		    return -1;
+		}
+	    }
+	}
+    }
+
+  for (size_t i = 0; i < dt->affected.count; i++)
+    {
+      domtree_unlink (dt, dt->affected.data[i]);
+      domtree_link (dt, dt->affected.data[i], nca);
+    }
+
+  for (size_t i = 0; i < dt->affected.count; i++)
+    domtree_set_depths (dt, dt->affected.data[i], depth);
+
+  return 0;
+}
+
+int
+domtree_update (domtree_t *const dt, cfg_t *const cfg)
+{
+  if (dt == NULL || cfg == NULL || dt->reverse || cfg_nodes (cfg) < dt->size)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+  size_t edges = cfg_edges (cfg);
+  if (edges == dt->edges)
+    return 0;
+
+  if (domtree_grow (dt, cfg) == -1)
+    return -1;
+
+  /* Dominance intervals have to be computed again */
+  free (dt->pre);
+  free (dt->post);
+  dt->pre = dt->post = NULL;
+
+  for (; dt->edges < edges; dt->edges++)
+    if (!dt->done[dt->edges] && domtree_insert (dt, cfg, dt->edges) == -1)
+      return -1;
+
+  return 0;
+}
+
+/* **********[ Loop-nesting Forest ]********** */
+
+typedef struct
+{
+  size_t header;       /* Header node */
+  size_t parent;       /* Enclosing loop (CFG_NONE if outermost) */
+  size_t depth;	       /* Nesting depth (outermost loops are at depth 1) */
+  size_t body_start;   /* Body is body[body_start] ... body[body_end - 1] */
+  size_t body_end;     /* End of the body (nested loops included) */
+  size_t exits_start;  /* Exits are exits[exits_start] ... */
+  size_t exits_end;    /* ... exits[exits_end - 1] */
+  size_t entries;      /* Number of times the loop has been entered */
+  size_t instructions; /* Number of instructions executed in the loop */
+} loop_t;
+
+struct _loops_t
+{
+  size_t count;	     /* Number of loops */
+  loop_t *loops;     /* Loops, inner loops come first */
+  size_t nodes;	     /* Number of nodes of the CFG */
+  size_t *innermost; /* Innermost loop of each node (CFG_NONE if none) */
+  size_t *body;	     /* Loop bodies, ordered along the nesting forest */
+  size_t *exits;     /* Edges leaving the loops */
+  cfg_t *cfg;	     /* CFG the loops were computed on */
+};
+
+/* Union-find lookup with path compression */
+static size_t
+loops_find (size_t *uf, size_t v)
+{
+  size_t root = v;
+  while (uf[root] != root)
+    root = uf[root];
+
+  while (uf[v] != root)
+    {
+      size_t next = uf[v];
+      uf[v] = root;
+      v = next;
+    }
+
+  return root;
+}
+
+/* Collect the loops and their nesting (Havlak-like): headers are processed
+ * from the deepest to the shallowest in the dominator tree, so inner loops
+ * are collapsed onto their header before enclosing loops are explored */
+static int
+loops_collect (loops_t *const lf, cfg_t *const cfg, domtree_t *const dt,
+	       const graph_t *const g)
+{
+  size_t n = lf->nodes;
+  size_t *uf = malloc (n * sizeof (size_t));
+  size_t *by_pre = malloc (n * sizeof (size_t));
+  size_t *head_of = malloc (n * sizeof (size_t));
+  vector_t stack = {0};
+  int ret = -1;
+
+  if (uf == NULL || by_pre == NULL || head_of == NULL)
+    goto end;
+
+  for (size_t v = 0; v < n; v++)
+    {
+      uf[v] = v;
+      by_pre[v] = head_of[v] = CFG_NONE;
+      if (dt->pre[v] != CFG_NONE)
+	by_pre[dt->pre[v]] = v;
+    }
+
+  /* Headers are targets of back edges (edges to a dominator) */
+  size_t headers = 0;
+  for (size_t e = 0; e < cfg_edges (cfg); e++)
+    {
+      size_t u = cfg_edge_src (cfg, e), h = cfg_edge_dst (cfg, e);
+      if (head_of[h] == CFG_NONE && domtree_dominates (dt, h, u))
+	{
+	  head_of[h] = 0;
+	  headers++;
+	}
+    }
+
+  lf->loops = malloc ((headers ? headers : 1) * sizeof (loop_t));
+  if (lf->loops == NULL)
+    goto end;
+
+  for (size_t p = n; p > 0; p--)
+    {
+      size_t h = by_pre[p - 1];
+      if (h == CFG_NONE || head_of[h] == CFG_NONE)
+	continue;
+
+      size_t loop = lf->count++;
+      lf->loops[loop] = (loop_t){.header = h, .parent = CFG_NONE};
+      lf->innermost[h] = loop;
+      head_of[h] = loop;
+
+      /* Walk backward from the sources of the back edges up to the header */
+      stack.count = 0;
+      for (size_t k = g->pred_idx[h]; k < g->pred_idx[h + 1]; k++)
+	if (g->pred[k] != h && domtree_dominates (dt, h, g->pred[k]) &&
+	    vector_push (&stack, g->pred[k]) == -1)
+	  goto end;
+
+      while (stack.count > 0)
+	{
+	  size_t v = loops_find (uf, stack.data[--stack.count]);
+	  if (v == h)
+	    continue;
+
+	  /* Either an inner loop (collapsed on its header) or a new node */
+	  if (head_of[v] != CFG_NONE)
+	    lf->loops[head_of[v]].parent = loop;
+	  else
+	    lf->innermost[v] = loop;
+	  uf[v] = h;
+
+	  for (size_t k = g->pred_idx[v]; k < g->pred_idx[v + 1]; k++)
+	    if (domtree_reachable (dt, g->pred[k]) &&
+		vector_push (&stack, g->pred[k]) == -1)
+	      goto end;
+	}
+    }
+
+  ret = 0;
+
+end:
+  free (uf);
+  free (by_pre);
+  free (head_of);
+  free (stack.data);
+
+  if (ret == -1)
+    errno = ENOMEM;
+
+  return ret;
+}
+
+/* Lay out the loop bodies so that each loop (with its nested loops) is a
+ * contiguous range of nodes, ordered along a pre-order of the forest */
+static int
+loops_layout (loops_t *const lf, cfg_t *const cfg)
+{
+  size_t n = lf->nodes, count = lf->count, arcs = 0;
+  size_t *from = malloc ((n + count + 1) * sizeof (size_t));
+  size_t *to = malloc ((n + count + 1) * sizeof (size_t));
+  size_t *own_idx = NULL, *own = NULL, *kids_idx = NULL, *kids = NULL;
+  size_t *stack = malloc ((count + 1) * sizeof (size_t));
+  size_t *cursor = malloc ((count + 1) * sizeof (size_t));
+  int ret = -1;
+
+  lf->body = malloc ((n ? n : 1) * sizeof (size_t));
+  if (!from || !to || !stack || !cursor || !lf->body)
+    goto end;
+
+  /* Nodes grouped by innermost loop */
+  for (size_t v = 0; v < n; v++)
+    if (lf->innermost[v] != CFG_NONE)
+      {
+	from[arcs] = lf->innermost[v];
+	to[arcs++] = v;
+      }
+  if (csr_fill (count, arcs, from, to, &own_idx, &own) == -1)
+    goto end;
+
+  /* Children of each loop, the virtual loop 'count' holding the roots */
+  arcs = 0;
+  for (size_t l = 0; l < count; l++)
+    {
+      size_t parent = lf->loops[l].parent;
+      from[arcs] = (parent == CFG_NONE) ? count : parent;
+      to[arcs++] = l;
+    }
+  if (csr_fill (count + 1, arcs, from, to, &kids_idx, &kids) == -1)
+    goto end;
+
+  size_t pos = 0, top = 0;
+  for (size_t r = kids_idx[count]; r < kids_idx[count + 1]; r++)
+    {
+      stack[top] = kids[r];
+      cursor[top++] = kids_idx[kids[r]];
+      lf->loops[kids[r]].body_start = pos;
+      for (size_t k = own_idx[kids[r]]; k < own_idx[kids[r] + 1]; k++)
+	lf->body[pos++] = own[k];
+
+      while (top > 0)
+	{
+	  size_t l = stack[top - 1];
+	  if (cursor[top - 1] == kids_idx[l + 1])
+	    {
+	      lf->loops[l].body_end = pos;
+	      top--;
+	      continue;
+	    }
+
+	  size_t c = kids[cursor[top - 1]++];
+	  lf->loops[c].body_start = pos;
+	  for (size_t k = own_idx[c]; k < own_idx[c + 1]; k++)
+	    lf->body[pos++] = own[k];
+	  stack[top] = c;
+	  cursor[top++] = kids_idx[c];
+	}
+    }
+
+  /* Depths (enclosing loops have greater indexes than nested ones) */
+  for (size_t l = count; l > 0; l--)
+    {
+      loop_t *loop = &(lf->loops[l - 1]);
+      loop->depth =
+	  (loop->parent == CFG_NONE) ? 1 : lf->loops[loop->parent].depth + 1;
+    }
+
+  /* Executed instructions, accumulated from inner to outer loops */
+  for (size_t v = 0; v < n; v++)
+    if (lf->innermost[v] != CFG_NONE)
+      lf->loops[lf->innermost[v]].instructions += cfg_node_hits (cfg, v);
+
+  for (size_t l = 0; l < count; l++)
+    if (lf->loops[l].parent != CFG_NONE)
+      lf->loops[lf->loops[l].parent].instructions += lf->loops[l].instructions;
+
+  ret = 0;
+
+end:
+  free (from);
+  free (to);
+  free (own_idx);
+  free (own);
+  free (kids_idx);
+  free (kids);
+  free (stack);
+  free (cursor);
+
+  if (ret == -1)
+    errno = ENOMEM;
+
+  return ret;
+}
+
+/* Find the edges leaving each loop and count the entries in each loop */
+static int
+loops_edges (loops_t *const lf, cfg_t *const cfg)
+{
+  size_t m = cfg_edges (cfg), count = lf->count, arcs = 0;
+  vector_t from = {0}, to = {0};
+  size_t *idx = NULL;
+  int ret = -1;
+
+  for (size_t e = 0; e < m; e++)
+    {
+      size_t u = cfg_edge_src (cfg, e), w = cfg_edge_dst (cfg, e);
+
+      for (size_t l = lf->innermost[u];
+	   l != CFG_NONE && !loops_contains (lf, l, w); l = lf->loops[l].parent)
+	if (vector_push (&from, l) == -1 || vector_push (&to, e) == -1)
+	  goto end;
+
+      size_t l = lf->innermost[w];
+      if (l != CFG_NONE && lf->loops[l].header == w &&
+	  !loops_contains (lf, l, u))
+	lf->loops[l].entries += cfg_edge_hits (cfg, e);
+    }
+
+  /* The entry node is reached once without any edge */
+  if (count > 0 && lf->innermost[0] != CFG_NONE &&
+      lf->loops[lf->innermost[0]].header == 0)
+    lf->loops[lf->innermost[0]].entries++;
+
+  arcs = from.count;
+  if (csr_fill (count, arcs, from.data, to.data, &idx, &lf->exits) == -1)
+    goto end;
+
+  for (size_t l = 0; l < count; l++)
+    {
+      lf->loops[l].exits_start = idx[l];
+      lf->loops[l].exits_end = idx[l + 1];
+    }
+
+  ret = 0;
+
+end:
+  free (from.data);
+  free (to.data);
+  free (idx);
+
+  if (ret == -1)
+    errno = ENOMEM;
+
+  return ret;
+}
+
+loops_t *
+loops_new (cfg_t *const cfg)
+{
+  if (cfg == NULL)
+    {
+      errno = EINVAL;
+      return NULL;
+    }
+
+  graph_t g = {0};
+  loops_t *lf = malloc (sizeof (loops_t));
+  if (lf == NULL)
+    return NULL;
+
+  *lf = (loops_t){0};
+  domtree_t *dt = domtree_new (cfg);
+  if (dt == NULL)
+    goto fail;
+
+  lf->cfg = cfg;
+  lf->nodes = cfg_nodes (cfg);
+  lf->innermost = malloc (lf->nodes * sizeof (size_t));
+  if (lf->innermost == NULL)
+    goto fail;
+
+  for (size_t v = 0; v < lf->nodes; v++)
+    lf->innermost[v] = CFG_NONE;
+
+  if ((dt->pre == NULL && domtree_number (dt) == -1) ||
+      graph_build (&g, cfg, false) == -1 ||
+      loops_collect (lf, cfg, dt, &g) == -1 || loops_layout (lf, cfg) == -1 ||
+      loops_edges (lf, cfg) == -1)
+    goto fail;
+
+  graph_free (&g);
+  domtree_delete (dt);
+  return lf;
+
+fail:
+  graph_free (&g);
+  domtree_delete (dt);
+  loops_delete (lf);
+  errno = ENOMEM;
+  return NULL;
+}
+
+void
+loops_delete (loops_t *loops)
+{
+  if (loops == NULL)
+    return;
+
+  free (loops->loops);
+  free (loops->innermost);
+  free (loops->body);
+  free (loops->exits);
+  free (loops);
+}
+
+size_t
+loops_count (loops_t *const loops)
+{
+  return (loops == NULL) ? 0 : loops->count;
+}
+
+size_t
+loops_innermost (loops_t *const loops, const size_t node)
+{
+  if (loops == NULL || node >= loops->nodes)
+    {
+      errno = EINVAL;
+      return CFG_NONE;
+    }
+
+  return loops->innermost[node];
+}
+
+bool
+loops_contains (loops_t *const loops, const size_t loop, const size_t node)
+{
+  if (loops == NULL || loop >= loops->count || node >= loops->nodes)
+    {
+      errno = EINVAL;
+      return false;
+    }
+
+  /* Enclosing loops have greater indexes than nested ones */
+  size_t l = loops->innermost[node];
+  while (l != CFG_NONE && l < loop)
+    l = loops->loops[l].parent;
+
+  return l == loop;
+}
+
+/* Get the loop structure, NULL on error */
+static loop_t *
+loops_get (loops_t *const loops, const size_t loop)
+{
+  if (loops == NULL || loop >= loops->count)
+    {
+      errno = EINVAL;
+      return NULL;
+    }
+
+  return &(loops->loops[loop]);
+}
+
+size_t
+loops_header (loops_t *const loops, const size_t loop)
+{
+  loop_t *l = loops_get (loops, loop);
+  return (l == NULL) ? CFG_NONE : l->header;
+}
+
+size_t
+loops_parent (loops_t *const loops, const size_t loop)
+{
+  loop_t *l = loops_get (loops, loop);
+  return (l == NULL) ? CFG_NONE : l->parent;
+}
+
+size_t
+loops_depth (loops_t *const loops, const size_t loop)
+{
+  loop_t *l = loops_get (loops, loop);
+  return (l == NULL) ? 0 : l->depth;
+}
+
+size_t
+loops_size (loops_t *const loops, const size_t loop)
+{
+  loop_t *l = loops_get (loops, loop);
+  return (l == NULL) ? 0 : l->body_end - l->body_start;
+}
+
+size_t
+loops_node (loops_t *const loops, const size_t loop, const size_t i)
+{
+  loop_t *l = loops_get (loops, loop);
+  if (l == NULL || i >= l->body_end - l->body_start)
+    {
+      errno = EINVAL;
+      return CFG_NONE;
+    }
+
+  return loops->body[l->body_start + i];
+}
+
+size_t
+loops_exits (loops_t *const loops, const size_t loop)
+{
+  loop_t *l = loops_get (loops, loop);
+  return (l == NULL) ? 0 : l->exits_end - l->exits_start;
+}
+
+size_t
+loops_exit (loops_t *const loops, const size_t loop, const size_t i)
+{
+  loop_t *l = loops_get (loops, loop);
+  if (l == NULL || i >= l->exits_end - l->exits_start)
+    {
+      errno = EINVAL;
+      return CFG_NONE;
+    }
+
+  return loops->exits[l->exits_start + i];
+}
+
+size_t
+loops_entries (loops_t *const loops, const size_t loop)
+{
+  loop_t *l = loops_get (loops, loop);
+  return (l == NULL) ? 0 : l->entries;
+}
+
+size_t
+loops_iterations (loops_t *const loops, const size_t loop)
+{
+  loop_t *l = loops_get (loops, loop);
+  return (l == NULL) ? 0 : cfg_node_hits (loops->cfg, l->header);
+}
+
+size_t
+loops_instructions (loops_t *const loops, const size_t loop)
+{
+  loop_t *l = loops_get (loops, loop);
+  return (l == NULL) ? 0 : l->instructions;
+}
+
+/* **********[ Functions ]********** */
+
+typedef struct
+{
+  size_t entry;	       /* Entry node */
+  size_t body_start;   /* Nodes are body[body_start] ... */
+  size_t body_end;     /* ... body[body_end - 1] (entry first) */
+  size_t calls;	       /* Number of times the function has been called */
+  size_t instructions; /* Number of instructions executed in the function */
+} function_t;
+
+struct _functions_t
+{
+  size_t count;		 /* Number of functions */
+  function_t *functions; /* Functions, ordered by entry node */
+  size_t nodes;		 /* Number of nodes of the CFG */
+  size_t *owner;	 /* Function of each node */
+  size_t *body;		 /* Nodes of the functions, function after function */
+};
+
+/* Node of the CFG at a given address */
+typedef struct
+{
+  uintptr_t addr;
+  size_t node;
+} addr_node_t;
+
+static int
+addr_node_compare (const void *a, const void *b)
+{
+  const addr_node_t *x = a, *y = b;
+  if (x->addr != y->addr)
+    return (x->addr > y->addr) - (x->addr < y->addr);
+  return (x->node > y->node) - (x->node < y->node);
+}
+
+/* Returns the first entry of the sorted map at addr (or after it) */
+static size_t
+addr_node_lower (const addr_node_t *const map, const size_t count,
+		 const uintptr_t addr)
+{
+  size_t lo = 0, hi = count;
+  while (lo < hi)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+      if (map[mid].addr < addr)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+
+  return lo;
+}
+
+/* Grow the function owning the nodes of the queue (from 'head'): calls are
+ * followed to their return site, returns and call edges are not followed
+ * and other entries are never crossed */
+static int
+functions_grow (functions_t *const fn, cfg_t *const cfg,
+		const addr_node_t *const map, const bool *const is_entry,
+		vector_t *const queue, size_t head)
+{
+  for (; head < queue->count; head++)
+    {
+      size_t v = queue->data[head];
+      instr_t *instr = cfg_node_instr (cfg, v);
+
+      switch (instr_type (instr))
+	{
+	case RET:
+	  break;
+
+	case CALL:
+	  {
+	    uintptr_t site = instr_addr (instr) + instr_size (instr);
+	    for (size_t i = addr_node_lower (map, fn->nodes, site);
+		 i < fn->nodes && map[i].addr == site; i++)
+	      if (fn->owner[map[i].node] == CFG_NONE && !is_entry[map[i].node])
+		{
+		  fn->owner[map[i].node] = fn->owner[v];
+		  if (vector_push (queue, map[i].node) == -1)
+		    return -1;
+		}
+	  }
+	  break;
+
+	default:
+	  for (size_t i = 0; i < cfg_node_degree (cfg, v); i++)
+	    {
+	      size_t w = cfg_edge_dst (cfg, cfg_node_edge (cfg, v, i));
+	      if (fn->owner[w] == CFG_NONE && !is_entry[w])
+		{
+		  fn->owner[w] = fn->owner[v];
+		  if (vector_push (queue, w) == -1)
+		    return -1;
+		}
+	    }
+	}
+    }
+
+  return 0;
+}
+
+/* Start a new function at node v and grow it */
+static int
+functions_add (functions_t *const fn, cfg_t *const cfg,
+	       const addr_node_t *const map, const bool *const is_entry,
+	       vector_t *const queue, const size_t v)
+{
+  size_t head = queue->count;
+  if (fn->count % 64 == 0)
+    {
+      function_t *functions =
+	  realloc (fn->functions, (fn->count + 64) * sizeof (function_t));
+      if (functions == NULL)
+	return -1;
+      fn->functions = functions;
+    }
+
+  fn->functions[fn->count] = (function_t){.entry = v};
+  fn->owner[v] = fn->count++;
+  if (vector_push (queue, v) == -1)
+    return -1;
+
+  return functions_grow (fn, cfg, map, is_entry, queue, head);
+}
+
+/* Lay out the nodes of the functions contiguously (entry first) and gather
+ * their profile */
+static int
+functions_layout (functions_t *const fn, cfg_t *const cfg)
+{
+  size_t *cursor = calloc (fn->count + 1, sizeof (size_t));
+  fn->body = malloc ((fn->nodes ? fn->nodes : 1) * sizeof (size_t));
+  if (cursor == NULL || fn->body == NULL)
+    {
+      free (cursor);
+      return -1;
+    }
+
+  for (size_t v = 0; v < fn->nodes; v++)
+    {
+      cursor[fn->owner[v] + 1]++;
+      fn->functions[fn->owner[v]].instructions += cfg_node_hits (cfg, v);
+    }
+
+  for (size_t f = 0; f < fn->count; f++)
+    {
+      cursor[f + 1] += cursor[f];
+      fn->functions[f].body_start = cursor[f];
+      fn->functions[f].body_end = cursor[f + 1];
+      fn->body[cursor[f]++] = fn->functions[f].entry;
+    }
+
+  for (size_t v = 0; v < fn->nodes; v++)
+    if (v != fn->functions[fn->owner[v]].entry)
+      fn->body[cursor[fn->owner[v]]++] = v;
+
+  /* Calls are the edges from call instructions to the entries */
+  for (size_t e = 0; e < cfg_edges (cfg); e++)
+    {
+      size_t src = cfg_edge_src (cfg, e), dst = cfg_edge_dst (cfg, e);
+      function_t *f = &(fn->functions[fn->owner[dst]]);
+      if (f->entry == dst && instr_type (cfg_node_instr (cfg, src)) == CALL)
+	f->calls += cfg_edge_hits (cfg, e);
+    }
+
+  free (cursor);
+  return 0;
+}
+
+functions_t *
+functions_new (cfg_t *const cfg, const uintptr_t *entries, const size_t count)
+{
+  if (cfg == NULL || (entries == NULL && count > 0))
+    {
+      errno = EINVAL;
+      return NULL;
+    }
+
+  functions_t *fn = malloc (sizeof (functions_t));
+  if (fn == NULL)
+    return NULL;
+
+  *fn = (functions_t){0};
+  fn->nodes = cfg_nodes (cfg);
+
+  size_t n = fn->nodes;
+  addr_node_t *map = malloc ((n ? n : 1) * sizeof (addr_node_t));
+  bool *is_entry = calloc (n ? n : 1, sizeof (bool));
+  fn->owner = malloc ((n ? n : 1) * sizeof (size_t));
+  vector_t queue = {0};
+
+  if (map == NULL || is_entry == NULL || fn->owner == NULL)
+    goto fail;
+
+  for (size_t v = 0; v < n; v++)
+    {
+      map[v] = (addr_node_t){instr_addr (cfg_node_instr (cfg, v)), v};
+      fn->owner[v] = CFG_NONE;
+    }
+  qsort (map, n, sizeof (addr_node_t), addr_node_compare);
+
+  /* Entries: the entry of the CFG, the call targets and the given ones */
+  if (n > 0)
+    is_entry[0] = true;
+
+  for (size_t e = 0; e < cfg_edges (cfg); e++)
+    if (instr_type (cfg_node_instr (cfg, cfg_edge_src (cfg, e))) == CALL)
+      is_entry[cfg_edge_dst (cfg, e)] = true;
+
+  for (size_t i = 0; i < count; i++)
+    for (size_t j = addr_node_lower (map, n, entries[i]);
+	 j < n && map[j].addr == entries[i]; j++)
+      is_entry[map[j].node] = true;
+
+  /* Grow the functions from their entry, in the order of the nodes */
+  for (size_t v = 0; v < n; v++)
+    if (is_entry[v] &&
+	functions_add (fn, cfg, map, is_entry, &queue, v) == -1)
+      goto fail;
+
+  /* Nodes reached from no entry (e.g. after returning to a caller that was
+   * never seen) start functions of their own */
+  for (size_t v = 0; v < n; v++)
+    if (fn->owner[v] == CFG_NONE &&
+	functions_add (fn, cfg, map, is_entry, &queue, v) == -1)
+      goto fail;
+
+  if (functions_layout (fn, cfg) == -1)
+    goto fail;
+
+  free (map);
+  free (is_entry);
+  free (queue.data);
+  return fn;
+
+fail:
+  free (map);
+  free (is_entry);
+  free (queue.data);
+  functions_delete (fn);
+  errno = ENOMEM;
+  return NULL;
+}
+
+void
+functions_delete (functions_t *fn)
+{
+  if (fn == NULL)
+    return;
+
+  free (fn->functions);
+  free (fn->owner);
+  free (fn->body);
+  free (fn);
+}
+
+size_t
+functions_count (functions_t *const fn)
+{
+  return (fn == NULL) ? 0 : fn->count;
+}
+
+size_t
+functions_of (functions_t *const fn, const size_t node)
+{
+  if (fn == NULL || node >= fn->nodes)
+    {
+      errno = EINVAL;
+      return CFG_NONE;
+    }
+
+  return fn->owner[node];
+}
+
+/* Get the function structure, NULL on error */
+static function_t *
+functions_get (functions_t *const fn, const size_t function)
+{
+  if (fn == NULL || function >= fn->count)
+    {
+      errno = EINVAL;
+      return NULL;
+    }
+
+  return &(fn->functions[function]);
+}
+
+size_t
+functions_entry (functions_t *const fn, const size_t function)
+{
+  function_t *f = functions_get (fn, function);
+  return (f == NULL) ? CFG_NONE : f->entry;
+}
+
+size_t
+functions_size (functions_t *const fn, const size_t function)
+{
+  function_t *f = functions_get (fn, function);
+  return (f == NULL) ? 0 : f->body_end - f->body_start;
+}
+
+size_t
+functions_node (functions_t *const fn, const size_t function, const size_t i)
+{
+  function_t *f = functions_get (fn, function);
+  if (f == NULL || i >= f->body_end - f->body_start)
+    {
+      errno = EINVAL;
+      return CFG_NONE;
+    }
+
+  return fn->body[f->body_start + i];
+}
+
+size_t
+functions_calls (functions_t *const fn, const size_t function)
+{
+  function_t *f = functions_get (fn, function);
+  return (f == NULL) ? 0 : f->calls;
+}
+
+size_t
+functions_instructions (functions_t *const fn, const size_t function)
+{
+  function_t *f = functions_get (fn, function);
+  return (f == NULL) ? 0 : f->instructions;
+}
@@ -0,0 +1,1447 @@
+/*
+ * tracker is an analyzer for binary executable files
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019-2020 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "disassembler.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* **********[ Instruction Classification ]********** */
+
+instr_type_t
+disasm_instr_type (csh handle, cs_insn *insn)
+{
+  if (cs_insn_group (handle, insn, CS_GRP_RET))
+    return RET;
+
+  if (cs_insn_group (handle, insn, CS_GRP_CALL))
+    return CALL;
+
+  if (cs_insn_group (handle, insn, CS_GRP_JUMP))
+    return (insn->id == X86_INS_JMP) ? JMP : BRANCH;
+
+  return INSTR;
+}
+
+node_t
+disasm_node_type (csh handle, cs_insn *insn)
+{
+  /* Returns go wherever the stack says */
+  if (cs_insn_group (handle, insn, CS_GRP_RET))
+    return dynjump;
+
+  if (!cs_insn_group (handle, insn, CS_GRP_JUMP) &&
+      !cs_insn_group (handle, insn, CS_GRP_CALL))
+    return single;
+
+  /* Jumps and calls with a computed target */
+  cs_x86 *x86 = &(insn->detail->x86);
+  if (x86->op_count != 1 || x86->operands[0].type != X86_OP_IMM)
+    return dynjump;
+
+  /* Direct jumps and calls have a unique successor */
+  if (insn->id == X86_INS_JMP || insn->id == X86_INS_CALL)
+    return single;
+
+  return branch;
+}
+
+/* Get the static successors of a decoded instruction: the target of a
+ * direct jump or call (0 if none, far ones being left to the dynamic
+ * analysis) and whether execution may go on with the next instruction */
+static bool
+disasm_successors (csh handle, cs_insn *insn, uintptr_t *target)
+{
+  *target = 0;
+
+  /* No static successor after a return, a halt or an undefined opcode */
+  if (cs_insn_group (handle, insn, CS_GRP_RET) || insn->id == X86_INS_HLT ||
+      insn->id == X86_INS_UD2)
+    return false;
+
+  bool jump = cs_insn_group (handle, insn, CS_GRP_JUMP);
+  bool call = cs_insn_group (handle, insn, CS_GRP_CALL);
+  cs_x86 *x86 = &(insn->detail->x86);
+
+  if ((jump || call) && insn->id != X86_INS_LJMP &&
+      insn->id != X86_INS_LCALL && x86->op_count == 1 &&
+      x86->operands[0].type == X86_OP_IMM)
+    *target = x86->operands[0].imm;
+
+  /* Unconditional jumps have no fall-through */
+  return insn->id != X86_INS_JMP && insn->id != X86_INS_LJMP;
+}
+
+/* **********[ Static Disassembler ]********** */
+
+/* Executable segment and the instructions already claimed in it */
+typedef struct
+{
+  uintptr_t addr;	/* Link-time address of the segment */
+  size_t size;		/* Size of the segment */
+  const uint8_t *bytes; /* Content of the segment */
+  atomic_uchar *seen;	/* Non-zero if an instruction starts at this byte */
+} region_t;
+
+/* Statically decoded instruction */
+typedef struct
+{
+  uintptr_t addr;    /* Link-time address */
+  uintptr_t target;  /* Link-time target of a direct jump (0 if none) */
+  uint8_t size;	     /* Size of the instruction */
+  bool executed;     /* The instruction belongs to the CFG */
+  bool fallthrough;  /* Execution may go on with the next instruction */
+  instr_type_t type; /* Kind of control-flow transfer */
+  node_t node_type;  /* CFG node type */
+} sinstr_t;
+
+struct _disasm_t
+{
+  cs_mode mode;		  /* Capstone mode of the executable */
+  uintptr_t bias;	  /* Difference between run-time and link-time */
+  decode_cache_t *cache;  /* Instructions already decoded (or NULL) */
+  size_t regions_count;	  /* Number of executable segments */
+  region_t *regions;	  /* Executable segments */
+  size_t count;		  /* Number of instructions found */
+  sinstr_t *instrs;	  /* Instructions found, sorted by address */
+};
+
+/* Disassembling thread */
+typedef struct
+{
+  disasm_t *d;
+  const uintptr_t *seeds; /* Start points (link-time addresses) */
+  size_t seeds_count;	  /* Number of start points */
+  atomic_size_t *next;	  /* Next start point to explore (shared) */
+  sinstr_t *found;	  /* Instructions decoded by this thread */
+  size_t found_count;
+  size_t found_size;
+  uintptr_t *stack; /* Addresses waiting to be decoded */
+  size_t stack_count;
+  size_t stack_size;
+  int error; /* errno value on failure (0 otherwise) */
+} worker_t;
+
+/* Number of start points taken at once by a thread */
+#define SEEDS_CHUNK 64
+
+static int
+cmp_addr (const void *a, const void *b)
+{
+  uintptr_t x = *(const uintptr_t *) a, y = *(const uintptr_t *) b;
+  return (x > y) - (x < y);
+}
+
+static int
+cmp_sinstr (const void *a, const void *b)
+{
+  return cmp_addr (&((const sinstr_t *) a)->addr,
+		   &((const sinstr_t *) b)->addr);
+}
+
+/* Returns the region holding addr, NULL if none */
+static region_t *
+region_get (disasm_t *const d, const uintptr_t addr)
+{
+  for (size_t i = 0; i < d->regions_count; i++)
+    if (addr >= d->regions[i].addr &&
+	addr - d->regions[i].addr < d->regions[i].size)
+      return &(d->regions[i]);
+
+  return NULL;
+}
+
+/* Push addr on the stack of the worker if nobody has claimed it yet */
+static int
+worker_claim (worker_t *const w, const uintptr_t addr)
+{
+  region_t *region = region_get (w->d, addr);
+  if (region == NULL ||
+      atomic_exchange_explicit (&(region->seen[addr - region->addr]), 1,
+				memory_order_relaxed))
+    return 0;
+
+  if (w->stack_count == w->stack_size)
+    {
+      size_t size = w->stack_size ? 2 * w->stack_size : 1024;
+      uintptr_t *stack = realloc (w->stack, size * sizeof (uintptr_t));
+      if (stack == NULL)
+	return -1;
+      w->stack = stack;
+      w->stack_size = size;
+    }
+  w->stack[w->stack_count++] = addr;
+
+  return 0;
+}
+
+static uintptr_t cache_bias (decode_cache_t *const cache);
+static const decoded_t *cache_find (decode_cache_t *const cache,
+				    const uintptr_t addr);
+
+/* Decode the instruction at addr (taken from the decode cache if it is
+ * there), record it and claim its successors */
+static int
+worker_decode (worker_t *const w, csh handle, cs_insn *insn,
+	       const uintptr_t addr)
+{
+  decode_cache_t *cache = w->d->cache;
+  uintptr_t bias = cache_bias (cache);
+  const decoded_t *decoded =
+      (cache == NULL) ? NULL : cache_find (cache, addr + bias);
+  uintptr_t target;
+  bool fallthrough;
+  uint8_t size;
+  instr_type_t type;
+  node_t node_type;
+
+  if (decoded != NULL)
+    {
+      size = decoded->size;
+      fallthrough = decoded->fallthrough;
+      target = (decoded->target == 0) ? 0 : decoded->target - bias;
+      type = decoded->type;
+      node_type = decoded->node_type;
+    }
+  else
+    {
+      region_t *region = region_get (w->d, addr);
+      const uint8_t *code = region->bytes + (addr - region->addr);
+      size_t left = region->size - (addr - region->addr);
+      uint64_t address = addr;
+
+      if (!cs_disasm_iter (handle, &code, &left, &address, insn))
+	return 0; /* Not an instruction, the path stops here */
+
+      size = insn->size;
+      fallthrough = disasm_successors (handle, insn, &target);
+      type = disasm_instr_type (handle, insn);
+      node_type = disasm_node_type (handle, insn);
+    }
+
+  if (w->found_count == w->found_size)
+    {
+      size_t n = w->found_size ? 2 * w->found_size : 1024;
+      sinstr_t *found = realloc (w->found, n * sizeof (sinstr_t));
+      if (found == NULL)
+	return -1;
+      w->found = found;
+      w->found_size = n;
+    }
+  w->found[w->found_count++] = (sinstr_t){.addr = addr,
+					  .target = target,
+					  .size = size,
+					  .executed = false,
+					  .fallthrough = fallthrough,
+					  .type = type,
+					  .node_type = node_type};
+
+  if (target != 0 && worker_claim (w, target) == -1)
+    return -1;
+
+  return fallthrough ? worker_claim (w, addr + size) : 0;
+}
+
+static void *
+worker_run (void *arg)
+{
+  worker_t *w = arg;
+  csh handle;
+
+  if (cs_open (CS_ARCH_X86, w->d->mode, &handle) != CS_ERR_OK)
+    {
+      w->error = EINVAL;
+      return NULL;
+    }
+  cs_option (handle, CS_OPT_DETAIL, CS_OPT_ON);
+
+  cs_insn *insn = cs_malloc (handle);
+  if (insn == NULL)
+    {
+      w->error = ENOMEM;
+      goto end;
+    }
+
+  size_t first;
+  while ((first = atomic_fetch_add (w->next, SEEDS_CHUNK)) < w->seeds_count)
+    for (size_t i = first; i < first + SEEDS_CHUNK && i < w->seeds_count; i++)
+      {
+	if (worker_claim (w, w->seeds[i]) == -1)
+	  goto fail;
+
+	/* Depth-first exploration from the start point */
+	while (w->stack_count > 0)
+	  if (worker_decode (w, handle, insn, w->stack[--w->stack_count]) ==
+	      -1)
+	    goto fail;
+      }
+
+  goto end;
+
+fail:
+  w->error = errno ? errno : ENOMEM;
+
+end:
+  if (insn != NULL)
+    cs_free (insn, 1);
+  cs_close (&handle);
+
+  return NULL;
+}
+
+disasm_t *
+disasm_new (executable_t *exec, const uintptr_t bias, decode_cache_t *cache)
+{
+  cs_mode mode;
+  switch (executable_arch (exec))
+    {
+    case x86_32_arch:
+      mode = CS_MODE_32;
+      break;
+
+    case x86_64_arch:
+      mode = CS_MODE_64;
+      break;
+
+    default:
+      errno = EINVAL;
+      return NULL;
+    }
+
+  disasm_t *d = calloc (1, sizeof (disasm_t));
+  if (d == NULL)
+    return NULL;
+
+  d->mode = mode;
+  d->bias = bias;
+  d->cache = cache;
+
+  while (executable_segment (exec, d->regions_count, NULL, NULL) != NULL)
+    d->regions_count++;
+
+  d->regions = calloc (d->regions_count ? d->regions_count : 1,
+		       sizeof (region_t));
+  if (d->regions == NULL)
+    goto fail;
+
+  for (size_t i = 0; i < d->regions_count; i++)
+    {
+      region_t *region = &(d->regions[i]);
+      region->bytes =
+	  executable_segment (exec, i, &(region->addr), &(region->size));
+      region->seen = calloc (region->size, sizeof (atomic_uchar));
+      if (region->seen == NULL)
+	goto fail;
+    }
+
+  return d;
+
+fail:
+  disasm_delete (d);
+  return NULL;
+}
+
+void
+disasm_delete (disasm_t *d)
+{
+  if (d == NULL)
+    return;
+
+  if (d->regions != NULL)
+    for (size_t i = 0; i < d->regions_count; i++)
+      free (d->regions[i].seen);
+
+  free (d->regions);
+  free (d->instrs);
+  free (d);
+}
+
+/* Disassemble recursively from the start points (link-time addresses)
+ * with up to 'threads' threads and add the instructions found to d,
+ * returns 0 on success and an errno value on error */
+static int
+disasm_explore (disasm_t *const d, const uintptr_t *const seeds,
+		const size_t seeds_count, const size_t threads)
+{
+  /* Start the workers (the first one runs in the calling thread) */
+  size_t workers = (threads == 0) ? 1 : threads;
+  worker_t *w = calloc (workers, sizeof (worker_t));
+  pthread_t *tids = calloc (workers, sizeof (pthread_t));
+  bool *started = calloc (workers, sizeof (bool));
+  atomic_size_t next = 0;
+  int error = 0;
+
+  if (w == NULL || tids == NULL || started == NULL)
+    {
+      error = ENOMEM;
+      goto end;
+    }
+
+  for (size_t i = 0; i < workers; i++)
+    {
+      w[i] = (worker_t){
+	  .d = d, .seeds = seeds, .seeds_count = seeds_count, .next = &next};
+      if (i > 0)
+	started[i] = !pthread_create (&tids[i], NULL, worker_run, &w[i]);
+    }
+  worker_run (&w[0]);
+
+  size_t count = d->count;
+  for (size_t i = 0; i < workers; i++)
+    {
+      if (started[i])
+	pthread_join (tids[i], NULL);
+      if (error == 0)
+	error = w[i].error;
+      count += w[i].found_count;
+    }
+  if (error != 0)
+    goto end;
+
+  /* Gather the new instructions with the previous ones */
+  sinstr_t *instrs = realloc (d->instrs, (count ? count : 1) *
+					      sizeof (sinstr_t));
+  if (instrs == NULL)
+    {
+      error = ENOMEM;
+      goto end;
+    }
+
+  d->instrs = instrs;
+  for (size_t i = 0; i < workers; i++)
+    if (w[i].found_count > 0)
+      {
+	memcpy (d->instrs + d->count, w[i].found,
+		w[i].found_count * sizeof (sinstr_t));
+	d->count += w[i].found_count;
+      }
+  qsort (d->instrs, d->count, sizeof (sinstr_t), cmp_sinstr);
+
+end:
+  if (w != NULL)
+    for (size_t i = 0; i < workers; i++)
+      {
+	free (w[i].found);
+	free (w[i].stack);
+      }
+  free (w);
+  free (tids);
+  free (started);
+
+  return error;
+}
+
+int
+disasm_run (disasm_t *const d, cfg_t *const cfg, const size_t threads)
+{
+  if (d == NULL || cfg == NULL)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+  /* Start points are the executed instructions (link-time addresses) */
+  size_t seeds_count = cfg_nodes (cfg);
+  uintptr_t *seeds = malloc ((seeds_count ? seeds_count : 1) *
+			     sizeof (uintptr_t));
+  if (seeds == NULL)
+    return -1;
+
+  for (size_t node = 0; node < seeds_count; node++)
+    seeds[node] = instr_addr (cfg_node_instr (cfg, node)) - d->bias;
+  qsort (seeds, seeds_count, sizeof (uintptr_t), cmp_addr);
+
+  int error = disasm_explore (d, seeds, seeds_count, threads);
+  if (error != 0)
+    {
+      free (seeds);
+      errno = error;
+      return -1;
+    }
+
+  /* Mark the executed instructions (both arrays are sorted) */
+  for (size_t i = 0, j = 0; i < d->count; i++)
+    {
+      while (j < seeds_count && seeds[j] < d->instrs[i].addr)
+	j++;
+      if (j < seeds_count && seeds[j] == d->instrs[i].addr)
+	d->instrs[i].executed = true;
+    }
+  free (seeds);
+
+  return 0;
+}
+
+int
+disasm_run_static (disasm_t *const d, executable_t *exec,
+		   const size_t threads)
+{
+  if (d == NULL || exec == NULL)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+  /* Start points are the entry point and the function symbols */
+  size_t seeds_count = executable_symbols (exec) + 1;
+  uintptr_t *seeds = malloc (seeds_count * sizeof (uintptr_t));
+  if (seeds == NULL)
+    return -1;
+
+  seeds[0] = executable_entry (exec);
+  for (size_t i = 1; i < seeds_count; i++)
+    seeds[i] = executable_symbol (exec, i - 1, NULL, NULL);
+
+  int error = disasm_explore (d, seeds, seeds_count, threads);
+  free (seeds);
+  if (error != 0)
+    {
+      errno = error;
+      return -1;
+    }
+
+  return 0;
+}
+
+size_t
+disasm_count (disasm_t *const d)
+{
+  return (d == NULL) ? 0 : d->count;
+}
+
+uintptr_t
+disasm_addr (disasm_t *const d, const size_t i)
+{
+  if (d == NULL || i >= d->count)
+    {
+      errno = EINVAL;
+      return 0;
+    }
+
+  return d->instrs[i].addr + d->bias;
+}
+
+size_t
+disasm_size (disasm_t *const d, const size_t i)
+{
+  if (d == NULL || i >= d->count)
+    {
+      errno = EINVAL;
+      return 0;
+    }
+
+  return d->instrs[i].size;
+}
+
+bool
+disasm_executed (disasm_t *const d, const size_t i)
+{
+  if (d == NULL || i >= d->count)
+    {
+      errno = EINVAL;
+      return false;
+    }
+
+  return d->instrs[i].executed;
+}
+
+size_t
+disasm_lookup (disasm_t *const d, const uintptr_t addr)
+{
+  if (d == NULL)
+    {
+      errno = EINVAL;
+      return CFG_NONE;
+    }
+
+  if (d->count == 0)
+    return CFG_NONE;
+
+  sinstr_t key = {.addr = addr - d->bias};
+  sinstr_t *found =
+      bsearch (&key, d->instrs, d->count, sizeof (sinstr_t), cmp_sinstr);
+
+  return (found == NULL) ? CFG_NONE : (size_t) (found - d->instrs);
+}
+
+/* Get the instruction of the i-th instruction found from ht, or create it
+ * and store it in ht. Returns NULL on error */
+static instr_t *
+disasm_instr (disasm_t *const d, hashtable_t *const ht, const size_t i)
+{
+  sinstr_t *s = &(d->instrs[i]);
+  instr_t *instr = hashtable_find (ht, s->addr + d->bias, 0);
+  if (instr != NULL)
+    return instr;
+
+  region_t *region = region_get (d, s->addr);
+  instr = instr_new (s->addr + d->bias, s->size,
+		     region->bytes + (s->addr - region->addr));
+  if (instr == NULL)
+    return NULL;
+  instr_set_type (instr, s->type);
+
+  if (!hashtable_insert (ht, instr))
+    {
+      instr_delete (instr);
+      errno = ENOMEM;
+      return NULL;
+    }
+
+  return instr;
+}
+
+cfg_t *
+disasm_cfg (disasm_t *const d, const uintptr_t entry, hashtable_t *const ht)
+{
+  if (d == NULL || ht == NULL || d->count == 0)
+    {
+      errno = EINVAL;
+      return NULL;
+    }
+
+  size_t first = disasm_lookup (d, entry);
+  if (first == CFG_NONE)
+    first = 0;
+
+  instr_t *instr = disasm_instr (d, ht, first);
+  cfg_t *cfg =
+      (instr == NULL) ? NULL : cfg_new (instr, d->instrs[first].node_type);
+  if (cfg == NULL)
+    return NULL;
+
+  /* Each edge is added as a trace of two instructions */
+  for (size_t i = 0; i < d->count; i++)
+    {
+      sinstr_t *s = &(d->instrs[i]);
+      instr_t *src = disasm_instr (d, ht, i);
+      if (src == NULL || cfg_restart (cfg, src, s->node_type) == NULL)
+	goto fail;
+
+      uintptr_t successors[2] = {s->target,
+				 s->fallthrough ? s->addr + s->size : 0};
+      for (size_t k = 0; k < 2; k++)
+	{
+	  size_t j = (successors[k] == 0)
+			 ? CFG_NONE
+			 : disasm_lookup (d, successors[k] + d->bias);
+	  if (j == CFG_NONE)
+	    continue;
+
+	  instr_t *dst = disasm_instr (d, ht, j);
+	  if (dst == NULL ||
+	      (cfg_current (cfg) != cfg_lookup (cfg, src) &&
+	       cfg_restart (cfg, src, s->node_type) == NULL) ||
+	      cfg_insert (cfg, dst, d->instrs[j].node_type) == NULL)
+	    goto fail;
+	}
+    }
+
+  return cfg;
+
+fail:
+  cfg_delete (cfg);
+  return NULL;
+}
+
+/* **********[ Decode Cache ]********** */
+
+/* Size of the pieces of code decoded by each thread */
+#define CHUNK_SIZE (64 * 1024)
+
+/* Instruction decoded in a chunk */
+typedef struct
+{
+  uintptr_t addr;      /* Link-time address */
+  uintptr_t target;    /* Link-time target of a direct jump (0 if none) */
+  uint8_t size;	       /* Size of the instruction */
+  uint8_t type;	       /* Kind of control-flow transfer (instr_type_t) */
+  uint8_t node;	       /* CFG node type (node_t) */
+  uint8_t fallthrough; /* Execution may go on with the next instruction */
+  size_t text;	       /* Offset of the text in the arena of the chunk */
+} centry_t;
+
+/* Piece of a code section decoded linearly by a single thread */
+typedef struct
+{
+  size_t region;     /* Index of the code section */
+  uintptr_t start;   /* First address of the chunk */
+  uintptr_t end;     /* Last address of the chunk (excluded) */
+  uintptr_t next;    /* Address following the last instruction decoded */
+  centry_t *entries; /* Instructions decoded */
+  size_t count;
+  size_t size;
+  char *arena; /* Texts of the instructions */
+  size_t arena_count;
+  size_t arena_size;
+} chunk_t;
+
+struct _decode_cache_t
+{
+  cs_mode mode;		/* Capstone mode of the executable */
+  bool intel;		/* Intel syntax (AT&T otherwise) */
+  uintptr_t bias;	/* Difference between run-time and link-time */
+  size_t regions_count; /* Number of code sections */
+  region_t *regions;	/* Code sections */
+  size_t chunks_count;	/* Number of chunks */
+  chunk_t *chunks;	/* Chunks (sorted by address) */
+  atomic_size_t next;	/* Next chunk to decode (shared) */
+  size_t count;		/* Number of instructions */
+  decoded_t *instrs;	/* Instructions (sorted by run-time address) */
+  size_t invalidated;	/* Number of instructions invalidated */
+  size_t last;		/* Index of the last instruction looked up */
+  void *mapping;	/* File mapped by decode_cache_load() (or NULL) */
+  size_t mapping_size;	/* Size of the mapping */
+};
+
+/* Open a capstone handle set up as the tracer does */
+static int
+cache_open (decode_cache_t *const cache, csh *handle)
+{
+  if (cs_open (CS_ARCH_X86, cache->mode, handle) != CS_ERR_OK)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+  cs_option (*handle, CS_OPT_SYNTAX,
+	     cache->intel ? CS_OPT_SYNTAX_INTEL : CS_OPT_SYNTAX_ATT);
+  cs_option (*handle, CS_OPT_DETAIL, CS_OPT_ON);
+
+  return 0;
+}
+
+/* Decode the instruction at addr into the chunk (operands refer to
+ * run-time addresses), returns its size (0 if the bytes are not an
+ * instruction) or -1 on error */
+static int
+chunk_decode (chunk_t *const chunk, const region_t *const region,
+	      const uintptr_t bias, csh handle, cs_insn *insn,
+	      const uintptr_t addr)
+{
+  const uint8_t *code = region->bytes + (addr - region->addr);
+  size_t size = region->size - (addr - region->addr);
+  uint64_t address = addr + bias;
+
+  if (!cs_disasm_iter (handle, &code, &size, &address, insn))
+    return 0;
+
+  size_t len = strlen (insn->mnemonic) + strlen (insn->op_str) + 3;
+  if (chunk->arena_count + len > chunk->arena_size)
+    {
+      size_t n = 2 * chunk->arena_size + len;
+      char *arena = realloc (chunk->arena, n);
+      if (arena == NULL)
+	return -1;
+      chunk->arena = arena;
+      chunk->arena_size = n;
+    }
+
+  if (chunk->count == chunk->size)
+    {
+      size_t n = chunk->size ? 2 * chunk->size : 1024;
+      centry_t *entries = realloc (chunk->entries, n * sizeof (centry_t));
+      if (entries == NULL)
+	return -1;
+      chunk->entries = entries;
+      chunk->size = n;
+    }
+
+  /* Same text as the one displayed by the tracer */
+  sprintf (chunk->arena + chunk->arena_count, "%s  %s", insn->mnemonic,
+	   insn->op_str);
+  uintptr_t target;
+  bool fallthrough = disasm_successors (handle, insn, &target);
+  chunk->entries[chunk->count++] =
+      (centry_t){.addr = addr,
+		 .target = (target == 0) ? 0 : target - bias,
+		 .size = insn->size,
+		 .type = disasm_instr_type (handle, insn),
+		 .node = disasm_node_type (handle, insn),
+		 .fallthrough = fallthrough,
+		 .text = chunk->arena_count};
+  chunk->arena_count += len;
+
+  return insn->size;
+}
+
+/* Decode linearly from addr to the end of the chunk (bytes which are not
+ * instructions are skipped one by one), returns 0 on success */
+static int
+chunk_sweep (chunk_t *const chunk, const region_t *const region,
+	     const uintptr_t bias, csh handle, cs_insn *insn, uintptr_t addr)
+{
+  while (addr < chunk->end)
+    {
+      int size = chunk_decode (chunk, region, bias, handle, insn, addr);
+      if (size == -1)
+	return -1;
+      addr += (size > 0) ? size : 1;
+    }
+  chunk->next = addr;
+
+  return 0;
+}
+
+/* Decoding thread */
+typedef struct
+{
+  decode_cache_t *cache;
+  int error; /* errno value on failure (0 otherwise) */
+} cache_worker_t;
+
+static void *
+cache_worker_run (void *arg)
+{
+  cache_worker_t *w = arg;
+  decode_cache_t *cache = w->cache;
+  csh handle;
+
+  if (cache_open (cache, &handle) == -1)
+    {
+      w->error = errno;
+      return NULL;
+    }
+
+  cs_insn *insn = cs_malloc (handle);
+  if (insn == NULL)
+    w->error = ENOMEM;
+
+  size_t i;
+  while (w->error == 0 &&
+	 (i = atomic_fetch_add (&cache->next, 1)) < cache->chunks_count)
+    {
+      chunk_t *chunk = &(cache->chunks[i]);
+      if (chunk_sweep (chunk, &(cache->regions[chunk->region]), cache->bias,
+		       handle, insn, chunk->start) == -1)
+	w->error = errno ? errno : ENOMEM;
+    }
+
+  if (insn != NULL)
+    cs_free (insn, 1);
+  cs_close (&handle);
+
+  return NULL;
+}
+
+/* The previous chunk may end with an instruction overlapping this one:
+ * decode again from its end until both decodings meet */
+static int
+chunk_resync (chunk_t *const chunk, const region_t *const region,
+	      const uintptr_t bias, csh handle, cs_insn *insn, uintptr_t addr)
+{
+  /* Instructions decoded before meeting the chunk */
+  chunk_t fixed = {.end = chunk->end};
+  size_t first = 0;
+
+  while (addr < chunk->end)
+    {
+      /* Both decodings meet at an instruction of the chunk */
+      while (first < chunk->count && chunk->entries[first].addr < addr)
+	first++;
+      if (first < chunk->count && chunk->entries[first].addr == addr)
+	break;
+
+      int size = chunk_decode (&fixed, region, bias, handle, insn, addr);
+      if (size == -1)
+	{
+	  free (fixed.entries);
+	  free (fixed.arena);
+	  return -1;
+	}
+      addr += (size > 0) ? size : 1;
+    }
+
+  /* Replace the entries before the meeting point (texts are appended to
+   * the arena of the chunk) */
+  size_t kept = chunk->count - first;
+  size_t count = fixed.count + kept;
+  centry_t *entries = malloc ((count ? count : 1) * sizeof (centry_t));
+  char *arena = realloc (chunk->arena, chunk->arena_count + fixed.arena_count);
+  if (entries == NULL || (arena == NULL && fixed.arena_count > 0))
+    {
+      free (entries);
+      free (fixed.entries);
+      free (fixed.arena);
+      return -1;
+    }
+
+  if (arena != NULL)
+    {
+      chunk->arena = arena;
+      chunk->arena_size = chunk->arena_count + fixed.arena_count;
+    }
+  if (fixed.arena_count > 0)
+    memcpy (chunk->arena + chunk->arena_count, fixed.arena,
+	    fixed.arena_count);
+  for (size_t i = 0; i < fixed.count; i++)
+    {
+      entries[i] = fixed.entries[i];
+      entries[i].text += chunk->arena_count;
+    }
+  chunk->arena_count += fixed.arena_count;
+
+  if (kept > 0)
+    memcpy (entries + fixed.count, chunk->entries + first,
+	    kept * sizeof (centry_t));
+  else
+    chunk->next = addr;
+
+  free (chunk->entries);
+  chunk->entries = entries;
+  chunk->count = chunk->size = count;
+
+  free (fixed.entries);
+  free (fixed.arena);
+
+  return 0;
+}
+
+/* Allocate a decode cache and gather the code sections of exec (its
+ * executable segments if there is no section header) */
+static decode_cache_t *
+cache_alloc (executable_t *exec, const uintptr_t bias, const bool intel)
+{
+  cs_mode mode;
+  switch (executable_arch (exec))
+    {
+    case x86_32_arch:
+      mode = CS_MODE_32;
+      break;
+
+    case x86_64_arch:
+      mode = CS_MODE_64;
+      break;
+
+    default:
+      errno = EINVAL;
+      return NULL;
+    }
+
+  decode_cache_t *cache = calloc (1, sizeof (decode_cache_t));
+  if (cache == NULL)
+    return NULL;
+
+  cache->mode = mode;
+  cache->intel = intel;
+  cache->bias = bias;
+
+  bool sections = (executable_code (exec, 0, NULL, NULL) != NULL);
+  while ((sections ? executable_code (exec, cache->regions_count, NULL, NULL)
+		   : executable_segment (exec, cache->regions_count, NULL,
+					 NULL)) != NULL)
+    cache->regions_count++;
+
+  cache->regions = calloc (cache->regions_count ? cache->regions_count : 1,
+			   sizeof (region_t));
+  if (cache->regions == NULL)
+    {
+      free (cache);
+      return NULL;
+    }
+
+  for (size_t i = 0; i < cache->regions_count; i++)
+    {
+      region_t *region = &(cache->regions[i]);
+      region->bytes =
+	  sections ? executable_code (exec, i, &(region->addr),
+				      &(region->size))
+		   : executable_segment (exec, i, &(region->addr),
+					 &(region->size));
+    }
+
+  return cache;
+}
+
+decode_cache_t *
+decode_cache_new (executable_t *exec, const uintptr_t bias, const bool intel,
+		  const size_t threads)
+{
+  decode_cache_t *cache = cache_alloc (exec, bias, intel);
+  if (cache == NULL)
+    return NULL;
+
+  for (size_t i = 0; i < cache->regions_count; i++)
+    cache->chunks_count +=
+	(cache->regions[i].size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+  cache->chunks = calloc (cache->chunks_count ? cache->chunks_count : 1,
+			  sizeof (chunk_t));
+  if (cache->chunks == NULL)
+    goto fail;
+
+  for (size_t i = 0, c = 0; i < cache->regions_count; i++)
+    for (size_t offset = 0; offset < cache->regions[i].size;
+	 offset += CHUNK_SIZE)
+      {
+	uintptr_t start = cache->regions[i].addr + offset;
+	size_t size = cache->regions[i].size - offset;
+	cache->chunks[c++] = (chunk_t){
+	    .region = i,
+	    .start = start,
+	    .end = start + ((size < CHUNK_SIZE) ? size : CHUNK_SIZE)};
+      }
+
+  /* Decode the chunks in parallel (the first worker is the caller) */
+  size_t workers = (threads == 0) ? 1 : threads;
+  cache_worker_t *w = calloc (workers, sizeof (cache_worker_t));
+  pthread_t *tids = calloc (workers, sizeof (pthread_t));
+  bool *started = calloc (workers, sizeof (bool));
+  int error = 0;
+
+  if (w == NULL || tids == NULL || started == NULL)
+    error = ENOMEM;
+  else
+    {
+      atomic_init (&cache->next, 0);
+      for (size_t i = 0; i < workers; i++)
+	{
+	  w[i] = (cache_worker_t){.cache = cache, .error = 0};
+	  if (i > 0)
+	    started[i] =
+		!pthread_create (&tids[i], NULL, cache_worker_run, &w[i]);
+	}
+      cache_worker_run (&w[0]);
+
+      for (size_t i = 0; i < workers; i++)
+	{
+	  if (started[i])
+	    pthread_join (tids[i], NULL);
+	  if (error == 0)
+	    error = w[i].error;
+	}
+    }
+
+  free (w);
+  free (tids);
+  free (started);
+  if (error != 0)
+    {
+      errno = error;
+      goto fail;
+    }
+
+  /* Resynchronize each chunk with the end of the previous one */
+  csh handle;
+  if (cache_open (cache, &handle) == -1)
+    goto fail;
+
+  cs_insn *insn = cs_malloc (handle);
+  for (size_t i = 1; insn != NULL && i < cache->chunks_count; i++)
+    {
+      chunk_t *chunk = &(cache->chunks[i]), *previous = chunk - 1;
+      if (previous->region == chunk->region && previous->next > chunk->start &&
+	  chunk_resync (chunk, &(cache->regions[chunk->region]), bias, handle,
+			insn, previous->next) == -1)
+	{
+	  cs_free (insn, 1);
+	  insn = NULL;
+	}
+    }
+
+  if (insn == NULL)
+    {
+      cs_close (&handle);
+      errno = ENOMEM;
+      goto fail;
+    }
+  cs_free (insn, 1);
+  cs_close (&handle);
+
+  /* Gather the instructions of all the chunks */
+  for (size_t i = 0; i < cache->chunks_count; i++)
+    cache->count += cache->chunks[i].count;
+
+  cache->instrs = malloc ((cache->count ? cache->count : 1) *
+			  sizeof (decoded_t));
+  if (cache->instrs == NULL)
+    goto fail;
+
+  size_t count = 0;
+  for (size_t i = 0; i < cache->chunks_count; i++)
+    {
+      chunk_t *chunk = &(cache->chunks[i]);
+      region_t *region = &(cache->regions[chunk->region]);
+      for (size_t j = 0; j < chunk->count; j++)
+	{
+	  centry_t *e = &(chunk->entries[j]);
+	  cache->instrs[count++] =
+	      (decoded_t){.addr = e->addr + bias,
+			  .target = (e->target == 0) ? 0 : e->target + bias,
+			  .size = e->size,
+			  .type = e->type,
+			  .node_type = e->node,
+			  .fallthrough = e->fallthrough,
+			  .bytes = region->bytes + (e->addr - region->addr),
+			  .text = chunk->arena + e->text};
+	}
+
+      /* Only the texts are kept */
+      free (chunk->entries);
+      chunk->entries = NULL;
+    }
+  qsort (cache->instrs, cache->count, sizeof (decoded_t), cmp_addr);
+
+  return cache;
+
+fail:
+  decode_cache_delete (cache);
+  return NULL;
+}
+
+void
+decode_cache_delete (decode_cache_t *cache)
+{
+  if (cache == NULL)
+    return;
+
+  if (cache->chunks != NULL)
+    for (size_t i = 0; i < cache->chunks_count; i++)
+      {
+	free (cache->chunks[i].entries);
+	free (cache->chunks[i].arena);
+      }
+
+  free (cache->chunks);
+  free (cache->regions);
+  free (cache->instrs);
+  if (cache->mapping != NULL)
+    munmap (cache->mapping, cache->mapping_size);
+  free (cache);
+}
+
+size_t
+decode_cache_count (decode_cache_t *const cache)
+{
+  return (cache == NULL) ? 0 : cache->count;
+}
+
+/* Returns the difference between run-time and link-time addresses */
+static uintptr_t
+cache_bias (decode_cache_t *const cache)
+{
+  return (cache == NULL) ? 0 : cache->bias;
+}
+
+/* Returns the instruction at the run-time address addr, NULL if none
+ * (the cache is left untouched, so threads may share it) */
+static const decoded_t *
+cache_find (decode_cache_t *const cache, const uintptr_t addr)
+{
+  decoded_t key = {.addr = addr};
+  decoded_t *found =
+      bsearch (&key, cache->instrs, cache->count, sizeof (decoded_t),
+	       cmp_addr);
+
+  /* Invalidated instructions are kept (with a null size) to preserve the
+   * order of the array */
+  return (found == NULL || found->size == 0) ? NULL : found;
+}
+
+const decoded_t *
+decode_cache_lookup (decode_cache_t *const cache, const uintptr_t addr)
+{
+  if (cache == NULL || cache->count == 0)
+    return NULL;
+
+  /* Execution mostly goes on with the next instruction */
+  size_t last = cache->last;
+  if (last + 1 < cache->count && cache->instrs[last + 1].addr == addr)
+    {
+      cache->last = last + 1;
+      return (cache->instrs[last + 1].size == 0) ? NULL
+						   : &(cache->instrs[last + 1]);
+    }
+  if (cache->instrs[last].addr == addr)
+    return (cache->instrs[last].size == 0) ? NULL : &(cache->instrs[last]);
+
+  const decoded_t *found = cache_find (cache, addr);
+  if (found != NULL)
+    cache->last = found - cache->instrs;
+
+  return found;
+}
+
+size_t
+decode_cache_invalidate (decode_cache_t *const cache, const uintptr_t start,
+			 const uintptr_t end)
+{
+  if (cache == NULL || cache->count == 0 || start >= end)
+    return 0;
+
+  /* First instruction ending after start */
+  size_t lo = 0, hi = cache->count;
+  while (lo < hi)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+      if (cache->instrs[mid].addr < start)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  if (lo > 0 && cache->instrs[lo - 1].addr + cache->instrs[lo - 1].size > start)
+    lo--;
+
+  size_t count = 0;
+  for (size_t i = lo; i < cache->count && cache->instrs[i].addr < end; i++)
+    if (cache->instrs[i].size != 0)
+      {
+	cache->instrs[i].size = 0;
+	count++;
+      }
+  cache->invalidated += count;
+
+  return count;
+}
+
+/* A decode cache file holds a header, the instructions (link-time
+ * addresses, texts given as offsets) and the texts. The opcodes are not
+ * stored, they are taken from the mapping of the executable. The texts
+ * hold the run-time addresses of the operands (branch targets, RIP-relative
+ * addresses), so the file is only valid for the bias it was decoded with */
+
+#define DECODE_FILE_MAGIC "TRKDEC03"
+
+typedef struct
+{
+  char magic[8];   /* DECODE_FILE_MAGIC */
+  uint64_t layout; /* Sizes of the records (same ABI check) */
+  uint64_t mode;   /* Capstone mode */
+  uint64_t intel;  /* Intel syntax (AT&T otherwise) */
+  uint64_t bias;   /* Bias the instructions were decoded with */
+  uint64_t count;  /* Number of instructions */
+  uint64_t texts;  /* Offset of the texts */
+  uint64_t end;	   /* Size of the file */
+} decode_file_t;
+
+static uint64_t
+decode_file_layout (void)
+{
+  return sizeof (size_t) | sizeof (centry_t) << 8 |
+	 sizeof (decode_file_t) << 16;
+}
+
+int
+decode_cache_save (decode_cache_t *const cache, const char *filename)
+{
+  if (cache == NULL || filename == NULL)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+  decode_file_t header = {.magic = DECODE_FILE_MAGIC,
+			  .layout = decode_file_layout (),
+			  .mode = cache->mode,
+			  .intel = cache->intel,
+			  .bias = cache->bias,
+			  .count = cache->count - cache->invalidated};
+  header.texts = sizeof (decode_file_t) + header.count * sizeof (centry_t);
+
+  /* Invalidated instructions are not saved */
+  size_t texts_size = 0;
+  for (size_t i = 0; i < cache->count; i++)
+    if (cache->instrs[i].size != 0)
+      texts_size += strlen (cache->instrs[i].text) + 1;
+  header.end = header.texts + texts_size;
+
+  /* Written to a temporary file renamed over the previous one, so that
+   * the caches mapped from it (possibly this one) are left intact */
+  size_t size = strlen (filename) + 8;
+  char *tmp = malloc (size);
+  if (tmp == NULL)
+    return -1;
+  snprintf (tmp, size, "%s.XXXXXX", filename);
+
+  int fdesc = mkstemp (tmp);
+  FILE *fd = (fdesc == -1) ? NULL : fdopen (fdesc, "wb");
+  if (fd == NULL)
+    {
+      if (fdesc != -1)
+	{
+	  close (fdesc);
+	  unlink (tmp);
+	}
+      free (tmp);
+      return -1;
+    }
+
+  bool error = fwrite (&header, sizeof (decode_file_t), 1, fd) != 1;
+
+  size_t text = 0;
+  for (size_t i = 0; i < cache->count && !error; i++)
+    {
+      const decoded_t *d = &(cache->instrs[i]);
+      if (d->size == 0)
+	continue;
+
+      centry_t entry = {.addr = d->addr - cache->bias,
+			.target =
+			    (d->target == 0) ? 0 : d->target - cache->bias,
+			.size = d->size,
+			.type = d->type,
+			.node = d->node_type,
+			.fallthrough = d->fallthrough,
+			.text = text};
+      text += strlen (d->text) + 1;
+      error = fwrite (&entry, sizeof (centry_t), 1, fd) != 1;
+    }
+
+  for (size_t i = 0; i < cache->count && !error; i++)
+    {
+      if (cache->instrs[i].size == 0)
+	continue;
+
+      size_t len = strlen (cache->instrs[i].text) + 1;
+      error = fwrite (cache->instrs[i].text, 1, len, fd) != len;
+    }
+
+  if (fclose (fd) == EOF || error || rename (tmp, filename) == -1)
+    {
+      int errsv = errno ? errno : EIO;
+      unlink (tmp);
+      free (tmp);
+      errno = errsv;
+      return -1;
+    }
+  free (tmp);
+
+  return 0;
+}
+
+/* Check the content of a mapped decode cache file and point the
+ * instructions to it, returns false on error (and set errno, EINVAL if the
+ * file is invalid) */
+static bool
+decode_file_map (decode_cache_t *const cache, const uint8_t *const map,
+		 const size_t size)
+{
+  const decode_file_t *h = (const decode_file_t *) map;
+
+  if (size < sizeof (decode_file_t) ||
+      memcmp (h->magic, DECODE_FILE_MAGIC, 8) ||
+      h->layout != decode_file_layout () || h->mode != cache->mode ||
+      h->intel != cache->intel || h->bias != cache->bias ||
+      h->end != size ||
+      h->count > (size - sizeof (decode_file_t)) / sizeof (centry_t) ||
+      h->texts != sizeof (decode_file_t) + h->count * sizeof (centry_t) ||
+      (h->texts < h->end && map[h->end - 1] != '\0'))
+    {
+      errno = EINVAL;
+      return false;
+    }
+
+  cache->count = h->count;
+  cache->instrs =
+      malloc ((cache->count ? cache->count : 1) * sizeof (decoded_t));
+  if (cache->instrs == NULL)
+    return false;
+
+  /* Instructions are sorted by address, as the code sections */
+  const centry_t *entries = (const centry_t *) (map + sizeof (decode_file_t));
+  const char *texts = (const char *) map + h->texts;
+  size_t r = 0;
+  for (size_t i = 0; i < cache->count; i++)
+    {
+      const centry_t *e = &(entries[i]);
+      if ((i > 0 && e->addr <= entries[i - 1].addr) || e->size == 0 ||
+	  e->type > RET || e->node > dynjump || e->fallthrough > 1 ||
+	  e->text >= h->end - h->texts)
+	{
+	  errno = EINVAL;
+	  return false;
+	}
+
+      while (r < cache->regions_count &&
+	     e->addr >= cache->regions[r].addr + cache->regions[r].size)
+	r++;
+      const region_t *region = &(cache->regions[r]);
+      if (r == cache->regions_count || e->addr < region->addr ||
+	  e->size > region->addr + region->size - e->addr)
+	{
+	  errno = EINVAL;
+	  return false;
+	}
+
+      cache->instrs[i] =
+	  (decoded_t){.addr = e->addr + cache->bias,
+		      .target = (e->target == 0) ? 0 : e->target + cache->bias,
+		      .size = e->size,
+		      .type = e->type,
+		      .node_type = e->node,
+		      .fallthrough = e->fallthrough,
+		      .bytes = region->bytes + (e->addr - region->addr),
+		      .text = texts + e->text};
+    }
+
+  return true;
+}
+
+decode_cache_t *
+decode_cache_load (executable_t *exec, const uintptr_t bias,
+		   const bool intel, const char *filename)
+{
+  if (filename == NULL)
+    {
+      errno = EINVAL;
+      return NULL;
+    }
+
+  decode_cache_t *cache = cache_alloc (exec, bias, intel);
+  if (cache == NULL)
+    return NULL;
+
+  int fd = open (filename, O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (fd == -1 || fstat (fd, &st) == -1)
+    {
+      int error = errno;
+      if (fd != -1)
+	close (fd);
+      decode_cache_delete (cache);
+      errno = error;
+      return NULL;
+    }
+
+  /* The texts are used in place */
+  size_t size = st.st_size;
+  void *map = (size == 0) ? MAP_FAILED
+			  : mmap (NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (map == MAP_FAILED)
+    {
+      int error = (size == 0) ? EINVAL : errno;
+      decode_cache_delete (cache);
+      errno = error;
+      return NULL;
+    }
+
+  cache->mapping = map;
+  cache->mapping_size = size;
+  if (!decode_file_map (cache, map, size))
+    {
+      int error = errno;
+      decode_cache_delete (cache);
+      errno = error;
+      return NULL;
+    }
+
+  return cache;
+}
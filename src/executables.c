@@ -9,78 +9,973 @@
  * This software is released under a 3-clause BSD license (see COPYING file).
  */
 
+#define _POSIX_C_SOURCE 200809L
+
+#include "config.h"
+
 #include "executables.h"
 
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdlib.h>
 
 #include <elf.h>
-#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
 #include <string.h>
+#include <unistd.h>
 
+#include <sys/mman.h>
 #include <sys/stat.h>
 
+/* Size of the blocks of the arena of demangled names */
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+/* Longest build-ID kept (the usual ones are 8 to 20 bytes long) */
+#define BUILD_ID_MAX 64
+
+/* Loadable segment holding code */
+typedef struct
+{
+  uintptr_t addr;	/* Virtual address of the segment (link-time) */
+  size_t size;		/* Size of the segment in the file */
+  const uint8_t *bytes; /* Content of the segment (in the mapping) */
+} segment_t;
+
+/* Section of the file */
+typedef struct
+{
+  const char *name;	/* Name (in the mapping) */
+  uintptr_t addr;	/* Virtual address (link-time), 0 if not loaded */
+  size_t size;		/* Size of the section */
+  const uint8_t *bytes; /* Content (in the mapping), NULL if none */
+  bool code;		/* The section holds instructions */
+} section_t;
+
+/* Address range of a loaded section */
+typedef struct
+{
+  uintptr_t start; /* First address (link-time) */
+  uintptr_t end;   /* Last address (excluded) */
+  size_t section;  /* Index of the section */
+} interval_t;
+
+/* Function symbol */
+typedef struct
+{
+  uintptr_t start; /* Address of the symbol (link-time) */
+  size_t size;	   /* Size of the symbol (0 if unknown) */
+  size_t name;	   /* Offset of the name in the mapping */
+} symbol_t;
+
+/* Imported function, called through a PLT entry */
+typedef struct
+{
+  uintptr_t addr; /* Address of the PLT entry (link-time) */
+  size_t size;	  /* Size of the PLT entry */
+  size_t name;	  /* Offset of the name in the mapping */
+} import_t;
+
+/* Row of the line table, giving the source line of the addresses up to the
+ * next row */
+typedef struct
+{
+  uintptr_t addr; /* First address (link-time) */
+  uint32_t file;  /* Index of the source file */
+  uint32_t line;  /* Line number (0 at the end of a sequence) */
+} line_t;
+
+/* Block of the arena holding the demangled names (blocks never move) */
+typedef struct _arena_block_t
+{
+  struct _arena_block_t *next; /* Previous block allocated */
+  size_t used;		       /* Bytes used in data */
+  size_t size;		       /* Size of data */
+  char data[];
+} arena_block_t;
+
+/* GOT slot filled by the dynamic linker with an imported symbol */
+typedef struct
+{
+  uintptr_t addr; /* Address of the slot (link-time) */
+  size_t name;	  /* Offset of the name in the mapping */
+} slot_t;
+
 struct _executable_t
 {
   arch_t arch;
+  const uint8_t *image;		 /* Mapping of the whole file */
+  size_t image_size;		 /* Size of the file */
   union
   {
-    Elf32_Ehdr elf32;
-    Elf64_Ehdr elf64;
-  } header;
+    const Elf32_Ehdr *elf32;
+    const Elf64_Ehdr *elf64;
+  } header;			 /* ELF header (in the mapping) */
+  size_t segments_count;	 /* Number of executable segments */
+  segment_t *segments;		 /* Executable segments */
+  size_t sections_count;	 /* Number of sections */
+  section_t *sections;		 /* Sections (in the file order) */
+  size_t section_cursor;	 /* Position of the section iterator */
+  size_t intervals_count;	 /* Number of loaded sections */
+  interval_t *intervals;	 /* Loaded sections (sorted by address) */
+  atomic_size_t section_hit;	 /* Interval of the last section found */
+  bool use_cache;		 /* Indexes are kept in the on-disk cache */
+  pthread_mutex_t symbols_lock;	 /* Serialize the symbol index building */
+  atomic_bool symbols_read;	 /* The symbol index has been built */
+  size_t symbols_count;		 /* Number of function symbols */
+  symbol_t *symbols;		 /* Function symbols (sorted by address) */
+  uintptr_t *eytzinger;		 /* Symbol addresses in Eytzinger layout */
+  size_t *ranks;		 /* Ranks of the Eytzinger keys in symbols */
+  size_t imports_count;		 /* Number of imports */
+  import_t *imports;		 /* Imports (sorted by PLT entry address) */
+  uintptr_t base;		 /* Link-time address of the file offset 0 */
+  const uint8_t *build_id;	 /* GNU build-ID (in the mapping) or NULL */
+  size_t build_id_size;		 /* Size of the build-ID */
+  char id[2 * BUILD_ID_MAX + 1]; /* Identifier, empty until first used */
+  pthread_mutex_t lines_lock;	 /* Serialize the reading of the lines */
+  atomic_bool lines_read;	 /* The line table has been read */
+  size_t lines_count;		 /* Number of rows of the line table */
+  line_t *lines;		 /* Line table (sorted by address) */
+  size_t files_count;		 /* Number of source files */
+  const char **files;		 /* Source file names (in the mapping) */
+  pthread_mutex_t names_lock;	 /* Serialize the demangling */
+  _Atomic (const char *) *names; /* Demangled symbols then imports */
+  arena_block_t *arena;		 /* Storage of the demangled names */
 };
 
-executable_t *
-executable_new (char *execfilename)
+/* Check that [offset, offset + count * size) lies in the file and that the
+ * records are aligned on 'align' bytes */
+static bool
+in_image (executable_t *exec, const uint64_t offset, const uint64_t count,
+	  const uint64_t size, const size_t align)
 {
-  struct stat exec_stats;
-  if (stat (execfilename, &exec_stats) == -1)
-    err (EXIT_FAILURE, "error: '%s'", execfilename);
+  return offset % align == 0 && offset <= exec->image_size &&
+	 (size == 0 || count <= (exec->image_size - offset) / size);
+}
+
+/* Get the index-th program header, converted to the 64 bits layout */
+static void
+get_phdr (executable_t *exec, const size_t index, Elf64_Phdr *phdr)
+{
+  if (exec->arch == x86_32_arch)
+    {
+      const Elf32_Phdr *phdr32 =
+	  (const Elf32_Phdr *) (exec->image + exec->header.elf32->e_phoff) +
+	  index;
+      *phdr = (Elf64_Phdr){.p_type = phdr32->p_type,
+			   .p_flags = phdr32->p_flags,
+			   .p_offset = phdr32->p_offset,
+			   .p_vaddr = phdr32->p_vaddr,
+			   .p_filesz = phdr32->p_filesz,
+			   .p_memsz = phdr32->p_memsz};
+    }
+  else
+    *phdr = ((const Elf64_Phdr *) (exec->image +
+				   exec->header.elf64->e_phoff))[index];
+}
+
+/* Get the index-th section header, converted to the 64 bits layout */
+static void
+get_shdr (executable_t *exec, const size_t index, Elf64_Shdr *shdr)
+{
+  if (exec->arch == x86_32_arch)
+    {
+      const Elf32_Shdr *shdr32 =
+	  (const Elf32_Shdr *) (exec->image + exec->header.elf32->e_shoff) +
+	  index;
+      *shdr = (Elf64_Shdr){.sh_name = shdr32->sh_name,
+			   .sh_type = shdr32->sh_type,
+			   .sh_flags = shdr32->sh_flags,
+			   .sh_addr = shdr32->sh_addr,
+			   .sh_offset = shdr32->sh_offset,
+			   .sh_size = shdr32->sh_size,
+			   .sh_link = shdr32->sh_link,
+			   .sh_info = shdr32->sh_info,
+			   .sh_entsize = shdr32->sh_entsize};
+    }
+  else
+    *shdr = ((const Elf64_Shdr *) (exec->image +
+				   exec->header.elf64->e_shoff))[index];
+}
+
+/* Read the executable segments (PT_LOAD with PF_X) of the file, returns 0
+ * on success and -1 on error */
+static int
+read_segments (executable_t *exec)
+{
+  bool elf32 = (exec->arch == x86_32_arch);
+  size_t phoff =
+      elf32 ? exec->header.elf32->e_phoff : exec->header.elf64->e_phoff;
+  size_t phnum =
+      elf32 ? exec->header.elf32->e_phnum : exec->header.elf64->e_phnum;
 
-  if (!S_ISREG (exec_stats.st_mode) || !(exec_stats.st_mode & S_IXUSR))
-    errx (EXIT_FAILURE, "error: '%s' is not an executable file", execfilename);
+  if (!in_image (exec, phoff, phnum,
+		 elf32 ? sizeof (Elf32_Phdr) : sizeof (Elf64_Phdr),
+		 elf32 ? 4 : 8))
+    {
+      errno = ENOEXEC;
+      return -1;
+    }
 
-  /* Check if given file is an executable and discover its architecture */
-  FILE *execfile = fopen (execfilename, "rb");
-  if (execfile == NULL)
-    err (EXIT_FAILURE, "error: '%s'", execfilename);
+  exec->segments_count = 0;
+  exec->segments = calloc (phnum ? phnum : 1, sizeof (segment_t));
+  if (exec->segments == NULL)
+    return -1;
 
-  /* Open file */
-  char buf[4] = {0};
-  if (fread (&buf, 4, 1, execfile) != 1)
-    errx (EXIT_FAILURE, "error: cannot read '%s'", execfilename);
+  bool first = true;
+  for (size_t i = 0; i < phnum; i++)
+    {
+      Elf64_Phdr phdr;
+      get_phdr (exec, i, &phdr);
 
-  /* Check ELF magic number (first 4 bytes: 0x7f "ELF") */
-  if (buf[0] != 0x7f || strncmp (&(buf[1]), "ELF", 3) != 0)
-    errx (EXIT_FAILURE, "error: '%s' is not an ELF binary", execfilename);
+      /* Loadable segments are sorted by address, the first one gives the
+       * address of the start of the file once mapped */
+      if (phdr.p_type == PT_LOAD && first)
+	{
+	  exec->base = phdr.p_vaddr - phdr.p_offset;
+	  first = false;
+	}
 
-  /* Extract executable architecture (byte at 0x12) */
-  fseek (execfile, 0x12, SEEK_SET);
-  if (fread (&buf, 1, 1, execfile) != 1)
-    errx (EXIT_FAILURE, "error: cannot read '%s'", execfilename);
-  rewind (execfile);
+      if (phdr.p_type != PT_LOAD || !(phdr.p_flags & PF_X) ||
+	  phdr.p_filesz == 0)
+	continue;
 
-  executable_t *exec = malloc (sizeof (executable_t));
-  if (exec == NULL)
+      if (!in_image (exec, phdr.p_offset, 1, phdr.p_filesz, 1))
+	{
+	  errno = ENOEXEC;
+	  return -1;
+	}
+
+      segment_t *seg = &(exec->segments[exec->segments_count++]);
+      seg->addr = phdr.p_vaddr;
+      seg->size = phdr.p_filesz;
+      seg->bytes = exec->image + phdr.p_offset;
+    }
+
+  return 0;
+}
+
+static int
+interval_compare (const void *a, const void *b)
+{
+  const interval_t *i1 = a, *i2 = b;
+  if (i1->start != i2->start)
+    return (i1->start > i2->start) - (i1->start < i2->start);
+  return (i1->section > i2->section) - (i1->section < i2->section);
+}
+
+/* Read the section header table (sections without a valid name or content
+ * are kept, with an empty name or no bytes), returns 0 on success and -1
+ * on error */
+static int
+read_sections (executable_t *exec)
+{
+  bool elf32 = (exec->arch == x86_32_arch);
+  size_t shoff =
+      elf32 ? exec->header.elf32->e_shoff : exec->header.elf64->e_shoff;
+  size_t shnum =
+      elf32 ? exec->header.elf32->e_shnum : exec->header.elf64->e_shnum;
+  size_t shstrndx =
+      elf32 ? exec->header.elf32->e_shstrndx : exec->header.elf64->e_shstrndx;
+
+  exec->sections_count = exec->intervals_count = 0;
+  if (shoff == 0 || shnum == 0)
+    return 0; /* Stripped from its section headers */
+
+  if (!in_image (exec, shoff, shnum,
+		 elf32 ? sizeof (Elf32_Shdr) : sizeof (Elf64_Shdr),
+		 elf32 ? 4 : 8))
+    {
+      errno = ENOEXEC;
+      return -1;
+    }
+
+  exec->sections = calloc (shnum, sizeof (section_t));
+  exec->intervals = malloc (shnum * sizeof (interval_t));
+  if (exec->sections == NULL || exec->intervals == NULL)
+    return -1;
+
+  /* Section names string table */
+  const char *strtab = NULL;
+  size_t strtab_size = 0;
+  if (shstrndx < shnum)
+    {
+      Elf64_Shdr shdr;
+      get_shdr (exec, shstrndx, &shdr);
+      if (shdr.sh_type == SHT_STRTAB &&
+	  in_image (exec, shdr.sh_offset, 1, shdr.sh_size, 1))
+	{
+	  strtab = (const char *) exec->image + shdr.sh_offset;
+	  strtab_size = shdr.sh_size;
+	}
+    }
+
+  for (size_t i = 0; i < shnum; i++)
+    {
+      Elf64_Shdr shdr;
+      get_shdr (exec, i, &shdr);
+
+      section_t *sec = &(exec->sections[exec->sections_count++]);
+      sec->name = "";
+      if (shdr.sh_name < strtab_size &&
+	  memchr (strtab + shdr.sh_name, '\0', strtab_size - shdr.sh_name))
+	sec->name = strtab + shdr.sh_name;
+      sec->addr = (shdr.sh_flags & SHF_ALLOC) ? shdr.sh_addr : 0;
+      sec->size = shdr.sh_size;
+      sec->bytes = NULL;
+      sec->code =
+	  (shdr.sh_flags & SHF_ALLOC) && (shdr.sh_flags & SHF_EXECINSTR);
+      /* Compressed sections have no usable content */
+      if (shdr.sh_type != SHT_NOBITS && shdr.sh_type != SHT_NULL &&
+	  !(shdr.sh_flags & SHF_COMPRESSED) &&
+	  in_image (exec, shdr.sh_offset, 1, shdr.sh_size, 1))
+	sec->bytes = exec->image + shdr.sh_offset;
+
+      /* Thread-local sections without content do not occupy their address
+       * range (it is also used by the following sections) */
+      if ((shdr.sh_flags & SHF_ALLOC) && shdr.sh_addr != 0 &&
+	  shdr.sh_size != 0 &&
+	  !((shdr.sh_flags & SHF_TLS) && shdr.sh_type == SHT_NOBITS))
+	exec->intervals[exec->intervals_count++] =
+	    (interval_t){.start = shdr.sh_addr,
+			 .end = shdr.sh_addr + shdr.sh_size,
+			 .section = i};
+    }
+
+  qsort (exec->intervals, exec->intervals_count, sizeof (interval_t),
+	 interval_compare);
+
+  return 0;
+}
+
+/* Symbols are sorted by address, the largest first for a same address */
+static int
+symbol_compare (const void *a, const void *b)
+{
+  const symbol_t *s1 = a, *s2 = b;
+  if (s1->start != s2->start)
+    return (s1->start > s2->start) - (s1->start < s2->start);
+  if (s1->size != s2->size)
+    return (s1->size < s2->size) - (s1->size > s2->size);
+  return (s1->name > s2->name) - (s1->name < s2->name);
+}
+
+/* Store the sorted symbols from 'rank' in the subtree of node k (the root
+ * is node 1, the children of k are 2k and 2k + 1), returns the next rank */
+static size_t
+eytzinger_fill (executable_t *exec, size_t rank, const size_t k)
+{
+  if (k > exec->symbols_count)
+    return rank;
+
+  rank = eytzinger_fill (exec, rank, 2 * k);
+  exec->eytzinger[k] = exec->symbols[rank].start;
+  exec->ranks[k] = rank;
+
+  return eytzinger_fill (exec, rank + 1, 2 * k + 1);
+}
+
+/* Add the function symbols of the symbol table in the index-th section,
+ * returns 0 on success and -1 on error */
+static int
+read_symtab (executable_t *exec, const size_t index, size_t *size)
+{
+  bool elf32 = (exec->arch == x86_32_arch);
+  size_t entsize = elf32 ? sizeof (Elf32_Sym) : sizeof (Elf64_Sym);
+  Elf64_Shdr shdr, strtab;
+
+  get_shdr (exec, index, &shdr);
+  if ((shdr.sh_type != SHT_SYMTAB && shdr.sh_type != SHT_DYNSYM) ||
+      shdr.sh_link >= exec->sections_count)
+    return 0;
+
+  get_shdr (exec, shdr.sh_link, &strtab);
+  if (strtab.sh_type != SHT_STRTAB ||
+      !in_image (exec, shdr.sh_offset, shdr.sh_size / entsize, entsize,
+		 elf32 ? 4 : 8) ||
+      !in_image (exec, strtab.sh_offset, 1, strtab.sh_size, 1))
+    return 0;
+
+  size_t count = shdr.sh_size / entsize;
+  for (size_t i = 0; i < count; i++)
+    {
+      Elf64_Sym sym;
+      if (elf32)
+	{
+	  const Elf32_Sym *sym32 =
+	      (const Elf32_Sym *) (exec->image + shdr.sh_offset) + i;
+	  sym = (Elf64_Sym){.st_name = sym32->st_name,
+			    .st_info = sym32->st_info,
+			    .st_shndx = sym32->st_shndx,
+			    .st_value = sym32->st_value,
+			    .st_size = sym32->st_size};
+	}
+      else
+	sym = ((const Elf64_Sym *) (exec->image + shdr.sh_offset))[i];
+
+      unsigned char type = ELF64_ST_TYPE (sym.st_info);
+      if ((type != STT_FUNC && type != STT_GNU_IFUNC) ||
+	  sym.st_shndx == SHN_UNDEF || sym.st_value == 0 ||
+	  sym.st_name == 0 || sym.st_name >= strtab.sh_size ||
+	  !memchr (exec->image + strtab.sh_offset + sym.st_name, '\0',
+		   strtab.sh_size - sym.st_name))
+	continue;
+
+      if (exec->symbols_count == *size)
+	{
+	  symbol_t *grown =
+	      realloc (exec->symbols, 2 * (*size) * sizeof (symbol_t));
+	  if (grown == NULL)
+	    return -1;
+	  exec->symbols = grown;
+	  *size *= 2;
+	}
+
+      exec->symbols[exec->symbols_count++] =
+	  (symbol_t){.start = sym.st_value,
+		     .size = sym.st_size,
+		     .name = strtab.sh_offset + sym.st_name};
+    }
+
+  return 0;
+}
+
+/* Build the symbol index from .symtab and .dynsym: symbols are sorted (one
+ * per address) and their addresses laid out in Eytzinger order for the
+ * lookups. Returns 0 on success and -1 on error */
+static int
+read_symbols (executable_t *exec)
+{
+  size_t size = 64;
+  exec->symbols_count = 0;
+  exec->symbols = malloc (size * sizeof (symbol_t));
+  if (exec->symbols == NULL)
+    return -1;
+
+  for (size_t i = 0; i < exec->sections_count; i++)
+    if (read_symtab (exec, i, &size) == -1)
+      return -1;
+
+  qsort (exec->symbols, exec->symbols_count, sizeof (symbol_t),
+	 symbol_compare);
+
+  /* Keep one symbol per address (both tables often hold the same ones) */
+  size_t count = 0;
+  for (size_t i = 0; i < exec->symbols_count; i++)
+    if (count == 0 || exec->symbols[count - 1].start != exec->symbols[i].start)
+      exec->symbols[count++] = exec->symbols[i];
+  exec->symbols_count = count;
+
+  exec->eytzinger = malloc ((count + 1) * sizeof (uintptr_t));
+  exec->ranks = malloc ((count + 1) * sizeof (size_t));
+  if (exec->eytzinger == NULL || exec->ranks == NULL)
+    return -1;
+
+  eytzinger_fill (exec, 0, 1);
+
+  return 0;
+}
+
+/* A symbols file of the cache holds a header, the symbols (names given as
+ * offsets in the executable file) and the Eytzinger layout of their
+ * addresses with its ranks */
+
+#define SYMBOLS_FILE_MAGIC "TRKSYM01"
+
+typedef struct
+{
+  char magic[8];       /* SYMBOLS_FILE_MAGIC */
+  uint64_t layout;     /* Sizes of the records (same ABI check) */
+  uint64_t image_size; /* Size of the executable file */
+  uint64_t count;      /* Number of symbols */
+} symbols_file_t;
+
+static uint64_t
+symbols_file_layout (void)
+{
+  return sizeof (size_t) | sizeof (symbol_t) << 8 |
+	 sizeof (symbols_file_t) << 16;
+}
+
+/* Free the symbol index (left empty) */
+static void
+symbols_clear (executable_t *exec)
+{
+  free (exec->symbols);
+  free (exec->eytzinger);
+  free (exec->ranks);
+  exec->symbols = NULL;
+  exec->eytzinger = NULL;
+  exec->ranks = NULL;
+  exec->symbols_count = 0;
+}
+
+/* Read the symbol index from a symbols file, returns 0 on success and -1
+ * on error (EINVAL if the file does not match the executable) */
+static int
+symbols_load (executable_t *exec, const char *filename)
+{
+  FILE *fd = fopen (filename, "rbe");
+  if (fd == NULL)
+    return -1;
+
+  symbols_file_t h;
+  bool error =
+      fread (&h, sizeof (symbols_file_t), 1, fd) != 1 ||
+      memcmp (h.magic, SYMBOLS_FILE_MAGIC, 8) ||
+      h.layout != symbols_file_layout () || h.image_size != exec->image_size ||
+      h.count > exec->image_size / sizeof (symbol_t);
+
+  if (!error)
+    {
+      size_t count = h.count;
+      exec->symbols = malloc ((count ? count : 1) * sizeof (symbol_t));
+      exec->eytzinger = malloc ((count + 1) * sizeof (uintptr_t));
+      exec->ranks = malloc ((count + 1) * sizeof (size_t));
+      error = exec->symbols == NULL || exec->eytzinger == NULL ||
+	      exec->ranks == NULL ||
+	      fread (exec->symbols, sizeof (symbol_t), count, fd) != count ||
+	      fread (exec->eytzinger, sizeof (uintptr_t), count + 1, fd) !=
+		  count + 1 ||
+	      fread (exec->ranks, sizeof (size_t), count + 1, fd) != count + 1;
+      exec->symbols_count = count;
+
+      /* Names must lie in the file, ranks in the symbols */
+      for (size_t i = 0; i < count && !error; i++)
+	error = exec->symbols[i].name >= exec->image_size ||
+		!memchr (exec->image + exec->symbols[i].name, '\0',
+			 exec->image_size - exec->symbols[i].name);
+      for (size_t k = 1; k <= count && !error; k++)
+	error = exec->ranks[k] >= count;
+    }
+  fclose (fd);
+
+  if (error)
+    {
+      symbols_clear (exec);
+      errno = EINVAL;
+      return -1;
+    }
+
+  return 0;
+}
+
+/* Save the symbol index to a symbols file (written to a temporary file
+ * renamed over the previous one), returns 0 on success and -1 on error */
+static int
+symbols_save (executable_t *exec, const char *filename)
+{
+  size_t size = strlen (filename) + 8;
+  char *tmp = malloc (size);
+  if (tmp == NULL)
+    return -1;
+  snprintf (tmp, size, "%s.XXXXXX", filename);
+
+  int fdesc = mkstemp (tmp);
+  FILE *fd = (fdesc == -1) ? NULL : fdopen (fdesc, "wb");
+  if (fd == NULL)
+    {
+      if (fdesc != -1)
+	{
+	  close (fdesc);
+	  unlink (tmp);
+	}
+      free (tmp);
+      return -1;
+    }
+
+  size_t count = exec->symbols_count;
+  symbols_file_t header = {.magic = SYMBOLS_FILE_MAGIC,
+			   .layout = symbols_file_layout (),
+			   .image_size = exec->image_size,
+			   .count = count};
+  bool error =
+      fwrite (&header, sizeof (symbols_file_t), 1, fd) != 1 ||
+      fwrite (exec->symbols, sizeof (symbol_t), count, fd) != count ||
+      fwrite (exec->eytzinger, sizeof (uintptr_t), count + 1, fd) !=
+	  count + 1 ||
+      fwrite (exec->ranks, sizeof (size_t), count + 1, fd) != count + 1;
+
+  if (fclose (fd) == EOF || error || rename (tmp, filename) == -1)
+    {
+      int errsv = errno ? errno : EIO;
+      unlink (tmp);
+      free (tmp);
+      errno = errsv;
+      return -1;
+    }
+  free (tmp);
+
+  return 0;
+}
+
+/* Build the symbol index on first use, once for all the threads: it is
+ * read from the on-disk cache if enabled (and saved there once built),
+ * returns the number of symbols (0 if the index cannot be built) */
+static size_t
+symbols_index (executable_t *exec)
+{
+  if (atomic_load_explicit (&exec->symbols_read, memory_order_acquire))
+    return exec->symbols_count;
+
+  pthread_mutex_lock (&exec->symbols_lock);
+  if (!atomic_load_explicit (&exec->symbols_read, memory_order_relaxed))
+    {
+      char *path =
+	  exec->use_cache ? executable_cache_path (exec, "symbols") : NULL;
+      if (path == NULL || symbols_load (exec, path) == -1)
+	{
+	  if (read_symbols (exec) == -1)
+	    symbols_clear (exec);
+	  else if (path != NULL)
+	    symbols_save (exec, path); /* The index is kept anyway */
+	}
+      free (path);
+
+      /* Demangled names of the symbols then of the imports */
+      exec->names = calloc (exec->symbols_count + exec->imports_count + 1,
+			    sizeof (*exec->names));
+      if (exec->names == NULL)
+	symbols_clear (exec);
+
+      atomic_store_explicit (&exec->symbols_read, true, memory_order_release);
+    }
+  pthread_mutex_unlock (&exec->symbols_lock);
+
+  return exec->symbols_count;
+}
+
+static int
+slot_compare (const void *a, const void *b)
+{
+  const slot_t *s1 = a, *s2 = b;
+  return (s1->addr > s2->addr) - (s1->addr < s2->addr);
+}
+
+static int
+import_compare (const void *a, const void *b)
+{
+  const import_t *i1 = a, *i2 = b;
+  return (i1->addr > i2->addr) - (i1->addr < i2->addr);
+}
+
+/* Add the GOT slots of the jump slot and global data relocations of the
+ * index-th section (.rela.plt, .rela.dyn, .rel.plt, ...) to the slots */
+static int
+read_relocations (executable_t *exec, const size_t index, slot_t **slots,
+		  size_t *count, size_t *size)
+{
+  bool elf32 = (exec->arch == x86_32_arch);
+  Elf64_Shdr shdr, symtab, strtab;
+
+  get_shdr (exec, index, &shdr);
+  if ((shdr.sh_type != SHT_RELA && shdr.sh_type != SHT_REL) ||
+      shdr.sh_link == 0 || shdr.sh_link >= exec->sections_count)
+    return 0;
+
+  get_shdr (exec, shdr.sh_link, &symtab);
+  if (symtab.sh_type != SHT_DYNSYM || symtab.sh_link >= exec->sections_count)
+    return 0;
+  get_shdr (exec, symtab.sh_link, &strtab);
+
+  size_t entsize =
+      (shdr.sh_type == SHT_RELA)
+	  ? (elf32 ? sizeof (Elf32_Rela) : sizeof (Elf64_Rela))
+	  : (elf32 ? sizeof (Elf32_Rel) : sizeof (Elf64_Rel));
+  size_t symsize = elf32 ? sizeof (Elf32_Sym) : sizeof (Elf64_Sym);
+  size_t symbols = symtab.sh_size / symsize;
+  if (!in_image (exec, shdr.sh_offset, shdr.sh_size / entsize, entsize,
+		 elf32 ? 4 : 8) ||
+      !in_image (exec, symtab.sh_offset, symbols, symsize, elf32 ? 4 : 8) ||
+      !in_image (exec, strtab.sh_offset, 1, strtab.sh_size, 1))
+    return 0;
+
+  const uint8_t *relocs = exec->image + shdr.sh_offset;
+  for (size_t i = 0; i < shdr.sh_size / entsize; i++)
+    {
+      /* Rel and Rela share their first two fields */
+      uintptr_t offset;
+      size_t type, symbol, name;
+      if (elf32)
+	{
+	  const Elf32_Rel *rel = (const Elf32_Rel *) (relocs + i * entsize);
+	  offset = rel->r_offset;
+	  type = ELF32_R_TYPE (rel->r_info);
+	  symbol = ELF32_R_SYM (rel->r_info);
+	  if (type != R_386_JMP_SLOT && type != R_386_GLOB_DAT)
+	    continue;
+	}
+      else
+	{
+	  const Elf64_Rel *rel = (const Elf64_Rel *) (relocs + i * entsize);
+	  offset = rel->r_offset;
+	  type = ELF64_R_TYPE (rel->r_info);
+	  symbol = ELF64_R_SYM (rel->r_info);
+	  if (type != R_X86_64_JUMP_SLOT && type != R_X86_64_GLOB_DAT)
+	    continue;
+	}
+
+      if (symbol == 0 || symbol >= symbols)
+	continue;
+
+      name = elf32 ? ((const Elf32_Sym *) (exec->image + symtab.sh_offset))
+			 [symbol].st_name
+		   : ((const Elf64_Sym *) (exec->image + symtab.sh_offset))
+			 [symbol].st_name;
+      if (name == 0 || name >= strtab.sh_size ||
+	  !memchr (exec->image + strtab.sh_offset + name, '\0',
+		   strtab.sh_size - name))
+	continue;
+
+      if (*count == *size)
+	{
+	  slot_t *grown = realloc (*slots, 2 * (*size) * sizeof (slot_t));
+	  if (grown == NULL)
+	    return -1;
+	  *slots = grown;
+	  *size *= 2;
+	}
+
+      (*slots)[(*count)++] =
+	  (slot_t){.addr = offset, .name = strtab.sh_offset + name};
+    }
+
+  return 0;
+}
+
+/* Find the GOT slot read by the indirect jump of the PLT entry at addr,
+ * returns 0 if there is none */
+static uintptr_t
+plt_slot (executable_t *exec, const uint8_t *entry, const uintptr_t addr,
+	  const size_t size, const uintptr_t got_plt)
+{
+  for (size_t i = 0; i + 6 <= size; i++)
+    {
+      if (entry[i] != 0xff || (entry[i + 1] != 0x25 && entry[i + 1] != 0xa3))
+	continue;
+
+      int32_t disp;
+      memcpy (&disp, entry + i + 2, sizeof (int32_t));
+
+      /* 'jmp *disp(%rip)' on x86-64, 'jmp *disp' and 'jmp *disp(%ebx)'
+       * (relative to the GOT) on i386 */
+      if (exec->arch == x86_64_arch && entry[i + 1] == 0x25)
+	return addr + i + 6 + disp;
+      if (exec->arch == x86_32_arch)
+	return (entry[i + 1] == 0x25) ? (uint32_t) disp
+				      : (uint32_t) (got_plt + disp);
+    }
+
+  return 0;
+}
+
+/* Name the PLT entries (in .plt, .plt.sec and .plt.got) after the symbol
+ * of the GOT slot they jump through, returns 0 on success and -1 on error */
+static int
+read_imports (executable_t *exec)
+{
+  size_t count = 0, size = 64;
+  slot_t *slots = malloc (size * sizeof (slot_t));
+  if (slots == NULL)
+    return -1;
+
+  for (size_t i = 0; i < exec->sections_count; i++)
+    if (read_relocations (exec, i, &slots, &count, &size) == -1)
+      {
+	free (slots);
+	return -1;
+      }
+  qsort (slots, count, sizeof (slot_t), slot_compare);
+
+  uintptr_t got_plt = 0;
+  executable_section_by_name (exec, ".got.plt", &got_plt, NULL);
+
+  /* At most one import per PLT entry */
+  size_t entries = 0;
+  for (size_t i = 0; i < exec->sections_count; i++)
+    if (strncmp (exec->sections[i].name, ".plt", 4) == 0)
+      entries += exec->sections[i].size / 8;
+
+  exec->imports_count = 0;
+  exec->imports = malloc ((entries ? entries : 1) * sizeof (import_t));
+  if (exec->imports == NULL)
+    {
+      free (slots);
+      return -1;
+    }
+
+  for (size_t i = 0; i < exec->sections_count && count > 0; i++)
+    {
+      section_t *sec = &(exec->sections[i]);
+      if (sec->bytes == NULL || (strcmp (sec->name, ".plt") != 0 &&
+				 strcmp (sec->name, ".plt.sec") != 0 &&
+				 strcmp (sec->name, ".plt.got") != 0))
+	continue;
+
+      Elf64_Shdr shdr;
+      get_shdr (exec, i, &shdr);
+      size_t entsize = (shdr.sh_entsize >= 8) ? shdr.sh_entsize : 16;
+      for (size_t offset = 0; offset + entsize <= sec->size; offset += entsize)
+	{
+	  uintptr_t addr = sec->addr + offset;
+	  slot_t key = {.addr = plt_slot (exec, sec->bytes + offset, addr,
+					  entsize, got_plt)};
+	  slot_t *slot = bsearch (&key, slots, count, sizeof (slot_t),
+				  slot_compare);
+	  if (slot != NULL)
+	    exec->imports[exec->imports_count++] =
+		(import_t){.addr = addr, .size = entsize, .name = slot->name};
+	}
+    }
+
+  qsort (exec->imports, exec->imports_count, sizeof (import_t),
+	 import_compare);
+  free (slots);
+
+  return 0;
+}
+
+/* Look for the GNU build-ID note among the 'size' bytes of notes, aligned
+ * on 'align' bytes, returns true if found */
+static bool
+find_build_id (executable_t *exec, const uint8_t *notes, size_t size,
+	       const size_t align)
+{
+  /* Note headers have the same layout in 32 and 64 bits */
+  while (size >= sizeof (Elf64_Nhdr))
+    {
+      const Elf64_Nhdr *nhdr = (const Elf64_Nhdr *) notes;
+      size_t namesz = (nhdr->n_namesz + align - 1) & ~(align - 1);
+      size_t descsz = (nhdr->n_descsz + align - 1) & ~(align - 1);
+      if (namesz > size - sizeof (Elf64_Nhdr) ||
+	  descsz > size - sizeof (Elf64_Nhdr) - namesz)
+	return false;
+
+      const uint8_t *name = notes + sizeof (Elf64_Nhdr);
+      if (nhdr->n_type == NT_GNU_BUILD_ID && nhdr->n_namesz == 4 &&
+	  !memcmp (name, "GNU", 4) && nhdr->n_descsz > 0 &&
+	  nhdr->n_descsz <= BUILD_ID_MAX)
+	{
+	  exec->build_id = name + namesz;
+	  exec->build_id_size = nhdr->n_descsz;
+	  return true;
+	}
+
+      notes += sizeof (Elf64_Nhdr) + namesz + descsz;
+      size -= sizeof (Elf64_Nhdr) + namesz + descsz;
+    }
+
+  return false;
+}
+
+/* Read the build-ID from the note segments, or from the note sections if
+ * the file has no program header (executables without build-ID are later
+ * identified by a hash of their content) */
+static void
+read_build_id (executable_t *exec)
+{
+  bool elf32 = (exec->arch == x86_32_arch);
+  size_t phnum =
+      elf32 ? exec->header.elf32->e_phnum : exec->header.elf64->e_phnum;
+
+  for (size_t i = 0; i < phnum; i++)
+    {
+      Elf64_Phdr phdr;
+      get_phdr (exec, i, &phdr);
+      if (phdr.p_type == PT_NOTE &&
+	  in_image (exec, phdr.p_offset, 1, phdr.p_filesz, 4) &&
+	  find_build_id (exec, exec->image + phdr.p_offset, phdr.p_filesz,
+			 (phdr.p_align == 8) ? 8 : 4))
+	return;
+    }
+
+  size_t size;
+  const uint8_t *notes = executable_section_by_name (
+      exec, ".note.gnu.build-id", NULL, &size);
+  if (notes != NULL && (notes - exec->image) % 4 == 0)
+    find_build_id (exec, notes, size, 4);
+}
+
+executable_t *
+executable_new (char *execfilename)
+{
+  /* Map the whole file once, all the tables are read from the mapping */
+  struct stat exec_stats;
+  int fd = open (execfilename, O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
     return NULL;
 
-  switch (buf[0])
+  if (fstat (fd, &exec_stats) == -1)
     {
-    case 0x03:
-      exec->arch = x86_32_arch;
-      fread (&(exec->header.elf32), 1, sizeof (Elf32_Ehdr), execfile);
-      break;
+      close (fd);
+      return NULL;
+    }
 
-    case 0x3e:
-      exec->arch = x86_64_arch;
-      fread (&(exec->header.elf64), 1, sizeof (Elf64_Ehdr), execfile);
-      break;
+  if (!S_ISREG (exec_stats.st_mode) ||
+      (size_t) exec_stats.st_size < EI_NIDENT)
+    {
+      close (fd);
+      errno = ENOEXEC;
+      return NULL;
+    }
 
-    default:
-      errx (EXIT_FAILURE, "error: '%s' unsupported architecture", execfilename);
+  void *image =
+      mmap (NULL, exec_stats.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (image == MAP_FAILED)
+    return NULL;
+
+  executable_t *exec = calloc (1, sizeof (executable_t));
+  if (exec == NULL)
+    {
+      munmap (image, exec_stats.st_size);
+      return NULL;
+    }
+
+  exec->image = image;
+  exec->image_size = exec_stats.st_size;
+  exec->header.elf64 = image;
+  atomic_init (&exec->section_hit, 0);
+  atomic_init (&exec->lines_read, false);
+  pthread_mutex_init (&exec->lines_lock, NULL);
+  atomic_init (&exec->symbols_read, false);
+  pthread_mutex_init (&exec->symbols_lock, NULL);
+  pthread_mutex_init (&exec->names_lock, NULL);
+
+  /* Check ELF magic number (first 4 bytes: 0x7f "ELF"), the class gives
+   * the layout of the headers and the machine the arch */
+  if (memcmp (exec->image, ELFMAG, SELFMAG) != 0)
+    exec->arch = unknown_arch;
+  else if (exec->image[EI_CLASS] == ELFCLASS32 &&
+	   exec->image_size >= sizeof (Elf32_Ehdr) &&
+	   exec->header.elf32->e_machine == EM_386)
+    exec->arch = x86_32_arch;
+  else if (exec->image[EI_CLASS] == ELFCLASS64 &&
+	   exec->image_size >= sizeof (Elf64_Ehdr) &&
+	   exec->header.elf64->e_machine == EM_X86_64)
+    exec->arch = x86_64_arch;
+  else
+    exec->arch = unknown_arch;
+
+  if (exec->arch == unknown_arch)
+    {
+      executable_delete (exec);
+      errno = ENOEXEC;
+      return NULL;
     }
 
-  /* Closing file after verifications */
-  fclose (execfile);
+  /* The symbol index is built on first use (see symbols_index()) */
+  if (read_segments (exec) == -1 || read_sections (exec) == -1 ||
+      read_imports (exec) == -1)
+    {
+      int error = errno;
+      executable_delete (exec);
+      errno = error;
+      return NULL;
+    }
+  read_build_id (exec);
 
   return exec;
 }
@@ -88,6 +983,28 @@ executable_new (char *execfilename)
 void
 executable_delete (executable_t *exec)
 {
+  if (exec == NULL)
+    return;
+
+  free (exec->segments);
+  free (exec->sections);
+  free (exec->intervals);
+  symbols_clear (exec);
+  pthread_mutex_destroy (&exec->symbols_lock);
+  free (exec->imports);
+  free (exec->lines);
+  free (exec->files);
+  pthread_mutex_destroy (&exec->lines_lock);
+  free (exec->names);
+  while (exec->arena != NULL)
+    {
+      arena_block_t *block = exec->arena;
+      exec->arena = block->next;
+      free (block);
+    }
+  pthread_mutex_destroy (&exec->names_lock);
+  if (exec->image != NULL)
+    munmap ((void *) exec->image, exec->image_size);
   free (exec);
 }
 
@@ -111,20 +1028,1107 @@ executable_print_arch (executable_t *exec, FILE *fd)
   fputs (arch2str[exec->arch], fd);
 }
 
-char *
+uintptr_t
+executable_entry (executable_t *exec)
+{
+  if (exec == NULL)
+    return 0;
+
+  return (exec->arch == x86_32_arch) ? exec->header.elf32->e_entry
+				     : exec->header.elf64->e_entry;
+}
+
+uintptr_t
+executable_base (executable_t *exec)
+{
+  if (exec == NULL)
+    return 0;
+
+  return exec->base;
+}
+
+const uint8_t *
+executable_segment (executable_t *exec, const size_t index, uintptr_t *addr,
+		    size_t *size)
+{
+  if (exec == NULL || index >= exec->segments_count)
+    return NULL;
+
+  if (addr != NULL)
+    *addr = exec->segments[index].addr;
+  if (size != NULL)
+    *size = exec->segments[index].size;
+
+  return exec->segments[index].bytes;
+}
+
+size_t
+executable_sections (executable_t *exec)
+{
+  return (exec == NULL) ? 0 : exec->sections_count;
+}
+
+const char *
 executable_section_next (executable_t *exec)
 {
-  return NULL;
+  if (exec == NULL)
+    return NULL;
+
+  /* Restart from the first section after the last one */
+  if (exec->section_cursor >= exec->sections_count)
+    {
+      exec->section_cursor = 0;
+      return NULL;
+    }
+
+  return exec->sections[exec->section_cursor++].name;
 }
 
-char *
-executable_get_section_by_addr (executable_t *exec, uintptr_t addr)
+const uint8_t *
+executable_section_by_name (executable_t *exec, const char *name,
+			    uintptr_t *addr, size_t *size)
 {
+  if (exec == NULL || name == NULL)
+    return NULL;
+
+  for (size_t i = 0; i < exec->sections_count; i++)
+    if (exec->sections[i].bytes != NULL &&
+	strcmp (exec->sections[i].name, name) == 0)
+      {
+	if (addr != NULL)
+	  *addr = exec->sections[i].addr;
+	if (size != NULL)
+	  *size = exec->sections[i].size;
+
+	return exec->sections[i].bytes;
+      }
+
   return NULL;
 }
 
-char *
-executable_get_symbol_by_addr (executable_t *exec, uintptr_t addr)
+const uint8_t *
+executable_code (executable_t *exec, const size_t index, uintptr_t *addr,
+		 size_t *size)
 {
-  return NULL;
+  if (exec == NULL)
+    return NULL;
+
+  /* Look for the index-th code section with some content */
+  size_t count = 0;
+  for (size_t i = 0; i < exec->sections_count; i++)
+    if (exec->sections[i].code && exec->sections[i].bytes != NULL &&
+	count++ == index)
+      {
+	if (addr != NULL)
+	  *addr = exec->sections[i].addr;
+	if (size != NULL)
+	  *size = exec->sections[i].size;
+
+	return exec->sections[i].bytes;
+      }
+
+  return NULL;
+}
+
+const char *
+executable_get_section_by_addr (executable_t *exec, uintptr_t addr)
+{
+  if (exec == NULL || exec->intervals_count == 0)
+    return NULL;
+
+  /* Consecutive lookups usually fall in the same section */
+  size_t hit = atomic_load_explicit (&exec->section_hit, memory_order_relaxed);
+  interval_t *interval = &(exec->intervals[hit]);
+  if (interval->start <= addr && addr < interval->end)
+    return exec->sections[interval->section].name;
+
+  /* Last interval starting at or below addr */
+  size_t low = 0, high = exec->intervals_count;
+  while (high - low > 1)
+    {
+      size_t middle = low + (high - low) / 2;
+      if (exec->intervals[middle].start <= addr)
+	low = middle;
+      else
+	high = middle;
+    }
+
+  interval = &(exec->intervals[low]);
+  if (addr < interval->start || addr >= interval->end)
+    return NULL;
+
+  atomic_store_explicit (&exec->section_hit, low, memory_order_relaxed);
+
+  return exec->sections[interval->section].name;
+}
+
+/* Check if the symbol covers addr (a symbol of unknown size only covers
+ * its first byte) */
+static inline bool
+symbol_covers (const symbol_t *const sym, const uintptr_t addr)
+{
+  return addr >= sym->start &&
+	 (addr - sym->start < sym->size || addr == sym->start);
+}
+
+/* Get the rank of the symbol covering addr plus one, 0 if none */
+static size_t
+symbol_find (executable_t *exec, const uintptr_t addr)
+{
+  if (symbols_index (exec) == 0)
+    return 0;
+
+  /* Branch-free descent to the first address above addr (the trailing
+   * right moves are undone by the shift), 0 if there is none */
+  size_t k = 1;
+  while (k <= exec->symbols_count)
+    k = 2 * k + (exec->eytzinger[k] <= addr);
+  k >>= __builtin_ffsll (~(unsigned long long) k);
+
+  /* The symbol just before it is the last one starting at or below addr */
+  size_t rank = (k == 0) ? exec->symbols_count : exec->ranks[k];
+  if (rank == 0 || !symbol_covers (&(exec->symbols[rank - 1]), addr))
+    return 0;
+
+  return rank;
+}
+
+const char *
+executable_get_symbol_by_addr (executable_t *exec, uintptr_t addr)
+{
+  if (exec == NULL)
+    return NULL;
+
+  size_t rank = symbol_find (exec, addr);
+  if (rank == 0)
+    return NULL;
+
+  return (const char *) exec->image + exec->symbols[rank - 1].name;
+}
+
+size_t
+executable_get_symbols_by_addr (executable_t *exec, const uintptr_t *addrs,
+				const size_t count, const char **names)
+{
+  if (exec == NULL || (count > 0 && (addrs == NULL || names == NULL)))
+    return 0;
+
+  /* Merge the sorted addresses with the sorted symbols */
+  size_t found = 0, rank = 0;
+  symbols_index (exec);
+  for (size_t i = 0; i < count; i++)
+    {
+      while (rank < exec->symbols_count &&
+	     exec->symbols[rank].start <= addrs[i])
+	rank++;
+
+      names[i] = NULL;
+      if (rank > 0 && symbol_covers (&(exec->symbols[rank - 1]), addrs[i]))
+	{
+	  names[i] = (const char *) exec->image + exec->symbols[rank - 1].name;
+	  found++;
+	}
+    }
+
+  return found;
+}
+
+size_t
+executable_symbols (executable_t *exec)
+{
+  return (exec == NULL) ? 0 : symbols_index (exec);
+}
+
+uintptr_t
+executable_symbol (executable_t *exec, const size_t index, size_t *size,
+		   const char **name)
+{
+  if (exec == NULL || index >= symbols_index (exec))
+    return 0;
+
+  if (size != NULL)
+    *size = exec->symbols[index].size;
+  if (name != NULL)
+    *name = (const char *) exec->image + exec->symbols[index].name;
+
+  return exec->symbols[index].start;
+}
+
+/* Get the rank of the import whose PLT entry covers addr plus one, 0 if
+ * none */
+static size_t
+import_find (executable_t *exec, const uintptr_t addr)
+{
+  /* Last PLT entry starting at or below addr */
+  size_t low = 0, high = exec->imports_count;
+  while (low < high)
+    {
+      size_t middle = low + (high - low) / 2;
+      if (exec->imports[middle].addr <= addr)
+	low = middle + 1;
+      else
+	high = middle;
+    }
+
+  if (low == 0 || addr - exec->imports[low - 1].addr >=
+		      exec->imports[low - 1].size)
+    return 0;
+
+  return low;
+}
+
+const char *
+executable_get_import_by_addr (executable_t *exec, uintptr_t addr)
+{
+  if (exec == NULL)
+    return NULL;
+
+  size_t rank = import_find (exec, addr);
+  if (rank == 0)
+    return NULL;
+
+  return (const char *) exec->image + exec->imports[rank - 1].name;
+}
+
+size_t
+executable_imports (executable_t *exec)
+{
+  return (exec == NULL) ? 0 : exec->imports_count;
+}
+
+uintptr_t
+executable_import (executable_t *exec, const size_t index, const char **name)
+{
+  if (exec == NULL || index >= exec->imports_count)
+    return 0;
+
+  if (name != NULL)
+    *name = (const char *) exec->image + exec->imports[index].name;
+
+  return exec->imports[index].addr;
+}
+
+const uint8_t *
+executable_build_id (executable_t *exec, size_t *size)
+{
+  if (exec == NULL || exec->build_id == NULL)
+    return NULL;
+
+  if (size != NULL)
+    *size = exec->build_id_size;
+
+  return exec->build_id;
+}
+
+const char *
+executable_id (executable_t *exec)
+{
+  if (exec == NULL)
+    return NULL;
+
+  if (exec->id[0] != '\0')
+    return exec->id;
+
+  if (exec->build_id != NULL)
+    {
+      for (size_t i = 0; i < exec->build_id_size; i++)
+	sprintf (exec->id + 2 * i, "%02x", exec->build_id[i]);
+      return exec->id;
+    }
+
+  /* 64 bits FNV-1a hash of the whole file */
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < exec->image_size; i++)
+    hash = (hash ^ exec->image[i]) * 0x100000001b3ULL;
+  sprintf (exec->id, "fnv-%016" PRIx64 "-%zx", hash, exec->image_size);
+
+  return exec->id;
+}
+
+/* Create the directory if it does not exist, returns 0 on success */
+static int
+make_directory (const char *path)
+{
+  if (mkdir (path, 0700) == -1 && errno != EEXIST)
+    return -1;
+
+  return 0;
+}
+
+char *
+executable_cache_path (executable_t *exec, const char *name)
+{
+  if (exec == NULL || name == NULL || *name == '\0' || strchr (name, '/'))
+    {
+      errno = EINVAL;
+      return NULL;
+    }
+
+  /* $XDG_CACHE_HOME/tracker/ID/NAME (default to $HOME/.cache) */
+  const char *base = getenv ("XDG_CACHE_HOME");
+  const char *suffix = "";
+  if (base == NULL || *base != '/')
+    {
+      base = getenv ("HOME");
+      suffix = "/.cache";
+    }
+  if (base == NULL || *base == '\0')
+    {
+      errno = ENOENT;
+      return NULL;
+    }
+
+  const char *id = executable_id (exec);
+  size_t size = strlen (base) + strlen (suffix) + strlen ("/tracker/") +
+		strlen (id) + strlen (name) + 2;
+  char *path = malloc (size);
+  if (path == NULL)
+    return NULL;
+
+  /* Create the missing directories along the way */
+  int len = snprintf (path, size, "%s%s", base, suffix);
+  if (make_directory (path) == -1)
+    goto fail;
+  len += snprintf (path + len, size - len, "/tracker");
+  if (make_directory (path) == -1)
+    goto fail;
+  len += snprintf (path + len, size - len, "/%s", id);
+  if (make_directory (path) == -1)
+    goto fail;
+  snprintf (path + len, size - len, "/%s", name);
+
+  return path;
+
+fail:
+  free (path);
+  return NULL;
+}
+
+void
+executable_set_cache (executable_t *exec, const bool use_cache)
+{
+  if (exec != NULL)
+    exec->use_cache = use_cache;
+}
+
+/* **********[ DWARF Line Table ]********** */
+
+/* Cursor over DWARF data, reading past the end sets 'error' (and reads
+ * return 0) */
+typedef struct
+{
+  const uint8_t *ptr;
+  const uint8_t *end;
+  bool error;
+} dwarf_t;
+
+/* Read a little-endian integer of 'size' bytes */
+static uint64_t
+dwarf_uint (dwarf_t *d, const size_t size)
+{
+  if (d->error || (size_t) (d->end - d->ptr) < size)
+    {
+      d->error = true;
+      return 0;
+    }
+
+  uint64_t value = 0;
+  for (size_t i = 0; i < size && i < 8; i++)
+    value |= (uint64_t) d->ptr[i] << (8 * i);
+  d->ptr += size;
+
+  return value;
+}
+
+static uint64_t
+dwarf_uleb (dwarf_t *d)
+{
+  uint64_t value = 0;
+  for (unsigned shift = 0; !d->error; shift += 7)
+    {
+      if (d->ptr == d->end)
+	break;
+
+      uint8_t byte = *d->ptr++;
+      if (shift < 64)
+	value |= (uint64_t) (byte & 0x7f) << shift;
+      if (!(byte & 0x80))
+	return value;
+    }
+
+  d->error = true;
+  return 0;
+}
+
+static int64_t
+dwarf_sleb (dwarf_t *d)
+{
+  uint64_t value = 0;
+  for (unsigned shift = 0; !d->error; shift += 7)
+    {
+      if (d->ptr == d->end)
+	break;
+
+      uint8_t byte = *d->ptr++;
+      if (shift < 64)
+	value |= (uint64_t) (byte & 0x7f) << shift;
+      if (!(byte & 0x80))
+	{
+	  if ((byte & 0x40) && shift + 7 < 64)
+	    value |= ~(uint64_t) 0 << (shift + 7);
+	  return (int64_t) value;
+	}
+    }
+
+  d->error = true;
+  return 0;
+}
+
+/* Read a null-terminated string, returns NULL on error */
+static const char *
+dwarf_string (dwarf_t *d)
+{
+  const uint8_t *nul =
+      d->error ? NULL : memchr (d->ptr, '\0', d->end - d->ptr);
+  if (nul == NULL)
+    {
+      d->error = true;
+      return NULL;
+    }
+
+  const char *str = (const char *) d->ptr;
+  d->ptr = nul + 1;
+
+  return str;
+}
+
+/* Get the string at offset in a string section, NULL if invalid */
+static const char *
+dwarf_strp (const uint8_t *strs, const size_t size, const uint64_t offset)
+{
+  if (strs == NULL || offset >= size ||
+      !memchr (strs + offset, '\0', size - offset))
+    return NULL;
+
+  return (const char *) strs + offset;
+}
+
+/* DWARF constants (see the DWARF 5 standard, section 6.2) */
+enum
+{
+  DW_LNS_copy = 1,
+  DW_LNS_advance_pc = 2,
+  DW_LNS_advance_line = 3,
+  DW_LNS_set_file = 4,
+  DW_LNS_const_add_pc = 8,
+  DW_LNS_fixed_advance_pc = 9,
+  DW_LNE_end_sequence = 1,
+  DW_LNE_set_address = 2,
+  DW_LNE_define_file = 3,
+  DW_LNCT_path = 1,
+  DW_FORM_block = 0x09,
+  DW_FORM_data1 = 0x0b,
+  DW_FORM_data2 = 0x05,
+  DW_FORM_data4 = 0x06,
+  DW_FORM_data8 = 0x07,
+  DW_FORM_data16 = 0x1e,
+  DW_FORM_string = 0x08,
+  DW_FORM_strp = 0x0e,
+  DW_FORM_udata = 0x0f,
+  DW_FORM_line_strp = 0x1f
+};
+
+/* Row of the line table while it is built */
+typedef struct
+{
+  line_t row;
+  size_t order; /* Position in the line programs */
+} lrow_t;
+
+/* State of the reading of the line table */
+typedef struct
+{
+  executable_t *exec;
+  lrow_t *rows;		   /* Rows found so far */
+  size_t count;
+  size_t size;
+  size_t files_size;	   /* Capacity of exec->files */
+  const uint8_t *str;	   /* .debug_str */
+  size_t str_size;
+  const uint8_t *line_str; /* .debug_line_str */
+  size_t line_str_size;
+} lreader_t;
+
+static bool
+lreader_add_file (lreader_t *lr, const char *name)
+{
+  executable_t *exec = lr->exec;
+  if (exec->files_count == lr->files_size)
+    {
+      size_t n = lr->files_size ? 2 * lr->files_size : 64;
+      const char **files = realloc (exec->files, n * sizeof (const char *));
+      if (files == NULL)
+	return false;
+      exec->files = files;
+      lr->files_size = n;
+    }
+  exec->files[exec->files_count++] = name ? name : "?";
+
+  return true;
+}
+
+static bool
+lreader_add_row (lreader_t *lr, const uintptr_t addr, const size_t file,
+		 const uint64_t line)
+{
+  if (lr->count == lr->size)
+    {
+      size_t n = lr->size ? 2 * lr->size : 1024;
+      lrow_t *rows = realloc (lr->rows, n * sizeof (lrow_t));
+      if (rows == NULL)
+	return false;
+      lr->rows = rows;
+      lr->size = n;
+    }
+
+  lr->rows[lr->count] =
+      (lrow_t){.row = {.addr = addr,
+		       .file = (file < UINT32_MAX) ? file : UINT32_MAX,
+		       .line = (line < UINT32_MAX) ? line : UINT32_MAX},
+	       .order = lr->count};
+  lr->count++;
+
+  return true;
+}
+
+/* Read the value of an attribute of a DWARF 5 directory or file entry,
+ * strings are returned in str (NULL otherwise) */
+static bool
+read_line_form (lreader_t *lr, dwarf_t *d, const uint64_t form,
+		const bool dwarf64, const char **str)
+{
+  *str = NULL;
+  switch (form)
+    {
+    case DW_FORM_string:
+      *str = dwarf_string (d);
+      break;
+
+    case DW_FORM_strp:
+      *str = dwarf_strp (lr->str, lr->str_size,
+			 dwarf_uint (d, dwarf64 ? 8 : 4));
+      break;
+
+    case DW_FORM_line_strp:
+      *str = dwarf_strp (lr->line_str, lr->line_str_size,
+			 dwarf_uint (d, dwarf64 ? 8 : 4));
+      break;
+
+    case DW_FORM_udata:
+      dwarf_uleb (d);
+      break;
+
+    case DW_FORM_data1:
+    case DW_FORM_data2:
+    case DW_FORM_data4:
+    case DW_FORM_data8:
+      dwarf_uint (d, (form == DW_FORM_data1)   ? 1
+		     : (form == DW_FORM_data2) ? 2
+		     : (form == DW_FORM_data4) ? 4
+					       : 8);
+      break;
+
+    case DW_FORM_data16:
+      dwarf_uint (d, 16);
+      break;
+
+    case DW_FORM_block:
+      {
+	uint64_t size = dwarf_uleb (d);
+	if (size > (uint64_t) (d->end - d->ptr))
+	  d->error = true;
+	else
+	  d->ptr += size;
+      }
+      break;
+
+    default:
+      return false;
+    }
+
+  return !d->error;
+}
+
+/* Read the DWARF 5 directory or file name table, the paths of the files
+ * are appended to the files of the executable if 'files' is set */
+static bool
+read_line_entries (lreader_t *lr, dwarf_t *d, const bool dwarf64,
+		   const bool files)
+{
+  uint64_t formats[2 * 16];
+  size_t formats_count = dwarf_uint (d, 1);
+  if (formats_count > 16)
+    return false;
+
+  for (size_t i = 0; i < 2 * formats_count; i++)
+    formats[i] = dwarf_uleb (d);
+
+  uint64_t count = dwarf_uleb (d);
+  for (uint64_t e = 0; e < count && !d->error; e++)
+    {
+      const char *path = NULL;
+      for (size_t i = 0; i < formats_count; i++)
+	{
+	  const char *str;
+	  if (!read_line_form (lr, d, formats[2 * i + 1], dwarf64, &str))
+	    return false;
+	  if (formats[2 * i] == DW_LNCT_path)
+	    path = str;
+	}
+
+      if (files && !lreader_add_file (lr, path))
+	return false;
+    }
+
+  return !d->error;
+}
+
+/* Returns true if addr lies in a code section (sequences of the functions
+ * discarded by the linker start at 0 or at a tombstone address) */
+static bool
+in_code (executable_t *exec, const uintptr_t addr)
+{
+  for (size_t i = 0; i < exec->sections_count; i++)
+    if (exec->sections[i].code && exec->sections[i].addr <= addr &&
+	addr - exec->sections[i].addr < exec->sections[i].size)
+      return true;
+
+  return false;
+}
+
+/* Run the line program of a unit of .debug_line, returns false if the
+ * unit is invalid or on memory error */
+static bool
+read_line_unit (lreader_t *lr, dwarf_t *unit, const bool dwarf64)
+{
+  executable_t *exec = lr->exec;
+  unsigned version = dwarf_uint (unit, 2);
+  if (version < 2 || version > 5)
+    return false;
+
+  if (version >= 5)
+    dwarf_uint (unit, 2); /* Address and segment selector sizes */
+
+  uint64_t header_length = dwarf_uint (unit, dwarf64 ? 8 : 4);
+  if (header_length > (uint64_t) (unit->end - unit->ptr))
+    return false;
+  dwarf_t program = {.ptr = unit->ptr + header_length, .end = unit->end};
+
+  unsigned min_length = dwarf_uint (unit, 1);
+  if (version >= 4)
+    dwarf_uint (unit, 1); /* Maximum operations per instruction */
+  dwarf_uint (unit, 1);	  /* Default is_stmt */
+  int line_base = (int8_t) dwarf_uint (unit, 1);
+  unsigned line_range = dwarf_uint (unit, 1);
+  unsigned opcode_base = dwarf_uint (unit, 1);
+  if (unit->error || line_range == 0 || opcode_base == 0)
+    return false;
+
+  uint8_t lengths[256] = {0};
+  for (unsigned i = 1; i < opcode_base; i++)
+    lengths[i] = dwarf_uint (unit, 1);
+
+  /* File numbers start at 1 before DWARF 5 */
+  size_t files = exec->files_count;
+  if (version >= 5)
+    {
+      if (!read_line_entries (lr, unit, dwarf64, false) ||
+	  !read_line_entries (lr, unit, dwarf64, true))
+	return false;
+    }
+  else
+    {
+      while (!unit->error && unit->ptr < unit->end && *unit->ptr != '\0')
+	dwarf_string (unit); /* Include directories */
+      dwarf_uint (unit, 1);
+
+      files--;
+      while (!unit->error && unit->ptr < unit->end && *unit->ptr != '\0')
+	{
+	  if (!lreader_add_file (lr, dwarf_string (unit)))
+	    return false;
+	  dwarf_uleb (unit); /* Directory, time and size */
+	  dwarf_uleb (unit);
+	  dwarf_uleb (unit);
+	}
+    }
+  if (unit->error)
+    return false;
+
+  /* Line program state machine */
+  uint64_t addr = 0, file = 1, line = 1;
+  size_t sequence = lr->count;
+  dwarf_t *d = &program;
+  while (d->ptr < d->end && !d->error)
+    {
+      unsigned opcode = dwarf_uint (d, 1);
+      bool row = false;
+
+      if (opcode >= opcode_base)
+	{
+	  unsigned adjusted = opcode - opcode_base;
+	  addr += (adjusted / line_range) * min_length;
+	  line += line_base + (int) (adjusted % line_range);
+	  row = true;
+	}
+      else if (opcode == 0)
+	{
+	  uint64_t size = dwarf_uleb (d);
+	  if (size == 0 || size > (uint64_t) (d->end - d->ptr))
+	    return false;
+	  dwarf_t ext = {.ptr = d->ptr, .end = d->ptr + size};
+	  d->ptr += size;
+
+	  switch (dwarf_uint (&ext, 1))
+	    {
+	    case DW_LNE_end_sequence:
+	      /* Keep the sequence only if it is part of the code */
+	      if (lr->count == sequence ||
+		  !in_code (exec, lr->rows[sequence].row.addr))
+		lr->count = sequence;
+	      else if (!lreader_add_row (lr, addr, SIZE_MAX, 0))
+		return false;
+	      sequence = lr->count;
+	      addr = 0;
+	      file = line = 1;
+	      break;
+
+	    case DW_LNE_set_address:
+	      addr = dwarf_uint (&ext, size - 1);
+	      break;
+
+	    case DW_LNE_define_file:
+	      if (!lreader_add_file (lr, dwarf_string (&ext)))
+		return false;
+	      break;
+
+	    default:
+	      break;
+	    }
+	}
+      else
+	switch (opcode)
+	  {
+	  case DW_LNS_copy:
+	    row = true;
+	    break;
+
+	  case DW_LNS_advance_pc:
+	    addr += dwarf_uleb (d) * min_length;
+	    break;
+
+	  case DW_LNS_advance_line:
+	    line += dwarf_sleb (d);
+	    break;
+
+	  case DW_LNS_set_file:
+	    file = dwarf_uleb (d);
+	    break;
+
+	  case DW_LNS_const_add_pc:
+	    addr += ((255 - opcode_base) / line_range) * min_length;
+	    break;
+
+	  case DW_LNS_fixed_advance_pc:
+	    addr += dwarf_uint (d, 2);
+	    break;
+
+	  default:
+	    /* Skip the operands of the other opcodes */
+	    for (unsigned i = 0; i < lengths[opcode]; i++)
+	      dwarf_uleb (d);
+	    break;
+	  }
+
+      if (row && !lreader_add_row (lr, addr,
+				   (file + files < exec->files_count)
+				       ? file + files
+				       : SIZE_MAX,
+				   (file + files < exec->files_count) ? line
+								      : 0))
+	return false;
+    }
+
+  /* Drop a sequence left unterminated */
+  lr->count = sequence;
+
+  return true;
+}
+
+/* Rows are sorted by address, ends of sequence before the rows starting a
+ * sequence at the same address, then in the order of the line programs */
+static int
+lrow_compare (const void *a, const void *b)
+{
+  const lrow_t *r1 = a, *r2 = b;
+  if (r1->row.addr != r2->row.addr)
+    return (r1->row.addr > r2->row.addr) - (r1->row.addr < r2->row.addr);
+  if ((r1->row.line != 0) != (r2->row.line != 0))
+    return (r1->row.line != 0) - (r2->row.line != 0);
+  return (r1->order > r2->order) - (r1->order < r2->order);
+}
+
+/* Read the line table from .debug_line (units that cannot be understood
+ * are skipped), returns 0 on success and -1 on error */
+static int
+read_lines (executable_t *exec)
+{
+  size_t size;
+  const uint8_t *debug_line =
+      executable_section_by_name (exec, ".debug_line", NULL, &size);
+  if (debug_line == NULL)
+    return 0;
+
+  lreader_t lr = {.exec = exec};
+  lr.str = executable_section_by_name (exec, ".debug_str", NULL,
+				       &lr.str_size);
+  lr.line_str = executable_section_by_name (exec, ".debug_line_str", NULL,
+					    &lr.line_str_size);
+
+  dwarf_t d = {.ptr = debug_line, .end = debug_line + size};
+  while (d.ptr < d.end && !d.error)
+    {
+      uint64_t length = dwarf_uint (&d, 4);
+      bool dwarf64 = (length == 0xffffffff);
+      if (dwarf64)
+	length = dwarf_uint (&d, 8);
+      if (d.error || length > (uint64_t) (d.end - d.ptr))
+	break;
+
+      dwarf_t unit = {.ptr = d.ptr, .end = d.ptr + length};
+      d.ptr += length;
+
+      size_t files = exec->files_count, rows = lr.count;
+      if (!read_line_unit (&lr, &unit, dwarf64))
+	{
+	  if (errno == ENOMEM)
+	    {
+	      free (lr.rows);
+	      return -1;
+	    }
+	  exec->files_count = files;
+	  lr.count = rows;
+	}
+    }
+
+  /* Keep the last row of each address */
+  qsort (lr.rows, lr.count, sizeof (lrow_t), lrow_compare);
+  exec->lines = malloc ((lr.count ? lr.count : 1) * sizeof (line_t));
+  if (exec->lines == NULL)
+    {
+      free (lr.rows);
+      return -1;
+    }
+
+  for (size_t i = 0; i < lr.count; i++)
+    {
+      if (i + 1 < lr.count && lr.rows[i + 1].row.addr == lr.rows[i].row.addr)
+	continue;
+      exec->lines[exec->lines_count++] = lr.rows[i].row;
+    }
+  free (lr.rows);
+
+  return 0;
+}
+
+size_t
+executable_lines (executable_t *exec)
+{
+  if (exec == NULL)
+    return 0;
+
+  /* Read on first use, once for all the threads */
+  if (!atomic_load_explicit (&exec->lines_read, memory_order_acquire))
+    {
+      pthread_mutex_lock (&exec->lines_lock);
+      if (!atomic_load_explicit (&exec->lines_read, memory_order_relaxed))
+	{
+	  errno = 0;
+	  if (read_lines (exec) == -1)
+	    {
+	      free (exec->lines);
+	      exec->lines = NULL;
+	      exec->lines_count = 0;
+	    }
+	  atomic_store_explicit (&exec->lines_read, true,
+				 memory_order_release);
+	}
+      pthread_mutex_unlock (&exec->lines_lock);
+    }
+
+  return exec->lines_count;
+}
+
+/* Get the line of the row covering addr (at rank - 1), 0 if none */
+static size_t
+line_get (executable_t *exec, const size_t rank, const char **file)
+{
+  if (rank == 0 || exec->lines[rank - 1].line == 0 ||
+      exec->lines[rank - 1].file >= exec->files_count)
+    return 0;
+
+  if (file != NULL)
+    *file = exec->files[exec->lines[rank - 1].file];
+
+  return exec->lines[rank - 1].line;
+}
+
+size_t
+executable_get_line_by_addr (executable_t *exec, uintptr_t addr,
+			     const char **file)
+{
+  if (executable_lines (exec) == 0)
+    return 0;
+
+  /* Number of rows starting at or before addr */
+  size_t low = 0, high = exec->lines_count;
+  while (low < high)
+    {
+      size_t mid = low + (high - low) / 2;
+      if (exec->lines[mid].addr <= addr)
+	low = mid + 1;
+      else
+	high = mid;
+    }
+
+  return line_get (exec, low, file);
+}
+
+size_t
+executable_get_lines_by_addr (executable_t *exec, const uintptr_t *addrs,
+			      const size_t count, const char **files,
+			      size_t *lines)
+{
+  if (count > 0 && (addrs == NULL || lines == NULL))
+    return 0;
+
+  for (size_t i = 0; i < count; i++)
+    lines[i] = 0;
+  if (executable_lines (exec) == 0)
+    return 0;
+
+  /* Merge the sorted addresses with the sorted rows */
+  size_t found = 0, rank = 0;
+  for (size_t i = 0; i < count; i++)
+    {
+      while (rank < exec->lines_count && exec->lines[rank].addr <= addrs[i])
+	rank++;
+
+      lines[i] = line_get (exec, rank, (files != NULL) ? &files[i] : NULL);
+      found += (lines[i] != 0);
+    }
+
+  return found;
+}
+
+/* **********[ Demangled Names ]********** */
+
+#ifdef HAVE_CXA_DEMANGLE
+/* C++ ABI demangler (from the C++ runtime) */
+extern char *__cxa_demangle (const char *mangled, char *buffer,
+			     size_t *length, int *status);
+
+/* Copy the string to the arena, returns NULL on error */
+static const char *
+arena_copy (executable_t *exec, const char *str)
+{
+  size_t size = strlen (str) + 1;
+  arena_block_t *block = exec->arena;
+
+  if (block == NULL || block->size - block->used < size)
+    {
+      size_t n = (size > ARENA_BLOCK_SIZE) ? size : ARENA_BLOCK_SIZE;
+      block = malloc (sizeof (arena_block_t) + n);
+      if (block == NULL)
+	return NULL;
+      *block = (arena_block_t){.next = exec->arena, .used = 0, .size = n};
+      exec->arena = block;
+    }
+
+  char *copy = block->data + block->used;
+  memcpy (copy, str, size);
+  block->used += size;
+
+  return copy;
+}
+#endif
+
+/* Get the demangled form of the index-th name of the cache (symbols then
+ * imports), demangled on first use */
+static const char *
+demangled_name (executable_t *exec, const size_t index, const char *name)
+{
+  const char *demangled =
+      atomic_load_explicit (&exec->names[index], memory_order_acquire);
+  if (demangled != NULL)
+    return demangled;
+
+  pthread_mutex_lock (&exec->names_lock);
+  demangled = atomic_load_explicit (&exec->names[index], memory_order_relaxed);
+  if (demangled == NULL)
+    {
+      /* Names which are not mangled C++ names are kept as they are */
+      demangled = name;
+#ifdef HAVE_CXA_DEMANGLE
+      int status = -1;
+      char *str = (strncmp (name, "_Z", 2) == 0)
+		      ? __cxa_demangle (name, NULL, NULL, &status)
+		      : NULL;
+      const char *copy =
+	  (status == 0 && str != NULL) ? arena_copy (exec, str) : NULL;
+      if (copy != NULL)
+	demangled = copy;
+      free (str);
+#endif
+      atomic_store_explicit (&exec->names[index], demangled,
+			     memory_order_release);
+    }
+  pthread_mutex_unlock (&exec->names_lock);
+
+  return demangled;
+}
+
+const char *
+executable_get_demangled_symbol_by_addr (executable_t *exec, uintptr_t addr)
+{
+  if (exec == NULL)
+    return NULL;
+
+  size_t rank = symbol_find (exec, addr);
+  if (rank == 0)
+    return NULL;
+
+  return demangled_name (exec, rank - 1,
+			 (const char *) exec->image +
+			     exec->symbols[rank - 1].name);
+}
+
+const char *
+executable_get_demangled_import_by_addr (executable_t *exec, uintptr_t addr)
+{
+  if (exec == NULL)
+    return NULL;
+
+  size_t rank = import_find (exec, addr);
+  if (rank == 0)
+    return NULL;
+
+  /* The names of the imports follow the ones of the symbols */
+  symbols_index (exec);
+  if (exec->names == NULL)
+    return NULL;
+
+  return demangled_name (exec, exec->symbols_count + rank - 1,
+			 (const char *) exec->image +
+			     exec->imports[rank - 1].name);
 }
@@ -0,0 +1,464 @@
+/*
+ * tracker is an analyzer for binary executable files
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019-2020 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#include "exports.h"
+#include "writers.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* **********[ CFG Exports ]********** */
+
+static const char *type2str[3] = {"single", "branch", "dynjump"};
+
+int
+format_from_filename (const char *filename)
+{
+  const char *ext = (filename != NULL) ? strrchr (filename, '.') : NULL;
+  if (ext == NULL)
+    return -1;
+
+  if (!strcmp (ext, ".dot") || !strcmp (ext, ".gv"))
+    return dot_format;
+  if (!strcmp (ext, ".graphml"))
+    return graphml_format;
+  if (!strcmp (ext, ".json"))
+    return json_format;
+
+  return -1;
+}
+
+static void
+export_node (writer_t *const w, cfg_t *const cfg, const format_t format,
+	     const size_t node, const bool first)
+{
+  uintptr_t addr = instr_addr (cfg_node_instr (cfg, node));
+  node_t type = cfg_node_type (cfg, node);
+
+  switch (format)
+    {
+    case dot_format:
+      writer_str (w, "  n");
+      writer_dec (w, node);
+      writer_str (w, " [label=\"");
+      writer_hex (w, addr);
+      writer_str (w, "\\n");
+      writer_dec (w, cfg_node_hits (cfg, node));
+      writer_str (w, (type == branch)	? " hits\", shape=diamond];\n"
+		  : (type == dynjump) ? " hits\", shape=hexagon];\n"
+				      : " hits\"];\n");
+      break;
+
+    case graphml_format:
+      writer_str (w, "    <node id=\"n");
+      writer_dec (w, node);
+      writer_str (w, "\"><data key=\"address\">");
+      writer_hex (w, addr);
+      writer_str (w, "</data><data key=\"type\">");
+      writer_str (w, type2str[type]);
+      writer_str (w, "</data><data key=\"nhits\">");
+      writer_dec (w, cfg_node_hits (cfg, node));
+      writer_str (w, "</data></node>\n");
+      break;
+
+    case json_format:
+      writer_str (w, first ? "\n{\"id\":" : ",\n{\"id\":");
+      writer_dec (w, node);
+      writer_str (w, ",\"address\":\"");
+      writer_hex (w, addr);
+      writer_str (w, "\",\"type\":\"");
+      writer_str (w, type2str[type]);
+      writer_str (w, "\",\"hits\":");
+      writer_dec (w, cfg_node_hits (cfg, node));
+      writer_str (w, "}");
+      break;
+    }
+}
+
+static void
+export_edge (writer_t *const w, cfg_t *const cfg, const format_t format,
+	     const size_t edge, const bool first)
+{
+  size_t src = cfg_edge_src (cfg, edge), dst = cfg_edge_dst (cfg, edge);
+
+  switch (format)
+    {
+    case dot_format:
+      writer_str (w, "  n");
+      writer_dec (w, src);
+      writer_str (w, " -> n");
+      writer_dec (w, dst);
+      writer_str (w, " [label=\"");
+      writer_dec (w, cfg_edge_hits (cfg, edge));
+      writer_str (w, "\"];\n");
+      break;
+
+    case graphml_format:
+      writer_str (w, "    <edge source=\"n");
+      writer_dec (w, src);
+      writer_str (w, "\" target=\"n");
+      writer_dec (w, dst);
+      writer_str (w, "\"><data key=\"ehits\">");
+      writer_dec (w, cfg_edge_hits (cfg, edge));
+      writer_str (w, "</data></edge>\n");
+      break;
+
+    case json_format:
+      writer_str (w, first ? "\n{\"source\":" : ",\n{\"source\":");
+      writer_dec (w, src);
+      writer_str (w, ",\"target\":");
+      writer_dec (w, dst);
+      writer_str (w, ",\"hits\":");
+      writer_dec (w, cfg_edge_hits (cfg, edge));
+      writer_str (w, "}");
+      break;
+    }
+}
+
+static const char *headers[3] = {
+    "digraph cfg {\n"
+    "  node [shape=box, fontname=\"monospace\"];\n",
+
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    "<graphml xmlns=\"http://graphml.graphdrawing.org/xmlns\">\n"
+    "  <key id=\"address\" for=\"node\" attr.name=\"address\" "
+    "attr.type=\"string\"/>\n"
+    "  <key id=\"type\" for=\"node\" attr.name=\"type\" "
+    "attr.type=\"string\"/>\n"
+    "  <key id=\"nhits\" for=\"node\" attr.name=\"hits\" "
+    "attr.type=\"long\"/>\n"
+    "  <key id=\"ehits\" for=\"edge\" attr.name=\"hits\" "
+    "attr.type=\"long\"/>\n"
+    "  <graph id=\"cfg\" edgedefault=\"directed\">\n",
+
+    "{\"nodes\":["};
+
+static const char *separators[3] = {"", "", "\n],\n\"edges\":["};
+
+static const char *footers[3] = {"}\n", "  </graph>\n</graphml>\n", "\n]}\n"};
+
+int
+cfg_export (cfg_t *const cfg, FILE *fd, const format_t format,
+	    const filter_t *const filter)
+{
+  if (cfg == NULL || fd == NULL || format > json_format)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+  size_t nodes = cfg_nodes (cfg), edges = cfg_edges (cfg);
+  writer_t *w = writer_new (fd, false);
+  uint8_t *kept = NULL;
+  if (w == NULL)
+    return -1;
+
+  /* Selected nodes (one byte per node, only when filtering) */
+  if (filter != NULL)
+    {
+      kept = malloc (nodes ? nodes : 1);
+      if (kept == NULL)
+	{
+	  writer_delete (w);
+	  return -1;
+	}
+
+      for (size_t node = 0; node < nodes; node++)
+	{
+	  uintptr_t addr = instr_addr (cfg_node_instr (cfg, node));
+	  kept[node] = addr >= filter->start &&
+		       (filter->end == 0 || addr < filter->end) &&
+		       (filter->keep == NULL ||
+			filter->keep (cfg, node, filter->data));
+	}
+    }
+
+  bool first = true;
+  writer_str (w, headers[format]);
+  for (size_t node = 0; node < nodes; node++)
+    if (kept == NULL || kept[node])
+      {
+	export_node (w, cfg, format, node, first);
+	first = false;
+      }
+
+  first = true;
+  writer_str (w, separators[format]);
+  for (size_t edge = 0; edge < edges; edge++)
+    if (kept == NULL || (kept[cfg_edge_src (cfg, edge)] &&
+			 kept[cfg_edge_dst (cfg, edge)]))
+      {
+	export_edge (w, cfg, format, edge, first);
+	first = false;
+      }
+
+  writer_str (w, footers[format]);
+  int ret = writer_delete (w);
+
+  free (kept);
+
+  return ret;
+}
+
+/* **********[ Coverage Frontier ]********** */
+
+typedef struct
+{
+  size_t node; /* Frontier node */
+  size_t hits; /* Number of times it was reached */
+} frontier_t;
+
+static int
+frontier_compare (const void *a, const void *b)
+{
+  const frontier_t *f1 = a, *f2 = b;
+  if (f1->hits != f2->hits)
+    return (f1->hits < f2->hits) - (f1->hits > f2->hits);
+  return (f1->node > f2->node) - (f1->node < f2->node);
+}
+
+int
+cfg_export_frontier (cfg_t *const cfg, FILE *fd)
+{
+  if (cfg == NULL || fd == NULL)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+  /* Collect the frontier in one pass over the nodes */
+  size_t nodes = cfg_nodes (cfg), count = 0;
+  frontier_t *frontier = malloc ((nodes ? nodes : 1) * sizeof (frontier_t));
+  writer_t *w = writer_new (fd, false);
+  if (frontier == NULL || w == NULL)
+    {
+      free (frontier);
+      writer_delete (w);
+      return -1;
+    }
+  for (size_t node = 0; node < nodes; node++)
+    {
+      node_t type = cfg_node_type (cfg, node);
+      if (type == dynjump ||
+	  (type == branch && cfg_node_degree (cfg, node) == 1))
+	frontier[count++] =
+	    (frontier_t){.node = node, .hits = cfg_node_hits (cfg, node)};
+    }
+
+  qsort (frontier, count, sizeof (frontier_t), frontier_compare);
+
+  writer_str (w, "[");
+  for (size_t i = 0; i < count; i++)
+    {
+      size_t node = frontier[i].node;
+      instr_t *instr = cfg_node_instr (cfg, node);
+      uintptr_t addr = instr_addr (instr);
+
+      writer_str (w, i ? ",\n{\"address\":\"" : "\n{\"address\":\"");
+      writer_hex (w, addr);
+      writer_str (w, "\",\"hits\":");
+      writer_dec (w, frontier[i].hits);
+
+      if (cfg_node_type (cfg, node) == branch)
+	{
+	  /* Tell which side of the branch is missing */
+	  size_t edge = cfg_node_edge (cfg, node, 0);
+	  uintptr_t taken = instr_addr (
+	      cfg_node_instr (cfg, cfg_edge_dst (cfg, edge)));
+
+	  writer_str (w, ",\"type\":\"branch\",\"taken\":\"");
+	  writer_hex (w, taken);
+	  writer_str (w, (taken == addr + instr_size (instr))
+			  ? "\",\"missing\":\"jump\"}"
+			  : "\",\"missing\":\"fallthrough\"}");
+	}
+      else
+	{
+	  writer_str (w, ",\"type\":\"dynjump\",\"targets\":");
+	  writer_dec (w, cfg_node_degree (cfg, node));
+	  writer_str (w, ",\"stable_hits\":");
+	  writer_dec (w, cfg_node_stable_hits (cfg, node));
+	  writer_str (w, "}");
+	}
+    }
+  writer_str (w, "\n]\n");
+  int ret = writer_delete (w);
+
+  free (frontier);
+
+  return ret;
+}
+
+/* **********[ Call Graph Exports ]********** */
+
+static int
+size_compare (const void *a, const void *b)
+{
+  const size_t *s1 = a, *s2 = b;
+  return (*s1 > *s2) - (*s1 < *s2);
+}
+
+static const char *cg_headers[3] = {
+    "digraph callgraph {\n"
+    "  node [shape=box, fontname=\"monospace\"];\n",
+
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    "<graphml xmlns=\"http://graphml.graphdrawing.org/xmlns\">\n"
+    "  <key id=\"address\" for=\"node\" attr.name=\"address\" "
+    "attr.type=\"string\"/>\n"
+    "  <key id=\"calls\" for=\"edge\" attr.name=\"calls\" "
+    "attr.type=\"long\"/>\n"
+    "  <graph id=\"callgraph\" edgedefault=\"directed\">\n",
+
+    "{\"functions\":["};
+
+static const char *cg_separators[3] = {"", "", "\n],\n\"calls\":["};
+
+static const char *cg_footers[3] = {"}\n", "  </graph>\n</graphml>\n", ""};
+
+int
+callgraph_export (callgraph_t *const cg, cfg_t *const cfg, FILE *fd,
+		  const format_t format)
+{
+  if (cg == NULL || cfg == NULL || fd == NULL || format > json_format)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+  /* Functions are the root and the ends of the edges (sorted, unique) */
+  size_t edges = callgraph_edges (cg), count = 0;
+  size_t *functions = malloc ((2 * edges + 1) * sizeof (size_t));
+  writer_t *w = writer_new (fd, false);
+  if (functions == NULL || w == NULL)
+    {
+      free (functions);
+      writer_delete (w);
+      return -1;
+    }
+  functions[count++] = 0;
+  for (size_t edge = 0; edge < edges; edge++)
+    {
+      functions[count++] = callgraph_edge_caller (cg, edge);
+      functions[count++] = callgraph_edge_callee (cg, edge);
+    }
+  qsort (functions, count, sizeof (size_t), size_compare);
+
+  writer_str (w, cg_headers[format]);
+  for (size_t i = 0; i < count; i++)
+    {
+      if (i > 0 && functions[i] == functions[i - 1])
+	continue;
+
+      size_t f = functions[i];
+      uintptr_t addr = instr_addr (cfg_node_instr (cfg, f));
+      switch (format)
+	{
+	case dot_format:
+	  writer_str (w, "  f");
+	  writer_dec (w, f);
+	  writer_str (w, " [label=\"");
+	  writer_hex (w, addr);
+	  writer_str (w, "\"];\n");
+	  break;
+
+	case graphml_format:
+	  writer_str (w, "    <node id=\"f");
+	  writer_dec (w, f);
+	  writer_str (w, "\"><data key=\"address\">");
+	  writer_hex (w, addr);
+	  writer_str (w, "</data></node>\n");
+	  break;
+
+	case json_format:
+	  writer_str (w, i ? ",\n{\"id\":" : "\n{\"id\":");
+	  writer_dec (w, f);
+	  writer_str (w, ",\"address\":\"");
+	  writer_hex (w, addr);
+	  writer_str (w, "\"}");
+	  break;
+	}
+    }
+
+  writer_str (w, cg_separators[format]);
+  for (size_t edge = 0; edge < edges; edge++)
+    {
+      size_t caller = callgraph_edge_caller (cg, edge);
+      size_t callee = callgraph_edge_callee (cg, edge);
+      size_t calls = callgraph_edge_calls (cg, edge);
+      switch (format)
+	{
+	case dot_format:
+	  writer_str (w, "  f");
+	  writer_dec (w, caller);
+	  writer_str (w, " -> f");
+	  writer_dec (w, callee);
+	  writer_str (w, " [label=\"");
+	  writer_dec (w, calls);
+	  writer_str (w, "\"];\n");
+	  break;
+
+	case graphml_format:
+	  writer_str (w, "    <edge source=\"f");
+	  writer_dec (w, caller);
+	  writer_str (w, "\" target=\"f");
+	  writer_dec (w, callee);
+	  writer_str (w, "\"><data key=\"calls\">");
+	  writer_dec (w, calls);
+	  writer_str (w, "</data></edge>\n");
+	  break;
+
+	case json_format:
+	  writer_str (w, edge ? ",\n{\"caller\":" : "\n{\"caller\":");
+	  writer_dec (w, caller);
+	  writer_str (w, ",\"callee\":");
+	  writer_dec (w, callee);
+	  writer_str (w, ",\"calls\":");
+	  writer_dec (w, calls);
+	  writer_str (w, "}");
+	  break;
+	}
+    }
+
+  /* Only JSON can hold the calling-context tree along the call graph */
+  if (format == json_format)
+    {
+      size_t contexts = callgraph_contexts (cg);
+
+      writer_str (w, "\n],\n\"contexts\":[");
+      for (size_t c = 0; c < contexts; c++)
+	{
+	  size_t parent = callgraph_context_parent (cg, c);
+
+	  writer_str (w, c ? ",\n{\"id\":" : "\n{\"id\":");
+	  writer_dec (w, c);
+	  writer_str (w, ",\"parent\":");
+	  if (parent == CFG_NONE)
+	    writer_str (w, "null");
+	  else
+	    writer_dec (w, parent);
+	  writer_str (w, ",\"function\":");
+	  writer_dec (w, callgraph_context_function (cg, c));
+	  writer_str (w, ",\"calls\":");
+	  writer_dec (w, callgraph_context_calls (cg, c));
+	  writer_str (w, "}");
+	}
+      writer_str (w, "\n]}\n");
+    }
+
+  writer_str (w, cg_footers[format]);
+  int ret = writer_delete (w);
+
+  free (functions);
+
+  return ret;
+}
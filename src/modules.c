@@ -0,0 +1,496 @@
+/*
+ * tracker is an analyzer for binary executable files
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019-2020 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "modules.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Module of the process */
+typedef struct
+{
+  char *name;	      /* Path of the file (or name of the region) */
+  uintptr_t base;     /* Address of the file offset 0 */
+  bool loaded;	      /* The executable has been looked for */
+  executable_t *exec; /* Executable of the module (NULL if none) */
+} module_t;
+
+/* Mapping of a module */
+typedef struct
+{
+  uintptr_t start; /* First address */
+  uintptr_t end;   /* Last address (excluded) */
+  size_t module;   /* Module mapped */
+} mapping_t;
+
+struct _modules_t
+{
+  pid_t pid;		 /* Process */
+  size_t modules_count;	 /* Number of modules */
+  size_t modules_size;	 /* Allocated size of modules */
+  module_t *modules;	 /* Modules (in order of appearance) */
+  size_t mappings_count; /* Number of mappings */
+  size_t mappings_size;	 /* Allocated size of mappings */
+  mapping_t *mappings;	 /* Current mappings (sorted by address) */
+  size_t last_hit;	 /* Mapping of the last address found */
+};
+
+/* Find the module (name, base) or add it, returns MODULE_NONE on error */
+static size_t
+module_get (modules_t *const modules, const char *name, const uintptr_t base)
+{
+  for (size_t i = modules->modules_count; i > 0; i--)
+    if (modules->modules[i - 1].base == base &&
+	strcmp (modules->modules[i - 1].name, name) == 0)
+      return i - 1;
+
+  if (modules->modules_count == modules->modules_size)
+    {
+      module_t *grown = realloc (modules->modules, 2 * modules->modules_size *
+						       sizeof (module_t));
+      if (grown == NULL)
+	return MODULE_NONE;
+      modules->modules = grown;
+      modules->modules_size *= 2;
+    }
+
+  char *copy = strdup (name);
+  if (copy == NULL)
+    return MODULE_NONE;
+
+  modules->modules[modules->modules_count] =
+      (module_t){.name = copy, .base = base, .loaded = false, .exec = NULL};
+
+  return modules->modules_count++;
+}
+
+/* Parse a line of /proc/pid/maps and add its mapping (anonymous mappings
+ * are skipped), returns 0 on success and -1 on error */
+static int
+mapping_add (modules_t *const modules, char *line)
+{
+  uintptr_t start, end, offset;
+  int path = 0;
+  if (sscanf (line,
+	      "%" SCNxPTR "-%" SCNxPTR " %*s %" SCNxPTR " %*s %*s %n",
+	      &start, &end, &offset, &path) != 3 ||
+      path == 0 || line[path] == '\0' || line[path] == '\n')
+    return 0;
+
+  char *name = line + path;
+  name[strcspn (name, "\n")] = '\0';
+
+  /* The segments of a file are mapped next to each other but not at a
+   * constant distance of their offset, they belong to the module of the
+   * previous mapping of the file */
+  uintptr_t base = start - offset;
+  if (offset != 0 && modules->mappings_count > 0)
+    {
+      size_t previous = modules->mappings[modules->mappings_count - 1].module;
+      if (strcmp (modules->modules[previous].name, name) == 0)
+	base = modules->modules[previous].base;
+    }
+
+  size_t module = module_get (modules, name, base);
+  if (module == MODULE_NONE)
+    return -1;
+
+  if (modules->mappings_count == modules->mappings_size)
+    {
+      mapping_t *grown =
+	  realloc (modules->mappings,
+		   2 * modules->mappings_size * sizeof (mapping_t));
+      if (grown == NULL)
+	return -1;
+      modules->mappings = grown;
+      modules->mappings_size *= 2;
+    }
+
+  modules->mappings[modules->mappings_count++] =
+      (mapping_t){.start = start, .end = end, .module = module};
+
+  return 0;
+}
+
+modules_t *
+modules_new (const pid_t pid)
+{
+  modules_t *modules = calloc (1, sizeof (modules_t));
+  if (modules == NULL)
+    return NULL;
+
+  modules->pid = pid;
+  modules->modules_size = modules->mappings_size = 64;
+  modules->modules = malloc (modules->modules_size * sizeof (module_t));
+  modules->mappings = malloc (modules->mappings_size * sizeof (mapping_t));
+  if (modules->modules == NULL || modules->mappings == NULL ||
+      modules_update (modules) == -1)
+    {
+      modules_delete (modules);
+      return NULL;
+    }
+
+  return modules;
+}
+
+void
+modules_delete (modules_t *modules)
+{
+  if (modules == NULL)
+    return;
+
+  for (size_t i = 0; i < modules->modules_count; i++)
+    {
+      free (modules->modules[i].name);
+      executable_delete (modules->modules[i].exec);
+    }
+  free (modules->modules);
+  free (modules->mappings);
+  free (modules);
+}
+
+int
+modules_update (modules_t *const modules)
+{
+  if (modules == NULL)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+  char filename[64];
+  snprintf (filename, sizeof (filename), "/proc/%ld/maps",
+	    (long) modules->pid);
+
+  FILE *fd = fopen (filename, "re");
+  if (fd == NULL)
+    return -1;
+
+  /* The mappings are listed by increasing addresses */
+  char *line = NULL;
+  size_t size = 0;
+  int ret = 0;
+  modules->mappings_count = 0;
+  modules->last_hit = 0;
+  while (ret == 0 && getline (&line, &size, fd) != -1)
+    ret = mapping_add (modules, line);
+
+  free (line);
+  fclose (fd);
+
+  return ret;
+}
+
+size_t
+modules_count (modules_t *const modules)
+{
+  return (modules == NULL) ? 0 : modules->modules_count;
+}
+
+size_t
+modules_lookup (modules_t *const modules, const uintptr_t addr,
+		uintptr_t *offset)
+{
+  if (modules == NULL || modules->mappings_count == 0)
+    return MODULE_NONE;
+
+  /* Consecutive lookups usually fall in the same mapping */
+  mapping_t *mapping = &(modules->mappings[modules->last_hit]);
+  if (addr < mapping->start || addr >= mapping->end)
+    {
+      /* Last mapping starting at or below addr */
+      size_t low = 0, high = modules->mappings_count;
+      while (high - low > 1)
+	{
+	  size_t middle = low + (high - low) / 2;
+	  if (modules->mappings[middle].start <= addr)
+	    low = middle;
+	  else
+	    high = middle;
+	}
+
+      mapping = &(modules->mappings[low]);
+      if (addr < mapping->start || addr >= mapping->end)
+	return MODULE_NONE;
+      modules->last_hit = low;
+    }
+
+  if (offset != NULL)
+    *offset = addr - modules->modules[mapping->module].base;
+
+  return mapping->module;
+}
+
+const char *
+modules_name (modules_t *const modules, const size_t module)
+{
+  if (modules == NULL || module >= modules->modules_count)
+    {
+      errno = EINVAL;
+      return NULL;
+    }
+
+  return modules->modules[module].name;
+}
+
+uintptr_t
+modules_base (modules_t *const modules, const size_t module)
+{
+  if (modules == NULL || module >= modules->modules_count)
+    {
+      errno = EINVAL;
+      return 0;
+    }
+
+  return modules->modules[module].base;
+}
+
+executable_t *
+modules_executable (modules_t *const modules, const size_t module)
+{
+  if (modules == NULL || module >= modules->modules_count)
+    {
+      errno = EINVAL;
+      return NULL;
+    }
+
+  /* Regions which are not files (e.g. '[vdso]') have no executable */
+  module_t *m = &(modules->modules[module]);
+  if (!m->loaded && m->name[0] == '/')
+    m->exec = executable_new (m->name);
+  m->loaded = true;
+
+  return m->exec;
+}
+
+const char *
+modules_id (modules_t *const modules, const size_t module)
+{
+  executable_t *exec = modules_executable (modules, module);
+  if (exec == NULL)
+    return NULL;
+
+  return executable_id (exec);
+}
+
+uintptr_t
+modules_link_addr (modules_t *const modules, const uintptr_t addr,
+		   executable_t **exec)
+{
+  uintptr_t offset;
+  size_t module = modules_lookup (modules, addr, &offset);
+  executable_t *e = (module != MODULE_NONE)
+			? modules_executable (modules, module)
+			: NULL;
+  if (exec != NULL)
+    *exec = e;
+  if (e == NULL)
+    return 0;
+
+  return executable_base (e) + offset;
+}
+
+/* **********[ Module Coverage ]********** */
+
+/* A coverage file is a header followed by the records sorted by offset */
+
+#define COVERAGE_FILE_MAGIC "TRKCOV02"
+
+typedef struct
+{
+  char magic[8];   /* COVERAGE_FILE_MAGIC */
+  uint64_t layout; /* Sizes of the records (and byte order) */
+  uint64_t count;  /* Number of records */
+} coverage_file_t;
+
+/* Not a palindrome, so files of the other byte order are rejected too */
+static uint64_t
+coverage_file_layout (void)
+{
+  return sizeof (coverage_t) | sizeof (coverage_file_t) << 8 |
+	 (uint64_t) 0x54524b << 32;
+}
+
+ssize_t
+coverage_load (const char *filename, coverage_t **records)
+{
+  if (filename == NULL || records == NULL)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+  FILE *fd = fopen (filename, "rbe");
+  if (fd == NULL)
+    return -1;
+
+  coverage_file_t header;
+  if (fread (&header, sizeof (coverage_file_t), 1, fd) != 1 ||
+      memcmp (header.magic, COVERAGE_FILE_MAGIC, 8) ||
+      header.layout != coverage_file_layout () ||
+      header.count > SSIZE_MAX / sizeof (coverage_t))
+    {
+      fclose (fd);
+      errno = EINVAL;
+      return -1;
+    }
+
+  *records = malloc ((header.count ? header.count : 1) * sizeof (coverage_t));
+  if (*records == NULL)
+    {
+      fclose (fd);
+      return -1;
+    }
+
+  bool valid =
+      fread (*records, sizeof (coverage_t), header.count, fd) == header.count;
+  for (size_t i = 1; valid && i < header.count; i++)
+    valid = (*records)[i - 1].offset < (*records)[i].offset;
+  fclose (fd);
+
+  if (!valid)
+    {
+      free (*records);
+      *records = NULL;
+      errno = EINVAL;
+      return -1;
+    }
+
+  return header.count;
+}
+
+/* Merge the records into the coverage file, the caller holding its lock */
+static int
+coverage_merge_locked (const char *filename, const coverage_t *records,
+		       const size_t count)
+{
+  /* Records of the previous runs (none if the file is missing) */
+  coverage_t *old = NULL;
+  ssize_t old_count = coverage_load (filename, &old);
+  if (old_count == -1 && errno != ENOENT)
+    return -1;
+  if (old_count == -1)
+    old_count = 0;
+
+  /* Merge into a temporary file renamed over the previous one */
+  size_t size = strlen (filename) + 8;
+  char *tmp = malloc (size);
+  if (tmp == NULL)
+    {
+      free (old);
+      return -1;
+    }
+  snprintf (tmp, size, "%s.XXXXXX", filename);
+
+  int fdesc = mkstemp (tmp);
+  FILE *fd = (fdesc == -1) ? NULL : fdopen (fdesc, "wb");
+  if (fd == NULL)
+    {
+      if (fdesc != -1)
+	{
+	  close (fdesc);
+	  unlink (tmp);
+	}
+      free (tmp);
+      free (old);
+      return -1;
+    }
+
+  coverage_file_t header = {.magic = COVERAGE_FILE_MAGIC,
+			    .layout = coverage_file_layout (),
+			    .count = 0};
+  bool error = fwrite (&header, sizeof (coverage_file_t), 1, fd) != 1;
+
+  size_t i = 0, j = 0;
+  while (!error && (i < (size_t) old_count || j < count))
+    {
+      coverage_t record;
+      if (j == count ||
+	  (i < (size_t) old_count && old[i].offset < records[j].offset))
+	record = old[i++];
+      else if (i == (size_t) old_count || records[j].offset < old[i].offset)
+	record = records[j++];
+      else
+	{
+	  record = (coverage_t){old[i].offset, old[i].hits + records[j].hits};
+	  i++;
+	  j++;
+	}
+
+      error = fwrite (&record, sizeof (coverage_t), 1, fd) != 1;
+      header.count++;
+    }
+  free (old);
+
+  /* Write the number of records at last */
+  if (!error)
+    error = fseek (fd, 0, SEEK_SET) == -1 ||
+	    fwrite (&header, sizeof (coverage_file_t), 1, fd) != 1;
+
+  if (fclose (fd) == EOF || error || rename (tmp, filename) == -1)
+    {
+      int errsv = errno ? errno : EIO;
+      unlink (tmp);
+      free (tmp);
+      errno = errsv;
+      return -1;
+    }
+  free (tmp);
+
+  return 0;
+}
+
+int
+coverage_merge (const char *filename, const coverage_t *records,
+		const size_t count)
+{
+  if (filename == NULL || (records == NULL && count > 0))
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+  /* Concurrent runs are serialized by a lock on 'filename.lock' (the file
+   * itself is replaced by each merge, so it cannot be locked), otherwise
+   * the hits of all but the last rename would be lost */
+  size_t size = strlen (filename) + 6;
+  char *path = malloc (size);
+  if (path == NULL)
+    return -1;
+  snprintf (path, size, "%s.lock", filename);
+
+  int lock = open (path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  free (path);
+  if (lock == -1)
+    return -1;
+
+  struct flock fl = {.l_type = F_WRLCK, .l_whence = SEEK_SET};
+  int ret;
+  while ((ret = fcntl (lock, F_SETLKW, &fl)) == -1 && errno == EINTR)
+    ;
+  if (ret == 0)
+    ret = coverage_merge_locked (filename, records, count);
+
+  /* Closing the file releases the lock */
+  int errsv = errno;
+  close (lock);
+  errno = errsv;
+
+  return ret;
+}
@@ -9,21 +9,30 @@
  * This software is released under a 3-clause BSD license (see COPYING file).
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "traces.h"
 
 #include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
-/* **********[ Instruction Data-structure ]********** */
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-typedef enum { INSTR, BRANCH, CALL, JMP } instr_type_t;
+/* **********[ Instruction Data-structure ]********** */
 
 struct _instr_t
 {
-  uintptr_t address; /* Address where lies the instruction */
-  instr_type_t type; /* Instruction type */
-  uint8_t size;	     /* Opcode size */
-  uint8_t opcodes[]; /* Instruction opcode */
+  uintptr_t address;   /* Address where lies the instruction */
+  instr_type_t type;   /* Instruction type */
+  uint8_t size;	       /* Opcode size */
+  uint16_t generation; /* Version of the code at address */
+  uint8_t opcodes[];   /* Instruction opcode */
 };
 
 instr_t *
@@ -42,7 +51,9 @@ instr_new (const uintptr_t addr, const uint8_t size,
     return NULL;
 
   instr->address = addr;
+  instr->type = INSTR;
   instr->size = size;
+  instr->generation = 0;
   memcpy (instr->opcodes, opcodes, size);
 
   return instr;
@@ -72,6 +83,30 @@ instr_opcodes (instr_t *const instr)
   return instr->opcodes;
 }
 
+instr_type_t
+instr_type (instr_t *const instr)
+{
+  return instr->type;
+}
+
+void
+instr_set_type (instr_t *const instr, const instr_type_t type)
+{
+  instr->type = type;
+}
+
+uint16_t
+instr_generation (instr_t *const instr)
+{
+  return instr->generation;
+}
+
+void
+instr_set_generation (instr_t *const instr, const uint16_t generation)
+{
+  instr->generation = generation;
+}
+
 /* **********[ Hashtable Data-structure ]********** */
 
 struct _hashtable_t
@@ -140,10 +175,28 @@ fasthash64 (const uint8_t *buf, size_t len, uint64_t seed)
   return mix (h);
 }
 
+/* Instructions are hashed on their address and generation only, so that
+ * the one standing at a given version of the code is found without knowing
+ * its opcodes */
+static hash_t
+hash_key (const uintptr_t addr, const uint16_t generation)
+{
+  uint64_t key = addr;
+  return fasthash64 ((const uint8_t *) &key, sizeof (key), generation);
+}
+
 hash_t
 hash_instr (const instr_t *instr)
 {
-  return fasthash64 (instr->opcodes, instr->size, instr->address);
+  return hash_key (instr->address, instr->generation);
+}
+
+/* Returns true if both instructions are the same version of the code */
+static bool
+instr_equal (const instr_t *const i1, const instr_t *const i2)
+{
+  return i1->address == i2->address && i1->generation == i2->generation &&
+	 i1->size == i2->size && !memcmp (i1->opcodes, i2->opcodes, i1->size);
 }
 
 hashtable_t *
@@ -217,10 +270,7 @@ hashtable_insert (hashtable_t *const ht, instr_t *const instr)
   instr_t **bucket_instr = ht->buckets[index];
   while (bucket_instr[k] != NULL)
     {
-      if (bucket_instr[k]->address == instr->address &&
-	  bucket_instr[k]->size == instr->size &&
-	  !strncmp ((const char *) bucket_instr[k]->opcodes,
-		    (const char *) instr->opcodes, instr->size))
+      if (instr_equal (bucket_instr[k], instr))
 	return false;
       k++;
     }
@@ -241,33 +291,58 @@ hashtable_insert (hashtable_t *const ht, instr_t *const instr)
 
 bool
 hashtable_lookup (hashtable_t *const ht, instr_t *const instr)
+{
+  return hashtable_get (ht, instr) != NULL;
+}
+
+instr_t *
+hashtable_get (hashtable_t *const ht, instr_t *const instr)
 {
   if (ht == NULL || instr == NULL)
     {
       errno = EINVAL;
-      return false;
+      return NULL;
     }
 
   size_t index = hash_instr (instr) % ht->size;
 
   /* Bucket is empty */
   if (ht->buckets[index] == NULL)
-    return false;
+    return NULL;
 
   /* Bucket is not empty, scanning all entries to see if instr is here */
   size_t k = 0;
   instr_t **bucket_instr = ht->buckets[index];
   while (bucket_instr[k] != NULL)
     {
-      if (bucket_instr[k]->address == instr->address &&
-	  bucket_instr[k]->size == instr->size &&
-	  !strncmp ((const char *) bucket_instr[k]->opcodes,
-		    (const char *) instr->opcodes, instr->size))
-	return true;
+      if (instr_equal (bucket_instr[k], instr))
+	return bucket_instr[k];
       k++;
     }
 
-  return false;
+  return NULL;
+}
+
+instr_t *
+hashtable_find (hashtable_t *const ht, const uintptr_t addr,
+		const uint16_t generation)
+{
+  if (ht == NULL)
+    {
+      errno = EINVAL;
+      return NULL;
+    }
+
+  instr_t **bucket_instr = ht->buckets[hash_key (addr, generation) % ht->size];
+  if (bucket_instr == NULL)
+    return NULL;
+
+  for (size_t k = 0; bucket_instr[k] != NULL; k++)
+    if (bucket_instr[k]->address == addr &&
+	bucket_instr[k]->generation == generation)
+      return bucket_instr[k];
+
+  return NULL;
 }
 
 size_t
@@ -441,3 +516,1686 @@ trace_compare (trace_t *const t1, trace_t *const t2)
 
   return count;
 }
+
+/* **********[ Control-flow Graph Data-structure ]********** */
+
+/* Number of outgoing edges stored inside the node itself */
+#define CFG_INLINE_EDGES 2
+
+/* Degree from which outgoing edges are also indexed in a hash set */
+#define CFG_HASHED_EDGES 8
+
+/* Initial number of nodes and edges allocated for a CFG */
+#define CFG_INITIAL_SIZE 1024
+
+typedef struct
+{
+  size_t src;  /* Index of the source node */
+  size_t dst;  /* Index of the destination node */
+  size_t hits; /* Number of times the edge has been taken */
+} cfg_edge_t;
+
+/* Open addressing hash set of the outgoing edges of a node (on targets) */
+typedef struct
+{
+  size_t size;	  /* Number of slots (power of two) */
+  size_t slots[]; /* Edge index in each slot (CFG_NONE if empty) */
+} cfg_targets_t;
+
+typedef struct
+{
+  instr_t *instr;		/* Instruction of the node */
+  node_t type;			/* Node type (single, branch or dynjump) */
+  size_t hits;			/* Number of times the node was reached */
+  size_t degree;		/* Number of outgoing edges */
+  size_t out[CFG_INLINE_EDGES]; /* First outgoing edges (edge indexes) */
+  size_t *more;			/* Remaining outgoing edges (if any) */
+  cfg_targets_t *targets;	/* Outgoing edges set (for large degrees) */
+  size_t last_target;		/* Hits when the last target was found */
+} cfg_node_t;
+
+typedef struct
+{
+  uintptr_t address; /* Address of the instruction (to skip derefs) */
+  size_t node;	     /* Node holding the instruction (CFG_NONE if empty) */
+} cfg_slot_t;
+
+/* Records of a CFG file (see cfg_save()), indexes are stored on 64 bits
+ * (CFG_NONE as UINT64_MAX) and pointers as offsets from the file start */
+typedef struct
+{
+  uint64_t instr;		  /* Offset of the instruction */
+  uint64_t type;		  /* Node type */
+  uint64_t hits;		  /* Number of times the node was reached */
+  uint64_t degree;		  /* Number of outgoing edges */
+  uint64_t out[CFG_INLINE_EDGES]; /* First outgoing edges */
+  uint64_t more;		  /* Offset of the other edges (0 if none) */
+  uint64_t targets;		  /* Offset of the targets set (0 if none) */
+  uint64_t last_target;		  /* Hits when the last target was found */
+} cfg_file_node_t;
+
+typedef struct
+{
+  uint64_t src;	 /* Index of the source node */
+  uint64_t dst;	 /* Index of the destination node */
+  uint64_t hits; /* Number of times the edge has been taken */
+} cfg_file_edge_t;
+
+typedef struct
+{
+  uint64_t address; /* Address of the instruction */
+  uint64_t node;    /* Node holding the instruction (UINT64_MAX if empty) */
+} cfg_file_slot_t;
+
+struct _cfg_t
+{
+  size_t nodes_count; /* Number of nodes */
+  size_t nodes_size;  /* Allocated size of the nodes array */
+  cfg_node_t *nodes;  /* Nodes, indexed by their identifier */
+  size_t edges_count; /* Number of edges */
+  size_t edges_size;  /* Allocated size of the edges array */
+  cfg_edge_t *edges;  /* Edges, in order of creation */
+  size_t index_size;  /* Size of the index (power of two) */
+  cfg_slot_t *index;  /* Open addressing index from instructions to nodes */
+  size_t current;     /* Last inserted node */
+
+  const uint8_t *mapping;	     /* File mapped by cfg_load() (or NULL) */
+  size_t mapping_size;		     /* Size of the mapping */
+  const cfg_file_node_t *file_nodes; /* Nodes read in place (or NULL) */
+  const cfg_file_edge_t *file_edges; /* Edges read in place */
+  const cfg_file_slot_t *file_index; /* Index read in place */
+};
+
+/* A CFG loaded by cfg_load() is read in place from the file (frozen) until
+ * its first modification, which copies it to the heap (see cfg_thaw()) */
+static inline bool
+cfg_frozen (const cfg_t *const cfg)
+{
+  return cfg->file_nodes != NULL;
+}
+
+/* Returns a field of a node, an edge or a slot of the index, whether the
+ * CFG is frozen or not ('array' is nodes, edges or index) */
+#define CFG_FIELD(cfg, array, i, field)                                        \
+  (cfg_frozen (cfg) ? (size_t) (cfg)->file_##array[i].field                    \
+		    : (size_t) (cfg)->array[i].field)
+
+/* Returns the instruction of a node */
+static inline instr_t *
+cfg_instr_at (const cfg_t *const cfg, const size_t node)
+{
+  if (cfg_frozen (cfg))
+    return (instr_t *) (cfg->mapping + cfg->file_nodes[node].instr);
+
+  return cfg->nodes[node].instr;
+}
+
+/* Returns the slot of the index where instr is (or should be) stored */
+static size_t
+cfg_index_slot (const cfg_t *const cfg, const instr_t *const instr)
+{
+  size_t mask = cfg->index_size - 1;
+  size_t slot = hash_instr (instr) & mask;
+
+  while (CFG_FIELD (cfg, index, slot, node) != CFG_NONE &&
+	 (CFG_FIELD (cfg, index, slot, address) != instr->address ||
+	  !instr_equal (cfg_instr_at (cfg, CFG_FIELD (cfg, index, slot, node)),
+			instr)))
+    slot = (slot + 1) & mask;
+
+  return slot;
+}
+
+/* Double the size of the index and rehash all the nodes */
+static int
+cfg_index_grow (cfg_t *const cfg)
+{
+  size_t size = cfg->index_size * 2;
+  cfg_slot_t *index = malloc (size * sizeof (cfg_slot_t));
+  if (index == NULL)
+    return -1;
+
+  free (cfg->index);
+  cfg->index = index;
+  cfg->index_size = size;
+  memset (cfg->index, 0xff, size * sizeof (cfg_slot_t));
+
+  for (size_t node = 0; node < cfg->nodes_count; node++)
+    {
+      instr_t *instr = cfg->nodes[node].instr;
+      cfg->index[cfg_index_slot (cfg, instr)] =
+	  (cfg_slot_t){.address = instr->address, .node = node};
+    }
+
+  return 0;
+}
+
+/* Returns the node holding instr, creates it if needed (CFG_NONE on error) */
+static size_t
+cfg_node_get (cfg_t *const cfg, instr_t *const instr, const node_t type)
+{
+  size_t slot = cfg_index_slot (cfg, instr);
+  if (cfg->index[slot].node != CFG_NONE)
+    return cfg->index[slot].node;
+
+  if (cfg->nodes_count == cfg->nodes_size)
+    {
+      cfg_node_t *nodes =
+	  realloc (cfg->nodes, 2 * cfg->nodes_size * sizeof (cfg_node_t));
+      if (nodes == NULL)
+	return CFG_NONE;
+
+      cfg->nodes = nodes;
+      cfg->nodes_size *= 2;
+    }
+
+  size_t node = cfg->nodes_count++;
+  cfg->nodes[node] = (cfg_node_t){.instr = instr, .type = type};
+  cfg->index[slot] = (cfg_slot_t){.address = instr->address, .node = node};
+
+  /* Keep the load factor of the index under 1/2 */
+  if (2 * cfg->nodes_count > cfg->index_size && cfg_index_grow (cfg) == -1)
+    {
+      cfg->nodes_count--;
+      cfg->index[slot].node = CFG_NONE;
+      return CFG_NONE;
+    }
+
+  return node;
+}
+
+/* Returns the i-th outgoing edge of the node */
+static inline size_t
+cfg_node_out (const cfg_node_t *const node, const size_t i)
+{
+  return (i < CFG_INLINE_EDGES) ? node->out[i]
+				: node->more[i - CFG_INLINE_EDGES];
+}
+
+/* Returns the i-th outgoing edge of a node, whether the CFG is frozen or
+ * not */
+static size_t
+cfg_out (const cfg_t *const cfg, const size_t node, const size_t i)
+{
+  if (!cfg_frozen (cfg))
+    return cfg_node_out (&(cfg->nodes[node]), i);
+
+  const cfg_file_node_t *n = &(cfg->file_nodes[node]);
+  if (i < CFG_INLINE_EDGES)
+    return n->out[i];
+
+  return ((const uint64_t *) (cfg->mapping + n->more))[i - CFG_INLINE_EDGES];
+}
+
+/* Returns the first slot of a targets set to probe for the edge to dst */
+static inline size_t
+cfg_targets_hash (const size_t dst, const size_t size)
+{
+  return (dst * 0x9e3779b97f4a7c15ULL) >> 32 & (size - 1);
+}
+
+/* Returns the slot of the targets set where the edge to dst is (or should
+ * be) stored */
+static size_t
+cfg_targets_slot (const cfg_t *const cfg, const cfg_targets_t *const set,
+		  const size_t dst)
+{
+  size_t mask = set->size - 1;
+  size_t slot = cfg_targets_hash (dst, set->size);
+
+  while (set->slots[slot] != CFG_NONE &&
+	 cfg->edges[set->slots[slot]].dst != dst)
+    slot = (slot + 1) & mask;
+
+  return slot;
+}
+
+/* (Re)build the targets set of the node with a given size */
+static int
+cfg_targets_build (const cfg_t *const cfg, cfg_node_t *const node,
+		   const size_t size)
+{
+  cfg_targets_t *set =
+      malloc (sizeof (cfg_targets_t) + size * sizeof (size_t));
+  if (set == NULL)
+    return -1;
+
+  set->size = size;
+  memset (set->slots, 0xff, size * sizeof (size_t));
+  for (size_t i = 0; i < node->degree; i++)
+    {
+      size_t edge = cfg_node_out (node, i);
+      set->slots[cfg_targets_slot (cfg, set, cfg->edges[edge].dst)] = edge;
+    }
+
+  free (node->targets);
+  node->targets = set;
+
+  return 0;
+}
+
+/* Returns the edge going from src to dst, creates it if needed */
+static size_t
+cfg_edge_get (cfg_t *const cfg, const size_t src, const size_t dst)
+{
+  cfg_node_t *node = &(cfg->nodes[src]);
+
+  /* Look-up the target among the known ones */
+  if (node->targets != NULL)
+    {
+      size_t edge =
+	  node->targets->slots[cfg_targets_slot (cfg, node->targets, dst)];
+      if (edge != CFG_NONE)
+	return edge;
+    }
+  else
+    for (size_t i = 0; i < node->degree; i++)
+      {
+	size_t edge = cfg_node_out (node, i);
+	if (cfg->edges[edge].dst == dst)
+	  return edge;
+      }
+
+  if (cfg->edges_count == cfg->edges_size)
+    {
+      cfg_edge_t *edges =
+	  realloc (cfg->edges, 2 * cfg->edges_size * sizeof (cfg_edge_t));
+      if (edges == NULL)
+	return CFG_NONE;
+
+      cfg->edges = edges;
+      cfg->edges_size *= 2;
+    }
+
+  /* Spilled edges are stored in an array whose size is a power of two */
+  if (node->degree >= CFG_INLINE_EDGES)
+    {
+      size_t spilled = node->degree - CFG_INLINE_EDGES;
+      if ((spilled & (spilled - 1)) == 0)
+	{
+	  size_t *more = realloc (node->more, (spilled ? 2 * spilled : 2) *
+						  sizeof (size_t));
+	  if (more == NULL)
+	    return CFG_NONE;
+	  node->more = more;
+	}
+    }
+
+  size_t edge = cfg->edges_count++;
+  cfg->edges[edge] = (cfg_edge_t){.src = src, .dst = dst, .hits = 0};
+
+  if (node->degree < CFG_INLINE_EDGES)
+    node->out[node->degree] = edge;
+  else
+    node->more[node->degree - CFG_INLINE_EDGES] = edge;
+  node->degree++;
+  node->last_target = node->hits;
+
+  /* Index the targets once the degree gets large (load factor under 1/2) */
+  if (node->degree == CFG_HASHED_EDGES ||
+      (node->targets != NULL && 2 * node->degree > node->targets->size))
+    {
+      size_t size = node->targets ? 2 * node->targets->size
+				  : 4 * CFG_HASHED_EDGES;
+      if (cfg_targets_build (cfg, node, size) == -1)
+	return CFG_NONE;
+    }
+  else if (node->targets != NULL)
+    node->targets->slots[cfg_targets_slot (cfg, node->targets, dst)] = edge;
+
+  return edge;
+}
+
+/* Copy a frozen CFG to the heap before its first modification, the
+ * instructions stay in the mapping (until cfg_delete()) */
+static int
+cfg_thaw (cfg_t *const cfg)
+{
+  size_t nodes_size = CFG_INITIAL_SIZE, edges_size = CFG_INITIAL_SIZE;
+  while (nodes_size < cfg->nodes_count)
+    nodes_size *= 2;
+  while (edges_size < cfg->edges_count)
+    edges_size *= 2;
+
+  cfg_node_t *nodes = calloc (nodes_size, sizeof (cfg_node_t));
+  cfg_edge_t *edges = malloc (edges_size * sizeof (cfg_edge_t));
+  cfg_slot_t *index = malloc (cfg->index_size * sizeof (cfg_slot_t));
+  if (nodes == NULL || edges == NULL || index == NULL)
+    goto fail;
+
+  for (size_t e = 0; e < cfg->edges_count; e++)
+    edges[e] = (cfg_edge_t){.src = CFG_FIELD (cfg, edges, e, src),
+			    .dst = CFG_FIELD (cfg, edges, e, dst),
+			    .hits = CFG_FIELD (cfg, edges, e, hits)};
+
+  for (size_t i = 0; i < cfg->index_size; i++)
+    index[i] = (cfg_slot_t){.address = CFG_FIELD (cfg, index, i, address),
+			    .node = CFG_FIELD (cfg, index, i, node)};
+
+  for (size_t v = 0; v < cfg->nodes_count; v++)
+    {
+      const cfg_file_node_t *n = &(cfg->file_nodes[v]);
+      cfg_node_t *node = &(nodes[v]);
+
+      *node = (cfg_node_t){.instr = cfg_instr_at (cfg, v),
+			   .type = n->type,
+			   .hits = n->hits,
+			   .degree = n->degree,
+			   .last_target = n->last_target};
+      for (size_t i = 0; i < CFG_INLINE_EDGES && i < n->degree; i++)
+	node->out[i] = n->out[i];
+
+      /* Spilled edges keep a power of two capacity (see cfg_edge_get()) */
+      if (n->degree > CFG_INLINE_EDGES)
+	{
+	  size_t spilled = n->degree - CFG_INLINE_EDGES, size = 2;
+	  while (size < spilled)
+	    size *= 2;
+
+	  node->more = malloc (size * sizeof (size_t));
+	  if (node->more == NULL)
+	    goto fail;
+	  for (size_t i = 0; i < spilled; i++)
+	    node->more[i] = cfg_out (cfg, v, CFG_INLINE_EDGES + i);
+	}
+
+      if (n->targets != 0)
+	{
+	  const uint64_t *set = (const uint64_t *) (cfg->mapping + n->targets);
+	  node->targets =
+	      malloc (sizeof (cfg_targets_t) + set[0] * sizeof (size_t));
+	  if (node->targets == NULL)
+	    goto fail;
+
+	  node->targets->size = set[0];
+	  for (size_t i = 0; i < set[0]; i++)
+	    node->targets->slots[i] = set[1 + i];
+	}
+    }
+
+  cfg->nodes = nodes;
+  cfg->nodes_size = nodes_size;
+  cfg->edges = edges;
+  cfg->edges_size = edges_size;
+  cfg->index = index;
+  cfg->file_nodes = NULL;
+  cfg->file_edges = NULL;
+  cfg->file_index = NULL;
+
+  return 0;
+
+fail:
+  if (nodes != NULL)
+    for (size_t v = 0; v < cfg->nodes_count; v++)
+      {
+	free (nodes[v].more);
+	free (nodes[v].targets);
+      }
+  free (nodes);
+  free (edges);
+  free (index);
+  errno = ENOMEM;
+  return -1;
+}
+
+cfg_t *
+cfg_new (instr_t *instr, node_t node_type)
+{
+  if (instr == NULL)
+    {
+      errno = EINVAL;
+      return NULL;
+    }
+
+  cfg_t *cfg = malloc (sizeof (cfg_t));
+  if (cfg == NULL)
+    return NULL;
+
+  *cfg = (cfg_t){0};
+  cfg->nodes_size = CFG_INITIAL_SIZE;
+  cfg->edges_size = CFG_INITIAL_SIZE;
+  cfg->index_size = 2 * CFG_INITIAL_SIZE;
+  cfg->nodes = malloc (cfg->nodes_size * sizeof (cfg_node_t));
+  cfg->edges = malloc (cfg->edges_size * sizeof (cfg_edge_t));
+  cfg->index = malloc (cfg->index_size * sizeof (cfg_slot_t));
+  if (cfg->nodes == NULL || cfg->edges == NULL || cfg->index == NULL)
+    goto fail;
+  memset (cfg->index, 0xff, cfg->index_size * sizeof (cfg_slot_t));
+
+  /* Entry node */
+  cfg->current = cfg_node_get (cfg, instr, node_type);
+  if (cfg->current == CFG_NONE)
+    goto fail;
+  cfg->nodes[cfg->current].hits = 1;
+
+  return cfg;
+
+fail:
+  cfg_delete (cfg);
+  return NULL;
+}
+
+cfg_t *
+cfg_insert (cfg_t *cfg, instr_t *instr, node_t node_type)
+{
+  if (cfg == NULL || instr == NULL)
+    {
+      errno = EINVAL;
+      return NULL;
+    }
+
+  if (cfg_frozen (cfg) && cfg_thaw (cfg) == -1)
+    return NULL;
+
+  size_t node = cfg_node_get (cfg, instr, node_type);
+  if (node == CFG_NONE)
+    return NULL;
+
+  size_t edge = cfg_edge_get (cfg, cfg->current, node);
+  if (edge == CFG_NONE)
+    return NULL;
+
+  cfg->edges[edge].hits++;
+  cfg->nodes[node].hits++;
+  cfg->current = node;
+
+  return cfg;
+}
+
+cfg_t *
+cfg_restart (cfg_t *cfg, instr_t *instr, node_t node_type)
+{
+  if (cfg == NULL || instr == NULL)
+    {
+      errno = EINVAL;
+      return NULL;
+    }
+
+  if (cfg_frozen (cfg) && cfg_thaw (cfg) == -1)
+    return NULL;
+
+  size_t node = cfg_node_get (cfg, instr, node_type);
+  if (node == CFG_NONE)
+    return NULL;
+
+  cfg->nodes[node].hits++;
+  cfg->current = node;
+
+  return cfg;
+}
+
+void
+cfg_delete (cfg_t *cfg)
+{
+  if (cfg == NULL)
+    return;
+
+  if (cfg->nodes)
+    for (size_t node = 0; node < cfg->nodes_count; node++)
+      {
+	free (cfg->nodes[node].more);
+	free (cfg->nodes[node].targets);
+      }
+
+  free (cfg->nodes);
+  free (cfg->edges);
+  free (cfg->index);
+  if (cfg->mapping != NULL)
+    munmap ((void *) cfg->mapping, cfg->mapping_size);
+  free (cfg);
+}
+
+size_t
+cfg_nodes (cfg_t *const cfg)
+{
+  return (cfg == NULL) ? 0 : cfg->nodes_count;
+}
+
+size_t
+cfg_edges (cfg_t *const cfg)
+{
+  return (cfg == NULL) ? 0 : cfg->edges_count;
+}
+
+size_t
+cfg_lookup (cfg_t *const cfg, instr_t *const instr)
+{
+  if (cfg == NULL || instr == NULL)
+    {
+      errno = EINVAL;
+      return CFG_NONE;
+    }
+
+  return CFG_FIELD (cfg, index, cfg_index_slot (cfg, instr), node);
+}
+
+size_t
+cfg_current (cfg_t *const cfg)
+{
+  if (cfg == NULL || cfg->nodes_count == 0)
+    return CFG_NONE;
+
+  return cfg->current;
+}
+
+instr_t *
+cfg_node_instr (cfg_t *const cfg, const size_t node)
+{
+  if (cfg == NULL || node >= cfg->nodes_count)
+    {
+      errno = EINVAL;
+      return NULL;
+    }
+
+  return cfg_instr_at (cfg, node);
+}
+
+node_t
+cfg_node_type (cfg_t *const cfg, const size_t node)
+{
+  if (cfg == NULL || node >= cfg->nodes_count)
+    {
+      errno = EINVAL;
+      return single;
+    }
+
+  return (node_t) CFG_FIELD (cfg, nodes, node, type);
+}
+
+size_t
+cfg_node_hits (cfg_t *const cfg, const size_t node)
+{
+  if (cfg == NULL || node >= cfg->nodes_count)
+    {
+      errno = EINVAL;
+      return 0;
+    }
+
+  return CFG_FIELD (cfg, nodes, node, hits);
+}
+
+size_t
+cfg_node_degree (cfg_t *const cfg, const size_t node)
+{
+  if (cfg == NULL || node >= cfg->nodes_count)
+    {
+      errno = EINVAL;
+      return 0;
+    }
+
+  return CFG_FIELD (cfg, nodes, node, degree);
+}
+
+size_t
+cfg_node_edge (cfg_t *const cfg, const size_t node, const size_t i)
+{
+  if (cfg == NULL || node >= cfg->nodes_count ||
+      i >= CFG_FIELD (cfg, nodes, node, degree))
+    {
+      errno = EINVAL;
+      return CFG_NONE;
+    }
+
+  return cfg_out (cfg, node, i);
+}
+
+size_t
+cfg_node_successor (cfg_t *const cfg, const size_t node, const size_t dst)
+{
+  if (cfg == NULL || node >= cfg->nodes_count)
+    {
+      errno = EINVAL;
+      return CFG_NONE;
+    }
+
+  if (cfg_frozen (cfg) && cfg->file_nodes[node].targets != 0)
+    {
+      const uint64_t *set = (const uint64_t *) (cfg->mapping +
+						cfg->file_nodes[node].targets);
+      size_t slot = cfg_targets_hash (dst, set[0]);
+
+      while (set[1 + slot] != UINT64_MAX &&
+	     cfg->file_edges[set[1 + slot]].dst != dst)
+	slot = (slot + 1) & (set[0] - 1);
+
+      return (set[1 + slot] == UINT64_MAX) ? CFG_NONE : set[1 + slot];
+    }
+
+  if (!cfg_frozen (cfg) && cfg->nodes[node].targets != NULL)
+    {
+      cfg_targets_t *set = cfg->nodes[node].targets;
+      return set->slots[cfg_targets_slot (cfg, set, dst)];
+    }
+
+  for (size_t i = 0; i < CFG_FIELD (cfg, nodes, node, degree); i++)
+    if (CFG_FIELD (cfg, edges, cfg_out (cfg, node, i), dst) == dst)
+      return cfg_out (cfg, node, i);
+
+  return CFG_NONE;
+}
+
+size_t
+cfg_node_stable_hits (cfg_t *const cfg, const size_t node)
+{
+  if (cfg == NULL || node >= cfg->nodes_count)
+    {
+      errno = EINVAL;
+      return 0;
+    }
+
+  return CFG_FIELD (cfg, nodes, node, hits) -
+	 CFG_FIELD (cfg, nodes, node, last_target);
+}
+
+size_t
+cfg_edge_src (cfg_t *const cfg, const size_t edge)
+{
+  if (cfg == NULL || edge >= cfg->edges_count)
+    {
+      errno = EINVAL;
+      return CFG_NONE;
+    }
+
+  return CFG_FIELD (cfg, edges, edge, src);
+}
+
+size_t
+cfg_edge_dst (cfg_t *const cfg, const size_t edge)
+{
+  if (cfg == NULL || edge >= cfg->edges_count)
+    {
+      errno = EINVAL;
+      return CFG_NONE;
+    }
+
+  return CFG_FIELD (cfg, edges, edge, dst);
+}
+
+size_t
+cfg_edge_hits (cfg_t *const cfg, const size_t edge)
+{
+  if (cfg == NULL || edge >= cfg->edges_count)
+    {
+      errno = EINVAL;
+      return 0;
+    }
+
+  return CFG_FIELD (cfg, edges, edge, hits);
+}
+
+/* **********[ Parallel CFG Construction ]********** */
+
+/* Partial CFG of a contiguous subset of the traces */
+typedef struct
+{
+  trace_t **traces;			 /* Traces handled by the worker */
+  size_t count;				 /* Number of traces */
+  node_t (*node_type) (instr_t *const); /* Node classifier */
+  cfg_t *cfg;				 /* Partial CFG (NULL if no trace) */
+  size_t *found;			 /* Source hits when each edge appeared */
+  size_t found_size;			 /* Allocated size of found */
+  int error;				 /* errno value on failure (0 otherwise) */
+} cfg_partial_t;
+
+/* Insert the traces of the partial CFG and record the hits of the source
+ * node at the creation of each edge (to merge stable hits exactly) */
+static void *
+cfg_partial_build (void *arg)
+{
+  cfg_partial_t *p = arg;
+
+  for (size_t t = 0; t < p->count; t++)
+    {
+      if (p->traces[t] == NULL)
+	continue;
+
+      for (tnode_t *tn = p->traces[t]->head; tn != NULL; tn = tn->next)
+	{
+	  node_t type = p->node_type ? p->node_type (tn->instr) : single;
+	  size_t edges = cfg_edges (p->cfg);
+
+	  if (p->cfg == NULL)
+	    {
+	      p->cfg = cfg_new (tn->instr, type);
+	      if (p->cfg == NULL)
+		goto fail;
+	    }
+	  else if (tn == p->traces[t]->head)
+	    {
+	      if (cfg_restart (p->cfg, tn->instr, type) == NULL)
+		goto fail;
+	    }
+	  else if (cfg_insert (p->cfg, tn->instr, type) == NULL)
+	    goto fail;
+
+	  if (p->cfg->edges_count == edges)
+	    continue;
+
+	  if (edges == p->found_size)
+	    {
+	      size_t size = edges ? 2 * edges : CFG_INITIAL_SIZE;
+	      size_t *found = realloc (p->found, size * sizeof (size_t));
+	      if (found == NULL)
+		goto fail;
+	      p->found = found;
+	      p->found_size = size;
+	    }
+	  p->found[edges] =
+	      p->cfg->nodes[p->cfg->edges[edges].src].last_target;
+	}
+    }
+
+  return NULL;
+
+fail:
+  p->error = errno ? errno : ENOMEM;
+  return NULL;
+}
+
+/* Append the CFG cfg to dst (as if its traces were inserted after the ones
+ * of dst): new nodes and edges keep the order of cfg. found gives the hits
+ * of the source node at the creation of each edge of cfg, if NULL the stable
+ * hits of the sources of the new edges are the ones of their last target */
+static int
+cfg_merge (cfg_t *const dst, const cfg_t *const cfg, const size_t *found)
+{
+
+  /* Node of dst and hits before the merge for each node of src */
+  size_t(*map)[2] = malloc (cfg->nodes_count * sizeof (size_t[2]));
+  if (map == NULL)
+    return -1;
+
+  for (size_t v = 0; v < cfg->nodes_count; v++)
+    {
+      size_t node =
+	  cfg_node_get (dst, cfg->nodes[v].instr, cfg->nodes[v].type);
+      if (node == CFG_NONE)
+	goto fail;
+
+      map[v][0] = node;
+      map[v][1] = dst->nodes[node].hits;
+      dst->nodes[node].hits += cfg->nodes[v].hits;
+    }
+
+  for (size_t e = 0; e < cfg->edges_count; e++)
+    {
+      size_t u = cfg->edges[e].src;
+      size_t edges = dst->edges_count;
+      size_t edge = cfg_edge_get (dst, map[u][0], map[cfg->edges[e].dst][0]);
+      if (edge == CFG_NONE)
+	goto fail;
+
+      if (dst->edges_count != edges)
+	dst->nodes[map[u][0]].last_target =
+	    map[u][1] + (found ? found[e] : cfg->nodes[u].last_target);
+      dst->edges[edge].hits += cfg->edges[e].hits;
+    }
+
+  dst->current = map[cfg->current][0];
+  free (map);
+
+  return 0;
+
+fail:
+  free (map);
+  return -1;
+}
+
+int
+cfg_append (cfg_t *const dst, cfg_t *const src)
+{
+  if (dst == NULL || src == NULL)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+  if (cfg_frozen (dst) && cfg_thaw (dst) == -1)
+    return -1;
+
+  if (cfg_merge (dst, src, NULL) == -1)
+    {
+      errno = ENOMEM;
+      return -1;
+    }
+
+  return 0;
+}
+
+cfg_t *
+cfg_build (trace_t **traces, const size_t count,
+	   node_t (*node_type) (instr_t *const instr), const size_t threads)
+{
+  if (traces == NULL || count == 0)
+    {
+      errno = EINVAL;
+      return NULL;
+    }
+
+  size_t workers = (threads == 0) ? 1 : (threads < count) ? threads : count;
+  cfg_partial_t *partials = calloc (workers, sizeof (cfg_partial_t));
+  pthread_t *tids = calloc (workers, sizeof (pthread_t));
+  bool *started = calloc (workers, sizeof (bool));
+  cfg_t *cfg = NULL;
+  int error = 0;
+
+  if (partials == NULL || tids == NULL || started == NULL)
+    {
+      error = ENOMEM;
+      goto end;
+    }
+
+  /* Split the traces in contiguous subsets and start the workers (the
+   * first subset is handled by the calling thread) */
+  for (size_t w = 0; w < workers; w++)
+    {
+      size_t first = count * w / workers, last = count * (w + 1) / workers;
+      partials[w] = (cfg_partial_t){.traces = traces + first,
+				    .count = last - first,
+				    .node_type = node_type};
+
+      if (w > 0)
+	started[w] = !pthread_create (&tids[w], NULL, cfg_partial_build,
+				      &partials[w]);
+    }
+
+  cfg_partial_build (&partials[0]);
+  error = partials[0].error;
+  cfg = partials[0].cfg;
+  partials[0].cfg = NULL;
+
+  /* Deterministic reduction: merge the partial CFGs in the traces order */
+  for (size_t w = 1; w < workers; w++)
+    {
+      if (started[w])
+	pthread_join (tids[w], NULL);
+      else
+	cfg_partial_build (&partials[w]);
+
+      if (error == 0 && partials[w].error)
+	error = partials[w].error;
+      if (error != 0 || partials[w].cfg == NULL)
+	continue;
+
+      if (cfg == NULL)
+	{
+	  cfg = partials[w].cfg;
+	  partials[w].cfg = NULL;
+	}
+      else if (cfg_merge (cfg, partials[w].cfg, partials[w].found) == -1)
+	error = ENOMEM;
+    }
+
+  if (error == 0 && cfg == NULL)
+    error = EINVAL; /* All the traces are empty */
+
+end:
+  if (partials != NULL)
+    for (size_t w = 0; w < workers; w++)
+      {
+	cfg_delete (partials[w].cfg);
+	free (partials[w].found);
+      }
+  free (partials);
+  free (tids);
+  free (started);
+
+  if (error != 0)
+    {
+      cfg_delete (cfg);
+      errno = error;
+      return NULL;
+    }
+
+  return cfg;
+}
+
+/* **********[ Binary CFG Files ]********** */
+
+/* A CFG file is a header followed by the node table, the edge table, the
+ * index, the instructions, the spilled outgoing edges and the target sets
+ * of the nodes (a size followed by the slots). All the fields are 64 bits
+ * integers and pointers are stored as offsets from the start of the file,
+ * so cfg_load() reads the file in place from a read-only shared mapping,
+ * without allocation nor relocation. Instructions are stored as instr_t
+ * images (they are handed out as such), their layout is checked on load */
+
+#define CFG_FILE_MAGIC "TRKCFG03"
+
+/* Records of the file are aligned on 8 bytes */
+#define CFG_FILE_ALIGN(size) (((size) + 7) & ~((size_t) 7))
+
+typedef struct
+{
+  char magic[8];	/* CFG_FILE_MAGIC */
+  uint64_t layout;	/* Layout of the instructions (and byte order) */
+  uint64_t nodes_count; /* Number of nodes */
+  uint64_t edges_count; /* Number of edges */
+  uint64_t index_size;	/* Number of slots of the index */
+  uint64_t current;	/* Last inserted node */
+  uint64_t nodes;	/* Offset of the node table */
+  uint64_t edges;	/* Offset of the edge table */
+  uint64_t index;	/* Offset of the index */
+  uint64_t instrs;	/* Offset of the instructions */
+  uint64_t spills;	/* Offset of the spilled outgoing edges */
+  uint64_t targets;	/* Offset of the target sets */
+  uint64_t end;		/* Size of the file */
+} cfg_file_t;
+
+/* Not a palindrome, so files of the other byte order are rejected too */
+static uint64_t
+cfg_file_layout (void)
+{
+  return sizeof (instr_t) | offsetof (instr_t, opcodes) << 8 |
+	 sizeof (instr_type_t) << 16 | sizeof (uintptr_t) << 24 |
+	 (uint64_t) 0x54524b << 32;
+}
+
+/* Indexes are stored on 64 bits whatever the size of size_t */
+static uint64_t
+cfg_file_index (const size_t index)
+{
+  return (index == CFG_NONE) ? UINT64_MAX : index;
+}
+
+static size_t
+cfg_file_instr_size (const instr_t *const instr)
+{
+  return CFG_FILE_ALIGN (sizeof (instr_t) + instr->size);
+}
+
+static size_t
+cfg_file_spill_size (const cfg_node_t *const node)
+{
+  return (node->degree > CFG_INLINE_EDGES)
+	     ? (node->degree - CFG_INLINE_EDGES) * sizeof (uint64_t)
+	     : 0;
+}
+
+static size_t
+cfg_file_targets_size (const cfg_node_t *const node)
+{
+  return (node->targets == NULL)
+	     ? 0
+	     : (1 + node->targets->size) * sizeof (uint64_t);
+}
+
+/* Write count indexes as 64 bits integers, returns false on error */
+static bool
+cfg_file_write_indexes (const size_t *const indexes, const size_t count,
+			FILE *const fd)
+{
+  for (size_t i = 0; i < count; i++)
+    {
+      uint64_t index = cfg_file_index (indexes[i]);
+      if (fwrite (&index, sizeof (uint64_t), 1, fd) != 1)
+	return false;
+    }
+
+  return true;
+}
+
+/* Write the file image of a CFG (not frozen), returns false on error */
+static bool
+cfg_file_write (const cfg_t *const cfg, FILE *const fd)
+{
+  cfg_file_t header = {.magic = CFG_FILE_MAGIC,
+		       .layout = cfg_file_layout (),
+		       .nodes_count = cfg->nodes_count,
+		       .edges_count = cfg->edges_count,
+		       .index_size = cfg->index_size,
+		       .current = cfg->current};
+
+  size_t instrs_size = 0, spills_size = 0, targets_size = 0;
+  for (size_t v = 0; v < cfg->nodes_count; v++)
+    {
+      instrs_size += cfg_file_instr_size (cfg->nodes[v].instr);
+      spills_size += cfg_file_spill_size (&(cfg->nodes[v]));
+      targets_size += cfg_file_targets_size (&(cfg->nodes[v]));
+    }
+
+  header.nodes = sizeof (cfg_file_t);
+  header.edges = header.nodes + cfg->nodes_count * sizeof (cfg_file_node_t);
+  header.index = header.edges + cfg->edges_count * sizeof (cfg_file_edge_t);
+  header.instrs = header.index + cfg->index_size * sizeof (cfg_file_slot_t);
+  header.spills = header.instrs + instrs_size;
+  header.targets = header.spills + spills_size;
+  header.end = header.targets + targets_size;
+
+  bool error = fwrite (&header, sizeof (cfg_file_t), 1, fd) != 1;
+
+  /* Node table, with pointers turned into offsets */
+  uint64_t instr = header.instrs, spill = header.spills,
+	   targets = header.targets;
+  for (size_t v = 0; v < cfg->nodes_count && !error; v++)
+    {
+      const cfg_node_t *node = &(cfg->nodes[v]);
+      cfg_file_node_t record = {.instr = instr,
+				.type = node->type,
+				.hits = node->hits,
+				.degree = node->degree,
+				.last_target = node->last_target};
+      for (size_t i = 0; i < CFG_INLINE_EDGES; i++)
+	record.out[i] =
+	    (i < node->degree) ? node->out[i] : cfg_file_index (CFG_NONE);
+
+      instr += cfg_file_instr_size (node->instr);
+      if (cfg_file_spill_size (node))
+	record.more = spill;
+      spill += cfg_file_spill_size (node);
+      if (node->targets != NULL)
+	record.targets = targets;
+      targets += cfg_file_targets_size (node);
+
+      error = fwrite (&record, sizeof (cfg_file_node_t), 1, fd) != 1;
+    }
+
+  for (size_t e = 0; e < cfg->edges_count && !error; e++)
+    {
+      cfg_file_edge_t record = {.src = cfg->edges[e].src,
+				.dst = cfg->edges[e].dst,
+				.hits = cfg->edges[e].hits};
+      error = fwrite (&record, sizeof (cfg_file_edge_t), 1, fd) != 1;
+    }
+
+  for (size_t i = 0; i < cfg->index_size && !error; i++)
+    {
+      cfg_file_slot_t record = {.address = cfg->index[i].address,
+				.node = cfg_file_index (cfg->index[i].node)};
+      error = fwrite (&record, sizeof (cfg_file_slot_t), 1, fd) != 1;
+    }
+
+  /* Instructions (padded), spilled edges and target sets */
+  uint8_t image[CFG_FILE_ALIGN (sizeof (instr_t) + UINT8_MAX)];
+  for (size_t v = 0; v < cfg->nodes_count && !error; v++)
+    {
+      size_t size = cfg_file_instr_size (cfg->nodes[v].instr);
+      memset (image, 0, size);
+      memcpy (image, cfg->nodes[v].instr,
+	      sizeof (instr_t) + cfg->nodes[v].instr->size);
+      error = fwrite (image, 1, size, fd) != size;
+    }
+
+  for (size_t v = 0; v < cfg->nodes_count && !error; v++)
+    if (cfg->nodes[v].degree > CFG_INLINE_EDGES)
+      error = !cfg_file_write_indexes (
+	  cfg->nodes[v].more, cfg->nodes[v].degree - CFG_INLINE_EDGES, fd);
+
+  for (size_t v = 0; v < cfg->nodes_count && !error; v++)
+    {
+      const cfg_targets_t *set = cfg->nodes[v].targets;
+      if (set == NULL)
+	continue;
+
+      uint64_t size = set->size;
+      error = fwrite (&size, sizeof (uint64_t), 1, fd) != 1 ||
+	      !cfg_file_write_indexes (set->slots, set->size, fd);
+    }
+
+  return !error;
+}
+
+int
+cfg_save (cfg_t *const cfg, const char *filename)
+{
+  if (cfg == NULL || filename == NULL)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+  /* Written to a temporary file renamed over the previous one, so that
+   * the CFGs mapped from it (possibly this one) are left intact */
+  size_t size = strlen (filename) + 8;
+  char *tmp = malloc (size);
+  if (tmp == NULL)
+    return -1;
+  snprintf (tmp, size, "%s.XXXXXX", filename);
+
+  int fdesc = mkstemp (tmp);
+  FILE *fd = (fdesc == -1) ? NULL : fdopen (fdesc, "wb");
+  if (fd == NULL)
+    {
+      if (fdesc != -1)
+	{
+	  close (fdesc);
+	  unlink (tmp);
+	}
+      free (tmp);
+      return -1;
+    }
+
+  /* A frozen CFG is already the image of the file */
+  bool error = cfg_frozen (cfg) ? fwrite (cfg->mapping, 1, cfg->mapping_size,
+					  fd) != cfg->mapping_size
+				: !cfg_file_write (cfg, fd);
+
+  if (fclose (fd) == EOF || error || rename (tmp, filename) == -1)
+    {
+      int errsv = errno ? errno : EIO;
+      unlink (tmp);
+      free (tmp);
+      errno = errsv;
+      return -1;
+    }
+  free (tmp);
+
+  return 0;
+}
+
+/* Returns true if [offset, offset + size) is an aligned range of the
+ * section [start, end) */
+static bool
+cfg_file_within (const uint64_t offset, const uint64_t size,
+		 const uint64_t start, const uint64_t end)
+{
+  return offset >= start && offset <= end && end - offset >= size &&
+	 offset % 8 == 0;
+}
+
+/* Check the header and the content of a mapped CFG file and set up the CFG
+ * to read it in place, returns false if the file is invalid */
+static bool
+cfg_file_map (cfg_t *const cfg, const uint8_t *const map, const size_t size)
+{
+  const cfg_file_t *h = (const cfg_file_t *) map;
+
+  if (size < sizeof (cfg_file_t) || memcmp (h->magic, CFG_FILE_MAGIC, 8) ||
+      h->layout != cfg_file_layout () || h->end != size ||
+      h->nodes != sizeof (cfg_file_t) ||
+      h->nodes_count > (size - h->nodes) / sizeof (cfg_file_node_t) ||
+      h->edges != h->nodes + h->nodes_count * sizeof (cfg_file_node_t) ||
+      h->edges_count > (size - h->edges) / sizeof (cfg_file_edge_t) ||
+      h->index != h->edges + h->edges_count * sizeof (cfg_file_edge_t) ||
+      h->index_size > (size - h->index) / sizeof (cfg_file_slot_t) ||
+      h->instrs != h->index + h->index_size * sizeof (cfg_file_slot_t) ||
+      h->instrs > h->spills || h->spills > h->targets ||
+      h->targets > h->end || h->nodes_count == 0 ||
+      h->index_size <= h->nodes_count ||
+      (h->index_size & (h->index_size - 1)) ||
+      h->current >= h->nodes_count)
+    return false;
+
+  *cfg = (cfg_t){.nodes_count = h->nodes_count,
+		 .edges_count = h->edges_count,
+		 .index_size = h->index_size,
+		 .current = h->current,
+		 .mapping = map,
+		 .mapping_size = size,
+		 .file_nodes = (const cfg_file_node_t *) (map + h->nodes),
+		 .file_edges = (const cfg_file_edge_t *) (map + h->edges),
+		 .file_index = (const cfg_file_slot_t *) (map + h->index)};
+
+  for (size_t e = 0; e < cfg->edges_count; e++)
+    if (cfg->file_edges[e].src >= cfg->nodes_count ||
+	cfg->file_edges[e].dst >= cfg->nodes_count)
+      return false;
+
+  /* Each node has a slot of the index, the others are empty (lookups stop
+   * on an empty slot) */
+  size_t occupied = 0;
+  for (size_t i = 0; i < cfg->index_size; i++)
+    {
+      if (cfg->file_index[i].node == UINT64_MAX)
+	continue;
+      if (cfg->file_index[i].node >= cfg->nodes_count)
+	return false;
+      occupied++;
+    }
+  if (occupied != cfg->nodes_count)
+    return false;
+
+  for (size_t v = 0; v < cfg->nodes_count; v++)
+    {
+      const cfg_file_node_t *node = &(cfg->file_nodes[v]);
+
+      if (!cfg_file_within (node->instr, sizeof (instr_t), h->instrs,
+			    h->spills) ||
+	  !cfg_file_within (node->instr,
+			    sizeof (instr_t) + cfg_instr_at (cfg, v)->size,
+			    h->instrs, h->spills) ||
+	  node->degree > cfg->edges_count)
+	return false;
+
+      if (node->degree > CFG_INLINE_EDGES &&
+	  !cfg_file_within (node->more,
+			    (node->degree - CFG_INLINE_EDGES) *
+				sizeof (uint64_t),
+			    h->spills, h->targets))
+	return false;
+
+      if (node->targets != 0)
+	{
+	  if (!cfg_file_within (node->targets, sizeof (uint64_t), h->targets,
+				h->end))
+	    return false;
+
+	  const uint64_t *set = (const uint64_t *) (map + node->targets);
+	  if ((set[0] & (set[0] - 1)) || set[0] <= node->degree ||
+	      set[0] > (h->end - node->targets) / sizeof (uint64_t) - 1)
+	    return false;
+
+	  /* The probes of the set stop on an empty slot */
+	  size_t filled = 0;
+	  for (size_t i = 0; i < set[0]; i++)
+	    {
+	      if (set[1 + i] == UINT64_MAX)
+		continue;
+	      if (set[1 + i] >= cfg->edges_count)
+		return false;
+	      filled++;
+	    }
+	  if (filled >= set[0])
+	    return false;
+	}
+
+      for (size_t i = 0; i < node->degree; i++)
+	if (cfg_out (cfg, v, i) >= cfg->edges_count)
+	  return false;
+    }
+
+  return true;
+}
+
+cfg_t *
+cfg_load (const char *filename)
+{
+  if (filename == NULL)
+    {
+      errno = EINVAL;
+      return NULL;
+    }
+
+  int fd = open (filename, O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return NULL;
+
+  struct stat st;
+  if (fstat (fd, &st) == -1)
+    {
+      close (fd);
+      return NULL;
+    }
+
+  /* Read-only shared mapping: the file is never modified nor copied */
+  size_t size = st.st_size;
+  void *map = (size == 0) ? MAP_FAILED
+			  : mmap (NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close (fd);
+  if (map == MAP_FAILED)
+    {
+      errno = (size == 0) ? EINVAL : errno;
+      return NULL;
+    }
+
+  cfg_t *cfg = malloc (sizeof (cfg_t));
+  if (cfg == NULL || !cfg_file_map (cfg, map, size))
+    {
+      int error = (cfg == NULL) ? ENOMEM : EINVAL;
+      munmap (map, size);
+      free (cfg);
+      errno = error;
+      return NULL;
+    }
+
+  return cfg;
+}
+
+/* **********[ Call Graph Data-structure ]********** */
+
+/* Number of frames looked at for the target of a return (returns that skip
+ * more frames, e.g. longjmp(), are ignored) */
+#define CALLGRAPH_RETURN_SEARCH 8
+
+typedef struct
+{
+  size_t caller; /* Caller function (entry node) */
+  size_t callee; /* Callee function (entry node) */
+  size_t calls;	 /* Number of calls */
+} cg_edge_t;
+
+typedef struct
+{
+  size_t parent;   /* Calling context (CFG_NONE for the root) */
+  size_t function; /* Function (entry node) */
+  size_t depth;	   /* Depth in the tree (the root is at depth 0) */
+  size_t calls;	   /* Number of calls reaching this context */
+} cg_context_t;
+
+typedef struct
+{
+  size_t function; /* Function executing in the frame */
+  size_t context;  /* Calling context of the frame */
+  uintptr_t ret;   /* Return address of the frame */
+} cg_frame_t;
+
+/* Open addressing map from pairs of indexes to an index */
+typedef struct
+{
+  size_t a, b;	/* Key */
+  size_t value; /* Value (CFG_NONE if the slot is empty) */
+} cg_slot_t;
+
+typedef struct
+{
+  size_t size;	   /* Number of slots (power of two) */
+  size_t count;	   /* Number of keys */
+  cg_slot_t *slots; /* Slots */
+} cg_map_t;
+
+struct _callgraph_t
+{
+  size_t max_depth;	   /* Maximum depth of the calling-context tree */
+  size_t edges_count;	   /* Number of edges */
+  size_t edges_size;	   /* Allocated size of edges */
+  cg_edge_t *edges;	   /* Caller to callee edges */
+  size_t contexts_count;   /* Number of calling contexts */
+  size_t contexts_size;	   /* Allocated size of contexts */
+  cg_context_t *contexts;  /* Calling-context tree */
+  size_t frames_count;	   /* Depth of the shadow stack */
+  size_t frames_size;	   /* Allocated size of frames */
+  cg_frame_t *frames;	   /* Shadow stack */
+  cg_map_t edges_map;	   /* (caller, callee) to edge */
+  cg_map_t contexts_map;   /* (parent, function) to context */
+};
+
+/* Returns the slot of (a, b) in the map (empty if the key is absent) */
+static cg_slot_t *
+cg_map_slot (const cg_map_t *const map, const size_t a, const size_t b)
+{
+  size_t mask = map->size - 1;
+  size_t slot = ((a * 0x9e3779b97f4a7c15ULL) ^ b) * 0xff51afd7ed558ccdULL >>
+		32 & mask;
+
+  while (map->slots[slot].value != CFG_NONE &&
+	 (map->slots[slot].a != a || map->slots[slot].b != b))
+    slot = (slot + 1) & mask;
+
+  return &(map->slots[slot]);
+}
+
+static int
+cg_map_init (cg_map_t *const map, const size_t size)
+{
+  map->slots = malloc (size * sizeof (cg_slot_t));
+  if (map->slots == NULL)
+    return -1;
+
+  map->size = size;
+  map->count = 0;
+  memset (map->slots, 0xff, size * sizeof (cg_slot_t));
+
+  return 0;
+}
+
+/* Insert a new key in the map (keeping the load factor under 1/2) */
+static int
+cg_map_insert (cg_map_t *const map, const size_t a, const size_t b,
+	       const size_t value)
+{
+  if (2 * (map->count + 1) > map->size)
+    {
+      cg_map_t grown;
+      if (cg_map_init (&grown, 2 * map->size) == -1)
+	return -1;
+
+      for (size_t i = 0; i < map->size; i++)
+	if (map->slots[i].value != CFG_NONE)
+	  *cg_map_slot (&grown, map->slots[i].a, map->slots[i].b) =
+	      map->slots[i];
+
+      grown.count = map->count;
+      free (map->slots);
+      *map = grown;
+    }
+
+  *cg_map_slot (map, a, b) = (cg_slot_t){.a = a, .b = b, .value = value};
+  map->count++;
+
+  return 0;
+}
+
+/* Make room for one more element in an array of 'size' elements */
+static int
+cg_reserve (void **array, size_t *const size, const size_t count,
+	    const size_t elem)
+{
+  if (count < *size)
+    return 0;
+
+  void *grown = realloc (*array, 2 * (*size) * elem);
+  if (grown == NULL)
+    return -1;
+
+  *array = grown;
+  *size *= 2;
+
+  return 0;
+}
+
+callgraph_t *
+callgraph_new (const size_t max_depth)
+{
+  callgraph_t *cg = calloc (1, sizeof (callgraph_t));
+  if (cg == NULL)
+    return NULL;
+
+  cg->max_depth = max_depth;
+  cg->edges_size = cg->contexts_size = cg->frames_size = 64;
+  cg->edges = malloc (cg->edges_size * sizeof (cg_edge_t));
+  cg->contexts = malloc (cg->contexts_size * sizeof (cg_context_t));
+  cg->frames = malloc (cg->frames_size * sizeof (cg_frame_t));
+  if (cg->edges == NULL || cg->contexts == NULL || cg->frames == NULL ||
+      cg_map_init (&cg->edges_map, 128) == -1 ||
+      cg_map_init (&cg->contexts_map, 128) == -1)
+    {
+      callgraph_delete (cg);
+      return NULL;
+    }
+
+  /* Root context and frame run the entry of the CFG (node 0) */
+  cg->contexts[cg->contexts_count++] =
+      (cg_context_t){.parent = CFG_NONE, .function = 0, .depth = 0};
+  cg->frames[cg->frames_count++] =
+      (cg_frame_t){.function = 0, .context = 0, .ret = 0};
+
+  return cg;
+}
+
+void
+callgraph_delete (callgraph_t *cg)
+{
+  if (cg == NULL)
+    return;
+
+  free (cg->edges);
+  free (cg->contexts);
+  free (cg->frames);
+  free (cg->edges_map.slots);
+  free (cg->contexts_map.slots);
+  free (cg);
+}
+
+int
+callgraph_call (callgraph_t *const cg, const size_t callee,
+		const uintptr_t ret)
+{
+  if (cg == NULL || callee == CFG_NONE)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+  cg_frame_t *top = &(cg->frames[cg->frames_count - 1]);
+
+  /* Caller to callee edge */
+  cg_slot_t *slot = cg_map_slot (&cg->edges_map, top->function, callee);
+  size_t edge = slot->value;
+  if (edge == CFG_NONE)
+    {
+      if (cg_reserve ((void **) &cg->edges, &cg->edges_size, cg->edges_count,
+		      sizeof (cg_edge_t)) == -1)
+	return -1;
+
+      edge = cg->edges_count;
+      cg->edges[edge] =
+	  (cg_edge_t){.caller = top->function, .callee = callee, .calls = 0};
+      if (cg_map_insert (&cg->edges_map, top->function, callee, edge) == -1)
+	return -1;
+      cg->edges_count++;
+    }
+  cg->edges[edge].calls++;
+
+  /* Calling context (deeper calls are folded in the deepest context) */
+  size_t context = top->context;
+  if (cg->contexts[context].depth < cg->max_depth)
+    {
+      slot = cg_map_slot (&cg->contexts_map, context, callee);
+      if (slot->value == CFG_NONE)
+	{
+	  if (cg_reserve ((void **) &cg->contexts, &cg->contexts_size,
+			  cg->contexts_count, sizeof (cg_context_t)) == -1)
+	    return -1;
+
+	  cg->contexts[cg->contexts_count] =
+	      (cg_context_t){.parent = context,
+			     .function = callee,
+			     .depth = cg->contexts[context].depth + 1};
+	  if (cg_map_insert (&cg->contexts_map, context, callee,
+			     cg->contexts_count) == -1)
+	    return -1;
+	  context = cg->contexts_count++;
+	}
+      else
+	context = slot->value;
+    }
+  cg->contexts[context].calls++;
+
+  /* Push the frame on the shadow stack */
+  if (cg_reserve ((void **) &cg->frames, &cg->frames_size, cg->frames_count,
+		  sizeof (cg_frame_t)) == -1)
+    return -1;
+
+  cg->frames[cg->frames_count++] =
+      (cg_frame_t){.function = callee, .context = context, .ret = ret};
+
+  return 0;
+}
+
+void
+callgraph_return (callgraph_t *const cg, const uintptr_t addr)
+{
+  if (cg == NULL)
+    return;
+
+  /* Pop up to the frame returning to addr (the root frame never returns) */
+  for (size_t i = cg->frames_count - 1;
+       i > 0 && i + CALLGRAPH_RETURN_SEARCH >= cg->frames_count; i--)
+    if (cg->frames[i].ret == addr)
+      {
+	cg->frames_count = i;
+	return;
+      }
+}
+
+size_t
+callgraph_depth (callgraph_t *const cg)
+{
+  return (cg == NULL) ? 0 : cg->frames_count - 1;
+}
+
+size_t
+callgraph_edges (callgraph_t *const cg)
+{
+  return (cg == NULL) ? 0 : cg->edges_count;
+}
+
+size_t
+callgraph_edge_caller (callgraph_t *const cg, const size_t edge)
+{
+  if (cg == NULL || edge >= cg->edges_count)
+    {
+      errno = EINVAL;
+      return CFG_NONE;
+    }
+
+  return cg->edges[edge].caller;
+}
+
+size_t
+callgraph_edge_callee (callgraph_t *const cg, const size_t edge)
+{
+  if (cg == NULL || edge >= cg->edges_count)
+    {
+      errno = EINVAL;
+      return CFG_NONE;
+    }
+
+  return cg->edges[edge].callee;
+}
+
+size_t
+callgraph_edge_calls (callgraph_t *const cg, const size_t edge)
+{
+  if (cg == NULL || edge >= cg->edges_count)
+    {
+      errno = EINVAL;
+      return 0;
+    }
+
+  return cg->edges[edge].calls;
+}
+
+size_t
+callgraph_contexts (callgraph_t *const cg)
+{
+  return (cg == NULL) ? 0 : cg->contexts_count;
+}
+
+size_t
+callgraph_context_parent (callgraph_t *const cg, const size_t context)
+{
+  if (cg == NULL || context >= cg->contexts_count)
+    {
+      errno = EINVAL;
+      return CFG_NONE;
+    }
+
+  return cg->contexts[context].parent;
+}
+
+size_t
+callgraph_context_function (callgraph_t *const cg, const size_t context)
+{
+  if (cg == NULL || context >= cg->contexts_count)
+    {
+      errno = EINVAL;
+      return CFG_NONE;
+    }
+
+  return cg->contexts[context].function;
+}
+
+size_t
+callgraph_context_depth (callgraph_t *const cg, const size_t context)
+{
+  if (cg == NULL || context >= cg->contexts_count)
+    {
+      errno = EINVAL;
+      return 0;
+    }
+
+  return cg->contexts[context].depth;
+}
+
+size_t
+callgraph_context_calls (callgraph_t *const cg, const size_t context)
+{
+  if (cg == NULL || context >= cg->contexts_count)
+    {
+      errno = EINVAL;
+      return 0;
+    }
+
+  return cg->contexts[context].calls;
+}
@@ -23,8 +23,10 @@
 #include <elf.h>
 #include <err.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <libgen.h>
+#include <pthread.h>
 #include <string.h>
 
 #include <sys/personality.h>
@@ -36,16 +38,45 @@
 
 #include <capstone/capstone.h>
 
+#include <analyses.h>
+#include <disassembler.h>
 #include <executables.h>
+#include <exports.h>
+#include <modules.h>
 #include <traces.h>
+#include <writers.h>
 
 /* In amd64, maximum bytes for an opcode is 15 */
 #define MAX_OPCODE_BYTES 16
 
+/* Number of loops displayed in the report */
+#define TOP_LOOPS 10
+
+/* Number of functions displayed in the report */
+#define TOP_FUNCTIONS 10
+
+/* A dynjump site whose last new target was found within this ratio of its
+ * latest hits is considered as still growing */
+#define GROWING_RATIO 10
+
+/* Maximum depth of the calling-context tree */
+#define CONTEXT_DEPTH 32
+
+/* Number of modules displayed in the report */
+#define TOP_MODULES 10
+
+/* Number of source lines displayed in the report */
+#define TOP_LINES 10
+
+/* Size of the pages of code copied from the memory of the child */
+#define CODE_PAGE_SIZE 4096
+#define CODE_PAGE(addr) ((addr) & ~((uintptr_t) CODE_PAGE_SIZE - 1))
+
 /* Global variables for this module */
-static bool debug = false;   /* 'debug' option flag */
-static bool verbose = false; /* 'verbose' option flag */
-static FILE *output = NULL;  /* output file (default: stdout) */
+static bool debug = false;	     /* 'debug' option flag */
+static bool verbose = false;	     /* 'verbose' option flag */
+static FILE *output = NULL;	     /* output file (default: stdout) */
+static writer_t *step_output = NULL; /* per-step output (while tracing) */
 
 /* Get current instruction pointer address */
 static uintptr_t
@@ -60,6 +91,1354 @@ get_current_ip (struct user_regs_struct *regs)
 #endif
 }
 
+/* Set the instruction pointer address */
+static void
+set_current_ip (struct user_regs_struct *regs, uintptr_t ip)
+{
+#if defined(__x86_64__) /* amd64 architecture */
+  regs->rip = ip;
+#elif defined(__i386__) /* i386 architecture */
+  regs->eip = ip;
+#endif
+}
+
+/* Get current stack pointer address */
+static uintptr_t
+get_stack_pointer (struct user_regs_struct *regs)
+{
+#if defined(__x86_64__) /* amd64 architecture */
+  return regs->rsp;
+#elif defined(__i386__) /* i386 architecture */
+  return regs->esp;
+#endif
+}
+
+/* Get the number of the system call about to be executed */
+static long
+get_syscall_number (struct user_regs_struct *regs)
+{
+#if defined(__x86_64__) /* amd64 architecture */
+  return regs->rax;
+#elif defined(__i386__) /* i386 architecture */
+  return regs->eax;
+#endif
+}
+
+/* Check if the instruction is a system call changing the memory mappings
+ * (mmap(), munmap(), mremap() or mprotect()) */
+static bool
+is_mmap_syscall (arch_t arch, const uint8_t *bytes, long number)
+{
+  /* 'syscall', 'sysenter' and 'int 0x80' */
+  if (!(bytes[0] == 0x0f && (bytes[1] == 0x05 || bytes[1] == 0x34)) &&
+      !(bytes[0] == 0xcd && bytes[1] == 0x80))
+    return false;
+
+  if (arch == x86_64_arch)
+    return number == 9 || number == 10 || number == 11 || number == 25;
+
+  /* mmap(), munmap(), mprotect(), mremap() and mmap2() on i386 */
+  return number == 90 || number == 91 || number == 125 || number == 163 ||
+	 number == 192;
+}
+
+/* Breakpoint set on the return address of an opaque import */
+typedef struct
+{
+  uintptr_t addr; /* Address of the breakpoint (0 if none) */
+  long word;	  /* Original word at addr */
+} breakpoint_t;
+
+/* Let the child run at full speed up to addr */
+static void
+run_to (pid_t child, breakpoint_t *bp, uintptr_t addr)
+{
+  errno = 0;
+  bp->word = ptrace (PTRACE_PEEKTEXT, child, addr, NULL);
+  if (errno != 0 ||
+      ptrace (PTRACE_POKETEXT, child, addr,
+	      (void *) ((bp->word & ~0xffL) | 0xcc)) == -1)
+    err (EXIT_FAILURE, "error: cannot set a breakpoint at 0x%" PRIxPTR, addr);
+  bp->addr = addr;
+
+  while (ptrace (PTRACE_CONT, child, NULL, NULL))
+    ;
+}
+
+/* Check if the child stopped on the breakpoint ('int3' leaves the ip just
+ * after it), if so remove it and move the child back to its address */
+static bool
+breakpoint_reached (pid_t child, breakpoint_t *bp,
+		    struct user_regs_struct *regs)
+{
+  if (get_current_ip (regs) != bp->addr + 1)
+    return false;
+
+  if (ptrace (PTRACE_POKETEXT, child, bp->addr, (void *) bp->word) == -1)
+    err (EXIT_FAILURE, "error: cannot remove the breakpoint at 0x%" PRIxPTR,
+	 bp->addr);
+  set_current_ip (regs, bp->addr);
+  ptrace (PTRACE_SETREGS, child, NULL, regs);
+  bp->addr = 0;
+
+  return true;
+}
+
+/* End of the output line of an instruction (after its address) */
+typedef struct
+{
+  char *text;  /* Bytes, padding, mnemonic and operands */
+  size_t size; /* Length of the text */
+} output_line_t;
+
+/* Format the end of the output line of an instruction, returns 0 on
+ * success and -1 on error */
+static int
+format_line (output_line_t *line, const uint8_t *bytes, size_t size,
+	     const char *assembly)
+{
+  size_t len = 3 * size + 5 + strlen (assembly) + 2;
+  line->text = malloc (len);
+  if (line->text == NULL)
+    return -1;
+
+  /* Display the bytes */
+  size_t n = 0;
+  for (size_t i = 0; i < size; i++)
+    n += snprintf (line->text + n, len - n, " %02x", bytes[i]);
+
+  /* Pretty printing and formating */
+  if (size != 8 && size != 11)
+    line->text[n++] = '\t';
+
+  for (size_t i = 0; i + size / 3 < 4; i++)
+    line->text[n++] = '\t';
+
+  /* Display mnemonic and operand */
+  n += snprintf (line->text + n, len - n, "%s\n", assembly);
+  line->size = n;
+
+  return 0;
+}
+
+/* Flush the per-step output pending when exiting on an error */
+static void
+flush_step_output (void)
+{
+  if (step_output != NULL)
+    writer_flush (step_output);
+}
+
+/* Page of code executed by the child, the instructions are fetched from
+ * the copy of the page unless it is writable (or cannot be read) */
+typedef struct
+{
+  uintptr_t page;		 /* Address of the page */
+  bool writable;		 /* Page may change without a system call */
+  bool overwritten;		 /* Page holds code found overwritten */
+  uint8_t bytes[CODE_PAGE_SIZE]; /* Copy of the page */
+} code_page_t;
+
+/* Address of code found overwritten */
+typedef struct
+{
+  uintptr_t addr;      /* Address of the instruction */
+  uint16_t generation; /* Number of times the code at addr was overwritten */
+} code_version_t;
+
+/* Writable mapping of the child */
+typedef struct
+{
+  uintptr_t start; /* Start address of the mapping */
+  uintptr_t end;   /* End address of the mapping */
+} code_range_t;
+
+/* File mapped shared and writable by the child */
+typedef struct
+{
+  unsigned major;      /* Major number of the device */
+  unsigned minor;      /* Minor number of the device */
+  unsigned long inode; /* Inode of the file */
+} code_file_t;
+
+/* Code executed by the child */
+typedef struct
+{
+  pid_t pid;		    /* Traced process */
+  int mem;		    /* Memory of the process (-1 if not open) */
+  size_t count;		    /* Number of pages */
+  size_t size;		    /* Allocated size of the array */
+  code_page_t **pages;	    /* Pages (sorted by address) */
+  code_page_t *last;	    /* Last page looked up */
+  size_t versions_count;    /* Number of addresses overwritten */
+  size_t versions_size;	    /* Allocated size of the array */
+  code_version_t *versions; /* Addresses overwritten (sorted) */
+  size_t ranges_count;	    /* Number of writable mappings */
+  size_t ranges_size;	    /* Allocated size of the array */
+  code_range_t *ranges;	    /* Writable mappings (sorted) */
+  size_t overwrites;	    /* Number of instructions found overwritten */
+  size_t invalidated;	    /* Decode cache entries invalidated */
+} code_pages_t;
+
+static int
+code_page_compare (const void *key, const void *elem)
+{
+  uintptr_t page = *(const uintptr_t *) key;
+  uintptr_t other = (*(code_page_t *const *) elem)->page;
+  return (page > other) - (page < other);
+}
+
+static int
+code_version_compare (const void *key, const void *elem)
+{
+  uintptr_t addr = *(const uintptr_t *) key;
+  uintptr_t other = ((const code_version_t *) elem)->addr;
+  return (addr > other) - (addr < other);
+}
+
+static int
+code_range_compare (const void *key, const void *elem)
+{
+  uintptr_t addr = *(const uintptr_t *) key;
+  const code_range_t *range = elem;
+  return (addr >= range->end) - (addr < range->start);
+}
+
+/* Read a line of /proc/pid/maps, returns false if it cannot be parsed */
+static bool
+code_map_parse (const char *line, code_range_t *range, char perms[5],
+		code_file_t *file)
+{
+  return sscanf (line,
+		 "%" SCNxPTR "-%" SCNxPTR " %4s %*x %x:%x %lu", &range->start,
+		 &range->end, perms, &file->major, &file->minor,
+		 &file->inode) == 6;
+}
+
+/* Read the writable mappings of the child, returns 0 on success and -1 on
+ * error. A W^X JIT may map the same file (memfd or shm) twice, writing the
+ * code through a shared writable alias of the executable mapping: shared
+ * mappings of a file also mapped shared and writable count as writable */
+static int
+code_ranges_read (code_pages_t *cp)
+{
+  char filename[64];
+  snprintf (filename, sizeof (filename), "/proc/%ld/maps", (long) cp->pid);
+
+  FILE *fd = fopen (filename, "re");
+  if (fd == NULL)
+    return -1;
+
+  char *line = NULL;
+  size_t size = 0;
+  int ret = 0;
+  code_range_t range;
+  code_file_t file;
+  char perms[5];
+
+  /* Files mapped shared and writable */
+  code_file_t *files = NULL;
+  size_t files_count = 0, files_size = 0;
+  while (ret == 0 && getline (&line, &size, fd) != -1)
+    {
+      if (!code_map_parse (line, &range, perms, &file) || perms[1] != 'w' ||
+	  perms[3] != 's' || file.inode == 0)
+	continue;
+
+      if (files_count == files_size)
+	{
+	  size_t grown_size = 2 * files_size + 4;
+	  code_file_t *grown =
+	      realloc (files, grown_size * sizeof (code_file_t));
+	  if (grown == NULL)
+	    {
+	      ret = -1;
+	      continue;
+	    }
+	  files = grown;
+	  files_size = grown_size;
+	}
+      files[files_count++] = file;
+    }
+
+  /* The mappings are listed by increasing addresses */
+  rewind (fd);
+  cp->ranges_count = 0;
+  while (ret == 0 && getline (&line, &size, fd) != -1)
+    {
+      if (!code_map_parse (line, &range, perms, &file))
+	continue;
+
+      bool writable = (perms[1] == 'w');
+      for (size_t i = 0; !writable && perms[3] == 's' && i < files_count; i++)
+	writable = files[i].major == file.major &&
+		   files[i].minor == file.minor && files[i].inode == file.inode;
+      if (!writable)
+	continue;
+
+      if (cp->ranges_count == cp->ranges_size)
+	{
+	  size_t grown_size = 2 * cp->ranges_size + 16;
+	  code_range_t *grown =
+	      realloc (cp->ranges, grown_size * sizeof (code_range_t));
+	  if (grown == NULL)
+	    {
+	      ret = -1;
+	      continue;
+	    }
+	  cp->ranges = grown;
+	  cp->ranges_size = grown_size;
+	}
+      cp->ranges[cp->ranges_count++] = range;
+    }
+
+  free (files);
+  free (line);
+  fclose (fd);
+
+  return ret;
+}
+
+/* Start to follow the code of the child, returns 0 on success and -1 on
+ * error */
+static int
+code_pages_open (code_pages_t *cp, pid_t pid)
+{
+  char filename[64];
+  snprintf (filename, sizeof (filename), "/proc/%ld/mem", (long) pid);
+
+  cp->pid = pid;
+  cp->mem = open (filename, O_RDONLY | O_CLOEXEC);
+  if (cp->mem == -1)
+    return -1;
+
+  return code_ranges_read (cp);
+}
+
+/* Free the pages and close the memory of the child */
+static void
+code_pages_close (code_pages_t *cp)
+{
+  for (size_t i = 0; i < cp->count; i++)
+    free (cp->pages[i]);
+  free (cp->pages);
+  free (cp->versions);
+  free (cp->ranges);
+  if (cp->mem != -1)
+    close (cp->mem);
+}
+
+/* Read the page at addr from the child, returns true on success */
+static bool
+code_page_read (code_pages_t *cp, uintptr_t page, uint8_t *bytes)
+{
+  return pread (cp->mem, bytes, CODE_PAGE_SIZE, (off_t) page) ==
+	 CODE_PAGE_SIZE;
+}
+
+/* Check if the page at addr is in a writable mapping (or in a shared
+ * mapping written through another one, see code_ranges_read()) */
+static bool
+code_page_writable (code_pages_t *cp, uintptr_t page)
+{
+  return cp->ranges_count > 0 &&
+	 bsearch (&page, cp->ranges, cp->ranges_count, sizeof (code_range_t),
+		  code_range_compare) != NULL;
+}
+
+/* Get the page holding addr, NULL if it has never been read */
+static code_page_t *
+code_page_find (code_pages_t *cp, uintptr_t addr)
+{
+  uintptr_t page = CODE_PAGE (addr);
+  if (cp->last != NULL && cp->last->page == page)
+    return cp->last;
+
+  if (cp->count == 0)
+    return NULL;
+
+  code_page_t **found = bsearch (&page, cp->pages, cp->count,
+				 sizeof (code_page_t *), code_page_compare);
+  if (found == NULL)
+    return NULL;
+
+  cp->last = *found;
+  return cp->last;
+}
+
+/* Get the page holding addr, read from the child when first met */
+static code_page_t *
+code_page_get (code_pages_t *cp, uintptr_t addr)
+{
+  code_page_t *found = code_page_find (cp, addr);
+  if (found != NULL)
+    return found;
+
+  code_page_t *page = malloc (sizeof (code_page_t));
+  if (page == NULL)
+    err (EXIT_FAILURE, "error: cannot copy the code");
+  page->page = CODE_PAGE (addr);
+  page->overwritten = false;
+
+  /* Pages that cannot be read are read again at each step */
+  if (code_page_read (cp, page->page, page->bytes))
+    page->writable = code_page_writable (cp, page->page);
+  else
+    {
+      memset (page->bytes, 0, CODE_PAGE_SIZE);
+      page->writable = true;
+    }
+
+  if (cp->count == cp->size)
+    {
+      size_t size = 2 * cp->size + 16;
+      code_page_t **grown = realloc (cp->pages, size * sizeof (code_page_t *));
+      if (grown == NULL)
+	err (EXIT_FAILURE, "error: cannot copy the code");
+      cp->pages = grown;
+      cp->size = size;
+    }
+
+  size_t i = cp->count;
+  while (i > 0 && cp->pages[i - 1]->page > page->page)
+    i--;
+  memmove (&(cp->pages[i + 1]), &(cp->pages[i]),
+	   (cp->count - i) * sizeof (code_page_t *));
+  cp->pages[i] = page;
+  cp->count++;
+
+  cp->last = page;
+  return page;
+}
+
+/* Get the generation of the code at addr, 0 if never overwritten */
+static uint16_t
+code_generation (code_pages_t *cp, uintptr_t addr)
+{
+  code_page_t *page = code_page_find (cp, addr);
+  if (page == NULL || !page->overwritten)
+    return 0;
+
+  code_version_t *found =
+      bsearch (&addr, cp->versions, cp->versions_count,
+	       sizeof (code_version_t), code_version_compare);
+
+  return (found == NULL) ? 0 : found->generation;
+}
+
+/* Move the code at addr to its next generation */
+static void
+code_overwritten (code_pages_t *cp, uintptr_t addr)
+{
+  size_t i = 0;
+  while (i < cp->versions_count && cp->versions[i].addr < addr)
+    i++;
+
+  if (i == cp->versions_count || cp->versions[i].addr != addr)
+    {
+      if (cp->versions_count == cp->versions_size)
+	{
+	  size_t size = 2 * cp->versions_size + 16;
+	  code_version_t *grown =
+	      realloc (cp->versions, size * sizeof (code_version_t));
+	  if (grown == NULL)
+	    err (EXIT_FAILURE, "error: cannot version the code");
+	  cp->versions = grown;
+	  cp->versions_size = size;
+	}
+      memmove (&(cp->versions[i + 1]), &(cp->versions[i]),
+	       (cp->versions_count - i) * sizeof (code_version_t));
+      cp->versions[i] = (code_version_t){.addr = addr, .generation = 0};
+      cp->versions_count++;
+    }
+
+  if (cp->versions[i].generation == UINT16_MAX)
+    errx (EXIT_FAILURE,
+	  "error: code at 0x%" PRIxPTR " overwritten too many times", addr);
+  cp->versions[i].generation++;
+  code_page_find (cp, addr)->overwritten = true;
+}
+
+/* Record that the code from addr to addr + size is now bytes. The copy of
+ * the pages holds the opcodes of the last instructions executed, the ones
+ * overlapping bytes that changed move to their next generation (and the
+ * others keep their node of the CFG) */
+static void
+code_update (code_pages_t *cp, hashtable_t *ht, decode_cache_t *dcache,
+	     uintptr_t addr, const uint8_t *bytes, size_t size)
+{
+  for (size_t i = 0; i < size;)
+    {
+      uintptr_t start = addr + i;
+      size_t len = CODE_PAGE_SIZE - (start - CODE_PAGE (start));
+      if (len > size - i)
+	len = size - i;
+
+      code_page_t *page = code_page_find (cp, start);
+      uint8_t *copy = (page == NULL) ? NULL : page->bytes + start - page->page;
+      if (copy == NULL || !memcmp (copy, bytes + i, len))
+	{
+	  i += len;
+	  continue;
+	}
+
+      for (size_t j = 0; j < len;)
+	{
+	  if (copy[j] == bytes[i + j])
+	    {
+	      j++;
+	      continue;
+	    }
+
+	  size_t k = j;
+	  while (k < len && copy[k] != bytes[i + k])
+	    k++;
+
+	  uintptr_t from = start + j, to = start + k;
+	  cp->invalidated += decode_cache_invalidate (dcache, from, to);
+	  uintptr_t first = from - MAX_OPCODE_BYTES + 1;
+	  for (uintptr_t at = (first > from) ? 0 : first; at < to; at++)
+	    {
+	      instr_t *instr =
+		  hashtable_find (ht, at, code_generation (cp, at));
+	      if (instr != NULL && at + instr_size (instr) > from)
+		{
+		  code_overwritten (cp, at);
+		  cp->overwrites++;
+		}
+	    }
+
+	  memcpy (copy + j, bytes + i + j, k - j);
+	  j = k;
+	}
+      i += len;
+    }
+}
+
+/* Get the opcode at ip, from the copy of its pages unless they may have
+ * been written since they were read */
+static void
+code_fetch (code_pages_t *cp, hashtable_t *ht, decode_cache_t *dcache,
+	    pid_t child, uintptr_t ip, uint8_t *buf)
+{
+  code_page_t *page = code_page_get (cp, ip);
+  code_page_t *next = NULL;
+  size_t offset = ip - page->page;
+  if (offset + MAX_OPCODE_BYTES > CODE_PAGE_SIZE)
+    next = code_page_get (cp, page->page + CODE_PAGE_SIZE);
+
+  if (!page->writable && (next == NULL || !next->writable))
+    {
+      size_t len = (next == NULL) ? MAX_OPCODE_BYTES : CODE_PAGE_SIZE - offset;
+      memcpy (buf, page->bytes + offset, len);
+      if (next != NULL)
+	memcpy (buf + len, next->bytes, MAX_OPCODE_BYTES - len);
+      return;
+    }
+
+  for (size_t i = 0; i < MAX_OPCODE_BYTES; i += 8)
+    {
+      long *ptr = (long *) &(buf[i]);
+      *ptr = ptrace (PTRACE_PEEKDATA, child, ip + i, NULL);
+    }
+  code_update (cp, ht, dcache, ip, buf, MAX_OPCODE_BYTES);
+}
+
+/* The mappings of the child changed, compare the pages with their copy */
+static int
+code_remapped (code_pages_t *cp, hashtable_t *ht, decode_cache_t *dcache)
+{
+  if (code_ranges_read (cp) == -1)
+    return -1;
+
+  uint8_t bytes[CODE_PAGE_SIZE];
+  for (size_t i = 0; i < cp->count; i++)
+    {
+      code_page_t *page = cp->pages[i];
+      if (!code_page_read (cp, page->page, bytes))
+	{
+	  page->writable = true;
+	  continue;
+	}
+      page->writable = code_page_writable (cp, page->page);
+      code_update (cp, ht, dcache, page->page, bytes, CODE_PAGE_SIZE);
+    }
+
+  return 0;
+}
+
+/* Check if name is in the comma-separated list */
+static bool
+in_list (const char *list, const char *name)
+{
+  size_t len = strlen (name);
+  while (list != NULL && *list != '\0')
+    {
+      if (strncmp (list, name, len) == 0 &&
+	  (list[len] == ',' || list[len] == '\0'))
+	return true;
+
+      list = strchr (list, ',');
+      if (list != NULL)
+	list++;
+    }
+
+  return false;
+}
+
+static int
+addr_compare (const void *a, const void *b)
+{
+  const uintptr_t *a1 = a, *a2 = b;
+  return (*a1 > *a2) - (*a1 < *a2);
+}
+
+/* Get the run-time addresses of the PLT entries of the imports listed in
+ * names (sorted by address) */
+static uintptr_t *
+get_opaque_entries (executable_t *exec, uintptr_t bias, const char *names,
+		    size_t *count)
+{
+  size_t imports = executable_imports (exec);
+  uintptr_t *entries = malloc ((imports ? imports : 1) * sizeof (uintptr_t));
+  if (entries == NULL)
+    err (EXIT_FAILURE, "error: cannot list opaque imports");
+
+  *count = 0;
+  for (size_t i = 0; i < imports; i++)
+    {
+      const char *name;
+      uintptr_t addr = executable_import (exec, i, &name);
+      if (in_list (names, name))
+	entries[(*count)++] = addr + bias;
+    }
+
+  return entries;
+}
+
+/* Get the difference between the run-time and the link-time addresses of
+ * the executable (non-zero for position independent executables) */
+static uintptr_t
+get_load_bias (pid_t child, executable_t *exec)
+{
+  char path[64];
+  snprintf (path, sizeof (path), "/proc/%d/auxv", (int) child);
+
+  FILE *auxv = fopen (path, "rb");
+  if (auxv == NULL)
+    err (EXIT_FAILURE, "error: cannot open '%s'", path);
+
+  /* Look for the run-time entry point among the auxiliary vector */
+  uintptr_t entry = executable_entry (exec);
+  bool elf32 = (executable_arch (exec) == x86_32_arch);
+  while (true)
+    {
+      uint64_t type, value;
+      if (elf32)
+	{
+	  uint32_t pair[2];
+	  if (fread (pair, sizeof (pair), 1, auxv) != 1)
+	    break;
+	  type = pair[0];
+	  value = pair[1];
+	}
+      else
+	{
+	  uint64_t pair[2];
+	  if (fread (pair, sizeof (pair), 1, auxv) != 1)
+	    break;
+	  type = pair[0];
+	  value = pair[1];
+	}
+
+      if (type == AT_NULL)
+	break;
+      if (type == AT_ENTRY)
+	{
+	  entry = value;
+	  break;
+	}
+    }
+  fclose (auxv);
+
+  return entry - executable_entry (exec);
+}
+
+/* Display statistics about the static disassembly from the CFG (reusing
+ * the instructions of the decode cache) */
+static void
+print_static (executable_t *exec, uintptr_t bias, decode_cache_t *dcache,
+	      cfg_t *cfg)
+{
+  long cores = sysconf (_SC_NPROCESSORS_ONLN);
+  disasm_t *d = disasm_new (exec, bias, dcache);
+  if (d == NULL || disasm_run (d, cfg, (cores > 0) ? cores : 1) == -1)
+    err (EXIT_FAILURE, "error: cannot disassemble the executable");
+
+  size_t count = disasm_count (d), executed = 0;
+  for (size_t i = 0; i < count; i++)
+    if (disasm_executed (d, i))
+      executed++;
+
+  fprintf (output,
+	   "\n"
+	   "\tStatic disassembly\n"
+	   "\t==================\n"
+	   "* #static instructions:      %zu\n"
+	   "* #executed instructions:    %zu\n"
+	   "* #unexecuted instructions:  %zu\n",
+	   count, executed, count - executed);
+
+  if (verbose)
+    for (size_t i = 0; i < count; i++)
+      if (!disasm_executed (d, i))
+	fprintf (output, "0x%" PRIxPTR "  (%zu bytes, not executed)\n",
+		 disasm_addr (d, i), disasm_size (d, i));
+
+  disasm_delete (d);
+}
+
+/* Get the decode cache of the executable, from the on-disk cache if
+ * use_cache is set (a fresh decoding with up to 'threads' threads is then
+ * saved for the next runs), returns NULL on error. The texts hold run-time
+ * addresses, each bias has a file of its own */
+static decode_cache_t *
+get_decode_cache (executable_t *exec, uintptr_t bias, bool intel,
+		  bool use_cache, size_t threads)
+{
+  decode_cache_t *dcache = NULL;
+  char *path = NULL;
+
+  if (use_cache)
+    {
+      char name[64];
+      snprintf (name, sizeof (name), "%s-%" PRIxPTR,
+		intel ? "decode-intel" : "decode", bias);
+      path = executable_cache_path (exec, name);
+      if (path == NULL)
+	warn ("warning: cannot access the cache");
+      else
+	dcache = decode_cache_load (exec, bias, intel, path);
+    }
+
+  if (dcache == NULL)
+    {
+      dcache = decode_cache_new (exec, bias, intel, threads);
+      if (dcache != NULL && path != NULL &&
+	  decode_cache_save (dcache, path) == -1)
+	warn ("warning: cannot save the decoded code to '%s'", path);
+    }
+
+  free (path);
+
+  return dcache;
+}
+
+/* Append the CFG of this run to the one of the previous runs in the cache
+ * directory of exec. Its nodes are keyed by run-time address, so the file
+ * is named after the modules of the run and their load address: only runs
+ * with the same layout (same libraries, without ASLR) share a CFG */
+static void
+save_cached_cfg (executable_t *exec, modules_t *modules, cfg_t *cfg)
+{
+  /* 64 bits FNV-1a hash of the identifiers and bases of the modules */
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t m = 0; m < modules_count (modules); m++)
+    {
+      const char *id = modules_id (modules, m);
+      if (id == NULL)
+	id = modules_name (modules, m);
+      uintptr_t base = modules_base (modules, m);
+
+      for (const char *c = id; *c != '\0'; c++)
+	hash = (hash ^ (uint8_t) *c) * 0x100000001b3ULL;
+      for (size_t i = 0; i < sizeof (base); i++)
+	hash = (hash ^ ((base >> (8 * i)) & 0xff)) * 0x100000001b3ULL;
+    }
+
+  char name[32];
+  snprintf (name, sizeof (name), "cfg-%016" PRIx64, hash);
+  char *path = executable_cache_path (exec, name);
+  if (path == NULL)
+    {
+      warn ("warning: cannot save the CFG to the cache");
+      return;
+    }
+
+  cfg_t *cached = cfg_load (path);
+  if (cached == NULL && errno != ENOENT)
+    warn ("warning: cannot load the CFG from '%s'", path);
+
+  cfg_t *all = (cached != NULL) ? cached : cfg;
+  if ((all != cfg && cfg_append (all, cfg) == -1) ||
+      cfg_save (all, path) == -1)
+    warn ("warning: cannot save the CFG to '%s'", path);
+
+  cfg_delete (cached);
+  free (path);
+}
+
+/* Display statistics about the targets of the dynamic jumps */
+static void
+print_dynjumps (cfg_t *cfg)
+{
+  size_t sites = 0, targets = 0, growing = 0;
+
+  for (size_t node = 0; node < cfg_nodes (cfg); node++)
+    {
+      if (cfg_node_type (cfg, node) != dynjump)
+	continue;
+
+      sites++;
+      targets += cfg_node_degree (cfg, node);
+      if (GROWING_RATIO * cfg_node_stable_hits (cfg, node) <
+	  cfg_node_hits (cfg, node))
+	growing++;
+    }
+
+  fprintf (output,
+	   "* #dynjump sites:            %zu\n"
+	   "* #dynjump targets:          %zu\n"
+	   "* #dynjump growing sites:    %zu\n",
+	   sites, targets, growing);
+}
+
+typedef struct
+{
+  size_t loop;	       /* Loop index */
+  size_t instructions; /* Instructions executed within the loop */
+} loop_rank_t;
+
+static int
+loop_rank_compare (const void *a, const void *b)
+{
+  const loop_rank_t *l1 = a, *l2 = b;
+  return (l1->instructions < l2->instructions) -
+	 (l1->instructions > l2->instructions);
+}
+
+/* Display the loops executing the largest number of instructions */
+static void
+print_top_loops (cfg_t *cfg)
+{
+  loops_t *loops = loops_new (cfg);
+  if (loops == NULL)
+    err (EXIT_FAILURE, "error: cannot compute loops");
+
+  size_t count = loops_count (loops);
+  loop_rank_t *ranks = malloc ((count ? count : 1) * sizeof (loop_rank_t));
+  if (ranks == NULL)
+    err (EXIT_FAILURE, "error: cannot rank loops");
+
+  for (size_t l = 0; l < count; l++)
+    ranks[l] = (loop_rank_t){l, loops_instructions (loops, l)};
+  qsort (ranks, count, sizeof (loop_rank_t), loop_rank_compare);
+
+  fprintf (output,
+	   "\n"
+	   "\tTop loops (by executed instructions)\n"
+	   "\t====================================\n"
+	   "* #loops:                    %zu\n",
+	   count);
+
+  for (size_t i = 0; i < count && i < TOP_LOOPS; i++)
+    {
+      size_t l = ranks[i].loop;
+      instr_t *header = cfg_node_instr (cfg, loops_header (loops, l));
+      fprintf (output,
+	       "* 0x%" PRIxPTR ": %zu instructions executed, %zu iterations, "
+	       "%zu entries, depth %zu, %zu nodes\n",
+	       instr_addr (header), ranks[i].instructions,
+	       loops_iterations (loops, l), loops_entries (loops, l),
+	       loops_depth (loops, l), loops_size (loops, l));
+    }
+
+  free (ranks);
+  loops_delete (loops);
+}
+
+/* Display the functions executing the largest number of instructions */
+static void
+print_top_functions (executable_t *exec, uintptr_t bias, cfg_t *cfg,
+		     functions_t *fn, modules_t *modules)
+{
+  size_t count = functions_count (fn);
+  loop_rank_t *ranks = malloc ((count ? count : 1) * sizeof (loop_rank_t));
+  if (ranks == NULL)
+    err (EXIT_FAILURE, "error: cannot rank functions");
+
+  for (size_t f = 0; f < count; f++)
+    ranks[f] = (loop_rank_t){f, functions_instructions (fn, f)};
+  qsort (ranks, count, sizeof (loop_rank_t), loop_rank_compare);
+
+  fprintf (output,
+	   "\n"
+	   "\tTop functions (by executed instructions)\n"
+	   "\t========================================\n"
+	   "* #functions:                %zu\n",
+	   count);
+
+  for (size_t i = 0; i < count && i < TOP_FUNCTIONS; i++)
+    {
+      size_t f = ranks[i].loop;
+      uintptr_t entry =
+	  instr_addr (cfg_node_instr (cfg, functions_entry (fn, f)));
+
+      /* Names are taken from the executable of the module of the entry */
+      executable_t *module_exec = exec;
+      uintptr_t link = entry - bias;
+      if (modules != NULL)
+	link = modules_link_addr (modules, entry, &module_exec);
+
+      const char *symbol =
+	  executable_get_demangled_symbol_by_addr (module_exec, link);
+      const char *import =
+	  executable_get_demangled_import_by_addr (module_exec, link);
+      const char *section = executable_get_section_by_addr (module_exec, link);
+
+      fprintf (output,
+	       "* 0x%" PRIxPTR " <%s%s> (%s): %zu instructions executed, "
+	       "%zu calls, %zu nodes\n",
+	       entry, symbol ? symbol : import ? import : "?",
+	       (!symbol && import) ? "@plt" : "", section ? section : "?",
+	       ranks[i].instructions, functions_calls (fn, f),
+	       functions_size (fn, f));
+    }
+
+  free (ranks);
+}
+
+/* Executed instructions attributed to a source line */
+typedef struct
+{
+  uintptr_t addr;      /* Link-time address of the instruction */
+  const char *file;    /* Source file */
+  size_t line;	       /* Line number (0 if unknown) */
+  size_t instructions; /* Instructions executed */
+} line_rank_t;
+
+static int
+line_rank_addr_compare (const void *a, const void *b)
+{
+  const line_rank_t *l1 = a, *l2 = b;
+  return (l1->addr > l2->addr) - (l1->addr < l2->addr);
+}
+
+static int
+line_rank_line_compare (const void *a, const void *b)
+{
+  const line_rank_t *l1 = a, *l2 = b;
+  int cmp = strcmp (l1->file, l2->file);
+  if (cmp != 0)
+    return cmp;
+  return (l1->line > l2->line) - (l1->line < l2->line);
+}
+
+static int
+line_rank_compare (const void *a, const void *b)
+{
+  const line_rank_t *l1 = a, *l2 = b;
+  return (l1->instructions < l2->instructions) -
+	 (l1->instructions > l2->instructions);
+}
+
+/* Display the source lines of the executable executing the largest number
+ * of instructions (if it has a DWARF line table) */
+static void
+print_top_lines (executable_t *exec, uintptr_t bias, cfg_t *cfg)
+{
+  if (executable_lines (exec) == 0)
+    return;
+
+  size_t count = cfg_nodes (cfg);
+  line_rank_t *ranks = malloc ((count ? count : 1) * sizeof (line_rank_t));
+  uintptr_t *addrs = malloc ((count ? count : 1) * sizeof (uintptr_t));
+  const char **files = malloc ((count ? count : 1) * sizeof (const char *));
+  size_t *lines = malloc ((count ? count : 1) * sizeof (size_t));
+  if (ranks == NULL || addrs == NULL || files == NULL || lines == NULL)
+    err (EXIT_FAILURE, "error: cannot rank source lines");
+
+  /* Attribute the instructions in a single pass over the line table */
+  for (size_t v = 0; v < count; v++)
+    ranks[v] = (line_rank_t){instr_addr (cfg_node_instr (cfg, v)) - bias,
+			     NULL, 0, cfg_node_hits (cfg, v)};
+  qsort (ranks, count, sizeof (line_rank_t), line_rank_addr_compare);
+  for (size_t v = 0; v < count; v++)
+    addrs[v] = ranks[v].addr;
+  executable_get_lines_by_addr (exec, addrs, count, files, lines);
+
+  /* Sum the instructions of each line */
+  size_t known = 0;
+  for (size_t v = 0; v < count; v++)
+    if (lines[v] != 0)
+      ranks[known++] = (line_rank_t){addrs[v], files[v], lines[v],
+				     ranks[v].instructions};
+  qsort (ranks, known, sizeof (line_rank_t), line_rank_line_compare);
+
+  size_t distinct = 0;
+  for (size_t i = 0; i < known; i++)
+    if (distinct > 0 && !line_rank_line_compare (&ranks[distinct - 1],
+						 &ranks[i]))
+      ranks[distinct - 1].instructions += ranks[i].instructions;
+    else
+      ranks[distinct++] = ranks[i];
+  qsort (ranks, distinct, sizeof (line_rank_t), line_rank_compare);
+
+  fprintf (output,
+	   "\n"
+	   "\tTop source lines (by executed instructions)\n"
+	   "\t===========================================\n"
+	   "* #source lines:             %zu\n",
+	   distinct);
+
+  for (size_t i = 0; i < distinct && i < TOP_LINES; i++)
+    fprintf (output, "* %s:%zu: %zu instructions executed\n", ranks[i].file,
+	     ranks[i].line, ranks[i].instructions);
+
+  free (ranks);
+  free (addrs);
+  free (files);
+  free (lines);
+}
+
+/* Instruction executed in a module */
+typedef struct
+{
+  size_t module;
+  coverage_t record;
+} module_hit_t;
+
+static int
+module_hit_compare (const void *a, const void *b)
+{
+  const module_hit_t *h1 = a, *h2 = b;
+  if (h1->module != h2->module)
+    return (h1->module > h2->module) - (h1->module < h2->module);
+  return (h1->record.offset > h2->record.offset) -
+	 (h1->record.offset < h2->record.offset);
+}
+
+/* Add the hits of the instructions of each module in this run, keyed by
+ * their offset in the module, to the coverage file in the cache directory
+ * of its executable (coverage of runs with different load addresses can
+ * then be merged) */
+static void
+save_coverage (modules_t *modules, cfg_t *cfg)
+{
+  size_t count = cfg_nodes (cfg), known = 0;
+  module_hit_t *hits = malloc ((count ? count : 1) * sizeof (module_hit_t));
+  coverage_t *records = malloc ((count ? count : 1) * sizeof (coverage_t));
+  if (hits == NULL || records == NULL)
+    err (EXIT_FAILURE, "error: cannot save the coverage");
+
+  for (size_t v = 0; v < count; v++)
+    {
+      uintptr_t offset;
+      size_t module = modules_lookup (
+	  modules, instr_addr (cfg_node_instr (cfg, v)), &offset);
+      if (module != MODULE_NONE && modules_id (modules, module) != NULL)
+	hits[known++] =
+	    (module_hit_t){module, {offset, cfg_node_hits (cfg, v)}};
+    }
+  qsort (hits, known, sizeof (module_hit_t), module_hit_compare);
+
+  for (size_t i = 0, next; i < known; i = next)
+    {
+      for (next = i; next < known && hits[next].module == hits[i].module;
+	   next++)
+	records[next - i] = hits[next].record;
+
+      executable_t *exec = modules_executable (modules, hits[i].module);
+      char *path = executable_cache_path (exec, "coverage");
+      if (path == NULL || coverage_merge (path, records, next - i) == -1)
+	warn ("warning: cannot save the coverage of '%s'",
+	      modules_name (modules, hits[i].module));
+      free (path);
+    }
+
+  free (hits);
+  free (records);
+}
+
+/* Display the modules executing the largest number of instructions */
+static void
+print_top_modules (modules_t *modules, size_t *hits, size_t hits_size)
+{
+  size_t count = modules_count (modules);
+  loop_rank_t *ranks = malloc ((count ? count : 1) * sizeof (loop_rank_t));
+  if (ranks == NULL)
+    err (EXIT_FAILURE, "error: cannot rank modules");
+
+  for (size_t m = 0; m < count; m++)
+    ranks[m] = (loop_rank_t){m, (m < hits_size) ? hits[m] : 0};
+  qsort (ranks, count, sizeof (loop_rank_t), loop_rank_compare);
+
+  fprintf (output,
+	   "\n"
+	   "\tTop modules (by executed instructions)\n"
+	   "\t======================================\n"
+	   "* #modules:                  %zu\n",
+	   count);
+
+  for (size_t i = 0; i < count && i < TOP_MODULES && ranks[i].instructions;
+       i++)
+    fprintf (output, "* %s (0x%" PRIxPTR "): %zu instructions executed\n",
+	     modules_name (modules, ranks[i].loop),
+	     modules_base (modules, ranks[i].loop), ranks[i].instructions);
+
+  free (ranks);
+}
+
+/* Executables analysed statically in batch mode */
+typedef struct
+{
+  FILE *list;		/* Paths of the executables (one per line) */
+  pthread_mutex_t lock;	/* Lock on the list and the counters */
+  const char *dir;	/* Directory of the result files */
+  bool intel;		/* Intel syntax (AT&T otherwise) */
+  bool use_cache;	/* Reuse and fill the on-disk cache */
+  size_t analysed;	/* Number of executables analysed */
+  size_t failed;	/* Number of executables not analysed */
+} batch_t;
+
+/* Write the result of the static analysis of exec to fd */
+static void
+batch_report (executable_t *exec, const char *path, decode_cache_t *dcache,
+	      disasm_t *d, cfg_t *cfg, FILE *fd)
+{
+  fprintf (fd, "* Executable: %s\n", path);
+  fprintf (fd, "* Identifier: %s\n", executable_id (exec));
+  fprintf (fd, "* Architecture: ");
+  executable_print_arch (exec, fd);
+  fprintf (fd,
+	   "\n"
+	   "* #sections:                 %zu\n"
+	   "* #function symbols:         %zu\n"
+	   "* #imports:                  %zu\n"
+	   "* #predecoded instructions:  %zu\n"
+	   "* #static instructions:      %zu\n"
+	   "* #static cfg nodes:         %zu\n"
+	   "* #static cfg edges:         %zu\n",
+	   executable_sections (exec), executable_symbols (exec),
+	   executable_imports (exec), decode_cache_count (dcache),
+	   disasm_count (d), cfg_nodes (cfg), cfg_edges (cfg));
+
+  fprintf (fd, "\n"
+	       "\tFunctions\n"
+	       "\t=========\n");
+
+  /* Both the symbols and the instructions are sorted by address */
+  size_t count = disasm_count (d), i = 0;
+  for (size_t s = 0; s < executable_symbols (exec); s++)
+    {
+      size_t size;
+      const char *name;
+      uintptr_t start = executable_symbol (exec, s, &size, &name);
+      const char *demangled =
+	  executable_get_demangled_symbol_by_addr (exec, start);
+      const char *section = executable_get_section_by_addr (exec, start);
+
+      while (i < count && disasm_addr (d, i) < start)
+	i++;
+      size_t instructions = 0;
+      for (size_t j = i; j < count && disasm_addr (d, j) < start + size; j++)
+	instructions++;
+
+      fprintf (fd, "* 0x%" PRIxPTR " <%s> (%s): %zu instructions, %zu bytes\n",
+	       start, (demangled != NULL) ? demangled : name,
+	       (section != NULL) ? section : "?", instructions, size);
+    }
+}
+
+/* Analyse statically the executable at path and write the result to the
+ * directory of the batch, returns 0 on success and -1 on error */
+static int
+batch_analyse (batch_t *batch, char *path)
+{
+  executable_t *exec = executable_new (path);
+  if (exec == NULL)
+    {
+      if (errno == ENOEXEC)
+	warnx ("warning: '%s' is not a supported ELF binary", path);
+      else
+	warn ("warning: cannot read '%s'", path);
+      return -1;
+    }
+  executable_set_cache (exec, batch->use_cache);
+
+  /* Each executable is analysed by a single thread, the batch running
+   * one executable per thread */
+  int status = -1;
+  disasm_t *d = NULL;
+  cfg_t *cfg = NULL;
+  char *result = NULL, *tmp = NULL;
+  FILE *fd = NULL;
+  hashtable_t *ht = hashtable_new (DEFAULT_HASHTABLE_SIZE);
+  decode_cache_t *dcache =
+      get_decode_cache (exec, 0, batch->intel, batch->use_cache, 1);
+  if (ht == NULL || dcache == NULL ||
+      (d = disasm_new (exec, 0, dcache)) == NULL ||
+      disasm_run_static (d, exec, 1) == -1 ||
+      (disasm_count (d) > 0 &&
+       (cfg = disasm_cfg (d, executable_entry (exec), ht)) == NULL))
+    {
+      warn ("warning: cannot disassemble '%s'", path);
+      goto end;
+    }
+
+  /* Results are named after the identifier of the executable, the static
+   * CFG (ID.cfg, if any instruction was found) being loadable with
+   * cfg_load() */
+  const char *id = executable_id (exec);
+  size_t size = strlen (batch->dir) + strlen (id) + sizeof ("/.txt.XXXXXX");
+  result = malloc (size);
+  tmp = malloc (size);
+  if (result == NULL || tmp == NULL)
+    {
+      warn ("warning: cannot analyse '%s'", path);
+      goto end;
+    }
+
+  snprintf (result, size, "%s/%s.cfg", batch->dir, id);
+  if (cfg != NULL && cfg_save (cfg, result) == -1)
+    {
+      warn ("warning: cannot write file '%s'", result);
+      goto end;
+    }
+
+  /* Copies of an executable in the list share their identifier, each one
+   * writes a file of its own that replaces the result at once */
+  snprintf (result, size, "%s/%s.txt", batch->dir, id);
+  snprintf (tmp, size, "%s.XXXXXX", result);
+  int fdesc = mkstemp (tmp);
+  if (fdesc == -1 || (fd = fdopen (fdesc, "w")) == NULL)
+    {
+      warn ("warning: cannot open file '%s'", result);
+      if (fdesc != -1)
+	{
+	  close (fdesc);
+	  unlink (tmp);
+	}
+      goto end;
+    }
+
+  batch_report (exec, path, dcache, d, cfg, fd);
+  if (fclose (fd) == EOF || rename (tmp, result) == -1)
+    {
+      warn ("warning: cannot write file '%s'", result);
+      unlink (tmp);
+    }
+  else
+    status = 0;
+
+end:
+  free (result);
+  free (tmp);
+  cfg_delete (cfg);
+  hashtable_delete (ht);
+  disasm_delete (d);
+  decode_cache_delete (dcache);
+  executable_delete (exec);
+
+  return status;
+}
+
+/* Take the executables from the list one at a time until it is exhausted,
+ * so that threads never wait for each other but on the list */
+static void *
+batch_worker (void *arg)
+{
+  batch_t *batch = arg;
+  char *line = NULL;
+  size_t line_size = 0;
+
+  while (true)
+    {
+      pthread_mutex_lock (&(batch->lock));
+      ssize_t len = getline (&line, &line_size, batch->list);
+      pthread_mutex_unlock (&(batch->lock));
+      if (len == -1)
+	break;
+
+      if (len > 0 && line[len - 1] == '\n')
+	line[--len] = '\0';
+      if (len == 0)
+	continue;
+
+      int status = batch_analyse (batch, line);
+
+      pthread_mutex_lock (&(batch->lock));
+      if (status == 0)
+	batch->analysed++;
+      else
+	batch->failed++;
+      pthread_mutex_unlock (&(batch->lock));
+    }
+
+  free (line);
+
+  return NULL;
+}
+
+/* Analyse statically the executables listed in list with one thread per
+ * core, at most one executable per thread being in memory at a time.
+ * Returns the exit status of the batch */
+static int
+run_batch (FILE *list, const char *dir, bool intel, bool use_cache)
+{
+  struct stat dir_stats;
+  if (stat (dir, &dir_stats) == -1)
+    err (EXIT_FAILURE, "error: '%s'", dir);
+  if (!S_ISDIR (dir_stats.st_mode))
+    errx (EXIT_FAILURE, "error: '%s' is not a directory", dir);
+
+  batch_t batch = {.list = list,
+		   .dir = dir,
+		   .intel = intel,
+		   .use_cache = use_cache};
+  pthread_mutex_init (&(batch.lock), NULL);
+
+  /* Start the workers (the first one runs in the calling thread) */
+  long cores = sysconf (_SC_NPROCESSORS_ONLN);
+  size_t workers = (cores > 0) ? cores : 1;
+  pthread_t *tids = calloc (workers, sizeof (pthread_t));
+  bool *started = calloc (workers, sizeof (bool));
+  if (tids == NULL || started == NULL)
+    err (EXIT_FAILURE, "error: cannot start the batch");
+
+  for (size_t i = 1; i < workers; i++)
+    started[i] = !pthread_create (&tids[i], NULL, batch_worker, &batch);
+  batch_worker (&batch);
+
+  for (size_t i = 1; i < workers; i++)
+    if (started[i])
+      pthread_join (tids[i], NULL);
+
+  free (tids);
+  free (started);
+  pthread_mutex_destroy (&(batch.lock));
+
+  fprintf (output, "* #executables analysed:    %zu\n", batch.analysed);
+  fprintf (output, "* #executables failed:      %zu\n", batch.failed);
+
+  return (batch.failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* Selection of the nodes of a function for exports */
+typedef struct
+{
+  functions_t *fn; /* Functions of the CFG */
+  size_t function; /* Selected function */
+} function_filter_t;
+
+static bool
+keep_function (cfg_t *const cfg, const size_t node, void *data)
+{
+  (void) cfg;
+  function_filter_t *filter = data;
+  return functions_of (filter->fn, node) == filter->function;
+}
+
 int
 main (int argc, char *argv[], char *envp[])
 {
@@ -71,23 +1450,77 @@ main (int argc, char *argv[], char *envp[])
 
   /* Options parser settings */
   opterr = 0; /* Mute error message from getopt() */
-  const char *opts = "dhio:vV";
+  const char *opts = "ab:c:Cdf:F:g:hio:r:sS:vVx:";
 
   bool intel = false;
+  bool static_disasm = false;
+  bool use_cache = false;
+  bool aslr = false;
+  uintptr_t bias = 0;
+  const char *cfg_file = NULL;
+  const char *frontier_file = NULL;
+  const char *save_file = NULL;
+  const char *callgraph_file = NULL;
+  const char *opaque_names = NULL;
+  const char *batch_dir = NULL;
+  int callgraph_format = -1;
+  uintptr_t function_addr = 0;
+  int cfg_format = -1;
+  filter_t cfg_filter = {0};
 
-  const struct option long_opts[] = {{"debug", no_argument, NULL, 'd'},
-				     {"intel", no_argument, NULL, 'i'},
-				     {"output", required_argument, NULL, 'o'},
-				     {"verbose", no_argument, NULL, 'v'},
-				     {"version", no_argument, NULL, 'V'},
-				     {"help", no_argument, NULL, 'h'},
-				     {NULL, 0, NULL, 0}};
+  const struct option long_opts[] = {
+      {"aslr", no_argument, NULL, 'a'},
+      {"batch", required_argument, NULL, 'b'},
+      {"cache", no_argument, NULL, 'C'},
+      {"cfg", required_argument, NULL, 'c'},
+      {"debug", no_argument, NULL, 'd'},
+      {"frontier", required_argument, NULL, 'f'},
+      {"function", required_argument, NULL, 'F'},
+      {"callgraph", required_argument, NULL, 'g'},
+      {"intel", no_argument, NULL, 'i'},
+      {"opaque", required_argument, NULL, 'x'},
+      {"output", required_argument, NULL, 'o'},
+      {"range", required_argument, NULL, 'r'},
+      {"save", required_argument, NULL, 'S'},
+      {"static", no_argument, NULL, 's'},
+      {"verbose", no_argument, NULL, 'v'},
+      {"version", no_argument, NULL, 'V'},
+      {"help", no_argument, NULL, 'h'},
+      {NULL, 0, NULL, 0}};
 
   const char *usage_msg =
-      "Usage: %1$s [-o FILE|-i|-v|-d|-V|-h] [--] EXEC [ARGS]\n"
+      "Usage: %1$s [-o FILE|-c FILE|-r FROM:TO|-F ADDR|-f FILE|-g FILE|"
+      "-S FILE|-x FUNCS|-s|-i|-v|-d|-V|-h] [--] EXEC [ARGS]\n"
+      "       %1$s -b DIR [-o FILE|-C|-i] < LIST\n"
       "Trace the execution of EXEC on the given arguments ARGS\n"
       "\n"
       " -o FILE,--output FILE  write result to FILE\n"
+      " -c FILE,--cfg FILE     export the CFG to FILE (.dot, .graphml, .json)\n"
+      " -r FROM:TO,--range FROM:TO\n"
+      "                        export only the CFG between addresses FROM:TO\n"
+      " -F ADDR,--function ADDR\n"
+      "                        export only the function containing ADDR\n"
+      " -f FILE,--frontier FILE\n"
+      "                        write the branches to explore to FILE (json)\n"
+      " -g FILE,--callgraph FILE\n"
+      "                        export the call graph to FILE (.dot, .graphml,\n"
+      "                        .json)\n"
+      " -S FILE,--save FILE    save the CFG to FILE (binary format)\n"
+      " -x FUNCS,--opaque FUNCS\n"
+      "                        run the imported functions FUNCS (comma\n"
+      "                        separated) at full speed without tracing\n"
+      " -s,--static            disassemble statically from the executed code\n"
+      " -b DIR,--batch DIR     disassemble statically the executables listed\n"
+      "                        on the standard input (one per line), without\n"
+      "                        running them, and write the result of each to\n"
+      "                        DIR/ID.txt and its static CFG to DIR/ID.cfg\n"
+      "                        (ID being its build-ID or hash)\n"
+      " -C,--cache             reuse the analyses of EXEC kept in the cache\n"
+      "                        directory ($XDG_CACHE_HOME/tracker) and add\n"
+      "                        the coverage of each module to it (without\n"
+      "                        -a, the CFG of the runs whose modules are\n"
+      "                        loaded at the same addresses is kept too)\n"
+      " -a,--aslr              keep the address space layout randomization\n"
       " -i,--intel             switch to intel syntax (default: at&t)\n"
       " -v,--verbose           verbose output\n"
       " -d,--debug             debug output\n"
@@ -105,6 +1538,70 @@ main (int argc, char *argv[], char *envp[])
 	  err (EXIT_FAILURE, "error: cannot open file '%s'", optarg);
 	break;
 
+      case 'c': /* CFG export file */
+	cfg_file = optarg;
+	cfg_format = format_from_filename (optarg);
+	if (cfg_format == -1)
+	  errx (EXIT_FAILURE, "error: unknown CFG format for '%s'", optarg);
+	break;
+
+      case 'r': /* CFG export address range */
+	{
+	  char *end;
+	  cfg_filter.start = strtoull (optarg, &end, 0);
+	  if (*end != ':')
+	    errx (EXIT_FAILURE, "error: invalid address range '%s'", optarg);
+	  cfg_filter.end = strtoull (end + 1, &end, 0);
+	  if (*end != '\0' || cfg_filter.end <= cfg_filter.start)
+	    errx (EXIT_FAILURE, "error: invalid address range '%s'", optarg);
+	}
+	break;
+
+      case 'F': /* CFG export function */
+	{
+	  char *end;
+	  function_addr = strtoull (optarg, &end, 0);
+	  if (*end != '\0' || function_addr == 0)
+	    errx (EXIT_FAILURE, "error: invalid address '%s'", optarg);
+	}
+	break;
+
+      case 'f': /* Coverage frontier file */
+	frontier_file = optarg;
+	break;
+
+      case 'g': /* Call graph export file */
+	callgraph_file = optarg;
+	callgraph_format = format_from_filename (optarg);
+	if (callgraph_format == -1)
+	  errx (EXIT_FAILURE, "error: unknown call graph format for '%s'",
+		optarg);
+	break;
+
+      case 'b': /* Batch static analysis */
+	batch_dir = optarg;
+	break;
+
+      case 'S': /* Binary CFG file */
+	save_file = optarg;
+	break;
+
+      case 'x': /* Opaque imports */
+	opaque_names = optarg;
+	break;
+
+      case 'a': /* Address space layout randomization */
+	aslr = true;
+	break;
+
+      case 'C': /* On-disk cache of the analyses */
+	use_cache = true;
+	break;
+
+      case 's': /* Static disassembly */
+	static_disasm = true;
+	break;
+
       case 'i': /* intel syntax mode */
 	intel = true;
 	break;
@@ -132,6 +1629,10 @@ main (int argc, char *argv[], char *envp[])
 	errx (EXIT_FAILURE, "error: invalid option '%s'!", argv[optind - 1]);
       }
 
+  /* Batch mode does not trace any execution */
+  if (batch_dir != NULL)
+    return run_batch (stdin, batch_dir, intel, use_cache);
+
   /* Checking that extra arguments are present */
   if (optind > (argc - 1))
     errx (EXIT_FAILURE, "error: missing argument: an executable is required!");
@@ -146,7 +1647,20 @@ main (int argc, char *argv[], char *envp[])
   exec_argv[exec_argc] = NULL;
 
   /* Perfom various checks on the executable file */
+  struct stat exec_stats;
+  if (stat (exec_argv[0], &exec_stats) == -1)
+    err (EXIT_FAILURE, "error: '%s'", exec_argv[0]);
+
+  if (!S_ISREG (exec_stats.st_mode) || !(exec_stats.st_mode & S_IXUSR))
+    errx (EXIT_FAILURE, "error: '%s' is not an executable file", exec_argv[0]);
+
   executable_t *exec = executable_new (exec_argv[0]);
+  if (exec == NULL && errno == ENOEXEC)
+    errx (EXIT_FAILURE, "error: '%s' is not a supported ELF binary",
+	  exec_argv[0]);
+  else if (exec == NULL)
+    err (EXIT_FAILURE, "error: cannot read '%s'", exec_argv[0]);
+  executable_set_cache (exec, use_cache);
 
   if (verbose)
     {
@@ -172,8 +1686,9 @@ main (int argc, char *argv[], char *envp[])
   /* Initialized and start the child */
   if (child == 0)
     {
-      /* Disabling ASLR */
-      personality (ADDR_NO_RANDOMIZE);
+      /* Disabling ASLR (the addresses of the runs are the same) */
+      if (!aslr)
+	personality (ADDR_NO_RANDOMIZE);
 
       /* Start tracing the process */
       if (ptrace (PTRACE_TRACEME, 0, NULL, NULL) == -1)
@@ -220,71 +1735,264 @@ main (int argc, char *argv[], char *envp[])
   else
     cs_option (handle, CS_OPT_SYNTAX, CS_OPT_SYNTAX_ATT);
 
+  /* Instruction details are needed to classify the CFG nodes */
+  cs_option (handle, CS_OPT_DETAIL, CS_OPT_ON);
+
   /* Main disassembling loop */
   size_t instr_count = 0;
   hashtable_t *ht = hashtable_new (DEFAULT_HASHTABLE_SIZE);
   if (ht == NULL)
     err (EXIT_FAILURE, "error: cannot create hashtable");
 
+  cfg_t *cfg = NULL;
+
+  /* Shadow stack of the calls, the step after a call enters the callee and
+   * the step after a ret lands on the return address */
+  callgraph_t *cg = callgraph_new (CONTEXT_DEPTH);
+  if (cg == NULL)
+    err (EXIT_FAILURE, "error: cannot create call graph");
+  instr_type_t last_type = INSTR;
+  uintptr_t return_addr = 0;
+
+  /* Modules mapped in the process and instructions executed in each */
+  modules_t *modules = NULL;
+  bool mappings_changed = false;
+  size_t *module_hits = NULL, module_hits_size = 0;
+
+  /* PLT entries of the opaque imports */
+  uintptr_t *opaque = NULL;
+  size_t opaque_count = 0;
+  breakpoint_t bp = {0};
+
+  /* Instructions of the executable decoded ahead of the execution */
+  decode_cache_t *dcache = NULL;
+  size_t cache_hits = 0;
+
+  /* Pages of code executed, to find the code overwritten by the program
+   * itself (self-modifying code, JIT compilers) */
+  code_pages_t code_pages = {.mem = -1};
+
+  /* Output lines of the instructions (indexed by node of the CFG) */
+  output_line_t *lines = NULL;
+  size_t lines_size = 0;
+
+  /* The per-step output bypasses stdio, it is flushed by the exits on an
+   * error as stdio is */
+  writer_t *ob = writer_new (output, isatty (fileno (output)));
+  if (ob == NULL)
+    err (EXIT_FAILURE, "error: cannot allocate the output buffer");
+  step_output = ob;
+  if (atexit (flush_step_output) != 0)
+    errx (EXIT_FAILURE, "error: cannot register the output flush");
+
   while (true)
     {
+      bool opaque_call = false;
+
       /* Waiting for child process */
       wait (&status);
       if (WIFEXITED (status))
 	break;
 
+      /* The executable is mapped at the first stop (after execve()) */
+      if (instr_count == 0)
+	{
+	  bias = get_load_bias (child, exec);
+	  if (modules == NULL && (modules = modules_new (child)) == NULL)
+	    err (EXIT_FAILURE, "error: cannot read the memory map");
+	  if (code_pages.mem == -1 &&
+	      code_pages_open (&code_pages, child) == -1)
+	    err (EXIT_FAILURE, "error: cannot read the memory of the child");
+	  if (opaque_names != NULL && opaque == NULL)
+	    opaque = get_opaque_entries (exec, bias, opaque_names,
+					 &opaque_count);
+
+	  if (dcache == NULL)
+	    {
+	      /* The bias of a position-independent executable changes at
+	       * each run under ASLR, its decoding is not worth keeping */
+	      long cores = sysconf (_SC_NPROCESSORS_ONLN);
+	      dcache = get_decode_cache (exec, bias, intel,
+					 use_cache && (!aslr || bias == 0),
+					 (cores > 0) ? cores : 1);
+	      if (dcache == NULL)
+		err (EXIT_FAILURE, "error: cannot decode the executable");
+	    }
+	}
+
+      /* The previous instruction changed the memory mappings, the code
+       * may have been remapped or made writable */
+      if (mappings_changed &&
+	  (modules_update (modules) == -1 ||
+	   code_remapped (&code_pages, ht, dcache) == -1))
+	err (EXIT_FAILURE, "error: cannot read the memory map");
+      mappings_changed = false;
+
       /* Get instruction pointer */
       ptrace (PTRACE_GETREGS, child, NULL, &regs);
 
+      /* Stops inside an opaque import are not traced */
+      if (bp.addr != 0 && !breakpoint_reached (child, &bp, &regs))
+	{
+	  while (ptrace (PTRACE_CONT, child, NULL, NULL))
+	    ;
+	  continue;
+	}
+
       /* Printing instruction pointer */
       ip = get_current_ip (&regs);
-      fprintf (output, "0x%" PRIxPTR "  ", ip);
+      writer_hex (ob, ip);
+      writer_str (ob, "  ");
 
-      /* Get the opcode from memory */
-      for (size_t i = 0; i < MAX_OPCODE_BYTES; i += 8)
+      /* Attribute the instruction to its module */
+      size_t module = modules_lookup (modules, ip, NULL);
+      if (module != MODULE_NONE)
 	{
-	  long *ptr = (long *) &(buf[i]);
-	  *ptr = ptrace (PTRACE_PEEKDATA, child, ip + i, NULL);
+	  if (module >= module_hits_size)
+	    {
+	      size_t size = 2 * module + 16;
+	      size_t *grown = realloc (module_hits, size * sizeof (size_t));
+	      if (grown == NULL)
+		err (EXIT_FAILURE, "error: cannot count module hits");
+	      memset (grown + module_hits_size, 0,
+		      (size - module_hits_size) * sizeof (size_t));
+	      module_hits = grown;
+	      module_hits_size = size;
+	    }
+	  module_hits[module]++;
 	}
 
-      /* Get the mnemonic from decoder */
-      count = cs_disasm (handle, &(buf[0]), MAX_OPCODE_BYTES, 0x1000, 0, &insn);
-      if (count > 0)
-	{
-	  /* Display the bytes */
-	  for (size_t i = 0; i < insn[0].size; i++)
-	    fprintf (output, " %02x", buf[i]);
+      /* Get the opcode and the instruction executed there in the current
+       * generation of the code (if any) */
+      code_fetch (&code_pages, ht, dcache, child, ip, buf);
+      uint16_t generation = code_generation (&code_pages, ip);
+      instr_t *instr = hashtable_find (ht, ip, generation);
 
-	  /* Pretty printing and formating */
-	  if (insn[0].size != 8 && insn[0].size != 11)
-	    fprintf (output, "\t");
+      /* Instructions already executed are neither decoded nor formatted
+       * again, their node of the CFG holds all that is needed */
+      char text[sizeof (insn->mnemonic) + sizeof (insn->op_str) + 2];
+      const char *assembly = text;
+      node_t node_type = single;
+      size_t size = 0;
 
-	  for (int i = 0; i < 4 - (insn[0].size / 3); i++)
-	    fprintf (output, "\t");
+      count = 0;
+      if (instr != NULL)
+	{
+	  size = instr_size (instr);
+	  node_type = cfg_node_type (cfg, cfg_lookup (cfg, instr));
+	}
+      else
+	{
+	  /* Get the mnemonic from the decode cache, or from the decoder if
+	   * the instruction is unknown or has been modified since the start */
+	  const decoded_t *decoded = decode_cache_lookup (dcache, ip);
+	  instr_type_t type = INSTR;
 
-	  /* Display mnemonic and operand */
-	  fprintf (output, "%s  %s", insn[0].mnemonic, insn[0].op_str);
-	  fprintf (output, "\n");
+	  if (decoded != NULL && !memcmp (decoded->bytes, buf, decoded->size))
+	    {
+	      cache_hits++;
+	      size = decoded->size;
+	      type = decoded->type;
+	      node_type = decoded->node_type;
+	      assembly = decoded->text;
+	    }
+	  else if ((count = cs_disasm (handle, &(buf[0]), MAX_OPCODE_BYTES, ip,
+				       0, &insn)) > 0)
+	    {
+	      size = insn[0].size;
+	      type = disasm_instr_type (handle, insn);
+	      node_type = disasm_node_type (handle, insn);
+	      snprintf (text, sizeof (text), "%s  %s", insn[0].mnemonic,
+			insn[0].op_str);
+	    }
 
 	  /* Create the instr_t structure */
-	  instr_t *instr = instr_new (ip, insn[0].size, buf);
-	  if (!instr)
-	    err (EXIT_FAILURE, "error: cannot create instruction: ");
+	  if (size > 0)
+	    {
+	      instr = instr_new (ip, size, buf);
+	      if (!instr)
+		err (EXIT_FAILURE, "error: cannot create instruction: ");
+	      instr_set_type (instr, type);
+	      instr_set_generation (instr, generation);
+
+	      if (!hashtable_insert (ht, instr))
+		err (EXIT_FAILURE, "error: cannot store instruction");
+	    }
+	}
+
+      if (instr != NULL)
+	{
+	  /* Add the instruction to the control-flow graph */
+	  if (cfg == NULL)
+	    cfg = cfg_new (instr, node_type);
+	  else if (cfg_insert (cfg, instr, node_type) == NULL)
+	    err (EXIT_FAILURE, "error: cannot update cfg");
+
+	  if (cfg == NULL)
+	    err (EXIT_FAILURE, "error: cannot create cfg");
 
-	  if (!hashtable_insert (ht, instr))
+	  /* Display the line of the instruction, formatted once per node */
+	  size_t node = cfg_current (cfg);
+	  if (node >= lines_size)
 	    {
-	      if (errno != 0)
-		err (EXIT_FAILURE, "error:");
-	      instr_delete (instr);
+	      size_t new_size = 2 * node + 1024;
+	      output_line_t *grown =
+		  realloc (lines, new_size * sizeof (output_line_t));
+	      if (grown == NULL)
+		err (EXIT_FAILURE, "error: cannot format output");
+	      memset (grown + lines_size, 0,
+		      (new_size - lines_size) * sizeof (output_line_t));
+	      lines = grown;
+	      lines_size = new_size;
 	    }
+	  if (lines[node].text == NULL &&
+	      format_line (&(lines[node]), buf, size, assembly) == -1)
+	    err (EXIT_FAILURE, "error: cannot format output");
+	  writer_text (ob, lines[node].text, lines[node].size);
+
+	  /* Update the call graph */
+	  if (last_type == CALL && callgraph_call (cg, node, return_addr) == -1)
+	    err (EXIT_FAILURE, "error: cannot update call graph");
+	  else if (last_type == RET)
+	    callgraph_return (cg, ip);
+
+	  /* Calls entering the PLT entry of an opaque import */
+	  opaque_call = (last_type == CALL && opaque_count > 0 &&
+			 bsearch (&ip, opaque, opaque_count, sizeof (uintptr_t),
+				  addr_compare) != NULL);
+
+	  last_type = instr_type (instr);
+	  if (last_type == CALL)
+	    return_addr = ip + size;
+
+	  mappings_changed = is_mmap_syscall (executable_arch (exec), buf,
+					      get_syscall_number (&regs));
 
 	  /* Free capstone instruction structure */
-	  cs_free (insn, count);
+	  if (count > 0)
+	    cs_free (insn, count);
 
 	  /* Updating counters */
 	  instr_count++;
 	}
 
+      /* Run the opaque import up to the return address on top of the stack,
+       * the next step is then seen as a return from the import */
+      if (opaque_call)
+	{
+	  errno = 0;
+	  long word = ptrace (PTRACE_PEEKDATA, child, get_stack_pointer (&regs),
+			      NULL);
+	  if (errno != 0)
+	    err (EXIT_FAILURE, "error: cannot read the return address");
+
+	  run_to (child, &bp,
+		  (executable_arch (exec) == x86_32_arch) ? (uint32_t) word
+							  : (uintptr_t) word);
+	  last_type = RET;
+	  continue;
+	}
+
       /* Continue to next instruction... */
       /* Note that, sometimes, ptrace(PTRACE_SINGLESTEP) returns '-1'
        * to notify that the child process did not respond quick enough,
@@ -293,6 +2001,10 @@ main (int argc, char *argv[], char *envp[])
 	;
     }
 
+  step_output = NULL;
+  if (writer_delete (ob) == -1)
+    err (EXIT_FAILURE, "error: cannot write output");
+
   fprintf (output,
 	   "\n"
 	   "\tStatistics about this run\n"
@@ -301,12 +2013,132 @@ main (int argc, char *argv[], char *envp[])
 	   "* #unique instructions:      %zu\n"
 	   "* #hashtable buckets:        %zu\n"
 	   "* #hashtable filled buckets: %zu\n"
-	   "* #hashtable collisions:     %zu\n",
+	   "* #hashtable collisions:     %zu\n"
+	   "* #cfg nodes:                %zu\n"
+	   "* #cfg edges:                %zu\n"
+	   "* #call graph edges:         %zu\n"
+	   "* #calling contexts:         %zu\n"
+	   "* #predecoded instructions:  %zu\n"
+	   "* #decode cache hits:        %zu\n"
+	   "* #code overwrites:          %zu\n"
+	   "* #decode cache invalidated: %zu\n",
 	   instr_count, hashtable_entries (ht), (size_t) DEFAULT_HASHTABLE_SIZE,
-	   hashtable_filled_buckets (ht), hashtable_collisions (ht));
+	   hashtable_filled_buckets (ht), hashtable_collisions (ht),
+	   cfg_nodes (cfg), cfg_edges (cfg), callgraph_edges (cg),
+	   callgraph_contexts (cg), decode_cache_count (dcache), cache_hits,
+	   code_pages.overwrites, code_pages.invalidated);
+
+  functions_t *fn = NULL;
+  if (cfg != NULL)
+    {
+      /* Function symbols of the executable are also function entries */
+      size_t symbols = executable_symbols (exec);
+      uintptr_t *entries =
+	  malloc ((symbols ? symbols : 1) * sizeof (uintptr_t));
+      if (entries == NULL)
+	err (EXIT_FAILURE, "error: cannot compute functions");
+      for (size_t i = 0; i < symbols; i++)
+	entries[i] = executable_symbol (exec, i, NULL, NULL) + bias;
+
+      fn = functions_new (cfg, entries, symbols);
+      if (fn == NULL)
+	err (EXIT_FAILURE, "error: cannot compute functions");
+      free (entries);
+
+      print_dynjumps (cfg);
+      print_top_loops (cfg);
+      print_top_functions (exec, bias, cfg, fn, modules);
+      print_top_lines (exec, bias, cfg);
+      if (static_disasm)
+	print_static (exec, bias, dcache, cfg);
+      if (modules != NULL)
+	print_top_modules (modules, module_hits, module_hits_size);
+    }
+
+  /* Exporting the CFG */
+  if (cfg != NULL && cfg_file != NULL)
+    {
+      FILE *fd = fopen (cfg_file, "we");
+      if (!fd)
+	err (EXIT_FAILURE, "error: cannot open file '%s'", cfg_file);
+
+      /* Restrict the export to the function containing function_addr */
+      function_filter_t function_filter = {fn, CFG_NONE};
+      if (function_addr != 0)
+	{
+	  for (size_t node = 0; node < cfg_nodes (cfg); node++)
+	    if (instr_addr (cfg_node_instr (cfg, node)) == function_addr)
+	      function_filter.function = functions_of (fn, node);
+
+	  if (function_filter.function == CFG_NONE)
+	    errx (EXIT_FAILURE, "error: no instruction executed at 0x%" PRIxPTR,
+		  function_addr);
+
+	  cfg_filter.keep = keep_function;
+	  cfg_filter.data = &function_filter;
+	}
+
+      if (cfg_export (cfg, fd, cfg_format,
+		      (cfg_filter.end != 0 || cfg_filter.keep != NULL)
+			  ? &cfg_filter
+			  : NULL) == -1)
+	err (EXIT_FAILURE, "error: cannot export the CFG to '%s'", cfg_file);
+      fclose (fd);
+    }
+
+  /* Exporting the call graph */
+  if (cfg != NULL && callgraph_file != NULL)
+    {
+      FILE *fd = fopen (callgraph_file, "we");
+      if (!fd)
+	err (EXIT_FAILURE, "error: cannot open file '%s'", callgraph_file);
+
+      if (callgraph_export (cg, cfg, fd, callgraph_format) == -1)
+	err (EXIT_FAILURE, "error: cannot export the call graph to '%s'",
+	     callgraph_file);
+      fclose (fd);
+    }
+
+  /* Saving the CFG */
+  if (cfg != NULL && save_file != NULL && cfg_save (cfg, save_file) == -1)
+    err (EXIT_FAILURE, "error: cannot save the CFG to '%s'", save_file);
+
+  /* Keeping the CFG of all the runs along with the decoded code (runs
+   * without ASLR only, a layout being seldom met twice otherwise), and the
+   * coverage of each module (keyed by offset, whatever the layout) */
+  if (cfg != NULL && use_cache && modules != NULL)
+    {
+      if (!aslr)
+	save_cached_cfg (exec, modules, cfg);
+      save_coverage (modules, cfg);
+    }
+
+  /* Exporting the coverage frontier */
+  if (cfg != NULL && frontier_file != NULL)
+    {
+      FILE *fd = fopen (frontier_file, "we");
+      if (!fd)
+	err (EXIT_FAILURE, "error: cannot open file '%s'", frontier_file);
+
+      if (cfg_export_frontier (cfg, fd) == -1)
+	err (EXIT_FAILURE, "error: cannot export the frontier to '%s'",
+	     frontier_file);
+      fclose (fd);
+    }
 
   /* Cleaning memory */
   cs_close (&handle);
+  functions_delete (fn);
+  callgraph_delete (cg);
+  modules_delete (modules);
+  decode_cache_delete (dcache);
+  free (module_hits);
+  code_pages_close (&code_pages);
+  for (size_t i = 0; i < lines_size; i++)
+    free (lines[i].text);
+  free (lines);
+  free (opaque);
+  cfg_delete (cfg);
   hashtable_delete (ht);
   executable_delete (exec);
 
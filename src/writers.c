@@ -0,0 +1,223 @@
+/*
+ * tracker is an analyzer for binary executable files
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019-2020 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "writers.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/uio.h>
+
+/* Size of the buffer of the values formatted by the writer */
+#define WRITER_BUFFER_SIZE (1 << 16)
+
+/* Maximum number of chunks written at once (IOV_MAX on Linux) */
+#define WRITER_IOV 1024
+
+struct _writer_t
+{
+  int fd;			   /* Output file descriptor */
+  bool line_buffered;		   /* Flush after each line */
+  int error;			   /* errno of the first failed write */
+  size_t used;			   /* Bytes used in the buffer */
+  int iovcnt;			   /* Number of pending chunks */
+  struct iovec iov[WRITER_IOV];	   /* Pending chunks */
+  char buffer[WRITER_BUFFER_SIZE]; /* Values formatted by the writer */
+};
+
+writer_t *
+writer_new (FILE *fd, const bool line_buffered)
+{
+  if (fd == NULL)
+    {
+      errno = EINVAL;
+      return NULL;
+    }
+
+  /* What stdio still holds goes first */
+  int fdesc = fileno (fd);
+  if (fdesc == -1 || fflush (fd) == EOF)
+    return NULL;
+
+  writer_t *w = malloc (sizeof (writer_t));
+  if (w == NULL)
+    return NULL;
+
+  w->fd = fdesc;
+  w->line_buffered = line_buffered;
+  w->error = 0;
+  w->used = 0;
+  w->iovcnt = 0;
+
+  return w;
+}
+
+int
+writer_delete (writer_t *w)
+{
+  if (w == NULL)
+    return 0;
+
+  int ret = writer_flush (w);
+  int errsv = errno;
+  free (w);
+  errno = errsv;
+
+  return ret;
+}
+
+int
+writer_flush (writer_t *const w)
+{
+  if (w == NULL)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+  struct iovec *iov = w->iov;
+  int iovcnt = w->iovcnt;
+
+  while (iovcnt > 0 && w->error == 0)
+    {
+      ssize_t written = writev (w->fd, iov, iovcnt);
+      if (written == -1 && errno == EINTR)
+	continue;
+      if (written == -1)
+	{
+	  w->error = errno;
+	  break;
+	}
+
+      /* Skip what has been written (writes may be partial) */
+      while (iovcnt > 0 && (size_t) written >= iov->iov_len)
+	{
+	  written -= iov->iov_len;
+	  iov++;
+	  iovcnt--;
+	}
+      if (iovcnt > 0)
+	{
+	  iov->iov_base = (char *) iov->iov_base + written;
+	  iov->iov_len -= written;
+	}
+    }
+
+  w->used = 0;
+  w->iovcnt = 0;
+
+  if (w->error != 0)
+    {
+      errno = w->error;
+      return -1;
+    }
+
+  return 0;
+}
+
+/* Get room for size more bytes (at most WRITER_BUFFER_SIZE) at the end of
+ * the buffer, and a chunk to refer to them */
+static char *
+writer_reserve (writer_t *const w, const size_t size)
+{
+  if (w->used + size > WRITER_BUFFER_SIZE || w->iovcnt == WRITER_IOV)
+    writer_flush (w);
+
+  return w->buffer + w->used;
+}
+
+/* Append the size bytes written at the end of the buffer to the output */
+static void
+writer_commit (writer_t *const w, const size_t size)
+{
+  char *text = w->buffer + w->used;
+  w->used += size;
+
+  /* Extend the last chunk if it ends where the text starts */
+  struct iovec *last = (w->iovcnt > 0) ? &(w->iov[w->iovcnt - 1]) : NULL;
+  if (last != NULL && (char *) last->iov_base + last->iov_len == text)
+    last->iov_len += size;
+  else
+    w->iov[w->iovcnt++] = (struct iovec){text, size};
+
+  if (w->line_buffered && size > 0 && text[size - 1] == '\n')
+    writer_flush (w);
+}
+
+void
+writer_str (writer_t *const w, const char *str)
+{
+  size_t len = strlen (str);
+
+  /* Strings larger than the buffer are written right away */
+  if (len > WRITER_BUFFER_SIZE)
+    {
+      writer_text (w, str, len);
+      writer_flush (w);
+      return;
+    }
+
+  memcpy (writer_reserve (w, len), str, len);
+  writer_commit (w, len);
+}
+
+void
+writer_text (writer_t *const w, const char *text, const size_t size)
+{
+  if (w->iovcnt == WRITER_IOV)
+    writer_flush (w);
+
+  w->iov[w->iovcnt++] = (struct iovec){(void *) text, size};
+  if (w->line_buffered && size > 0 && text[size - 1] == '\n')
+    writer_flush (w);
+}
+
+void
+writer_dec (writer_t *const w, size_t value)
+{
+  char digits[20];
+  size_t len = 0;
+
+  /* Digits are produced from the lowest */
+  do
+    {
+      digits[sizeof (digits) - ++len] = '0' + value % 10;
+      value /= 10;
+    }
+  while (value > 0);
+
+  memcpy (writer_reserve (w, len), digits + sizeof (digits) - len, len);
+  writer_commit (w, len);
+}
+
+void
+writer_hex (writer_t *const w, uintptr_t value)
+{
+  static const char hexdigits[] = "0123456789abcdef";
+  char digits[2 + 2 * sizeof (uintptr_t)];
+  size_t len = 0;
+
+  /* Digits are produced from the lowest, without leading zeros */
+  do
+    {
+      digits[sizeof (digits) - ++len] = hexdigits[value & 0xf];
+      value >>= 4;
+    }
+  while (value > 0);
+  digits[sizeof (digits) - ++len] = 'x';
+  digits[sizeof (digits) - ++len] = '0';
+
+  memcpy (writer_reserve (w, len), digits + sizeof (digits) - len, len);
+  writer_commit (w, len);
+}
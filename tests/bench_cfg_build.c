@@ -0,0 +1,113 @@
+/*
+ * tracker is an analyzer for binary executable files
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019-2020 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+/* Benchmark of the construction of a CFG from a corpus of traces with an
+ * increasing number of threads (the resulting CFGs must be identical) */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "traces.h"
+
+#define NODES 200000	   /* Instructions of the program */
+#define TRACES 64	   /* Number of traces in the corpus */
+#define TRACE_STEPS 100000 /* Instructions executed per trace */
+
+static uint64_t seed = 0x9e3779b97f4a7c15ULL;
+
+/* xorshift64 pseudo-random generator (deterministic across runs) */
+static uint64_t
+next_random (void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+  return seed;
+}
+
+static double
+now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int
+main (void)
+{
+  uint8_t *opcodes = (uint8_t *) "\x90";
+  instr_t **instr = malloc (NODES * sizeof (instr_t *));
+  trace_t **traces = malloc (TRACES * sizeof (trace_t *));
+  if (instr == NULL || traces == NULL)
+    return EXIT_FAILURE;
+
+  for (size_t i = 0; i < NODES; i++)
+    instr[i] = instr_new (0x400000 + 4 * i, 1, opcodes);
+
+  /* Program-like walks: mostly fall-through, a few jumps */
+  for (size_t t = 0; t < TRACES; t++)
+    {
+      size_t current = 0;
+      traces[t] = trace_new ();
+      for (size_t step = 0; step < TRACE_STEPS; step++)
+	{
+	  trace_append (traces[t], instr[current]);
+	  current = (next_random () % 100 < 90) ? (current + 1) % NODES
+						 : next_random () % NODES;
+	}
+    }
+
+  long cores = sysconf (_SC_NPROCESSORS_ONLN);
+  double reference = 0.0;
+  size_t nodes = 0, edges = 0;
+
+  printf ("%d traces of %d instructions (%ld cores)\n", TRACES, TRACE_STEPS,
+	  cores);
+  for (long threads = 1; threads <= 2 * cores && threads <= TRACES;
+       threads *= 2)
+    {
+      double start = now ();
+      cfg_t *cfg = cfg_build (traces, TRACES, NULL, threads);
+      double elapsed = now () - start;
+      if (cfg == NULL)
+	return EXIT_FAILURE;
+
+      if (threads == 1)
+	{
+	  reference = elapsed;
+	  nodes = cfg_nodes (cfg);
+	  edges = cfg_edges (cfg);
+	}
+      else if (cfg_nodes (cfg) != nodes || cfg_edges (cfg) != edges)
+	{
+	  fprintf (stderr, "error: CFGs differ with %ld threads\n", threads);
+	  return EXIT_FAILURE;
+	}
+
+      printf ("* %3ld threads: %8.3f s (speedup: %5.2fx)\n", threads, elapsed,
+	      reference / elapsed);
+      cfg_delete (cfg);
+    }
+
+  for (size_t t = 0; t < TRACES; t++)
+    trace_delete (traces[t]);
+  for (size_t i = 0; i < NODES; i++)
+    instr_delete (instr[i]);
+  free (traces);
+  free (instr);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,140 @@
+/*
+ * tracker is an analyzer for binary executable files
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019-2020 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+/* Benchmark of the incremental update of dominator trees against their
+ * recomputation from scratch, on a large CFG extended by a few new edges
+ * at a time (as when a fuzzer brings new traces) */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "analyses.h"
+
+#define DEFAULT_NODES 1000000 /* Instructions of the program */
+#define ROUNDS 20	      /* Number of new traces */
+#define ROUND_STEPS 64	      /* Instructions executed per new trace */
+
+static uint64_t seed = 0x9e3779b97f4a7c15ULL;
+
+/* xorshift64 pseudo-random generator (deterministic across runs) */
+static uint64_t
+next_random (void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+  return seed;
+}
+
+static double
+now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Program-like walk: mostly fall-through, short branches, a few far jumps */
+static size_t
+next_step (const size_t current, const size_t nodes)
+{
+  uint64_t r = next_random () % 100;
+  size_t next;
+
+  if (r < 80)
+    next = current + 1;
+  else if (r < 97)
+    next = current + (next_random () % 64) - 32;
+  else
+    next = next_random () % nodes;
+
+  return (next < nodes) ? next : next_random () % nodes;
+}
+
+int
+main (int argc, char *argv[])
+{
+  size_t nodes = (argc > 1) ? strtoul (argv[1], NULL, 10) : DEFAULT_NODES;
+  uint8_t *opcodes = (uint8_t *) "\x90";
+
+  instr_t **instr = malloc (nodes * sizeof (instr_t *));
+  if (instr == NULL)
+    return EXIT_FAILURE;
+
+  for (size_t i = 0; i < nodes; i++)
+    instr[i] = instr_new (0x400000 + 4 * i, 1, opcodes);
+
+  /* Initial CFG covering (a part of) the program */
+  size_t current = 0;
+  cfg_t *cfg = cfg_new (instr[0], single);
+  for (size_t i = 0; i < nodes; i++)
+    {
+      current = next_step (current, nodes);
+      cfg_insert (cfg, instr[current], single);
+    }
+
+  double start = now ();
+  domtree_t *dt = domtree_new (cfg);
+  double initial = now () - start;
+
+  printf ("CFG: %zu nodes, %zu edges (initial tree computed in %.3f s)\n",
+	  cfg_nodes (cfg), cfg_edges (cfg), initial);
+
+  /* New traces adding a few edges each */
+  double incremental = 0.0, recomputation = 0.0;
+  size_t new_edges = 0;
+  for (size_t round = 0; round < ROUNDS; round++)
+    {
+      size_t edges = cfg_edges (cfg);
+      for (size_t i = 0; i < ROUND_STEPS; i++)
+	{
+	  current = next_step (current, nodes);
+	  cfg_insert (cfg, instr[current], single);
+	}
+      new_edges += cfg_edges (cfg) - edges;
+
+      start = now ();
+      if (domtree_update (dt, cfg) == -1)
+	return EXIT_FAILURE;
+      incremental += now () - start;
+
+      start = now ();
+      domtree_t *fresh = domtree_new (cfg);
+      recomputation += now () - start;
+
+      /* Check that both trees agree */
+      for (size_t v = 0; v < cfg_nodes (cfg); v++)
+	if (domtree_idom (dt, v) != domtree_idom (fresh, v))
+	  {
+	    fprintf (stderr, "error: trees differ on node %zu\n", v);
+	    return EXIT_FAILURE;
+	  }
+      domtree_delete (fresh);
+    }
+
+  printf ("%d traces, %zu new edges\n"
+	  "* incremental update: %10.3f ms per trace\n"
+	  "* recomputation:      %10.3f ms per trace\n"
+	  "* speedup:            %10.1fx\n",
+	  ROUNDS, new_edges, 1000 * incremental / ROUNDS,
+	  1000 * recomputation / ROUNDS, recomputation / incremental);
+
+  domtree_delete (dt);
+  cfg_delete (cfg);
+  for (size_t i = 0; i < nodes; i++)
+    instr_delete (instr[i]);
+  free (instr);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,318 @@
+/*
+ * tracker is an analyzer for binary executable files
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019-2020 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#include <cmocka.h>
+
+#include <errno.h>
+
+#include "analyses.h"
+
+#define NODES 8
+
+/* Build the following CFG (through a single walk starting at node 0), node
+ * identifiers are given in order of first appearance in the walk so that
+ * instr[i] is held by node id[i]:
+ *
+ *   0 -> 1, 2    1 -> 3    2 -> 3    3 -> 4, 5
+ *   4 -> 6       5 -> 0, 6           6 -> 3, 7   (7 is the exit)
+ */
+static const size_t walk[] = {0, 1, 3, 5, 0, 2, 3, 4, 6, 3, 5, 6, 7};
+
+#define WALK_LENGTH (sizeof (walk) / sizeof (walk[0]))
+
+/* Build the CFG from the 'steps' first nodes of the walk */
+static cfg_t *
+cfg_sample (instr_t *instr[NODES], const size_t steps)
+{
+  uint8_t *opcodes = (uint8_t *) "\x90";
+
+  for (size_t i = 0; i < NODES; i++)
+    instr[i] = instr_new (0x400000 + i, 1, opcodes);
+
+  cfg_t *cfg = cfg_new (instr[0], branch);
+  for (size_t i = 1; i < steps; i++)
+    cfg_insert (cfg, instr[walk[i]], single);
+
+  return cfg;
+}
+
+static const size_t id[NODES] = {0, 1, 4, 2, 5, 3, 6, 7};
+
+static void
+dominators_test (__attribute__ ((unused)) void **state)
+{
+  instr_t *instr[NODES];
+  cfg_t *cfg = cfg_sample (instr, WALK_LENGTH);
+  assert_true (cfg_nodes (cfg) == NODES);
+  assert_true (cfg_edges (cfg) == 11);
+
+  /* Testing border cases */
+  assert_null (domtree_new (NULL));
+  assert_true (errno == EINVAL);
+
+  /* Testing dominators */
+  domtree_t *dt = domtree_new (cfg);
+  assert_non_null (dt);
+
+  const size_t idom[NODES] = {CFG_NONE, 0, 0, 0, 3, 3, 3, 6};
+  for (size_t v = 0; v < NODES; v++)
+    {
+      assert_true (cfg_lookup (cfg, instr[v]) == id[v]);
+      assert_true (domtree_reachable (dt, id[v]));
+      if (idom[v] == CFG_NONE)
+	assert_true (domtree_idom (dt, id[v]) == CFG_NONE);
+      else
+	assert_true (domtree_idom (dt, id[v]) == id[idom[v]]);
+    }
+  assert_true (domtree_idom (dt, NODES) == CFG_NONE && errno == EINVAL);
+
+  assert_true (domtree_dominates (dt, id[0], id[7]));
+  assert_true (domtree_dominates (dt, id[3], id[7]));
+  assert_true (domtree_dominates (dt, id[6], id[6]));
+  assert_false (domtree_dominates (dt, id[4], id[6]));
+  assert_false (domtree_dominates (dt, id[7], id[3]));
+
+  domtree_delete (dt);
+
+  /* Testing post-dominators */
+  dt = domtree_post_new (cfg);
+  assert_non_null (dt);
+
+  const size_t ipdom[NODES] = {3, 3, 3, 6, 6, 6, 7, CFG_NONE};
+  for (size_t v = 0; v < NODES; v++)
+    if (ipdom[v] == CFG_NONE)
+      assert_true (domtree_idom (dt, id[v]) == CFG_NONE);
+    else
+      assert_true (domtree_idom (dt, id[v]) == id[ipdom[v]]);
+
+  assert_true (domtree_dominates (dt, id[7], id[0]));
+  assert_true (domtree_dominates (dt, id[3], id[0]));
+  assert_true (domtree_dominates (dt, id[6], id[5]));
+  assert_false (domtree_dominates (dt, id[5], id[3]));
+  assert_false (domtree_dominates (dt, id[4], id[3]));
+
+  domtree_delete (dt);
+  domtree_delete (NULL);
+
+  cfg_delete (cfg);
+  for (size_t i = 0; i < NODES; i++)
+    instr_delete (instr[i]);
+}
+
+static void
+dominators_update_test (__attribute__ ((unused)) void **state)
+{
+  instr_t *instr[NODES];
+  cfg_t *cfg = cfg_sample (instr, 4); /* 0 -> 1 -> 3 -> 5 */
+
+  domtree_t *dt = domtree_new (cfg);
+  assert_non_null (dt);
+  assert_true (domtree_idom (dt, id[5]) == id[3]);
+  assert_true (domtree_idom (dt, id[3]) == id[1]);
+
+  /* Nothing to update */
+  assert_true (domtree_update (dt, cfg) == 0);
+  assert_true (domtree_update (NULL, cfg) == -1 && errno == EINVAL);
+
+  /* Close the loop 5 -> 0 -> 2 -> 3 (3 is not dominated by 1 anymore) */
+  for (size_t i = 4; i < 7; i++)
+    cfg_insert (cfg, instr[walk[i]], single);
+  assert_true (domtree_dominates (dt, id[1], id[5]));
+  assert_true (domtree_update (dt, cfg) == 0);
+  assert_true (domtree_idom (dt, id[3]) == id[0]);
+  assert_true (domtree_idom (dt, id[2]) == id[0]);
+  assert_false (domtree_dominates (dt, id[1], id[5]));
+
+  /* Add the remaining nodes and edges */
+  for (size_t i = 7; i < WALK_LENGTH; i++)
+    cfg_insert (cfg, instr[walk[i]], single);
+  assert_true (domtree_update (dt, cfg) == 0);
+
+  domtree_t *expected = domtree_new (cfg);
+  for (size_t v = 0; v < NODES; v++)
+    assert_true (domtree_idom (dt, v) == domtree_idom (expected, v));
+  domtree_delete (expected);
+  domtree_delete (dt);
+
+  /* Post-dominator trees cannot be updated */
+  dt = domtree_post_new (cfg);
+  assert_true (domtree_update (dt, cfg) == -1 && errno == EINVAL);
+  domtree_delete (dt);
+
+  cfg_delete (cfg);
+  for (size_t i = 0; i < NODES; i++)
+    instr_delete (instr[i]);
+}
+
+static void
+loops_test (__attribute__ ((unused)) void **state)
+{
+  instr_t *instr[NODES];
+  cfg_t *cfg = cfg_sample (instr, WALK_LENGTH);
+
+  /* Testing border cases */
+  assert_null (loops_new (NULL));
+  assert_true (errno == EINVAL);
+  assert_true (loops_count (NULL) == 0);
+
+  /* Testing nominal cases: loop 0 (header 3) is nested in loop 1 (header 0) */
+  loops_t *loops = loops_new (cfg);
+  assert_non_null (loops);
+  assert_true (loops_count (loops) == 2);
+
+  assert_true (loops_header (loops, 0) == id[3]);
+  assert_true (loops_header (loops, 1) == id[0]);
+  assert_true (loops_header (loops, 2) == CFG_NONE && errno == EINVAL);
+  assert_true (loops_parent (loops, 0) == 1);
+  assert_true (loops_parent (loops, 1) == CFG_NONE);
+  assert_true (loops_depth (loops, 0) == 2);
+  assert_true (loops_depth (loops, 1) == 1);
+
+  assert_true (loops_size (loops, 0) == 4);
+  assert_true (loops_size (loops, 1) == 7);
+  assert_true (loops_innermost (loops, id[4]) == 0);
+  assert_true (loops_innermost (loops, id[2]) == 1);
+  assert_true (loops_innermost (loops, id[7]) == CFG_NONE);
+  assert_true (loops_contains (loops, 1, id[6]));
+  assert_false (loops_contains (loops, 0, id[1]));
+  assert_false (loops_contains (loops, 1, id[7]));
+  for (size_t i = 0; i < loops_size (loops, 0); i++)
+    assert_true (loops_contains (loops, 0, loops_node (loops, 0, i)));
+  assert_true (loops_node (loops, 0, 4) == CFG_NONE);
+
+  /* Exits: 5 -> 0 and 6 -> 7 for the inner loop, 6 -> 7 for the outer */
+  assert_true (loops_exits (loops, 0) == 2);
+  assert_true (loops_exits (loops, 1) == 1);
+  size_t edge = loops_exit (loops, 1, 0);
+  assert_true (cfg_edge_src (cfg, edge) == id[6]);
+  assert_true (cfg_edge_dst (cfg, edge) == id[7]);
+
+  /* Dynamic counts from the walk */
+  assert_true (loops_iterations (loops, 0) == 3);
+  assert_true (loops_entries (loops, 0) == 2);
+  assert_true (loops_instructions (loops, 0) == 8);
+  assert_true (loops_iterations (loops, 1) == 2);
+  assert_true (loops_entries (loops, 1) == 1);
+  assert_true (loops_instructions (loops, 1) == 12);
+
+  loops_delete (loops);
+  loops_delete (NULL);
+
+  cfg_delete (cfg);
+  for (size_t i = 0; i < NODES; i++)
+    instr_delete (instr[i]);
+}
+
+static void
+functions_test (__attribute__ ((unused)) void **state)
+{
+  uint8_t *opcodes = (uint8_t *) "\x90\x90\x90\x90\x90";
+  struct
+  {
+    uintptr_t addr;
+    uint8_t size;
+    instr_type_t type;
+  } code[] = {
+      {0x100, 2, INSTR}, /* 0: main */
+      {0x102, 5, CALL},	 /* 1: call f */
+      {0x107, 2, INSTR}, /* 2: return site */
+      {0x109, 5, CALL},	 /* 3: call f */
+      {0x10e, 2, JMP},	 /* 4: jmp g (tail call) */
+      {0x200, 2, INSTR}, /* 5: f */
+      {0x202, 1, RET},	 /* 6: ret */
+      {0x300, 2, INSTR}, /* 7: g */
+      {0x302, 2, INSTR}, /* 8 */
+      {0x400, 2, INSTR}, /* 9: start of another trace */
+      {0x402, 2, INSTR}, /* 10 */
+  };
+  const size_t count = sizeof (code) / sizeof (code[0]);
+  const size_t path[] = {0, 1, 5, 6, 2, 3, 5, 6, 4, 7, 8};
+  instr_t *instr[count];
+
+  for (size_t i = 0; i < count; i++)
+    {
+      instr[i] = instr_new (code[i].addr, code[i].size, opcodes);
+      instr_set_type (instr[i], code[i].type);
+    }
+
+  cfg_t *cfg = cfg_new (instr[path[0]], single);
+  for (size_t i = 1; i < sizeof (path) / sizeof (size_t); i++)
+    cfg_insert (cfg, instr[path[i]], single);
+  cfg_restart (cfg, instr[9], single);
+  cfg_insert (cfg, instr[10], single);
+
+  /* Testing border cases */
+  assert_null (functions_new (NULL, NULL, 0));
+  assert_null (functions_new (cfg, NULL, 1));
+  assert_true (functions_count (NULL) == 0);
+  assert_true (functions_entry (NULL, 0) == CFG_NONE);
+
+  /* Without symbols, g is part of main (reached by a jump) */
+  functions_t *fn = functions_new (cfg, NULL, 0);
+  assert_non_null (fn);
+  assert_true (functions_count (fn) == 3);
+  assert_true (functions_size (fn, 0) == 7);
+  assert_true (functions_of (fn, cfg_lookup (cfg, instr[8])) == 0);
+  assert_true (functions_of (fn, cfg_lookup (cfg, instr[10])) == 2);
+  functions_delete (fn);
+
+  /* With the symbol of g */
+  uintptr_t symbols[] = {0x300};
+  fn = functions_new (cfg, symbols, 1);
+  assert_non_null (fn);
+  assert_true (functions_count (fn) == 4);
+
+  size_t expected[][5] = {{0, 1, 2, 3, 4}, {5, 6}, {7, 8}, {9, 10}};
+  size_t sizes[] = {5, 2, 2, 2};
+  for (size_t f = 0; f < 4; f++)
+    {
+      assert_true (functions_size (fn, f) == sizes[f]);
+      assert_true (functions_entry (fn, f) ==
+		   cfg_lookup (cfg, instr[expected[f][0]]));
+      for (size_t i = 0; i < sizes[f]; i++)
+	{
+	  size_t node = functions_node (fn, f, i);
+	  assert_true (functions_of (fn, node) == f);
+	  assert_true (node == cfg_lookup (cfg, instr[expected[f][i]]));
+	}
+    }
+  assert_true (functions_node (fn, 1, 2) == CFG_NONE);
+
+  /* Profiles */
+  assert_true (functions_calls (fn, 1) == 2);
+  assert_true (functions_instructions (fn, 1) == 4);
+  assert_true (functions_calls (fn, 0) == 0);
+  assert_true (functions_instructions (fn, 0) == 5);
+  assert_true (functions_calls (fn, 2) == 0);
+  assert_true (functions_instructions (fn, 3) == 2);
+
+  functions_delete (fn);
+  cfg_delete (cfg);
+  for (size_t i = 0; i < count; i++)
+    instr_delete (instr[i]);
+}
+
+int
+main (void)
+{
+  const struct CMUnitTest tests[] = {
+      cmocka_unit_test (dominators_test),
+      cmocka_unit_test (dominators_update_test),
+      cmocka_unit_test (loops_test),
+      cmocka_unit_test (functions_test),
+  };
+
+  return cmocka_run_group_tests (tests, NULL, NULL);
+}
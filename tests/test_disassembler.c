@@ -0,0 +1,293 @@
+/*
+ * tracker is an analyzer for binary executable files
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019-2020 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#define _GNU_SOURCE
+
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#include <cmocka.h>
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/auxv.h>
+
+#include "disassembler.h"
+
+/* The tests are run on their own executable */
+static char self[] = "/proc/self/exe";
+
+/* Size of the chunks decoded by each thread of the decode cache */
+#define CHUNK_SIZE (64 * 1024)
+
+/* Number of instructions of the fixture */
+#define FIXTURE_COUNT 40000
+#define STRINGIFY(x) #x
+#define XSTRINGIFY(x) STRINGIFY (x)
+
+/* Fixture in the code section: a run of 5 bytes calls to the next
+ * instruction (never executed), spanning several chunks. As 64 KiB is not
+ * a multiple of 5, some of the calls straddle a chunk boundary and the
+ * chunks starting in the middle of a call must be resynchronized */
+__asm__ (".pushsection .text.fixture, \"ax\"\n"
+	 ".globl fixture\n"
+	 ".hidden fixture\n"
+	 "fixture:\n"
+	 ".rept " XSTRINGIFY (FIXTURE_COUNT) "\n"
+	 ".byte 0xe8, 0x00, 0x00, 0x00, 0x00\n"
+	 ".endr\n"
+	 ".popsection\n");
+extern const uint8_t fixture[];
+
+/* Difference between the run-time and the link-time addresses */
+static uintptr_t
+self_bias (executable_t *exec)
+{
+  return getauxval (AT_ENTRY) - executable_entry (exec);
+}
+
+/* Check that the decode cache holds the calls of the fixture (and nothing
+ * in their middle) */
+static void
+check_fixture (decode_cache_t *cache)
+{
+  uintptr_t start = (uintptr_t) fixture;
+
+  for (size_t i = 0; i < FIXTURE_COUNT; i++)
+    {
+      uintptr_t addr = start + 5 * i;
+      const decoded_t *d = decode_cache_lookup (cache, addr);
+      assert_non_null (d);
+      assert_true (d->addr == addr);
+      assert_true (d->size == 5);
+      assert_true (d->bytes[0] == 0xe8);
+      assert_true (d->type == CALL);
+      assert_true (d->target == addr + 5);
+      assert_true (d->fallthrough);
+    }
+
+  for (size_t i = 0; i < FIXTURE_COUNT; i += 997)
+    for (size_t offset = 1; offset < 5; offset++)
+      assert_null (decode_cache_lookup (cache, start + 5 * i + offset));
+}
+
+static void
+decode_cache_test (__attribute__ ((unused)) void **state)
+{
+  executable_t *exec = executable_new (self);
+  assert_non_null (exec);
+  uintptr_t bias = self_bias (exec);
+
+  /* Testing border cases */
+  assert_null (decode_cache_new (NULL, 0, false, 1));
+  assert_null (decode_cache_lookup (NULL, 0));
+  assert_true (decode_cache_count (NULL) == 0);
+  assert_true (decode_cache_invalidate (NULL, 0, 1) == 0);
+  decode_cache_delete (NULL);
+
+  decode_cache_t *cache = decode_cache_new (exec, bias, false, 1);
+  assert_non_null (cache);
+  assert_true (decode_cache_count (cache) >= FIXTURE_COUNT);
+  assert_null (decode_cache_lookup (cache, 0));
+
+  /* The fixture spans at least two chunk boundaries, and at least one of
+   * them falls in the middle of a call */
+  uintptr_t region = 0, start = (uintptr_t) fixture - bias;
+  size_t size;
+  for (size_t i = 0; executable_code (exec, i, &region, &size) != NULL; i++)
+    if (region <= start && start < region + size)
+      break;
+  uintptr_t boundary =
+      region + ((start - region) / CHUNK_SIZE + 1) * CHUNK_SIZE;
+  if ((boundary - start) % 5 == 0)
+    boundary += CHUNK_SIZE;
+  assert_true (boundary + CHUNK_SIZE < start + 5 * FIXTURE_COUNT);
+  assert_true ((boundary - start) % 5 != 0);
+
+  const decoded_t *d = decode_cache_lookup (
+      cache, bias + boundary - (boundary - start) % 5);
+  assert_non_null (d);
+  assert_true (d->size == 5);
+  assert_null (decode_cache_lookup (cache, bias + boundary));
+
+  /* Sequential lookups (fast path) and scattered ones */
+  check_fixture (cache);
+
+  /* Decoding with several threads gives the same instructions */
+  decode_cache_t *parallel = decode_cache_new (exec, bias, false, 4);
+  assert_non_null (parallel);
+  assert_true (decode_cache_count (parallel) == decode_cache_count (cache));
+  check_fixture (parallel);
+  decode_cache_delete (parallel);
+
+  decode_cache_delete (cache);
+  executable_delete (exec);
+}
+
+static void
+decode_cache_save_test (__attribute__ ((unused)) void **state)
+{
+  executable_t *exec = executable_new (self);
+  assert_non_null (exec);
+  uintptr_t bias = self_bias (exec);
+
+  decode_cache_t *cache = decode_cache_new (exec, bias, true, 2);
+  assert_non_null (cache);
+
+  char filename[] = "/tmp/tracker-decode-XXXXXX";
+  int fd = mkstemp (filename);
+  assert_true (fd != -1);
+  close (fd);
+
+  /* Testing border cases */
+  assert_true (decode_cache_save (NULL, filename) == -1);
+  assert_true (decode_cache_save (cache, NULL) == -1);
+  assert_null (decode_cache_load (exec, bias, true, NULL));
+  assert_null (decode_cache_load (exec, bias, true, "/nonexistent/cache"));
+  assert_null (decode_cache_load (exec, bias, true, filename)); /* Empty */
+
+  /* The loaded cache is identical (texts included) */
+  assert_true (decode_cache_save (cache, filename) == 0);
+  decode_cache_t *loaded = decode_cache_load (exec, bias, true, filename);
+  assert_non_null (loaded);
+  assert_true (decode_cache_count (loaded) == decode_cache_count (cache));
+  check_fixture (loaded);
+
+  const decoded_t *d1 = decode_cache_lookup (cache, (uintptr_t) fixture);
+  const decoded_t *d2 = decode_cache_lookup (loaded, (uintptr_t) fixture);
+  assert_string_equal (d1->text, d2->text);
+  assert_true (d1->node_type == d2->node_type);
+  decode_cache_delete (loaded);
+
+  /* Caches are only loaded with the same syntax */
+  assert_null (decode_cache_load (exec, bias, false, filename));
+  assert_true (errno == EINVAL);
+
+  /* ... and the same bias, the texts holding run-time addresses */
+  assert_null (decode_cache_load (exec, bias + 0x1000, true, filename));
+  assert_true (errno == EINVAL);
+  decode_cache_t *moved = decode_cache_new (exec, bias + 0x1000, true, 2);
+  assert_non_null (moved);
+  assert_true (decode_cache_save (moved, filename) == 0);
+  assert_null (decode_cache_load (exec, bias, true, filename));
+  assert_true (errno == EINVAL);
+  decode_cache_delete (moved);
+  moved = decode_cache_load (exec, bias + 0x1000, true, filename);
+  assert_non_null (moved);
+  assert_true (decode_cache_lookup (moved, (uintptr_t) fixture + 0x1000)
+		   ->target == (uintptr_t) fixture + 0x1005);
+  decode_cache_delete (moved);
+
+  /* Invalidated instructions are neither returned nor saved */
+  uintptr_t addr = (uintptr_t) fixture + 5 * 100;
+  assert_true (decode_cache_invalidate (cache, addr + 2, addr + 3) == 1);
+  assert_null (decode_cache_lookup (cache, addr));
+  assert_non_null (decode_cache_lookup (cache, addr + 5));
+  assert_true (decode_cache_invalidate (cache, addr, addr + 10) == 1);
+  assert_null (decode_cache_lookup (cache, addr + 5));
+  assert_true (decode_cache_invalidate (cache, addr, addr + 10) == 0);
+  assert_true (decode_cache_invalidate (cache, addr + 1, addr) == 0);
+
+  assert_true (decode_cache_save (cache, filename) == 0);
+  loaded = decode_cache_load (exec, bias, true, filename);
+  assert_non_null (loaded);
+  assert_true (decode_cache_count (loaded) == decode_cache_count (cache) - 2);
+
+  /* Saving a loaded cache over its own file leaves its mapping intact */
+  assert_true (decode_cache_save (loaded, filename) == 0);
+  assert_string_equal (decode_cache_lookup (loaded, addr + 10)->text,
+		       decode_cache_lookup (cache, addr + 10)->text);
+  assert_null (decode_cache_lookup (loaded, addr));
+  assert_null (decode_cache_lookup (loaded, addr + 5));
+  assert_non_null (decode_cache_lookup (loaded, addr + 10));
+  decode_cache_delete (loaded);
+
+  unlink (filename);
+  decode_cache_delete (cache);
+  executable_delete (exec);
+}
+
+static void
+disasm_cfg_test (__attribute__ ((unused)) void **state)
+{
+  executable_t *exec = executable_new (self);
+  assert_non_null (exec);
+  uintptr_t bias = self_bias (exec);
+  hashtable_t *ht = hashtable_new (DEFAULT_HASHTABLE_SIZE);
+  assert_non_null (ht);
+
+  /* Testing border cases */
+  disasm_t *d = disasm_new (exec, bias, NULL);
+  assert_non_null (d);
+  assert_null (disasm_cfg (NULL, 0, ht));
+  assert_null (disasm_cfg (d, 0, ht)); /* No instruction found yet */
+
+  /* Explore from the fixture, where each call leads to the next one */
+  uintptr_t start = (uintptr_t) fixture;
+  instr_t *seed = instr_new (start, 5, fixture);
+  cfg_t *seeds = cfg_new (seed, single);
+  assert_non_null (seeds);
+  assert_true (disasm_run (d, seeds, 1) == 0);
+  assert_null (disasm_cfg (d, start, NULL));
+
+  cfg_t *cfg = disasm_cfg (d, start, ht);
+  assert_non_null (cfg);
+  assert_true (cfg_nodes (cfg) == disasm_count (d));
+  assert_true (instr_addr (cfg_node_instr (cfg, 0)) == start);
+
+  for (size_t i = 0; i < FIXTURE_COUNT - 1; i += 997)
+    {
+      instr_t *instr = hashtable_find (ht, start + 5 * i, 0);
+      assert_non_null (instr);
+      assert_true (instr_type (instr) == CALL);
+
+      /* The target and the fall-through are the same edge */
+      size_t node = cfg_lookup (cfg, instr);
+      assert_true (cfg_node_degree (cfg, node) == 1);
+      size_t dst = cfg_edge_dst (cfg, cfg_node_edge (cfg, node, 0));
+      assert_true (instr_addr (cfg_node_instr (cfg, dst)) ==
+		   start + 5 * (i + 1));
+    }
+
+  /* The instructions already stored are reused */
+  size_t entries = hashtable_entries (ht);
+  cfg_t *again = disasm_cfg (d, start, ht);
+  assert_non_null (again);
+  assert_true (hashtable_entries (ht) == entries);
+  assert_true (cfg_nodes (again) == cfg_nodes (cfg));
+  assert_true (cfg_edges (again) == cfg_edges (cfg));
+
+  cfg_delete (again);
+  cfg_delete (cfg);
+  cfg_delete (seeds);
+  instr_delete (seed);
+  hashtable_delete (ht);
+  disasm_delete (d);
+  executable_delete (exec);
+}
+
+int
+main (void)
+{
+  const struct CMUnitTest tests[] = {
+      cmocka_unit_test (decode_cache_test),
+      cmocka_unit_test (decode_cache_save_test),
+      cmocka_unit_test (disasm_cfg_test),
+  };
+
+  return cmocka_run_group_tests (tests, NULL, NULL);
+}
@@ -0,0 +1,483 @@
+/*
+ * tracker is an analyzer for binary executable files
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019-2020 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#include <cmocka.h>
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#include "executables.h"
+
+/* The tests are run on their own executable */
+static char self[] = "/proc/self/exe";
+
+static void
+executable_test (__attribute__ ((unused)) void **state)
+{
+  executable_t *exec = executable_new (self);
+  assert_non_null (exec);
+
+  /* Testing border cases */
+  char missing[] = "/nonexistent/exec", garbage[] = "/tmp/tracker-exec-XXXXXX";
+  int fd = mkstemp (garbage);
+  assert_true (fd != -1);
+  assert_true (write (fd, "#!/bin/sh\nexit 0\n", 17) == 17);
+  close (fd);
+
+  assert_null (executable_new (missing));
+  assert_true (errno == ENOENT);
+  assert_null (executable_new (garbage));
+  assert_true (errno == ENOEXEC);
+  unlink (garbage);
+
+  assert_true (executable_arch (NULL) == unknown_arch);
+  assert_true (executable_entry (NULL) == 0);
+  assert_true (executable_sections (NULL) == 0);
+  assert_null (executable_section_next (NULL));
+  assert_null (executable_section_by_name (NULL, ".text", NULL, NULL));
+  assert_null (executable_section_by_name (exec, NULL, NULL, NULL));
+  assert_null (executable_section_by_name (exec, ".nonexistent", NULL, NULL));
+  assert_null (executable_segment (NULL, 0, NULL, NULL));
+
+  assert_true (executable_arch (exec) ==
+	       ((sizeof (void *) == 8) ? x86_64_arch : x86_32_arch));
+
+  /* The entry point lies in .text, within an executable segment */
+  uintptr_t text_addr, seg_addr, entry = executable_entry (exec);
+  size_t text_size, seg_size;
+  const uint8_t *text =
+      executable_section_by_name (exec, ".text", &text_addr, &text_size);
+  assert_non_null (text);
+  assert_true (text_addr <= entry && entry < text_addr + text_size);
+
+  bool found = false;
+  const uint8_t *bytes;
+  for (size_t i = 0;
+       (bytes = executable_segment (exec, i, &seg_addr, &seg_size)) != NULL;
+       i++)
+    if (seg_addr <= text_addr && text_addr + text_size <= seg_addr + seg_size)
+      {
+	/* Sections and segments share the same mapping */
+	assert_ptr_equal (bytes + (text_addr - seg_addr), text);
+	found = true;
+      }
+  assert_true (found);
+
+  /* The iterator goes through all the sections and cycles */
+  size_t count = 0;
+  bool has_text = false;
+  const char *name;
+  while ((name = executable_section_next (exec)) != NULL)
+    {
+      has_text |= !strcmp (name, ".text");
+      count++;
+    }
+  assert_true (has_text);
+  assert_true (count == executable_sections (exec));
+  assert_string_equal (executable_section_next (exec), "");
+
+  /* Sections without content in the file are not returned */
+  assert_null (executable_section_by_name (exec, ".bss", NULL, NULL));
+
+  executable_delete (exec);
+  executable_delete (NULL);
+}
+
+/* Reference lookup by a linear scan of the symbols */
+static const char *
+symbol_scan (executable_t *exec, const uintptr_t addr)
+{
+  const char *found = NULL;
+  for (size_t i = 0; i < executable_symbols (exec); i++)
+    {
+      size_t size;
+      const char *name;
+      uintptr_t start = executable_symbol (exec, i, &size, &name);
+      if (start <= addr && (addr - start < size || addr == start))
+	found = name;
+      else if (start <= addr)
+	found = NULL;
+    }
+
+  return found;
+}
+
+static void
+symbol_test (__attribute__ ((unused)) void **state)
+{
+  executable_t *exec = executable_new (self);
+  const char *names[4];
+
+  /* Testing border cases */
+  assert_null (executable_get_symbol_by_addr (NULL, 0x1000));
+  assert_true (executable_get_symbols_by_addr (NULL, NULL, 0, NULL) == 0);
+  assert_true (executable_get_symbols_by_addr (exec, NULL, 1, names) == 0);
+  assert_true (executable_symbols (NULL) == 0);
+  assert_true (executable_symbol (NULL, 0, NULL, NULL) == 0);
+  assert_true (executable_symbol (exec, executable_symbols (exec), NULL,
+				  NULL) == 0);
+  assert_null (executable_get_symbol_by_addr (exec, 0));
+
+  /* Symbols are sorted and found at their address and inside */
+  size_t count = executable_symbols (exec);
+  uintptr_t main_addr = 0, previous = 0;
+  assert_true (count > 0);
+  for (size_t i = 0; i < count; i++)
+    {
+      size_t size;
+      const char *name;
+      uintptr_t start = executable_symbol (exec, i, &size, &name);
+      assert_true (start > previous);
+      previous = start;
+
+      assert_string_equal (executable_get_symbol_by_addr (exec, start), name);
+      if (size > 1)
+	assert_string_equal (
+	    executable_get_symbol_by_addr (exec, start + size - 1), name);
+      if (!strcmp (name, "main"))
+	main_addr = start;
+    }
+  assert_true (main_addr != 0);
+
+  /* The index agrees with a linear scan, in single and batch lookups */
+  uintptr_t low = executable_symbol (exec, 0, NULL, NULL);
+  uintptr_t high = executable_symbol (exec, count - 1, NULL, NULL) + 64;
+  uintptr_t step = (high - low) / 997 + 1;
+  for (uintptr_t addr = low - 64; addr < high; addr += step)
+    {
+      uintptr_t addrs[4] = {addr, addr + 1, addr + step / 2, addr + step - 1};
+      const char *expected = symbol_scan (exec, addr);
+      const char *found = executable_get_symbol_by_addr (exec, addr);
+      assert_true (expected == found);
+
+      size_t matched = executable_get_symbols_by_addr (exec, addrs, 4, names);
+      size_t expected_matched = 0;
+      for (size_t i = 0; i < 4; i++)
+	{
+	  assert_true (names[i] == symbol_scan (exec, addrs[i]));
+	  expected_matched += (names[i] != NULL);
+	}
+      assert_true (matched == expected_matched);
+    }
+
+  executable_delete (exec);
+}
+
+static void
+section_test (__attribute__ ((unused)) void **state)
+{
+  executable_t *exec = executable_new (self);
+
+  /* Testing border cases */
+  assert_null (executable_get_section_by_addr (NULL, 0x1000));
+  assert_null (executable_get_section_by_addr (exec, 0));
+  assert_null (executable_get_section_by_addr (exec, UINTPTR_MAX));
+
+  uintptr_t text_addr, data_addr;
+  size_t text_size, data_size;
+  assert_non_null (
+      executable_section_by_name (exec, ".text", &text_addr, &text_size));
+  assert_non_null (
+      executable_section_by_name (exec, ".data", &data_addr, &data_size));
+
+  /* Alternate between sections to miss the last-hit cache */
+  for (size_t i = 0; i < 3; i++)
+    {
+      assert_string_equal (executable_get_section_by_addr (exec, text_addr),
+			   ".text");
+      assert_string_equal (
+	  executable_get_section_by_addr (exec, text_addr + text_size - 1),
+	  ".text");
+      assert_string_equal (executable_get_section_by_addr (exec, data_addr),
+			   ".data");
+    }
+  assert_true (executable_get_section_by_addr (exec, text_addr - 1) == NULL ||
+	       strcmp (executable_get_section_by_addr (exec, text_addr - 1),
+		       ".text"));
+
+  /* Function symbols lie in loaded sections */
+  for (size_t i = 0; i < executable_symbols (exec); i++)
+    assert_non_null (executable_get_section_by_addr (
+	exec, executable_symbol (exec, i, NULL, NULL)));
+
+  executable_delete (exec);
+}
+
+static void
+import_test (__attribute__ ((unused)) void **state)
+{
+  executable_t *exec = executable_new (self);
+
+  /* Testing border cases */
+  assert_null (executable_get_import_by_addr (NULL, 0x1000));
+  assert_null (executable_get_import_by_addr (exec, 0));
+  assert_true (executable_imports (NULL) == 0);
+  assert_true (executable_import (NULL, 0, NULL) == 0);
+  assert_true (executable_import (exec, executable_imports (exec), NULL) ==
+	       0);
+
+  /* Imports are named over their whole PLT entry */
+  bool has_mkstemp = false;
+  uintptr_t previous = 0;
+  for (size_t i = 0; i < executable_imports (exec); i++)
+    {
+      const char *name;
+      uintptr_t addr = executable_import (exec, i, &name);
+      assert_true (addr > previous);
+      previous = addr;
+
+      assert_string_equal (executable_get_import_by_addr (exec, addr), name);
+      assert_string_equal (executable_get_import_by_addr (exec, addr + 7),
+			   name);
+      assert_true (strncmp (executable_get_section_by_addr (exec, addr),
+			    ".plt", 4) == 0);
+      has_mkstemp |= !strcmp (name, "mkstemp");
+    }
+  assert_true (has_mkstemp);
+
+  executable_delete (exec);
+}
+
+/* C function under a mangled C++ name (tracker::mangled(int)) */
+void mangled (int) __asm__ ("_ZN7tracker7mangledEi");
+void
+mangled (__attribute__ ((unused)) int i)
+{
+}
+
+static void
+demangle_test (__attribute__ ((unused)) void **state)
+{
+  executable_t *exec = executable_new (self);
+
+  /* Testing border cases */
+  assert_null (executable_get_demangled_symbol_by_addr (NULL, 0x1000));
+  assert_null (executable_get_demangled_symbol_by_addr (exec, 0));
+  assert_null (executable_get_demangled_import_by_addr (NULL, 0x1000));
+  assert_null (executable_get_demangled_import_by_addr (exec, 0));
+
+  bool found = false;
+  for (size_t i = 0; i < executable_symbols (exec); i++)
+    {
+      const char *name;
+      uintptr_t addr = executable_symbol (exec, i, NULL, &name);
+      const char *demangled =
+	  executable_get_demangled_symbol_by_addr (exec, addr);
+      assert_non_null (demangled);
+
+      /* Names are demangled once and for all */
+      assert_ptr_equal (executable_get_demangled_symbol_by_addr (exec, addr),
+			demangled);
+
+      if (strcmp (name, "_ZN7tracker7mangledEi") == 0)
+	{
+	  /* Without C++ runtime, names are left as they are */
+	  assert_true (!strcmp (demangled, "tracker::mangled(int)") ||
+		       demangled == name);
+	  found = true;
+	}
+      else if (strncmp (name, "_Z", 2) != 0)
+	assert_ptr_equal (demangled, name);
+    }
+  assert_true (found);
+
+  /* Imports of a C program are not mangled */
+  for (size_t i = 0; i < executable_imports (exec); i++)
+    {
+      const char *name;
+      uintptr_t addr = executable_import (exec, i, &name);
+      assert_ptr_equal (executable_get_demangled_import_by_addr (exec, addr),
+			name);
+    }
+
+  executable_delete (exec);
+}
+
+static void
+line_test (__attribute__ ((unused)) void **state)
+{
+  const size_t first_line = __LINE__ - 3;
+  executable_t *exec = executable_new (self);
+
+  /* Testing border cases */
+  assert_true (executable_lines (NULL) == 0);
+  assert_true (executable_get_line_by_addr (NULL, 0x1000, NULL) == 0);
+  assert_true (executable_get_line_by_addr (exec, 0, NULL) == 0);
+  assert_true (executable_get_line_by_addr (exec, UINTPTR_MAX, NULL) == 0);
+
+  /* Tests are built with debug information */
+  assert_true (executable_lines (exec) > 0);
+
+  /* The entry of this function is attributed to its first lines */
+  size_t symbols = executable_symbols (exec);
+  uintptr_t *addrs = malloc (symbols * sizeof (uintptr_t));
+  const char **files = malloc (symbols * sizeof (const char *));
+  size_t *lines = malloc (symbols * sizeof (size_t));
+  assert_non_null (addrs);
+  assert_non_null (files);
+  assert_non_null (lines);
+
+  bool found = false;
+  for (size_t i = 0; i < symbols; i++)
+    {
+      const char *name, *file = NULL;
+      addrs[i] = executable_symbol (exec, i, NULL, &name);
+      if (strcmp (name, "line_test") != 0)
+	continue;
+
+      size_t line = executable_get_line_by_addr (exec, addrs[i], &file);
+      assert_non_null (file);
+      assert_non_null (strstr (file, "test_executables.c"));
+      assert_true (line >= first_line - 2 && line <= first_line + 2);
+      found = true;
+    }
+  assert_true (found);
+
+  /* Batch lookups agree with single lookups */
+  size_t matched =
+      executable_get_lines_by_addr (exec, addrs, symbols, files, lines);
+  size_t expected = 0;
+  for (size_t i = 0; i < symbols; i++)
+    {
+      const char *file = NULL;
+      size_t line = executable_get_line_by_addr (exec, addrs[i], &file);
+      assert_true (lines[i] == line);
+      if (line != 0)
+	{
+	  assert_string_equal (files[i], file);
+	  expected++;
+	}
+    }
+  assert_true (matched == expected && matched > 0);
+
+  free (addrs);
+  free (files);
+  free (lines);
+  executable_delete (exec);
+}
+
+static void
+cache_test (__attribute__ ((unused)) void **state)
+{
+  executable_t *exec = executable_new (self), *same = executable_new (self);
+
+  /* Testing border cases */
+  assert_null (executable_build_id (NULL, NULL));
+  assert_null (executable_id (NULL));
+  assert_null (executable_cache_path (NULL, "cfg"));
+  assert_null (executable_cache_path (exec, NULL));
+  assert_null (executable_cache_path (exec, ""));
+  assert_null (executable_cache_path (exec, "../cfg"));
+  assert_true (errno == EINVAL);
+
+  /* The identifier is the build-ID (if any) and does not change */
+  size_t size;
+  const uint8_t *build_id = executable_build_id (exec, &size);
+  const char *id = executable_id (exec);
+  assert_non_null (id);
+  assert_string_equal (id, executable_id (same));
+  if (build_id != NULL)
+    {
+      assert_true (strlen (id) == 2 * size);
+      for (size_t i = 0; i < size; i++)
+	{
+	  char hex[3];
+	  sprintf (hex, "%02x", build_id[i]);
+	  assert_memory_equal (id + 2 * i, hex, 2);
+	}
+    }
+
+  /* Cache directories are created on demand */
+  char base[] = "/tmp/tracker-cache-XXXXXX";
+  assert_non_null (mkdtemp (base));
+  assert_true (setenv ("XDG_CACHE_HOME", base, 1) == 0);
+
+  char *path = executable_cache_path (exec, "cfg");
+  assert_non_null (path);
+  char expected[256];
+  snprintf (expected, sizeof (expected), "%s/tracker/%s/cfg", base, id);
+  assert_string_equal (path, expected);
+
+  struct stat st;
+  *strrchr (path, '/') = '\0';
+  assert_true (stat (path, &st) == 0 && S_ISDIR (st.st_mode));
+
+  char *again = executable_cache_path (same, "cfg");
+  assert_non_null (again);
+  assert_string_equal (again, expected);
+
+  /* The symbol index is saved to the cache on first use, then read from
+   * there (and rebuilt if the file is damaged) */
+  executable_set_cache (NULL, true);
+  for (size_t round = 0; round < 3; round++)
+    {
+      executable_t *cached = executable_new (self);
+      executable_set_cache (cached, true);
+      assert_true (executable_symbols (cached) == executable_symbols (exec));
+      for (size_t i = 0; i < executable_symbols (exec); i++)
+	{
+	  size_t size1, size2;
+	  const char *name1, *name2;
+	  uintptr_t start = executable_symbol (exec, i, &size1, &name1);
+	  assert_true (executable_symbol (cached, i, &size2, &name2) == start);
+	  assert_true (size1 == size2);
+	  assert_string_equal (name1, name2);
+	  assert_string_equal (executable_get_symbol_by_addr (cached, start),
+			       name1);
+	}
+      executable_delete (cached);
+
+      snprintf (expected, sizeof (expected), "%s/tracker/%s/symbols", base,
+		id);
+      assert_true (stat (expected, &st) == 0);
+      if (round == 1)
+	assert_true (truncate (expected, st.st_size - 8) == 0);
+    }
+  assert_true (unlink (expected) == 0);
+
+  assert_true (rmdir (path) == 0);
+  *strrchr (path, '/') = '\0';
+  assert_true (rmdir (path) == 0);
+  assert_true (rmdir (base) == 0);
+  free (path);
+  free (again);
+
+  executable_delete (exec);
+  executable_delete (same);
+}
+
+int
+main (void)
+{
+  const struct CMUnitTest tests[] = {
+      cmocka_unit_test (executable_test),
+      cmocka_unit_test (symbol_test),
+      cmocka_unit_test (section_test),
+      cmocka_unit_test (import_test),
+      cmocka_unit_test (demangle_test),
+      cmocka_unit_test (line_test),
+      cmocka_unit_test (cache_test),
+  };
+
+  return cmocka_run_group_tests (tests, NULL, NULL);
+}
@@ -0,0 +1,242 @@
+/*
+ * tracker is an analyzer for binary executable files
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019-2020 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#include <cmocka.h>
+
+#include <errno.h>
+#include <string.h>
+
+#include "exports.h"
+
+/* Export the CFG and read it back into buffer */
+static void
+export_to_buffer (cfg_t *cfg, format_t format, filter_t *filter,
+		  char *buffer, size_t size)
+{
+  FILE *fd = tmpfile ();
+  assert_non_null (fd);
+  assert_true (cfg_export (cfg, fd, format, filter) == 0);
+
+  rewind (fd);
+  size_t len = fread (buffer, 1, size - 1, fd);
+  buffer[len] = '\0';
+  fclose (fd);
+}
+
+static bool
+keep_even (__attribute__ ((unused)) cfg_t *const cfg, const size_t node,
+	   __attribute__ ((unused)) void *data)
+{
+  return node % 2 == 0;
+}
+
+static void
+exports_test (__attribute__ ((unused)) void **state)
+{
+  char buffer[4096];
+  uint8_t *opcodes = (uint8_t *) "\x90";
+  instr_t *instr1 = instr_new (0x1000, 1, opcodes),
+	  *instr2 = instr_new (0x1001, 1, opcodes),
+	  *instr3 = instr_new (0x2000, 1, opcodes);
+
+  /* 0x1000 -> 0x1001 -> 0x2000 -> 0x1000 -> 0x1001 */
+  cfg_t *cfg = cfg_new (instr1, single);
+  cfg_insert (cfg, instr2, branch);
+  cfg_insert (cfg, instr3, dynjump);
+  cfg_insert (cfg, instr1, single);
+  cfg_insert (cfg, instr2, branch);
+
+  /* Testing border cases */
+  assert_true (cfg_export (NULL, stdout, dot_format, NULL) == -1);
+  assert_true (errno == EINVAL);
+  assert_true (cfg_export (cfg, NULL, dot_format, NULL) == -1);
+  assert_true (format_from_filename ("cfg.txt") == -1);
+  assert_true (format_from_filename ("cfg") == -1);
+  assert_true (format_from_filename ("cfg.graphml") == graphml_format);
+
+  /* Testing formats */
+  export_to_buffer (cfg, dot_format, NULL, buffer, sizeof (buffer));
+  assert_non_null (strstr (buffer, "digraph cfg {\n"));
+  assert_non_null (strstr (buffer, "  n0 [label=\"0x1000\\n2 hits\"];\n"));
+  assert_non_null (strstr (buffer, "shape=diamond"));
+  assert_non_null (strstr (buffer, "  n0 -> n1 [label=\"2\"];\n"));
+  assert_non_null (strstr (buffer, "  n2 -> n0 [label=\"1\"];\n"));
+
+  export_to_buffer (cfg, graphml_format, NULL, buffer, sizeof (buffer));
+  assert_non_null (strstr (buffer, "<node id=\"n2\"><data key=\"address\">"
+				   "0x2000</data><data key=\"type\">dynjump"));
+  assert_non_null (strstr (buffer, "<edge source=\"n1\" target=\"n2\">"));
+  assert_non_null (strstr (buffer, "</graphml>\n"));
+
+  export_to_buffer (cfg, json_format, NULL, buffer, sizeof (buffer));
+  assert_string_equal (
+      buffer,
+      "{\"nodes\":[\n"
+      "{\"id\":0,\"address\":\"0x1000\",\"type\":\"single\",\"hits\":2},\n"
+      "{\"id\":1,\"address\":\"0x1001\",\"type\":\"branch\",\"hits\":2},\n"
+      "{\"id\":2,\"address\":\"0x2000\",\"type\":\"dynjump\",\"hits\":1}\n"
+      "],\n\"edges\":[\n"
+      "{\"source\":0,\"target\":1,\"hits\":2},\n"
+      "{\"source\":1,\"target\":2,\"hits\":1},\n"
+      "{\"source\":2,\"target\":0,\"hits\":1}\n"
+      "]}\n");
+
+  /* Testing filters */
+  filter_t range = {.start = 0x1000, .end = 0x2000};
+  export_to_buffer (cfg, json_format, &range, buffer, sizeof (buffer));
+  assert_null (strstr (buffer, "0x2000"));
+  assert_non_null (strstr (buffer, "{\"source\":0,\"target\":1,\"hits\":2}\n"));
+  assert_null (strstr (buffer, "\"target\":2"));
+
+  filter_t even = {.keep = keep_even};
+  export_to_buffer (cfg, dot_format, &even, buffer, sizeof (buffer));
+  assert_non_null (strstr (buffer, "  n2 -> n0"));
+  assert_null (strstr (buffer, "  n1 "));
+  assert_null (strstr (buffer, "-> n1"));
+
+  cfg_delete (cfg);
+  instr_delete (instr1);
+  instr_delete (instr2);
+  instr_delete (instr3);
+}
+
+static void
+frontier_test (__attribute__ ((unused)) void **state)
+{
+  char buffer[4096];
+  uint8_t *opcodes = (uint8_t *) "\x90\x90";
+  instr_t *b1 = instr_new (0x1000, 2, opcodes),
+	  *a = instr_new (0x1002, 2, opcodes),
+	  *b2 = instr_new (0x1010, 2, opcodes),
+	  *j = instr_new (0x1020, 2, opcodes),
+	  *t = instr_new (0x1030, 2, opcodes);
+
+  /* b1 falls through twice, b2 jumps once, j reaches b2 and b1 */
+  cfg_t *cfg = cfg_new (b1, branch);
+  cfg_insert (cfg, a, single);
+  cfg_insert (cfg, j, dynjump);
+  cfg_insert (cfg, b2, branch);
+  cfg_insert (cfg, t, single);
+  cfg_insert (cfg, j, dynjump);
+  cfg_insert (cfg, b1, branch);
+  cfg_insert (cfg, a, single);
+  cfg_insert (cfg, j, dynjump);
+
+  assert_true (cfg_export_frontier (NULL, stdout) == -1);
+  assert_true (cfg_export_frontier (cfg, NULL) == -1);
+
+  FILE *fd = tmpfile ();
+  assert_non_null (fd);
+  assert_true (cfg_export_frontier (cfg, fd) == 0);
+  rewind (fd);
+  buffer[fread (buffer, 1, sizeof (buffer) - 1, fd)] = '\0';
+  fclose (fd);
+
+  assert_string_equal (buffer,
+		       "[\n"
+		       "{\"address\":\"0x1020\",\"hits\":3,\"type\":"
+		       "\"dynjump\",\"targets\":2,\"stable_hits\":1},\n"
+		       "{\"address\":\"0x1000\",\"hits\":2,\"type\":"
+		       "\"branch\",\"taken\":\"0x1002\",\"missing\":\"jump\"},\n"
+		       "{\"address\":\"0x1010\",\"hits\":1,\"type\":"
+		       "\"branch\",\"taken\":\"0x1030\",\"missing\":"
+		       "\"fallthrough\"}\n"
+		       "]\n");
+
+  cfg_delete (cfg);
+  instr_delete (b1);
+  instr_delete (a);
+  instr_delete (b2);
+  instr_delete (j);
+  instr_delete (t);
+}
+
+static void
+callgraph_export_test (__attribute__ ((unused)) void **state)
+{
+  char buffer[4096];
+  uint8_t *opcodes = (uint8_t *) "\x90\x90";
+  instr_t *m = instr_new (0x1000, 2, opcodes),
+	  *f = instr_new (0x2000, 2, opcodes),
+	  *g = instr_new (0x3000, 2, opcodes);
+
+  cfg_t *cfg = cfg_new (m, single);
+  cfg_insert (cfg, f, single);
+  cfg_insert (cfg, g, single);
+
+  /* main calls f twice and f calls g once */
+  callgraph_t *cg = callgraph_new (8);
+  callgraph_call (cg, 1, 0x1002);
+  callgraph_call (cg, 2, 0x2002);
+  callgraph_return (cg, 0x2002);
+  callgraph_return (cg, 0x1002);
+  callgraph_call (cg, 1, 0x1002);
+
+  assert_true (callgraph_export (NULL, cfg, stdout, dot_format) == -1);
+  assert_true (callgraph_export (cg, NULL, stdout, dot_format) == -1);
+  assert_true (callgraph_export (cg, cfg, NULL, dot_format) == -1);
+
+  FILE *fd = tmpfile ();
+  assert_non_null (fd);
+  assert_true (callgraph_export (cg, cfg, fd, dot_format) == 0);
+  rewind (fd);
+  buffer[fread (buffer, 1, sizeof (buffer) - 1, fd)] = '\0';
+  fclose (fd);
+
+  assert_non_null (strstr (buffer, "digraph callgraph {"));
+  assert_non_null (strstr (buffer, "  f0 [label=\"0x1000\"];"));
+  assert_non_null (strstr (buffer, "  f2 [label=\"0x3000\"];"));
+  assert_non_null (strstr (buffer, "  f0 -> f1 [label=\"2\"];"));
+  assert_non_null (strstr (buffer, "  f1 -> f2 [label=\"1\"];"));
+
+  fd = tmpfile ();
+  assert_non_null (fd);
+  assert_true (callgraph_export (cg, cfg, fd, json_format) == 0);
+  rewind (fd);
+  buffer[fread (buffer, 1, sizeof (buffer) - 1, fd)] = '\0';
+  fclose (fd);
+
+  assert_string_equal (buffer,
+		       "{\"functions\":[\n"
+		       "{\"id\":0,\"address\":\"0x1000\"},\n"
+		       "{\"id\":1,\"address\":\"0x2000\"},\n"
+		       "{\"id\":2,\"address\":\"0x3000\"}\n"
+		       "],\n\"calls\":[\n"
+		       "{\"caller\":0,\"callee\":1,\"calls\":2},\n"
+		       "{\"caller\":1,\"callee\":2,\"calls\":1}\n"
+		       "],\n\"contexts\":[\n"
+		       "{\"id\":0,\"parent\":null,\"function\":0,\"calls\":0},\n"
+		       "{\"id\":1,\"parent\":0,\"function\":1,\"calls\":2},\n"
+		       "{\"id\":2,\"parent\":1,\"function\":2,\"calls\":1}\n"
+		       "]}\n");
+
+  callgraph_delete (cg);
+  cfg_delete (cfg);
+  instr_delete (m);
+  instr_delete (f);
+  instr_delete (g);
+}
+
+int
+main (void)
+{
+  const struct CMUnitTest tests[] = {
+      cmocka_unit_test (exports_test),
+      cmocka_unit_test (frontier_test),
+      cmocka_unit_test (callgraph_export_test),
+  };
+
+  return cmocka_run_group_tests (tests, NULL, NULL);
+}
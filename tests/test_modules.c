@@ -0,0 +1,216 @@
+/*
+ * tracker is an analyzer for binary executable files
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019-2020 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#include <cmocka.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "modules.h"
+
+static void
+modules_test (__attribute__ ((unused)) void **state)
+{
+  /* Testing border cases */
+  assert_null (modules_new (-1));
+  assert_true (modules_update (NULL) == -1);
+  assert_true (modules_count (NULL) == 0);
+  assert_true (modules_lookup (NULL, 0x1000, NULL) == MODULE_NONE);
+  assert_null (modules_name (NULL, 0));
+  assert_true (modules_base (NULL, 0) == 0);
+  assert_null (modules_executable (NULL, 0));
+  assert_null (modules_id (NULL, 0));
+  assert_true (modules_link_addr (NULL, 0x1000, NULL) == 0);
+  modules_delete (NULL);
+
+  modules_t *modules = modules_new (getpid ());
+  assert_non_null (modules);
+  assert_null (modules_name (modules, modules_count (modules)));
+  assert_true (modules_lookup (modules, 0, NULL) == MODULE_NONE);
+
+  /* The code of the test belongs to its executable */
+  char self[4096];
+  ssize_t len = readlink ("/proc/self/exe", self, sizeof (self) - 1);
+  assert_true (len > 0);
+  self[len] = '\0';
+
+  uintptr_t offset, addr = (uintptr_t) &modules_test;
+  size_t module = modules_lookup (modules, addr, &offset);
+  assert_true (module != MODULE_NONE);
+  assert_string_equal (modules_name (modules, module), self);
+  assert_true (offset == addr - modules_base (modules, module));
+  assert_true (modules_lookup (modules, addr + 1, NULL) == module);
+
+  /* Its executable is loaded once */
+  executable_t *exec = modules_executable (modules, module);
+  assert_non_null (exec);
+  assert_ptr_equal (modules_executable (modules, module), exec);
+
+  /* Run-time addresses map back to their link-time address */
+  executable_t *found = NULL;
+  uintptr_t link = modules_link_addr (modules, addr, &found);
+  assert_ptr_equal (found, exec);
+  assert_true (link == executable_base (exec) + offset);
+  assert_string_equal (executable_get_symbol_by_addr (exec, link),
+		       "modules_test");
+  assert_string_equal (modules_id (modules, module), executable_id (exec));
+
+  /* The stack is a module without executable */
+  int local;
+  module = modules_lookup (modules, (uintptr_t) &local, NULL);
+  assert_true (module != MODULE_NONE);
+  assert_string_equal (modules_name (modules, module), "[stack]");
+  assert_null (modules_executable (modules, module));
+  assert_null (modules_id (modules, module));
+  assert_true (modules_link_addr (modules, (uintptr_t) &local, &found) == 0);
+  assert_null (found);
+
+  /* A new file mapping is found after an update (the executable loaded
+   * above is also mapped in the process), modules keep their index after
+   * being unmapped */
+  assert_true (modules_update (modules) == 0);
+  char filename[] = "/tmp/tracker-module-XXXXXX";
+  int fd = mkstemp (filename);
+  assert_true (fd != -1);
+  assert_true (ftruncate (fd, 4096) == 0);
+  void *map = mmap (NULL, 4096, PROT_READ, MAP_PRIVATE, fd, 0);
+  assert_true (map != MAP_FAILED);
+  close (fd);
+
+  size_t count = modules_count (modules);
+  assert_true (modules_lookup (modules, (uintptr_t) map, NULL) ==
+	       MODULE_NONE);
+  assert_true (modules_update (modules) == 0);
+  module = modules_lookup (modules, (uintptr_t) map + 16, &offset);
+  assert_true (module == count);
+  assert_true (offset == 16);
+  assert_string_equal (modules_name (modules, module), filename);
+  assert_null (modules_executable (modules, module)); /* Not an ELF file */
+
+  munmap (map, 4096);
+  unlink (filename);
+  assert_true (modules_update (modules) == 0);
+  assert_true (modules_lookup (modules, (uintptr_t) map, NULL) ==
+	       MODULE_NONE);
+  assert_true (modules_count (modules) == count + 1);
+  assert_true (modules_lookup (modules, addr, NULL) ==
+	       modules_lookup (modules, addr, NULL));
+
+  modules_delete (modules);
+}
+
+static void
+coverage_test (__attribute__ ((unused)) void **state)
+{
+  char filename[] = "/tmp/tracker-coverage-XXXXXX";
+  int fd = mkstemp (filename);
+  assert_true (fd != -1);
+  close (fd);
+  unlink (filename);
+
+  /* Testing border cases */
+  coverage_t *records = NULL;
+  assert_true (coverage_load (NULL, &records) == -1);
+  assert_true (coverage_load (filename, &records) == -1);
+  assert_true (errno == ENOENT);
+  assert_true (coverage_merge (NULL, NULL, 0) == -1);
+
+  /* The first run creates the file */
+  coverage_t run1[] = {{0x10, 1}, {0x20, 2}, {0x40, 4}};
+  assert_true (coverage_merge (filename, run1, 3) == 0);
+  assert_true (coverage_load (filename, &records) == 3);
+  assert_memory_equal (records, run1, sizeof (run1));
+  free (records);
+
+  /* The next runs add their hits */
+  coverage_t run2[] = {{0x08, 8}, {0x20, 3}, {0x50, 5}};
+  coverage_t merged[] = {{0x08, 8}, {0x10, 1}, {0x20, 5}, {0x40, 4},
+			 {0x50, 5}};
+  assert_true (coverage_merge (filename, run2, 3) == 0);
+  assert_true (coverage_load (filename, &records) == 5);
+  assert_memory_equal (records, merged, sizeof (merged));
+  free (records);
+
+  assert_true (coverage_merge (filename, NULL, 0) == 0);
+  assert_true (coverage_load (filename, &records) == 5);
+  free (records);
+
+  /* Concurrent merges do not lose any hit */
+  const size_t children = 4, merges = 50;
+  coverage_t one[] = {{0x08, 1}};
+  for (size_t c = 0; c < children; c++)
+    {
+      pid_t pid = fork ();
+      assert_true (pid != -1);
+      if (pid == 0)
+	{
+	  int failed = 0;
+	  for (size_t m = 0; m < merges; m++)
+	    failed |= coverage_merge (filename, one, 1);
+	  _exit (failed ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+    }
+  for (size_t c = 0; c < children; c++)
+    {
+      int status;
+      assert_true (wait (&status) != -1);
+      assert_true (WIFEXITED (status) && WEXITSTATUS (status) == 0);
+    }
+  assert_true (coverage_load (filename, &records) == 5);
+  assert_true (records[0].hits == 8 + children * merges);
+  free (records);
+
+  /* Files of another layout are rejected */
+  fd = open (filename, O_WRONLY);
+  assert_true (fd != -1);
+  uint64_t layout = 0;
+  assert_true (pwrite (fd, &layout, sizeof (layout), 8) == sizeof (layout));
+  close (fd);
+  assert_true (coverage_load (filename, &records) == -1);
+  assert_true (errno == EINVAL);
+
+  /* Other files are rejected */
+  fd = open (filename, O_WRONLY | O_TRUNC);
+  assert_true (fd != -1);
+  assert_true (write (fd, "TRKCFG01", 8) == 8);
+  close (fd);
+  assert_true (coverage_load (filename, &records) == -1);
+  assert_true (errno == EINVAL);
+  assert_true (coverage_merge (filename, run1, 3) == -1);
+
+  char lock[sizeof (filename) + 5];
+  snprintf (lock, sizeof (lock), "%s.lock", filename);
+  unlink (lock);
+  unlink (filename);
+}
+
+int
+main (void)
+{
+  const struct CMUnitTest tests[] = {
+      cmocka_unit_test (modules_test),
+      cmocka_unit_test (coverage_test),
+  };
+
+  return cmocka_run_group_tests (tests, NULL, NULL);
+}
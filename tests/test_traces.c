@@ -9,6 +9,8 @@
  * This software is released under a 3-clause BSD license (see COPYING file).
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <setjmp.h>
 #include <stdarg.h>
 #include <stddef.h>
@@ -16,6 +18,9 @@
 #include <cmocka.h>
 
 #include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 #include "traces.h"
 
@@ -99,8 +104,8 @@ hashtable_test (__attribute__ ((unused)) void **state)
 
   /* Testing accessors */
   assert_true (hashtable_entries (ht) == 10);
-  assert_true (hashtable_collisions (ht) == 6);
-  assert_true (hashtable_filled_buckets (ht) == ht_size);
+  assert_true (hashtable_collisions (ht) == 7);
+  assert_true (hashtable_filled_buckets (ht) == 3);
 
   /* Testing hashtable_lookup */
   assert_false (hashtable_lookup (NULL, instr1));
@@ -130,6 +135,59 @@ hashtable_test (__attribute__ ((unused)) void **state)
   assert_true (errno == EINVAL);
 }
 
+static void
+generation_test (__attribute__ ((unused)) void **state)
+{
+  uintptr_t addr = 0x401000;
+  uint8_t *opcodes1 = (uint8_t *) "\x00\x48\x89\xe5",
+	  *opcodes2 = (uint8_t *) "\x00\x48\x31\xc0";
+
+  /* Code at addr executed, overwritten, then restored */
+  instr_t *instr1 = instr_new (addr, 4, opcodes1),
+	  *instr2 = instr_new (addr, 4, opcodes2),
+	  *instr3 = instr_new (addr, 4, opcodes1);
+  assert_true (instr_generation (instr1) == 0);
+  instr_set_generation (instr2, 1);
+  instr_set_generation (instr3, 2);
+  assert_true (instr_generation (instr3) == 2);
+
+  hashtable_t *ht = hashtable_new (DEFAULT_HASHTABLE_SIZE);
+  assert_non_null (ht);
+
+  /* Opcodes are compared beyond null bytes */
+  instr_t *other = instr_new (addr, 4, opcodes2);
+  assert_true (hashtable_insert (ht, instr1));
+  assert_true (hashtable_insert (ht, other));
+  assert_false (hashtable_insert (ht, other));
+
+  /* Versions of the code at the same address are distinct */
+  assert_true (hashtable_insert (ht, instr2));
+  assert_true (hashtable_insert (ht, instr3));
+  assert_true (hashtable_entries (ht) == 4);
+  assert_true (hashtable_get (ht, instr3) == instr3);
+
+  /* Lookup by address and generation */
+  assert_true (hashtable_find (ht, addr, 0) == instr1);
+  assert_true (hashtable_find (ht, addr, 1) == instr2);
+  assert_true (hashtable_find (ht, addr, 2) == instr3);
+  assert_null (hashtable_find (ht, addr, 3));
+  assert_null (hashtable_find (ht, addr + 1, 0));
+  assert_null (hashtable_find (NULL, addr, 0));
+  assert_true (errno == EINVAL);
+
+  /* Each version is a node of the CFG */
+  cfg_t *cfg = cfg_new (instr1, single);
+  assert_non_null (cfg_insert (cfg, instr2, single));
+  assert_non_null (cfg_insert (cfg, instr3, single));
+  assert_non_null (cfg_insert (cfg, instr1, single));
+  assert_true (cfg_nodes (cfg) == 3);
+  assert_true (cfg_lookup (cfg, instr3) == 2);
+  assert_true (cfg_node_hits (cfg, 0) == 2);
+
+  cfg_delete (cfg);
+  hashtable_delete (ht);
+}
+
 static void
 trace_test (__attribute__ ((unused)) void **state)
 {
@@ -222,13 +280,465 @@ trace_test (__attribute__ ((unused)) void **state)
   instr_delete (instr11);
 }
 
+static void
+cfg_test (__attribute__ ((unused)) void **state)
+{
+  uint8_t *opcodes = (uint8_t *) "\x90\x90\x90\x90";
+  instr_t *instr[5];
+  for (size_t i = 0; i < 5; i++)
+    instr[i] = instr_new (0x1000 + i, 1, opcodes);
+
+  /* Testing border cases */
+  assert_null (cfg_new (NULL, single));
+  assert_true (errno == EINVAL);
+  assert_null (cfg_insert (NULL, instr[0], single));
+  assert_true (errno == EINVAL);
+  assert_true (cfg_nodes (NULL) == 0);
+
+  /* Testing nominal cases: 0 -> 1 -> 2 -> 1 -> 3 -> 4 */
+  cfg_t *cfg = cfg_new (instr[0], single);
+  assert_non_null (cfg);
+  assert_null (cfg_insert (cfg, NULL, single));
+
+  assert_non_null (cfg_insert (cfg, instr[1], branch));
+  assert_non_null (cfg_insert (cfg, instr[2], single));
+  assert_non_null (cfg_insert (cfg, instr[1], branch));
+  assert_non_null (cfg_insert (cfg, instr[3], dynjump));
+  assert_non_null (cfg_insert (cfg, instr[4], single));
+
+  assert_true (cfg_nodes (cfg) == 5);
+  assert_true (cfg_edges (cfg) == 5);
+  assert_true (cfg_current (cfg) == 4);
+  assert_true (cfg_current (NULL) == CFG_NONE);
+
+  /* Lookup is performed on the content of the instruction */
+  instr_t *copy = instr_new (0x1001, 1, opcodes);
+  assert_true (cfg_lookup (cfg, copy) == 1);
+  instr_delete (copy);
+
+  assert_true (cfg_node_instr (cfg, 3) == instr[3]);
+  assert_null (cfg_node_instr (cfg, 5));
+  assert_true (cfg_node_type (cfg, 1) == branch);
+  assert_true (cfg_node_type (cfg, 3) == dynjump);
+  assert_true (cfg_node_hits (cfg, 0) == 1);
+  assert_true (cfg_node_hits (cfg, 1) == 2);
+
+  assert_true (cfg_node_degree (cfg, 1) == 2);
+  assert_true (cfg_node_degree (cfg, 4) == 0);
+  size_t edge = cfg_node_edge (cfg, 1, 1);
+  assert_true (cfg_edge_src (cfg, edge) == 1);
+  assert_true (cfg_edge_dst (cfg, edge) == 3);
+  assert_true (cfg_edge_hits (cfg, cfg_node_edge (cfg, 0, 0)) == 1);
+  assert_true (cfg_node_edge (cfg, 1, 2) == CFG_NONE);
+  assert_true (cfg_edge_dst (cfg, 5) == CFG_NONE);
+
+  cfg_delete (cfg);
+  cfg_delete (NULL);
+
+  for (size_t i = 0; i < 5; i++)
+    instr_delete (instr[i]);
+}
+
+static void
+cfg_dynjump_test (__attribute__ ((unused)) void **state)
+{
+  const size_t targets = 100;
+  uint8_t *opcodes = (uint8_t *) "\xff\xe0"; /* jmp *%rax */
+  instr_t *jump = instr_new (0x1000, 2, opcodes);
+  instr_t *instr[targets];
+  for (size_t i = 0; i < targets; i++)
+    instr[i] = instr_new (0x2000 + 16 * i, 2, opcodes);
+
+  /* Jump twice to each target, going back to the jump after each target */
+  cfg_t *cfg = cfg_new (jump, dynjump);
+  for (size_t round = 0; round < 2; round++)
+    for (size_t i = 0; i < targets; i++)
+      {
+	assert_non_null (cfg_insert (cfg, instr[i], dynjump));
+	assert_non_null (cfg_insert (cfg, jump, dynjump));
+      }
+
+  size_t node = cfg_lookup (cfg, jump);
+  assert_true (node == 0);
+  assert_true (cfg_node_degree (cfg, node) == targets);
+  assert_true (cfg_nodes (cfg) == targets + 1);
+  assert_true (cfg_edges (cfg) == 2 * targets);
+
+  for (size_t i = 0; i < targets; i++)
+    {
+      size_t edge = cfg_node_successor (cfg, node, cfg_lookup (cfg, instr[i]));
+      assert_true (edge != CFG_NONE);
+      assert_true (cfg_edge_src (cfg, edge) == node);
+      assert_true (cfg_edge_dst (cfg, edge) == cfg_lookup (cfg, instr[i]));
+      assert_true (cfg_edge_hits (cfg, edge) == 2);
+      assert_true (cfg_node_successor (cfg, cfg_edge_dst (cfg, edge), 1) ==
+		   CFG_NONE);
+    }
+  assert_true (cfg_node_successor (cfg, node, node) == CFG_NONE);
+  assert_true (cfg_node_successor (NULL, node, 1) == CFG_NONE);
+
+  /* The target set stopped growing after the first round */
+  assert_true (cfg_node_hits (cfg, node) == 2 * targets + 1);
+  assert_true (cfg_node_stable_hits (cfg, node) == targets + 1);
+
+  cfg_delete (cfg);
+
+  instr_delete (jump);
+  for (size_t i = 0; i < targets; i++)
+    instr_delete (instr[i]);
+}
+
+static node_t
+parity_type (instr_t *const instr)
+{
+  return (instr_addr (instr) / 4) % 3;
+}
+
+static void
+cfg_build_test (__attribute__ ((unused)) void **state)
+{
+  const size_t instrs = 64, traces_count = 13;
+  uint8_t *opcodes = (uint8_t *) "\x90\x90\x90\x90";
+  instr_t *instr[2][instrs];
+  trace_t *traces[traces_count];
+  uint64_t seed = 42;
+
+  /* Two copies of each instruction, used alternatively by the traces */
+  for (size_t i = 0; i < instrs; i++)
+    {
+      instr[0][i] = instr_new (0x1000 + 4 * i, 4, opcodes);
+      instr[1][i] = instr_new (0x1000 + 4 * i, 4, opcodes);
+    }
+
+  /* Random walks of various lengths (trace 5 is empty) */
+  for (size_t t = 0; t < traces_count; t++)
+    {
+      traces[t] = trace_new ();
+      size_t current = (t % 4 == 0) ? 0 : t;
+      for (size_t step = 0; t != 5 && step < 50 + 37 * t; step++)
+	{
+	  trace_append (traces[t], instr[t % 2][current]);
+	  seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+	  current = (seed >> 33) % 4 ? (current + 1) % instrs
+				     : (seed >> 40) % instrs;
+	}
+    }
+
+  /* Sequential build */
+  cfg_t *ref = NULL;
+  for (size_t t = 0; t < traces_count; t++)
+    for (size_t i = 1; i <= trace_length (traces[t]); i++)
+      {
+	instr_t *in = trace_get (traces[t], i);
+	if (ref == NULL)
+	  ref = cfg_new (in, parity_type (in));
+	else if (i == 1)
+	  assert_non_null (cfg_restart (ref, in, parity_type (in)));
+	else
+	  assert_non_null (cfg_insert (ref, in, parity_type (in)));
+      }
+
+  /* Testing border cases */
+  assert_null (cfg_build (NULL, traces_count, NULL, 4));
+  assert_null (cfg_build (traces, 0, NULL, 4));
+  assert_null (cfg_build (&traces[5], 1, NULL, 4));
+  assert_true (errno == EINVAL);
+  assert_null (cfg_restart (NULL, instr[0][0], single));
+
+  /* Parallel builds must be identical to the sequential one */
+  size_t threads[] = {1, 2, 3, 5, 8, 32};
+  for (size_t k = 0; k < sizeof (threads) / sizeof (size_t); k++)
+    {
+      cfg_t *cfg = cfg_build (traces, traces_count, parity_type, threads[k]);
+      assert_non_null (cfg);
+      assert_true (cfg_nodes (cfg) == cfg_nodes (ref));
+      assert_true (cfg_edges (cfg) == cfg_edges (ref));
+
+      for (size_t n = 0; n < cfg_nodes (ref); n++)
+	{
+	  assert_true (cfg_node_instr (cfg, n) == cfg_node_instr (ref, n));
+	  assert_true (cfg_node_type (cfg, n) == cfg_node_type (ref, n));
+	  assert_true (cfg_node_hits (cfg, n) == cfg_node_hits (ref, n));
+	  assert_true (cfg_node_stable_hits (cfg, n) ==
+		       cfg_node_stable_hits (ref, n));
+	  assert_true (cfg_node_degree (cfg, n) == cfg_node_degree (ref, n));
+	  for (size_t i = 0; i < cfg_node_degree (ref, n); i++)
+	    assert_true (cfg_node_edge (cfg, n, i) == cfg_node_edge (ref, n, i));
+	}
+
+      for (size_t e = 0; e < cfg_edges (ref); e++)
+	{
+	  assert_true (cfg_edge_src (cfg, e) == cfg_edge_src (ref, e));
+	  assert_true (cfg_edge_dst (cfg, e) == cfg_edge_dst (ref, e));
+	  assert_true (cfg_edge_hits (cfg, e) == cfg_edge_hits (ref, e));
+	}
+
+      cfg_delete (cfg);
+    }
+
+  /* Appending the CFG of the last traces to the one of the first traces
+   * gives the same nodes, edges and hits */
+  cfg_t *first = cfg_build (traces, 7, parity_type, 1);
+  cfg_t *last = cfg_build (traces + 7, traces_count - 7, parity_type, 1);
+  assert_non_null (first);
+  assert_non_null (last);
+  assert_true (cfg_append (NULL, last) == -1);
+  assert_true (cfg_append (first, NULL) == -1);
+  assert_true (errno == EINVAL);
+  assert_true (cfg_append (first, last) == 0);
+  assert_true (cfg_nodes (first) == cfg_nodes (ref));
+  assert_true (cfg_edges (first) == cfg_edges (ref));
+  assert_true (cfg_current (first) == cfg_current (ref));
+  for (size_t n = 0; n < cfg_nodes (ref); n++)
+    {
+      assert_true (instr_addr (cfg_node_instr (first, n)) ==
+		   instr_addr (cfg_node_instr (ref, n)));
+      assert_true (cfg_node_hits (first, n) == cfg_node_hits (ref, n));
+    }
+  for (size_t e = 0; e < cfg_edges (ref); e++)
+    {
+      assert_true (cfg_edge_src (first, e) == cfg_edge_src (ref, e));
+      assert_true (cfg_edge_dst (first, e) == cfg_edge_dst (ref, e));
+      assert_true (cfg_edge_hits (first, e) == cfg_edge_hits (ref, e));
+    }
+  cfg_delete (first);
+  cfg_delete (last);
+
+  cfg_delete (ref);
+  for (size_t t = 0; t < traces_count; t++)
+    trace_delete (traces[t]);
+  for (size_t i = 0; i < instrs; i++)
+    {
+      instr_delete (instr[0][i]);
+      instr_delete (instr[1][i]);
+    }
+}
+
+static void
+cfg_save_test (__attribute__ ((unused)) void **state)
+{
+  const size_t targets = 20;
+  uint8_t *opcodes = (uint8_t *) "\xff\xe0\x90";
+  instr_t *jump = instr_new (0x1000, 2, opcodes);
+  instr_t *instr[targets];
+  for (size_t i = 0; i < targets; i++)
+    instr[i] = instr_new (0x2000 + 16 * i, 1 + i % 3, opcodes);
+
+  /* A dynjump with a target set and a few fall-throughs */
+  cfg_t *cfg = cfg_new (jump, dynjump);
+  for (size_t i = 0; i < targets; i++)
+    {
+      cfg_insert (cfg, instr[i], single);
+      cfg_insert (cfg, instr[(i + 1) % targets], single);
+      cfg_insert (cfg, jump, dynjump);
+    }
+
+  char filename[] = "/tmp/tracker-cfg-XXXXXX";
+  int fd = mkstemp (filename);
+  assert_true (fd != -1);
+  close (fd);
+
+  /* Testing border cases */
+  assert_true (cfg_save (NULL, filename) == -1);
+  assert_true (cfg_save (cfg, NULL) == -1);
+  assert_null (cfg_load (NULL));
+  assert_null (cfg_load ("/nonexistent/cfg"));
+  assert_null (cfg_load (filename)); /* Empty file */
+
+  assert_true (cfg_save (cfg, filename) == 0);
+  cfg_t *loaded = cfg_load (filename);
+  assert_non_null (loaded);
+
+  /* The loaded CFG is identical */
+  assert_true (cfg_nodes (loaded) == cfg_nodes (cfg));
+  assert_true (cfg_edges (loaded) == cfg_edges (cfg));
+  for (size_t n = 0; n < cfg_nodes (cfg); n++)
+    {
+      instr_t *in = cfg_node_instr (loaded, n);
+      assert_true (in != cfg_node_instr (cfg, n));
+      assert_true (instr_addr (in) == instr_addr (cfg_node_instr (cfg, n)));
+      assert_true (instr_size (in) == instr_size (cfg_node_instr (cfg, n)));
+      assert_memory_equal (instr_opcodes (in),
+			   instr_opcodes (cfg_node_instr (cfg, n)),
+			   instr_size (in));
+      assert_true (cfg_lookup (loaded, cfg_node_instr (cfg, n)) == n);
+      assert_true (cfg_node_type (loaded, n) == cfg_node_type (cfg, n));
+      assert_true (cfg_node_hits (loaded, n) == cfg_node_hits (cfg, n));
+      assert_true (cfg_node_stable_hits (loaded, n) ==
+		   cfg_node_stable_hits (cfg, n));
+      assert_true (cfg_node_degree (loaded, n) == cfg_node_degree (cfg, n));
+      for (size_t i = 0; i < cfg_node_degree (cfg, n); i++)
+	{
+	  size_t edge = cfg_node_edge (cfg, n, i);
+	  assert_true (cfg_node_edge (loaded, n, i) == edge);
+	  assert_true (cfg_node_successor (loaded, n,
+					   cfg_edge_dst (cfg, edge)) == edge);
+	}
+    }
+  for (size_t e = 0; e < cfg_edges (cfg); e++)
+    {
+      assert_true (cfg_edge_src (loaded, e) == cfg_edge_src (cfg, e));
+      assert_true (cfg_edge_dst (loaded, e) == cfg_edge_dst (cfg, e));
+      assert_true (cfg_edge_hits (loaded, e) == cfg_edge_hits (cfg, e));
+    }
+
+  /* Loaded CFGs can be continued, the file is left untouched */
+  size_t nodes = cfg_nodes (loaded), edges = cfg_edges (loaded);
+  instr_t *next = instr_new (0x3000, 1, opcodes);
+  assert_non_null (cfg_restart (loaded, instr[0], single));
+  assert_non_null (cfg_insert (loaded, next, single));
+  assert_non_null (cfg_insert (loaded, jump, dynjump));
+  assert_true (cfg_nodes (loaded) == nodes + 1);
+  assert_true (cfg_edges (loaded) == edges + 2);
+  assert_true (cfg_node_degree (loaded, 0) == cfg_node_degree (cfg, 0));
+  assert_true (cfg_node_successor (loaded, 0, cfg_edge_dst (cfg, 0)) == 0);
+  assert_true (cfg_node_hits (loaded, 0) == cfg_node_hits (cfg, 0) + 1);
+
+  /* Saving it over the file it was loaded from gives the continued CFG
+   * (the mapping is left intact) */
+  assert_true (cfg_save (loaded, filename) == 0);
+  assert_true (instr_addr (cfg_node_instr (loaded, 0)) == 0x1000);
+  cfg_delete (loaded);
+  loaded = cfg_load (filename);
+  assert_non_null (loaded);
+  assert_true (cfg_nodes (loaded) == nodes + 1);
+  assert_true (cfg_lookup (loaded, next) == nodes);
+  assert_true (cfg_current (loaded) == 0);
+
+  /* Saving a CFG read in place copies the file */
+  char copy[] = "/tmp/tracker-cfg-XXXXXX";
+  fd = mkstemp (copy);
+  assert_true (fd != -1);
+  close (fd);
+  assert_true (cfg_save (loaded, copy) == 0);
+  cfg_delete (loaded);
+  loaded = cfg_load (copy);
+  assert_non_null (loaded);
+  assert_true (cfg_edges (loaded) == edges + 2);
+  cfg_delete (loaded);
+  unlink (copy);
+  instr_delete (next);
+
+  /* Files whose index has no empty slot are rejected (lookups would never
+   * end), the header holds the size and the offset of the index */
+  uint64_t header[9];
+  fd = open (filename, O_RDWR);
+  assert_true (fd != -1);
+  assert_true (pread (fd, header, sizeof (header), 0) == sizeof (header));
+  for (uint64_t i = 0; i < header[4]; i++)
+    {
+      uint64_t node = 0;
+      assert_true (pwrite (fd, &node, sizeof (node), header[8] + 16 * i + 8) ==
+		   sizeof (node));
+    }
+  close (fd);
+  assert_null (cfg_load (filename));
+  assert_true (errno == EINVAL);
+
+  /* Truncated files are rejected */
+  assert_true (truncate (filename, 200) == 0);
+  assert_null (cfg_load (filename));
+  assert_true (errno == EINVAL);
+
+  unlink (filename);
+  cfg_delete (cfg);
+  instr_delete (jump);
+  for (size_t i = 0; i < targets; i++)
+    instr_delete (instr[i]);
+}
+
+static void
+callgraph_test (__attribute__ ((unused)) void **state)
+{
+  /* Testing border cases */
+  assert_true (callgraph_call (NULL, 1, 0x1000) == -1);
+  assert_true (callgraph_edges (NULL) == 0);
+  assert_true (callgraph_contexts (NULL) == 0);
+  callgraph_return (NULL, 0x1000);
+  callgraph_delete (NULL);
+
+  callgraph_t *cg = callgraph_new (3);
+  assert_non_null (cg);
+  assert_true (callgraph_call (cg, CFG_NONE, 0x1000) == -1);
+  assert_true (callgraph_edge_caller (cg, 0) == CFG_NONE);
+  assert_true (callgraph_context_parent (cg, 0) == CFG_NONE);
+  assert_true (callgraph_context_function (cg, 0) == 0);
+
+  /* main (0) calls f (1) twice, f calls g (2) */
+  for (size_t i = 0; i < 2; i++)
+    {
+      assert_true (callgraph_call (cg, 1, 0x1005 + i) == 0);
+      assert_true (callgraph_call (cg, 2, 0x2005) == 0);
+      assert_true (callgraph_depth (cg) == 2);
+      callgraph_return (cg, 0x2005);
+      callgraph_return (cg, 0x1005 + i);
+      assert_true (callgraph_depth (cg) == 0);
+    }
+
+  /* Unknown returns are ignored, the root frame is never popped */
+  callgraph_return (cg, 0x1234);
+  callgraph_return (cg, 0);
+  assert_true (callgraph_depth (cg) == 0);
+
+  assert_true (callgraph_edges (cg) == 2);
+  assert_true (callgraph_edge_caller (cg, 0) == 0);
+  assert_true (callgraph_edge_callee (cg, 0) == 1);
+  assert_true (callgraph_edge_calls (cg, 0) == 2);
+  assert_true (callgraph_edge_caller (cg, 1) == 1);
+  assert_true (callgraph_edge_callee (cg, 1) == 2);
+  assert_true (callgraph_edge_calls (cg, 1) == 2);
+  assert_true (callgraph_contexts (cg) == 3);
+
+  /* g called directly from main is a new context */
+  assert_true (callgraph_call (cg, 2, 0x1010) == 0);
+  assert_true (callgraph_contexts (cg) == 4);
+  assert_true (callgraph_context_parent (cg, 3) == 0);
+  assert_true (callgraph_context_function (cg, 3) == 2);
+
+  /* A return skipping frames (longjmp) pops them all */
+  assert_true (callgraph_call (cg, 1, 0x2010) == 0);
+  callgraph_return (cg, 0x1010);
+  assert_true (callgraph_depth (cg) == 0);
+
+  /* Deep recursion in r (3) is folded at the maximum depth */
+  for (size_t i = 0; i < 10; i++)
+    assert_true (callgraph_call (cg, 3, 0x3005) == 0);
+  assert_true (callgraph_depth (cg) == 10);
+  size_t deepest = callgraph_contexts (cg) - 1;
+  assert_true (callgraph_context_depth (cg, deepest) == 3);
+  assert_true (callgraph_context_calls (cg, deepest) == 8);
+  assert_true (callgraph_context_calls (cg, deepest - 1) == 1);
+
+  /* Frames with the same return address are popped one at a time */
+  callgraph_return (cg, 0x3005);
+  assert_true (callgraph_depth (cg) == 9);
+
+  /* Many distinct callees grow the edges and the maps */
+  for (size_t i = 0; i < 1000; i++)
+    {
+      assert_true (callgraph_call (cg, 100 + i, 0x4000) == 0);
+      callgraph_return (cg, 0x4000);
+    }
+  assert_true (callgraph_depth (cg) == 9);
+  assert_true (callgraph_edges (cg) == 1000 + 6);
+  assert_true (callgraph_edge_calls (cg, callgraph_edges (cg) - 1) == 1);
+
+  callgraph_delete (cg);
+}
+
 int
 main (void)
 {
   const struct CMUnitTest tests[] = {
       cmocka_unit_test (instr_test),
       cmocka_unit_test (hashtable_test),
+      cmocka_unit_test (generation_test),
       cmocka_unit_test (trace_test),
+      cmocka_unit_test (cfg_test),
+      cmocka_unit_test (cfg_dynjump_test),
+      cmocka_unit_test (cfg_build_test),
+      cmocka_unit_test (cfg_save_test),
+      cmocka_unit_test (callgraph_test),
   };
 
   return cmocka_run_group_tests (tests, NULL, NULL);
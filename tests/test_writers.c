@@ -0,0 +1,153 @@
+/*
+ * tracker is an analyzer for binary executable files
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019-2020 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#include <cmocka.h>
+
+#include <errno.h>
+#include <string.h>
+
+#include "writers.h"
+
+/* Read back the content of fd into buffer */
+static size_t
+read_back (FILE *fd, char *buffer, size_t size)
+{
+  rewind (fd);
+  size_t len = fread (buffer, 1, size - 1, fd);
+  buffer[len] = '\0';
+
+  return len;
+}
+
+static void
+writer_test (__attribute__ ((unused)) void **state)
+{
+  char buffer[256];
+
+  /* Testing border cases */
+  assert_null (writer_new (NULL, false));
+  assert_true (writer_flush (NULL) == -1);
+  assert_true (writer_delete (NULL) == 0);
+
+  /* What stdio holds is written before the writer output */
+  FILE *fd = tmpfile ();
+  assert_non_null (fd);
+  fputs ("stdio ", fd);
+
+  writer_t *w = writer_new (fd, false);
+  assert_non_null (w);
+  writer_str (w, "str ");
+  writer_dec (w, 0);
+  writer_str (w, " ");
+  writer_dec (w, 1234567890);
+  writer_str (w, " ");
+  writer_dec (w, SIZE_MAX);
+  writer_str (w, " ");
+  writer_hex (w, 0);
+  writer_str (w, " ");
+  writer_hex (w, 0xdeadbeef);
+  writer_str (w, " ");
+  writer_text (w, "text\n", 5);
+
+  /* Nothing is written before a flush */
+  assert_true (read_back (fd, buffer, sizeof (buffer)) == 6);
+  assert_true (writer_flush (w) == 0);
+  read_back (fd, buffer, sizeof (buffer));
+  assert_string_equal (buffer, "stdio str 0 1234567890 18446744073709551615 "
+			       "0x0 0xdeadbeef text\n");
+  assert_true (writer_delete (w) == 0);
+  fclose (fd);
+
+  /* Line-buffered writers flush each line */
+  fd = tmpfile ();
+  assert_non_null (fd);
+  w = writer_new (fd, true);
+  assert_non_null (w);
+  writer_str (w, "line ");
+  writer_dec (w, 1);
+  assert_true (read_back (fd, buffer, sizeof (buffer)) == 0);
+  writer_str (w, "\n");
+  read_back (fd, buffer, sizeof (buffer));
+  assert_string_equal (buffer, "line 1\n");
+  writer_text (w, "line 2\n", 7);
+  read_back (fd, buffer, sizeof (buffer));
+  assert_string_equal (buffer, "line 1\nline 2\n");
+  assert_true (writer_delete (w) == 0);
+  fclose (fd);
+
+  /* Failed writes are reported */
+  fd = fopen ("/dev/null", "r");
+  assert_non_null (fd);
+  w = writer_new (fd, false);
+  assert_non_null (w);
+  writer_str (w, "lost");
+  assert_true (writer_flush (w) == -1);
+  assert_true (errno == EBADF);
+  assert_true (writer_delete (w) == -1);
+  fclose (fd);
+}
+
+static void
+writer_large_test (__attribute__ ((unused)) void **state)
+{
+  /* More values and texts than the writer holds at once, and a string
+   * larger than its buffer */
+  size_t count = 100000, size = 200000;
+  char *large = malloc (size + 1);
+  assert_non_null (large);
+  memset (large, 'x', size);
+  large[size] = '\0';
+
+  FILE *fd = tmpfile ();
+  assert_non_null (fd);
+  writer_t *w = writer_new (fd, false);
+  assert_non_null (w);
+  for (size_t i = 0; i < count; i++)
+    {
+      writer_hex (w, i);
+      writer_text (w, ",", 1);
+    }
+  writer_str (w, large);
+  writer_dec (w, count);
+  assert_true (writer_delete (w) == 0);
+
+  rewind (fd);
+  for (size_t i = 0; i < count; i++)
+    {
+      unsigned long value;
+      assert_true (fscanf (fd, "0x%lx,", &value) == 1);
+      assert_true (value == i);
+    }
+  for (size_t i = 0; i < size; i++)
+    assert_true (fgetc (fd) == 'x');
+  unsigned long value;
+  assert_true (fscanf (fd, "%lu", &value) == 1);
+  assert_true (value == count);
+  assert_true (fgetc (fd) == EOF);
+
+  fclose (fd);
+  free (large);
+}
+
+int
+main (void)
+{
+  const struct CMUnitTest tests[] = {
+      cmocka_unit_test (writer_test),
+      cmocka_unit_test (writer_large_test),
+  };
+
+  return cmocka_run_group_tests (tests, NULL, NULL);
+}